@@ -0,0 +1,175 @@
+#include "AccessControl.h"
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sys/stat.h>
+
+constexpr std::chrono::seconds AccessControl::RELOAD_INTERVAL;
+
+static std::time_t file_mtime(const std::string& path) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) return 0;
+    return info.st_mtime;
+}
+
+void AccessControl::set_users(std::vector<std::int64_t> users) {
+    restricted_ = !users.empty();
+    replace_users(std::move(users));
+}
+
+bool AccessControl::load_file(const std::string& path) {
+    std::vector<std::int64_t> users;
+    if (!parse_file(path, users)) {
+        tgLog(RZ_LOG_ERROR, "[ACCESO] No se pudo leer la lista de usuarios '%s'", path.c_str());
+        return false;
+    }
+    path_ = path;
+    mtime_ = file_mtime(path);
+    checked_ = Clock::now();
+    restricted_ = true;
+    replace_users(std::move(users));
+    tgLog(RZ_LOG_INFO, "[ACCESO] %zu usuarios autorizados desde '%s'", users_.size(), path.c_str());
+    return true;
+}
+
+bool AccessControl::reload_if_changed(Clock::time_point now) {
+    if (path_.empty() || now - checked_ < RELOAD_INTERVAL) return false;
+    checked_ = now;
+
+    std::time_t mtime = file_mtime(path_);
+    if (mtime == 0 || mtime == mtime_) return false;
+
+    // Si falla se sigue con la lista anterior y se reintenta en el próximo intervalo
+    std::vector<std::int64_t> users;
+    if (!parse_file(path_, users)) {
+        tgLog(RZ_LOG_WARN, "[ACCESO] No se pudo recargar '%s': se mantiene la lista anterior", path_.c_str());
+        return false;
+    }
+    mtime_ = mtime;
+    std::size_t before = users_.size();
+    replace_users(std::move(users));
+    reloads_.fetch_add(1, std::memory_order_relaxed);
+    tgLog(RZ_LOG_INFO, "[ACCESO] Lista recargada: %zu usuarios (antes %zu)", users_.size(), before);
+    return true;
+}
+
+AccessControl::Verdict AccessControl::admit(std::int64_t user_id, std::int64_t chat_id, bool download,
+                                            Clock::time_point now) {
+    UserState* state = nullptr;
+    if (restricted_) {
+        auto it = user_id == 0 ? users_.end() : std::lower_bound(users_.begin(), users_.end(), user_id);
+        if (it == users_.end() || *it != user_id) {
+            unauthorized_.fetch_add(1, std::memory_order_relaxed);
+            return Unauthorized;
+        }
+        state = &states_[it - users_.begin()];
+    } else {
+        if (open_states_.size() >= MAX_TRACKED) open_states_.clear();
+        state = &open_states_[user_id != 0 ? user_id : chat_id];
+    }
+
+    // Una descarga también cuenta como mensaje
+    if (!take(state->messages, config_.message_rate, config_.message_burst, now)) {
+        message_limited_.fetch_add(1, std::memory_order_relaxed);
+        return MessageLimited;
+    }
+    if (download && !take(state->downloads, config_.download_rate, config_.download_burst, now)) {
+        download_limited_.fetch_add(1, std::memory_order_relaxed);
+        return DownloadLimited;
+    }
+    admitted_.fetch_add(1, std::memory_order_relaxed);
+    return Admitted;
+}
+
+bool AccessControl::allowed(std::int64_t user_id) const {
+    if (!restricted_) return true;
+    return user_id != 0 && std::binary_search(users_.begin(), users_.end(), user_id);
+}
+
+AccessControl::Stats AccessControl::stats() const {
+    Stats stats;
+    stats.users = user_count_.load(std::memory_order_relaxed);
+    stats.restricted = restricted_flag_.load(std::memory_order_relaxed);
+    stats.admitted = admitted_.load(std::memory_order_relaxed);
+    stats.unauthorized = unauthorized_.load(std::memory_order_relaxed);
+    stats.message_limited = message_limited_.load(std::memory_order_relaxed);
+    stats.download_limited = download_limited_.load(std::memory_order_relaxed);
+    stats.reloads = reloads_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+const char* AccessControl::verdict_name(Verdict verdict) {
+    switch (verdict) {
+    case Admitted:        return "admitido";
+    case Unauthorized:    return "no autorizado";
+    case MessageLimited:  return "límite de mensajes";
+    case DownloadLimited: return "límite de descargas";
+    }
+    return "?";
+}
+
+// Mismo cubo que OutboundScheduler: lleno al crearse
+bool AccessControl::take(Bucket& bucket, double rate, double burst, Clock::time_point now) {
+    if (rate <= 0.0) return true;
+    if (bucket.refilled == Clock::time_point()) {
+        bucket.tokens = burst;
+    } else if (now > bucket.refilled) {
+        double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+        bucket.tokens = std::min(burst, bucket.tokens + elapsed * rate);
+    }
+    bucket.refilled = std::max(bucket.refilled, now);
+
+    if (bucket.tokens < 1.0) return false;
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+/**
+ * @brief Lee un user_id por línea; admite comas, espacios y comentarios con '#'.
+ */
+bool AccessControl::parse_file(const std::string& path, std::vector<std::int64_t>& users) {
+    std::ifstream in(path);
+    if (!in) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::size_t comment = line.find('#');
+        if (comment != std::string::npos) line.resize(comment);
+
+        const char* p = line.c_str();
+        while (*p) {
+            char* end = nullptr;
+            long long value = std::strtoll(p, &end, 10);
+            if (end == p) {
+                ++p;
+                continue;
+            }
+            if (value != 0) users.push_back(value);
+            p = end;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Instala una lista nueva; los usuarios que siguen conservan sus cubos.
+ */
+void AccessControl::replace_users(std::vector<std::int64_t> users) {
+    std::sort(users.begin(), users.end());
+    users.erase(std::unique(users.begin(), users.end()), users.end());
+
+    std::vector<UserState> states(users.size());
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < users.size(); ++i) {
+        while (j < users_.size() && users_[j] < users[i]) ++j;
+        if (j < users_.size() && users_[j] == users[i]) states[i] = states_[j];
+    }
+
+    users_ = std::move(users);
+    states_ = std::move(states);
+    open_states_.clear();
+    user_count_.store(users_.size(), std::memory_order_relaxed);
+    restricted_flag_.store(restricted_, std::memory_order_relaxed);
+}
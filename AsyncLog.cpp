@@ -0,0 +1,218 @@
+#include "AsyncLog.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <linux/membarrier.h>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> AsyncLog::running_{false};
+std::atomic<bool> AsyncLog::fenced_{true};
+std::atomic<int> AsyncLog::level_{RZ_LOG_DEBUG_EXTRA};
+std::atomic<std::uint64_t> AsyncLog::inline_writes_{0};
+
+namespace {
+
+struct LogState {
+    std::mutex mutex;                                   // registro de anillos y despertar
+    std::mutex drain_mutex;                             // un solo consumidor por anillo a la vez
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<AsyncLog::Ring>> rings;
+    bool wake = false;
+    bool stop = false;
+    std::thread thread;
+    std::atomic<std::uint64_t> records{0};
+};
+
+LogState& state() {
+    static LogState* instance = new LogState();   // nunca se destruye: hay hilos que loguean al salir
+    return *instance;
+}
+
+// Marca el anillo como huérfano al terminar su hilo; el hilo de fondo lo vacía y lo libera
+struct RingOwner {
+    std::shared_ptr<AsyncLog::Ring> ring;
+    ~RingOwner() {
+        if (ring) ring->closed.store(true, std::memory_order_release);
+    }
+};
+
+thread_local RingOwner owner;
+
+// Formatea y escribe los registros pendientes de un anillo. Devuelve cuántos había
+std::size_t drain_ring(AsyncLog::Ring& ring) {
+    std::uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    std::uint64_t head = ring.head.load(std::memory_order_acquire);
+    std::size_t drained = 0;
+    char line[2048];
+
+    while (tail < head) {
+        std::size_t offset = static_cast<std::size_t>(tail & (AsyncLog::Ring::CAPACITY - 1));
+        std::size_t contiguous = AsyncLog::Ring::CAPACITY - offset;
+        if (contiguous < sizeof(AsyncLog::RecordHeader)) {
+            tail += contiguous;     // hueco sin cabecera antes de dar la vuelta
+            continue;
+        }
+
+        AsyncLog::RecordHeader header;
+        std::memcpy(&header, ring.data + offset, sizeof(header));
+        if (header.format) {
+            header.format(line, sizeof(line), header.fmt, ring.data + offset + sizeof(header));
+            rzLog(header.level, "%s", line);
+            ++drained;
+        }
+        tail += header.size;
+        ring.tail.store(tail, std::memory_order_release);
+    }
+    ring.tail.store(tail, std::memory_order_release);
+    return drained;
+}
+
+std::size_t drain_all() {
+    LogState& s = state();
+    std::lock_guard<std::mutex> drain_lock(s.drain_mutex);
+    std::vector<std::shared_ptr<AsyncLog::Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        rings = s.rings;
+    }
+
+    std::size_t drained = 0;
+    bool orphaned = false;
+    for (const auto& ring : rings) {
+        drained += drain_ring(*ring);
+        orphaned |= ring->closed.load(std::memory_order_acquire);
+    }
+    s.records.fetch_add(drained, std::memory_order_relaxed);
+
+    if (orphaned) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto it = s.rings.begin(); it != s.rings.end();) {
+            AsyncLog::Ring& ring = **it;
+            bool empty = ring.tail.load(std::memory_order_relaxed) == ring.head.load(std::memory_order_acquire);
+            if (ring.closed.load(std::memory_order_acquire) && empty) {
+                it = s.rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return drained;
+}
+
+void consumer_loop() {
+    LogState& s = state();
+    while (true) {
+        std::size_t drained = drain_all();
+
+        std::unique_lock<std::mutex> lock(s.mutex);
+        if (s.stop) break;
+        if (drained == 0) {
+            // Sin avisos ni errores, un ciclo cada 2 ms basta para no retrasar la salida
+            s.cv.wait_for(lock, std::chrono::milliseconds(2), [&s] { return s.wake || s.stop; });
+            s.wake = false;
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Arranca el hilo de fondo. Desde aquí tgLog deja de formatear en línea.
+ */
+void AsyncLog::start() {
+    LogState& s = state();
+    if (s.thread.joinable()) return;
+    s.stop = false;
+
+    // Como los hilos de despacho: SIGINT/SIGTERM se quedan en el hilo principal
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    s.thread = std::thread(consumer_loop);
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+    // Con membarrier los commits solo necesitan una barrera del compilador
+    bool registered = syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+    fenced_.store(!registered, std::memory_order_relaxed);
+    running_.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Vacía los anillos y detiene el hilo de fondo. Lo que se registre después
+ * se escribe en línea. Hay que llamarlo antes de rzLog_stop().
+ */
+void AsyncLog::stop() {
+    LogState& s = state();
+    if (!s.thread.joinable()) return;
+
+    running_.store(false, std::memory_order_seq_cst);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.stop = true;
+    }
+    s.cv.notify_one();
+    s.thread.join();
+
+    // Lo que otro hilo publicara mientras el de fondo terminaba. La barrera en
+    // todos los hilos empareja la de commit(): quien publique después de este
+    // drenaje ve running_ a false y lo vacía él
+    if (fenced_.load(std::memory_order_relaxed) ||
+        syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) != 0) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    drain_all();
+
+    Stats totals = stats();
+    rzLog(RZ_LOG_INFO, "[LOG] %llu registros asíncronos, %llu escritos en línea",
+        (unsigned long long)totals.records, (unsigned long long)totals.inline_writes);
+}
+
+/**
+ * @brief Escribe ya todo lo pendiente en los anillos (en el hilo que llama).
+ */
+void AsyncLog::flush() {
+    drain_all();
+}
+
+void AsyncLog::set_level(int level) {
+    level_.store(level, std::memory_order_relaxed);
+    rzLog_set_level(level);
+}
+
+AsyncLog::Stats AsyncLog::stats() {
+    LogState& s = state();
+    Stats stats;
+    stats.records = s.records.load(std::memory_order_relaxed);
+    stats.inline_writes = inline_writes_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    stats.rings = s.rings.size();
+    return stats;
+}
+
+AsyncLog::Ring* AsyncLog::register_thread() {
+    owner.ring = std::make_shared<Ring>();
+    LogState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.rings.push_back(owner.ring);
+    return owner.ring.get();
+}
+
+void AsyncLog::wake() {
+    LogState& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.wake = true;
+    }
+    s.cv.notify_one();
+}
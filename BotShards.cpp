@@ -0,0 +1,224 @@
+#include "BotShards.h"
+#include "AsyncLog.h"
+
+#include <limits>
+
+// Reenvíos recordados para mandarlos a la sesión que ya descarga el archivo
+static const std::size_t MAX_PLACEMENTS = 4096;
+
+BotShards::BotShards(std::unique_ptr<TdTransport> backend)
+    : manager_(new SharedClientManager(std::move(backend))) {}
+
+BotShards::~BotShards() {
+    stop();
+
+    // El hilo de métricas lee las sesiones, y las sesiones usan el SharedClientManager
+    metrics_server_.reset();
+    sessions_.clear();
+    manager_.reset();
+}
+
+TelegramBot* BotShards::add_session(const std::string& api_id, const std::string& bot_token,
+                                    const std::string& api_hash, const std::string& download_path) {
+    if (running_) {
+        tgLog(RZ_LOG_ERROR, "[SHARDS] Las sesiones deben añadirse antes de run()");
+        return nullptr;
+    }
+
+    std::size_t index = sessions_.size();
+    std::unique_ptr<TelegramBot> bot(new TelegramBot(manager_->open_session()));
+    if (!bot->initialize(api_id, bot_token, api_hash, download_path)) return nullptr;
+    bot->set_session_index(index);
+
+    std::size_t group = index;
+    for (std::size_t i = 0; i < tokens_.size(); ++i) {
+        if (tokens_[i] == bot_token) {
+            group = i;
+            break;
+        }
+    }
+    tokens_.push_back(bot_token);
+    group_.push_back(group);
+    sessions_.push_back(std::move(bot));
+
+    tgLog(RZ_LOG_INFO, "[SHARDS] Sesión %zu: %s", index,
+        group == index ? "atiende los mensajes de su bot" : "solo descargas del bot de la sesión");
+    return sessions_.back().get();
+}
+
+/**
+ * @brief Reparte los papeles de cada sesión y arranca la recepción y todos los bucles.
+ */
+void BotShards::run() {
+    if (running_ || sessions_.empty()) return;
+    running_ = true;
+
+    for (std::size_t i = 0; i < sessions_.size(); ++i) {
+        TelegramBot& bot = *sessions_[i];
+        if (i > 0) bot.share_dedup_index(*sessions_[0]);
+
+        if (group_[i] != i) {
+            bot.set_download_only(true);
+            continue;
+        }
+
+        // Solo reparte quien tiene otras sesiones de su misma cuenta
+        bool grouped = false;
+        for (std::size_t j = i + 1; j < sessions_.size(); ++j) grouped |= group_[j] == i;
+        if (grouped) {
+            bot.set_download_router([this, i](const DownloadJournal::Entry& entry) { return route(i, entry); });
+        }
+    }
+
+    manager_->start();
+    for (const auto& bot : sessions_) {
+        bot->run();
+    }
+    tgLog(RZ_LOG_INFO, "[SHARDS] %zu sesiones sobre un único ClientManager", sessions_.size());
+}
+
+void BotShards::stop() {
+    if (!running_) return;
+    running_ = false;
+
+    for (const auto& bot : sessions_) {
+        bot->stop();
+    }
+    manager_->stop();
+
+    Stats totals = stats();
+    SharedClientManager::Stats received = manager_->stats();
+    tgLog(RZ_LOG_INFO, "[SHARDS] %llu sesiones: %llu vídeos descargados en otra sesión, %llu en la propia; %llu respuestas recibidas (%llu descartadas)",
+        (unsigned long long)totals.sessions, (unsigned long long)totals.routed, (unsigned long long)totals.kept,
+        (unsigned long long)received.received, (unsigned long long)received.dropped);
+}
+
+BotShards::Stats BotShards::stats() const {
+    Stats stats;
+    stats.sessions = sessions_.size();
+    stats.routed = routed_.load(std::memory_order_relaxed);
+    stats.kept = kept_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/**
+ * @brief Elige la sesión del grupo que descarga un vídeo recibido por from.
+ *
+ * Gana la sesión autorizada con menos descargas activas más en cola; entre
+ * iguales se rota, para que una ráfaga no caiga entera en la misma.
+ * Se llama desde los hilos de despacho de from.
+ * @return true si la descarga pasa a otra sesión.
+ */
+bool BotShards::route(std::size_t from, const DownloadJournal::Entry& entry) {
+    std::size_t target = from;
+    {
+        std::lock_guard<std::mutex> lock(route_mutex_);
+        auto placed = entry.unique_id.empty() ? placement_.end() : placement_.find(entry.unique_id);
+        if (placed != placement_.end()) {
+            target = placed->second;
+        } else {
+            std::size_t best = std::numeric_limits<std::size_t>::max();
+            std::size_t count = sessions_.size();
+            for (std::size_t n = 0; n < count; ++n) {
+                std::size_t i = (next_ + n) % count;
+                if (group_[i] != from || (i != from && !sessions_[i]->is_ready())) continue;
+                DownloadScheduler::Stats downloads = sessions_[i]->download_stats();
+                std::size_t load = downloads.active + downloads.queued;
+                if (load < best) {
+                    best = load;
+                    target = i;
+                }
+            }
+            next_ = (target + 1) % count;
+
+            if (placement_.size() >= MAX_PLACEMENTS) placement_.clear();
+            if (!entry.unique_id.empty()) placement_[entry.unique_id] = target;
+        }
+    }
+
+    if (target == from) {
+        kept_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    routed_.fetch_add(1, std::memory_order_relaxed);
+    tgLog(RZ_LOG_INFO, "[SHARDS] %s (archivo %d) se descarga en la sesión %zu", entry.file_name.c_str(),
+        entry.file_id, target);
+    sessions_[target]->adopt_download(entry);
+    return true;
+}
+
+bool BotShards::start_metrics(const std::string& address, std::uint16_t port) {
+    metrics_server_.reset(new MetricsServer());
+    if (!metrics_server_->start(address, port, [this] { return render_metrics(); })) {
+        metrics_server_.reset();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Une las métricas de todas las sesiones con la etiqueta session="N".
+ *
+ * En el formato de texto las muestras de una familia deben ir juntas: se
+ * agrupan por familia en el orden en que aparecen, con su HELP/TYPE una vez.
+ * @return std::string
+ */
+std::string BotShards::render_metrics() const {
+    std::vector<std::string> order;
+    std::unordered_map<std::string, std::string> families;
+    std::unordered_map<std::string, std::size_t> owner;    // sesión cuyo HELP/TYPE se usa
+
+    for (std::size_t i = 0; i < sessions_.size(); ++i) {
+        std::string text = sessions_[i]->render_metrics();
+        std::string label = "session=\"" + std::to_string(i) + "\"";
+        std::string family;
+
+        std::size_t begin = 0;
+        while (begin < text.size()) {
+            std::size_t end = text.find('\n', begin);
+            if (end == std::string::npos) end = text.size();
+            std::string line = text.substr(begin, end - begin);
+            begin = end + 1;
+            if (line.empty()) continue;
+
+            if (line[0] == '#') {
+                // "# HELP nombre ..." / "# TYPE nombre ..."
+                std::size_t name_begin = line.find(' ', 2) + 1;
+                family = line.substr(name_begin, line.find(' ', name_begin) - name_begin);
+                auto it = owner.find(family);
+                if (it == owner.end()) {
+                    owner[family] = i;
+                    order.push_back(family);
+                } else if (it->second != i) {
+                    continue;
+                }
+                families[family] += line + "\n";
+                continue;
+            }
+
+            std::size_t name_end = line.find_first_of("{ ");
+            if (name_end == std::string::npos) continue;
+            if (line[name_end] == '{') {
+                line.insert(name_end + 1, label + ",");
+            } else {
+                line.insert(name_end, "{" + label + "}");
+            }
+            families[family] += line + "\n";
+        }
+    }
+
+    std::string out;
+    out.reserve(4096 * (sessions_.size() + 1));
+    for (const std::string& family : order) {
+        out += families[family];
+    }
+
+    Stats totals = stats();
+    SharedClientManager::Stats received = manager_->stats();
+    write_metric(out, "tgbot_shard_sessions", "gauge", "Sesiones de TDLib en el proceso.", double(totals.sessions));
+    write_metric(out, "tgbot_shard_routed_total", "counter", "Vídeos descargados en otra sesión del mismo bot.", double(totals.routed));
+    write_metric(out, "tgbot_shard_received_total", "counter", "Respuestas recibidas del ClientManager compartido.", double(received.received));
+    write_metric(out, "tgbot_shard_dropped_total", "counter", "Respuestas de clientes ya cerrados.", double(received.dropped));
+    return out;
+}
@@ -0,0 +1,117 @@
+#include "BotTask.h"
+
+#include <algorithm>
+#include <new>
+
+FramePool::SizeClass FramePool::classes_[FramePool::CLASSES];
+std::mutex FramePool::caches_mutex_;
+std::vector<FramePool::LocalCache*> FramePool::caches_;
+FramePool::Stats FramePool::retired_;
+std::uint64_t FramePool::retired_released_ = 0;
+
+FramePool::LocalCache& FramePool::local() {
+    thread_local LocalCache cache;
+    return cache;
+}
+
+FramePool::LocalCache::LocalCache() {
+    std::lock_guard<std::mutex> lock(caches_mutex_);
+    caches_.push_back(this);
+}
+
+FramePool::LocalCache::~LocalCache() {
+    for (std::size_t index = 0; index < CLASSES; ++index) {
+        while (FreeFrame* frame = free[index]) {
+            free[index] = frame->next;
+            push_shared(static_cast<int>(index), frame);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(caches_mutex_);
+    retired_.allocated += counters.allocated.load(std::memory_order_relaxed);
+    retired_.reused += counters.reused.load(std::memory_order_relaxed);
+    retired_.oversized += counters.oversized.load(std::memory_order_relaxed);
+    retired_released_ += counters.released.load(std::memory_order_relaxed);
+    caches_.erase(std::find(caches_.begin(), caches_.end(), this));
+}
+
+// A la lista común de la clase, o al heap si ya tiene MAX_FREE
+void FramePool::push_shared(int index, FreeFrame* frame) noexcept {
+    SizeClass& pool = classes_[index];
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pool.count < MAX_FREE) {
+            frame->next = pool.free;
+            pool.free = frame;
+            ++pool.count;
+            return;
+        }
+    }
+    ::operator delete(frame);
+}
+
+void* FramePool::allocate(std::size_t size) {
+    LocalCache& cache = local();
+    bump(cache.counters.allocated);
+
+    int index = class_of(size);
+    if (index < 0) {
+        bump(cache.counters.oversized);
+        return ::operator new(size);
+    }
+
+    // Primero la caché del hilo, sin lock
+    if (FreeFrame* frame = cache.free[index]) {
+        cache.free[index] = frame->next;
+        --cache.count[index];
+        bump(cache.counters.reused);
+        return frame;
+    }
+
+    SizeClass& pool = classes_[index];
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (FreeFrame* frame = pool.free) {
+            pool.free = frame->next;
+            --pool.count;
+            bump(cache.counters.reused);
+            return frame;
+        }
+    }
+    // Siempre el tamaño de la clase: el frame podrá reutilizarse para cualquiera de ella
+    return ::operator new(MIN_SIZE << index);
+}
+
+void FramePool::deallocate(void* frame, std::size_t size) noexcept {
+    LocalCache& cache = local();
+    bump(cache.counters.released);
+
+    int index = class_of(size);
+    if (index < 0) {
+        ::operator delete(frame);
+        return;
+    }
+
+    FreeFrame* free = static_cast<FreeFrame*>(frame);
+    if (cache.count[index] < LOCAL_MAX) {
+        free->next = cache.free[index];
+        cache.free[index] = free;
+        ++cache.count[index];
+        return;
+    }
+    push_shared(index, free);
+}
+
+FramePool::Stats FramePool::stats() {
+    std::lock_guard<std::mutex> lock(caches_mutex_);
+    Stats stats = retired_;
+    std::uint64_t released = retired_released_;
+    for (const LocalCache* cache : caches_) {
+        stats.allocated += cache->counters.allocated.load(std::memory_order_relaxed);
+        stats.reused += cache->counters.reused.load(std::memory_order_relaxed);
+        stats.oversized += cache->counters.oversized.load(std::memory_order_relaxed);
+        released += cache->counters.released.load(std::memory_order_relaxed);
+    }
+    stats.live = stats.allocated > released ? stats.allocated - released : 0;
+    return stats;
+}
@@ -0,0 +1,190 @@
+#include "CommandRouter.h"
+
+#include <charconv>
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Los nombres de usuario de Telegram no distinguen mayúsculas
+static bool same_username(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? char(a[i] - 'A' + 'a') : a[i];
+        char y = b[i] >= 'A' && b[i] <= 'Z' ? char(b[i] - 'A' + 'a') : b[i];
+        if (x != y) return false;
+    }
+    return true;
+}
+
+CommandArgs::CommandArgs(std::string_view text) : text_(text) {
+    std::size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && is_space(text[i])) ++i;
+        if (i == text.size()) break;
+        std::size_t begin = i;
+        while (i < text.size() && !is_space(text[i])) ++i;
+        if (count_ < MAX_ARGS) args_[count_] = text.substr(begin, i - begin);
+        ++count_;
+    }
+}
+
+std::string_view CommandArgs::rest(std::size_t index) const {
+    if (index >= count_) return std::string_view();
+    if (index < MAX_ARGS) return text_.substr(args_[index].data() - text_.data());
+
+    // Más allá de los guardados: se cuenta desde el último
+    std::size_t i = args_[MAX_ARGS - 1].data() - text_.data();
+    for (std::size_t n = MAX_ARGS - 1; n < index; ++n) {
+        while (i < text_.size() && !is_space(text_[i])) ++i;
+        while (i < text_.size() && is_space(text_[i])) ++i;
+    }
+    return text_.substr(i);
+}
+
+bool CommandArgs::get(std::size_t index, std::int64_t& value) const {
+    std::string_view arg = (*this)[index];
+    if (arg.empty()) return false;
+    auto result = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    return result.ec == std::errc() && result.ptr == arg.data() + arg.size();
+}
+
+CommandRouter::CommandRouter() {
+    rebuild();
+}
+
+bool CommandRouter::add(std::string_view name, std::string description, Handler handler,
+                        std::size_t min_args, std::size_t max_args, std::string usage) {
+    if (name.empty() || name.size() > MAX_NAME || !handler || min_args > max_args) return false;
+    for (char c : name) {
+        if (is_space(c) || c == '@' || c == '/') return false;
+    }
+    if (find(name) || commands_.size() >= EMPTY) return false;
+
+    Command command;
+    command.name = std::string(name);
+    command.description = std::move(description);
+    command.usage = std::move(usage);
+    command.min_args = min_args;
+    command.max_args = max_args;
+    command.handler = std::move(handler);
+    commands_.push_back(std::move(command));
+    rebuild();
+    return true;
+}
+
+bool CommandRouter::parse(std::string_view text, Parsed& out) {
+    if (text.size() < 2 || text[0] != '/') return false;
+
+    std::size_t i = 1;
+    while (i < text.size() && !is_space(text[i]) && text[i] != '@') ++i;
+    out.name = text.substr(1, i - 1);
+    if (out.name.empty()) return false;
+
+    out.bot = std::string_view();
+    if (i < text.size() && text[i] == '@') {
+        std::size_t begin = ++i;
+        while (i < text.size() && !is_space(text[i])) ++i;
+        out.bot = text.substr(begin, i - begin);
+    }
+
+    while (i < text.size() && is_space(text[i])) ++i;
+    out.args = text.substr(i);
+    return true;
+}
+
+bool CommandRouter::dispatch(std::int64_t chat_id, std::string_view text, std::string& response) const {
+    Parsed parsed;
+    if (!parse(text, parsed)) return false;
+
+    // En un grupo, "/start@otro_bot" no es para este: ni se contesta ni se trata como texto
+    if (!parsed.bot.empty() && !username_.empty() && !same_username(parsed.bot, username_)) {
+        response.clear();
+        return true;
+    }
+
+    const Command* command = find(parsed.name);
+    if (!command) return false;
+
+    Invocation invocation;
+    invocation.chat_id = chat_id;
+    invocation.name = parsed.name;
+    invocation.args = CommandArgs(parsed.args);
+
+    std::size_t count = invocation.args.size();
+    if (count < command->min_args || count > command->max_args) {
+        response = "Uso: /" + command->name;
+        if (!command->usage.empty()) response += " " + command->usage;
+        return true;
+    }
+
+    response = command->handler(invocation);
+    return true;
+}
+
+CommandRouter::Stats CommandRouter::stats() const {
+    Stats stats;
+    stats.commands = commands_.size();
+    stats.table_size = slots_.size();
+    stats.seed = seed_;
+    return stats;
+}
+
+/**
+ * @brief FNV-1a con la semilla mezclada en el estado inicial.
+ */
+std::uint32_t CommandRouter::hash(std::string_view name, std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : name) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+const CommandRouter::Command* CommandRouter::find(std::string_view name) const {
+    std::uint16_t index = slots_[hash(name, seed_) & mask_];
+    if (index == EMPTY || commands_[index].name != name) return nullptr;
+    return &commands_[index];
+}
+
+/**
+ * @brief Busca semilla y tamaño sin colisiones y regenera el texto de /help.
+ *
+ * Empieza con al menos el doble de huecos que comandos; si ninguna de las
+ * semillas probadas separa todos los nombres, dobla la tabla.
+ */
+void CommandRouter::rebuild() {
+    static const std::uint32_t SEEDS = 256;
+
+    std::size_t size = 8;
+    while (size < commands_.size() * 2) size <<= 1;
+
+    for (bool placed = false; !placed; size <<= 1) {
+        for (std::uint32_t seed = 0; seed < SEEDS && !placed; ++seed) {
+            slots_.assign(size, EMPTY);
+            placed = true;
+            for (std::size_t i = 0; i < commands_.size(); ++i) {
+                std::uint16_t& slot = slots_[hash(commands_[i].name, seed) & (size - 1)];
+                if (slot != EMPTY) {
+                    placed = false;
+                    break;
+                }
+                slot = static_cast<std::uint16_t>(i);
+            }
+            if (placed) {
+                seed_ = seed;
+                mask_ = static_cast<std::uint32_t>(size - 1);
+            }
+        }
+        if (placed) break;
+    }
+
+    help_ = "Comandos disponibles:";
+    for (const Command& command : commands_) {
+        if (command.description.empty()) continue;
+        help_ += "\n/" + command.name;
+        if (!command.usage.empty()) help_ += " " + command.usage;
+        help_ += " - " + command.description;
+    }
+}
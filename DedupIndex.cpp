@@ -0,0 +1,235 @@
+#include "DedupIndex.h"
+#include "LogCodec.h"
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const char INDEX_MAGIC[4] = { 'T', 'G', 'D', 'X' };
+static const std::uint32_t INDEX_VERSION = 1;
+
+static bool write_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+DedupIndex::~DedupIndex() {
+    close();
+}
+
+std::string DedupIndex::encode_add(const std::string& unique_id, const Item& item) {
+    std::string payload;
+    LogWriter w(payload);
+    w.put_string(unique_id);
+    w.put_string(item.path);
+    w.put<std::int64_t>(item.size);
+    w.put_string(item.checksum);
+    return payload;
+}
+
+bool DedupIndex::exists(const Item& item) {
+    struct stat info;
+    return ::stat(item.path.c_str(), &info) == 0 && S_ISREG(info.st_mode) && info.st_size == item.size;
+}
+
+bool DedupIndex::open(const std::string& path) {
+    close();
+
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    std::string data;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        char chunk[64 * 1024];
+        ssize_t n;
+        while ((n = ::read(fd, chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR)) {
+            if (n > 0) data.append(chunk, static_cast<std::size_t>(n));
+        }
+        ::close(fd);
+    }
+
+    std::size_t pos = data.size();
+    if (data.size() >= sizeof(INDEX_MAGIC) + 4) {
+        std::uint32_t version;
+        std::memcpy(&version, data.data() + sizeof(INDEX_MAGIC), 4);
+        if (std::memcmp(data.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || version != INDEX_VERSION) {
+            tgLog(RZ_LOG_ERROR, "[DEDUP] '%s' no es un índice de archivos válido", path.c_str());
+            return false;
+        }
+        pos = sizeof(INDEX_MAGIC) + 4;
+    }
+
+    std::unordered_map<std::string, Item> items;
+    LogRecord record;
+    while (read_log_record(data, pos, record)) {
+        LogReader r(record.payload, record.length);
+        std::string unique_id = r.get_string();
+        if (record.type == Add) {
+            Item item;
+            item.path = r.get_string();
+            item.size = r.get<std::int64_t>();
+            if (!r.at_end()) item.checksum = r.get_string();
+            if (r.ok()) items[unique_id] = std::move(item);
+        } else if (record.type == Remove && r.ok()) {
+            items.erase(unique_id);
+        }
+    }
+
+    // Los archivos borrados o cambiados a mano salen del índice
+    std::uint64_t stale = 0;
+    for (auto it = items.begin(); it != items.end();) {
+        if (exists(it->second)) {
+            ++it;
+        } else {
+            it = items.erase(it);
+            ++stale;
+        }
+    }
+
+    // Compactación ordenada por unique_id en un temporal que sustituye al índice
+    std::vector<const std::pair<const std::string, Item>*> sorted;
+    sorted.reserve(items.size());
+    for (const auto& item : items) sorted.push_back(&item);
+    std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+    std::string compacted(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    LogWriter(compacted).put<std::uint32_t>(INDEX_VERSION);
+    for (const auto* item : sorted) {
+        append_log_record(compacted, Add, encode_add(item->first, item->second));
+    }
+
+    std::string temp_path = path + ".tmp";
+    fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || !write_all(fd, compacted.data(), compacted.size()) || ::fdatasync(fd) != 0) {
+        tgLog(RZ_LOG_ERROR, "[DEDUP] No se pudo escribir '%s': %s", temp_path.c_str(), std::strerror(errno));
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    ::close(fd);
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        tgLog(RZ_LOG_ERROR, "[DEDUP] No se pudo sustituir '%s': %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    int dir = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        ::fsync(dir);
+        ::close(dir);
+    }
+
+    fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd_ < 0) {
+        tgLog(RZ_LOG_ERROR, "[DEDUP] No se pudo abrir '%s': %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    items_ = std::move(items);
+    stats_ = Stats();
+    stats_.entries = items_.size();
+    stats_.stale = stale;
+
+    tgLog(RZ_LOG_INFO, "[DEDUP] '%s': %zu archivos indexados (%llu ya no existían)",
+        path.c_str(), items_.size(), (unsigned long long)stale);
+    return true;
+}
+
+void DedupIndex::close() {
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    if (fd_ < 0) return;
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool DedupIndex::find(const std::string& unique_id, Item& out) {
+    if (fd_ < 0 || unique_id.empty()) return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = items_.find(unique_id);
+        if (it == items_.end()) {
+            ++stats_.misses;
+            return false;
+        }
+        out = it->second;
+    }
+
+    if (!exists(out)) {
+        tgLog(RZ_LOG_INFO, "[DEDUP] '%s' ya no está en disco: se descargará de nuevo", out.path.c_str());
+        remove(unique_id);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.stale;
+        ++stats_.misses;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.hits;
+    return true;
+}
+
+void DedupIndex::add(const std::string& unique_id, const std::string& path, std::int64_t size,
+                     const std::string& checksum) {
+    if (fd_ < 0 || unique_id.empty() || path.empty()) return;
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::string record;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Item& item = items_[unique_id];
+        item.path = path;
+        item.size = size;
+        item.checksum = checksum;
+        stats_.entries = items_.size();
+        append_log_record(record, Add, encode_add(unique_id, item));
+    }
+    append(record);
+}
+
+void DedupIndex::remove(const std::string& unique_id) {
+    if (fd_ < 0) return;
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::string record;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (items_.erase(unique_id) == 0) return;
+        stats_.entries = items_.size();
+
+        std::string payload;
+        LogWriter(payload).put_string(unique_id);
+        append_log_record(record, Remove, payload);
+    }
+    append(record);
+}
+
+// Con write_mutex_ tomado: los registros llegan al disco en el orden de los cambios
+void DedupIndex::append(const std::string& record) {
+    if (fd_ < 0) return;
+    if (!write_all(fd_, record.data(), record.size()) || ::fdatasync(fd_) != 0) {
+        tgLog(RZ_LOG_ERROR, "[DEDUP] Error escribiendo '%s': %s", path_.c_str(), std::strerror(errno));
+    }
+}
+
+DedupIndex::Stats DedupIndex::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,231 @@
+#include "DiskReservations.h"
+#include "AsyncLog.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+namespace {
+
+// Sube hasta el primer antecesor: false si ya no hay más
+bool parent_of(std::string& path) {
+    if (path == "/" || path == ".") return false;
+    std::size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) {
+        path = ".";
+    } else if (slash == 0) {
+        path = "/";
+    } else {
+        path.erase(slash);
+    }
+    return true;
+}
+
+// Libre para usuarios sin privilegios en el sistema de archivos de path o de su primer antecesor existente
+std::int64_t statvfs_free(std::string path) {
+    if (path.empty()) path = ".";
+    while (true) {
+        struct statvfs info;
+        if (::statvfs(path.c_str(), &info) == 0) {
+            return static_cast<std::int64_t>(info.f_bavail) * static_cast<std::int64_t>(info.f_frsize);
+        }
+        if (errno != ENOENT || !parent_of(path)) return -1;
+    }
+}
+
+// Dispositivo de path o de su primer antecesor existente
+bool device_of(std::string path, dev_t& device) {
+    if (path.empty()) path = ".";
+    while (true) {
+        struct stat info;
+        if (::stat(path.c_str(), &info) == 0) {
+            device = info.st_dev;
+            return true;
+        }
+        if (errno != ENOENT || !parent_of(path)) return false;
+    }
+}
+
+} // namespace
+
+void DiskReservations::set_path(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+}
+
+void DiskReservations::set_target_path(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    target_path_ = path;
+}
+
+// Se mira en cada reserva: la carpeta puede crearse (o montarse) después
+bool DiskReservations::separate_target_locked() const {
+    if (target_path_.empty()) return false;
+    dev_t cache;
+    dev_t target;
+    return device_of(path_, cache) && device_of(target_path_, target) && cache != target;
+}
+
+// needed cabe en el sistema de archivos de path con reserved ya comprometido y el margen
+bool DiskReservations::fits_locked(const std::string& path, std::int64_t needed, std::int64_t reserved) const {
+    std::int64_t free = statvfs_free(path);
+    if (free < 0) {
+        if (!warned_.exchange(true)) {
+            tgLog(RZ_LOG_WARN, "[DISCO] No se pudo medir el espacio libre de '%s': %s", path.c_str(), std::strerror(errno));
+        }
+        return true;
+    }
+    return needed <= free - reserved - margin_;
+}
+
+void DiskReservations::set_policy(std::int64_t margin, std::int64_t preallocate_min) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    margin_ = margin > 0 ? margin : 0;
+    preallocate_min_ = preallocate_min > 0 ? preallocate_min : 0;
+}
+
+std::int64_t DiskReservations::pending(const Reservation& reservation) {
+    return reservation.written < reservation.size ? reservation.size - reservation.written : 0;
+}
+
+bool DiskReservations::reserve(std::int32_t file_id, std::int64_t size, std::int64_t written, bool force) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Reservation reservation;
+    reservation.size = size > 0 ? size : 0;   // Tamaño desconocido: no reserva nada
+    reservation.written = written > 0 ? written : 0;
+
+    // La copia a otro sistema de archivos necesita el archivo entero, aunque ya esté empezado
+    if (separate_target_locked()) reservation.target = reservation.size;
+
+    auto it = reservations_.find(file_id);
+    std::int64_t previous = it != reservations_.end() ? pending(it->second) : 0;
+    std::int64_t previous_target = it != reservations_.end() ? it->second.target : 0;
+    std::int64_t needed = pending(reservation);
+
+    // Se mide con el lock tomado: dos admisiones a la vez no pueden repartirse el mismo hueco
+    if (!force) {
+        if ((needed > 0 && !fits_locked(path_, needed, stats_.reserved_bytes - previous)) ||
+            (reservation.target > 0 &&
+             !fits_locked(target_path_, reservation.target, stats_.target_reserved_bytes - previous_target))) {
+            ++stats_.rejected;
+            return false;
+        }
+    }
+
+    if (it == reservations_.end()) {
+        reservations_.emplace(file_id, reservation);
+    } else {
+        it->second = reservation;
+    }
+    stats_.reserved_bytes += needed - previous;
+    stats_.target_reserved_bytes += reservation.target - previous_target;
+    ++stats_.granted;
+    return true;
+}
+
+void DiskReservations::progress(std::int32_t file_id, std::int64_t written) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = reservations_.find(file_id);
+    if (it == reservations_.end() || written <= it->second.written) return;
+
+    std::int64_t previous = pending(it->second);
+    it->second.written = written;
+    stats_.reserved_bytes -= previous - pending(it->second);
+}
+
+bool DiskReservations::preallocate(std::int32_t file_id, const std::string& path) {
+    std::int64_t size;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = reservations_.find(file_id);
+        if (it == reservations_.end() || it->second.preallocate_tried) return false;
+        it->second.preallocate_tried = true;
+        if (preallocate_min_ == 0 || it->second.size < preallocate_min_ || path.empty()) return false;
+        size = it->second.size;
+    }
+
+    // KEEP_SIZE: los bloques quedan asignados más allá del final, TDLib sigue viendo su tamaño
+    int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    int result = fd < 0 ? -1 : ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+    int error = errno;
+    if (fd >= 0) ::close(fd);
+
+    if (result != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.preallocate_failed;
+        tgLog(RZ_LOG_WARN, "[DISCO] No se pudo preasignar el archivo %d (%lld bytes): %s", file_id,
+            (long long)size, std::strerror(error));
+        return false;
+    }
+
+    // Los bloques ya están ocupados: statvfs los descuenta y la reserva sobra
+    progress(file_id, size);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.preallocated;
+    tgLog(RZ_LOG_DEBUG, "[DISCO] Archivo %d preasignado: %lld bytes en '%s'", file_id, (long long)size, path.c_str());
+    return true;
+}
+
+void DiskReservations::downloaded(std::int32_t file_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = reservations_.find(file_id);
+    if (it == reservations_.end()) return;
+    stats_.reserved_bytes -= pending(it->second);
+    if (it->second.target > 0) relocating_[file_id] += it->second.target;
+    reservations_.erase(it);
+}
+
+void DiskReservations::relocated(std::int32_t file_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = relocating_.find(file_id);
+    if (it == relocating_.end()) return;
+    stats_.target_reserved_bytes -= it->second;
+    relocating_.erase(it);
+}
+
+void DiskReservations::release(std::int32_t file_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = reservations_.find(file_id);
+    if (it == reservations_.end()) return;
+    stats_.reserved_bytes -= pending(it->second);
+    stats_.target_reserved_bytes -= it->second.target;
+    reservations_.erase(it);
+}
+
+void DiskReservations::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : reservations_) {
+        stats_.target_reserved_bytes -= item.second.target;
+    }
+    reservations_.clear();
+    stats_.reserved_bytes = 0;
+}
+
+std::int64_t DiskReservations::available() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::int64_t free = statvfs_free(path_);
+    std::int64_t available = free < 0 ? INT64_MAX : free - stats_.reserved_bytes - margin_;
+    if (separate_target_locked()) {
+        std::int64_t target_free = statvfs_free(target_path_);
+        if (target_free >= 0 && target_free - stats_.target_reserved_bytes - margin_ < available) {
+            available = target_free - stats_.target_reserved_bytes - margin_;
+        }
+    }
+    return available;
+}
+
+std::int64_t DiskReservations::free_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statvfs_free(path_);
+}
+
+DiskReservations::Stats DiskReservations::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.reservations = reservations_.size();
+    return stats;
+}
@@ -0,0 +1,362 @@
+#include "DownloadJournal.h"
+#include "LogCodec.h"
+#include "AsyncLog.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+static const char JOURNAL_MAGIC[4] = { 'T', 'G', 'D', 'J' };
+static const std::uint32_t JOURNAL_VERSION = 1;
+
+static void decode_entry(LogReader& r, DownloadJournal::Entry& entry) {
+    entry.file_id = r.get<std::int32_t>();
+    entry.remote_id = r.get_string();
+    entry.unique_id = r.get_string();
+    entry.chat_id = r.get<std::int64_t>();
+    entry.message_id = r.get<std::int64_t>();
+    entry.offset = r.get<std::int64_t>();
+    entry.size = r.get<std::int64_t>();
+    entry.file_name = r.get_string();
+    entry.extension = r.get_string();
+    entry.mime_type = r.get_string();
+}
+
+DownloadJournal::~DownloadJournal() {
+    close();
+}
+
+std::string DownloadJournal::encode_entry(const Entry& entry) {
+    std::string payload;
+    LogWriter w(payload);
+    w.put<std::int32_t>(entry.file_id);
+    w.put_string(entry.remote_id);
+    w.put_string(entry.unique_id);
+    w.put<std::int64_t>(entry.chat_id);
+    w.put<std::int64_t>(entry.message_id);
+    w.put<std::int64_t>(entry.offset);
+    w.put<std::int64_t>(entry.size);
+    w.put_string(entry.file_name);
+    w.put_string(entry.extension);
+    w.put_string(entry.mime_type);
+    return payload;
+}
+
+bool DownloadJournal::write_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+std::string DownloadJournal::compact(const std::unordered_map<std::string, Entry>& live) {
+    std::string compacted(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    LogWriter(compacted).put<std::uint32_t>(JOURNAL_VERSION);
+    for (const auto& item : live) {
+        append_log_record(compacted, Start, encode_entry(item.second));
+    }
+    return compacted;
+}
+
+/**
+ * @brief Escribe data en un temporal que sustituye a path con rename().
+ * @return Descriptor del archivo nuevo, abierto para añadir; -1 si falló (path queda intacto).
+ */
+int DownloadJournal::replace_file(const std::string& path, const std::string& data) {
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || !write_all(fd, data.data(), data.size()) || ::fdatasync(fd) != 0) {
+        tgLog(RZ_LOG_ERROR, "[JOURNAL] No se pudo escribir '%s': %s", temp_path.c_str(), std::strerror(errno));
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        tgLog(RZ_LOG_ERROR, "[JOURNAL] No se pudo sustituir '%s': %s", path.c_str(), std::strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+
+    // El rename solo es duradero cuando se sincroniza el directorio
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    int dir = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        ::fsync(dir);
+        ::close(dir);
+    }
+
+    // El mismo descriptor sigue valiendo tras el rename: desde aquí solo se añade
+    ::fcntl(fd, F_SETFL, O_APPEND);
+    return fd;
+}
+
+bool DownloadJournal::open(const std::string& path, std::vector<Entry>& recovered) {
+    close();
+
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    // Lectura completa: el diario compactado solo contiene las descargas vivas
+    std::string data;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        char chunk[64 * 1024];
+        ssize_t n;
+        while ((n = ::read(fd, chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR)) {
+            if (n > 0) data.append(chunk, static_cast<std::size_t>(n));
+        }
+        ::close(fd);
+    }
+
+    std::unordered_map<std::string, Entry> live;
+    std::size_t pos = 0;
+    if (data.size() >= sizeof(JOURNAL_MAGIC) + 4) {
+        std::uint32_t version;
+        std::memcpy(&version, data.data() + sizeof(JOURNAL_MAGIC), 4);
+        if (std::memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || version != JOURNAL_VERSION) {
+            tgLog(RZ_LOG_ERROR, "[JOURNAL] '%s' no es un diario de descargas válido", path.c_str());
+            return false;
+        }
+        pos = sizeof(JOURNAL_MAGIC) + 4;
+    } else {
+        pos = data.size(); // Vacío o cabecera a medio escribir: se empieza de cero
+    }
+
+    LogRecord record;
+    while (read_log_record(data, pos, record)) {
+        LogReader r(record.payload, record.length);
+        switch (record.type) {
+        case Start:
+            {
+                Entry entry;
+                decode_entry(r, entry);
+                if (r.ok()) live[entry.unique_id] = std::move(entry);
+                break;
+            }
+        case Message:
+            {
+                std::string unique_id = r.get_string();
+                std::int64_t message_id = r.get<std::int64_t>();
+                auto it = live.find(unique_id);
+                if (r.ok() && it != live.end()) it->second.message_id = message_id;
+                break;
+            }
+        case Progress:
+            {
+                std::string unique_id = r.get_string();
+                std::int64_t offset = r.get<std::int64_t>();
+                auto it = live.find(unique_id);
+                if (r.ok() && it != live.end()) it->second.offset = offset;
+                break;
+            }
+        case Done:
+            {
+                std::string unique_id = r.get_string();
+                if (r.ok()) live.erase(unique_id);
+                break;
+            }
+        default:
+            break; // Tipo desconocido de una versión posterior: se ignora
+        }
+    }
+
+    std::uint64_t discarded = data.size() - pos;
+    std::size_t original_size = data.size();
+
+    // Compactación: un registro Start por descarga viva en un temporal que sustituye al diario
+    std::string compacted = compact(live);
+    fd_ = replace_file(path, compacted);
+    if (fd_ < 0) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    live_ = std::move(live);
+    ids_.clear();
+    pending_.clear();
+    stats_ = Stats();
+    stats_.recovered = live_.size();
+    stats_.discarded = discarded;
+    last_sync_ = Clock::now();
+    size_ = compacted_ = compacted.size();
+    rewrite_ = false;
+
+    for (const auto& item : live_) {
+        recovered.push_back(item.second);
+    }
+
+    tgLog(RZ_LOG_INFO, "[JOURNAL] '%s': %zu descargas por reanudar, compactado de %zu a %zu bytes%s",
+        path.c_str(), live_.size(), original_size, compacted.size(), discarded ? " (cola incompleta descartada)" : "");
+    return true;
+}
+
+void DownloadJournal::close() {
+    if (fd_ < 0) return;
+    sync(Clock::now(), true);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void DownloadJournal::append_locked(RecordType type, const std::string& payload) {
+    append_log_record(pending_, type, payload);
+    ++stats_.records;
+}
+
+void DownloadJournal::start(const Entry& entry) {
+    if (fd_ < 0 || entry.unique_id.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto previous = live_.find(entry.unique_id);
+    if (previous != live_.end() && previous->second.file_id != entry.file_id) {
+        auto id = ids_.find(previous->second.file_id);
+        if (id != ids_.end() && id->second == entry.unique_id) ids_.erase(id);
+    }
+    live_[entry.unique_id] = entry;
+    ids_[entry.file_id] = entry.unique_id;
+    append_locked(Start, encode_entry(entry));
+}
+
+void DownloadJournal::set_message(std::int32_t file_id, std::int64_t message_id) {
+    if (fd_ < 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto id = ids_.find(file_id);
+    if (id == ids_.end()) return;
+    Entry& entry = live_[id->second];
+    if (entry.message_id == message_id) return;
+    entry.message_id = message_id;
+
+    std::string payload;
+    LogWriter w(payload);
+    w.put_string(id->second);
+    w.put<std::int64_t>(message_id);
+    append_locked(Message, payload);
+}
+
+void DownloadJournal::progress(std::int32_t file_id, std::int64_t offset) {
+    if (fd_ < 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto id = ids_.find(file_id);
+    if (id == ids_.end()) return;
+    Entry& entry = live_[id->second];
+    if (offset - entry.offset < PROGRESS_STEP) return;
+    entry.offset = offset;
+
+    std::string payload;
+    LogWriter w(payload);
+    w.put_string(id->second);
+    w.put<std::int64_t>(offset);
+    append_locked(Progress, payload);
+}
+
+void DownloadJournal::done(std::int32_t file_id) {
+    if (fd_ < 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto id = ids_.find(file_id);
+    if (id == ids_.end()) return;
+
+    std::string payload;
+    LogWriter(payload).put_string(id->second);
+    append_locked(Done, payload);
+    live_.erase(id->second);
+    ids_.erase(id);
+}
+
+void DownloadJournal::discard(const std::string& unique_id) {
+    if (fd_ < 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = live_.find(unique_id);
+    if (it == live_.end()) return;
+
+    auto id = ids_.find(it->second.file_id);
+    if (id != ids_.end() && id->second == unique_id) ids_.erase(id);
+    live_.erase(it);
+
+    std::string payload;
+    LogWriter(payload).put_string(unique_id);
+    append_locked(Done, payload);
+}
+
+void DownloadJournal::detached(std::vector<Entry>& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : live_) {
+        auto id = ids_.find(item.second.file_id);
+        if (id == ids_.end() || id->second != item.first) out.push_back(item.second);
+    }
+}
+
+void DownloadJournal::detach_all() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ids_.clear();
+}
+
+void DownloadJournal::sync(Clock::time_point now, bool force) {
+    if (fd_ < 0) return;
+    std::lock_guard<std::mutex> sync_lock(sync_mutex_);
+    std::string compacted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.empty() || (!force && now - last_sync_ < sync_interval_)) return;
+        writing_.clear();
+        writing_.swap(pending_);
+        last_sync_ = now;
+
+        // live_ ya refleja el lote: la compactación lo sustituye
+        std::size_t size = size_ + writing_.size();
+        if (rewrite_ || (size > compact_size_ && size > 2 * compacted_)) compacted = compact(live_);
+    }
+
+    if (!compacted.empty()) {
+        int fd = replace_file(path_, compacted);
+        if (fd >= 0) {
+            ::close(fd_.exchange(fd));
+            std::size_t before = size_ + writing_.size();
+            size_ = compacted_ = compacted.size();
+            rewrite_ = false;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.syncs;
+            ++stats_.compactions;
+            stats_.bytes += compacted.size();
+            tgLog(RZ_LOG_INFO, "[JOURNAL] '%s' compactado de %zu a %zu bytes", path_.c_str(), before, size_);
+            return;
+        }
+        // Sin compactar se sigue añadiendo el lote; se reintenta en el siguiente sync
+    }
+
+    // Escritura y fdatasync fuera del lock: los hilos de despacho siguen añadiendo
+    if (!write_all(fd_, writing_.data(), writing_.size()) || ::fdatasync(fd_) != 0) {
+        int error = errno;
+
+        // Lo que llegase a escribirse se quita: un registro a medias cortaría la
+        // lectura de todos los siguientes. Si no se puede, se reescribe entero
+        if (::ftruncate(fd_, static_cast<off_t>(size_)) != 0) rewrite_ = true;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        writing_ += pending_;            // el lote vuelve delante de lo añadido mientras tanto
+        pending_.swap(writing_);
+        ++stats_.failed;
+        tgLog(RZ_LOG_ERROR, "[JOURNAL] Error escribiendo '%s': %s. Se reintenta en el siguiente sync",
+            path_.c_str(), std::strerror(error));
+        return;
+    }
+    size_ += writing_.size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.syncs;
+    stats_.bytes += writing_.size();
+}
+
+DownloadJournal::Stats DownloadJournal::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,197 @@
+#include "DownloadScheduler.h"
+
+#include <algorithm>
+
+DownloadScheduler::DownloadScheduler() {
+}
+
+DownloadScheduler::DownloadScheduler(const Config& config) : config_(config) {
+}
+
+void DownloadScheduler::set_config(const Config& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    if (config_.max_active == 0) config_.max_active = 1;
+    if (config_.max_active_per_chat == 0) config_.max_active_per_chat = 1;
+}
+
+void DownloadScheduler::enqueue(std::int32_t file_id, std::int64_t chat_id, std::int64_t size,
+                                Clock::time_point now, std::vector<std::int32_t>& started) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(file_id)) return; // Ya en cola o descargando
+
+    Entry entry;
+    entry.chat_id = chat_id;
+    entry.remaining = size;
+    entry.enqueued = now;
+    entries_.emplace(file_id, entry);
+    ++stats_.queued;
+
+    // Cola del chat ordenada por tamaño: el archivo más pequeño sale antes
+    std::deque<std::int32_t>& queue = queues_[chat_id];
+    if (queue.empty()) rotation_.push_back(chat_id);
+    auto pos = std::upper_bound(queue.begin(), queue.end(), size, [this](std::int64_t value, std::int32_t queued) {
+        return value < entries_[queued].remaining;
+    });
+    queue.insert(pos, file_id);
+
+    admit_locked(now, started);
+}
+
+void DownloadScheduler::finish(std::int32_t file_id, Clock::time_point now, std::vector<std::int32_t>& started) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(file_id);
+    if (it == entries_.end()) return;
+
+    if (it->second.active) {
+        std::size_t& per_chat = active_per_chat_[it->second.chat_id];
+        if (--per_chat == 0) active_per_chat_.erase(it->second.chat_id);
+        active_.erase(std::find(active_.begin(), active_.end(), file_id));
+        --stats_.active;
+        ++stats_.finished;
+    } else {
+        // Cancelada antes de empezar: sale de la cola de su chat
+        auto queue = queues_.find(it->second.chat_id);
+        if (queue != queues_.end()) {
+            queue->second.erase(std::find(queue->second.begin(), queue->second.end(), file_id));
+            if (queue->second.empty()) {
+                queues_.erase(queue);
+                rotation_.erase(std::find(rotation_.begin(), rotation_.end(), it->second.chat_id));
+            }
+        }
+        --stats_.queued;
+    }
+    entries_.erase(it);
+
+    // Una descarga terminada no debe reenviarse a TDLib con otra prioridad
+    priority_changes_.erase(std::remove_if(priority_changes_.begin(), priority_changes_.end(),
+        [file_id](const Priority& change) { return change.file_id == file_id; }), priority_changes_.end());
+
+    admit_locked(now, started);
+    reprioritize_locked();
+}
+
+// Reparte los huecos libres en round-robin entre los chats con cola
+void DownloadScheduler::admit_locked(Clock::time_point now, std::vector<std::int32_t>& started) {
+    std::size_t skipped = 0;
+    while (active_.size() < config_.max_active && !rotation_.empty() && skipped < rotation_.size()) {
+        std::int64_t chat_id = rotation_.front();
+        rotation_.pop_front();
+
+        auto per_chat = active_per_chat_.find(chat_id);
+        if (per_chat != active_per_chat_.end() && per_chat->second >= config_.max_active_per_chat) {
+            rotation_.push_back(chat_id); // Chat en su límite: turno para el siguiente
+            ++skipped;
+            continue;
+        }
+        skipped = 0;
+
+        std::deque<std::int32_t>& queue = queues_[chat_id];
+        std::int32_t file_id = queue.front();
+        queue.pop_front();
+        if (queue.empty()) {
+            queues_.erase(chat_id);
+        } else {
+            rotation_.push_back(chat_id);
+        }
+
+        Entry& entry = entries_[file_id];
+        entry.active = true;
+        ++active_per_chat_[chat_id];
+        active_.push_back(file_id);
+
+        double wait_ms = std::chrono::duration<double, std::milli>(now - entry.enqueued).count();
+        stats_.wait_ms_total += wait_ms;
+        stats_.wait_ms_max = std::max(stats_.wait_ms_max, wait_ms);
+        --stats_.queued;
+        ++stats_.active;
+        ++stats_.started;
+        started.push_back(file_id);
+    }
+
+    if (!started.empty()) reprioritize_locked();
+}
+
+void DownloadScheduler::update_remaining(std::int32_t file_id, std::int64_t remaining) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(file_id);
+    if (it == entries_.end() || !it->second.active || it->second.remaining == remaining) return;
+    it->second.remaining = remaining;
+    reprioritize_locked();
+}
+
+void DownloadScheduler::take_priority_changes(std::vector<Priority>& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out.insert(out.end(), priority_changes_.begin(), priority_changes_.end());
+    priority_changes_.clear();
+}
+
+// Menos bytes restantes, más prioridad: 32 para la primera, 31 para la segunda...
+void DownloadScheduler::reprioritize_locked() {
+    std::sort(active_.begin(), active_.end(), [this](std::int32_t a, std::int32_t b) {
+        return entries_[a].remaining < entries_[b].remaining;
+    });
+
+    for (std::size_t rank = 0; rank < active_.size(); ++rank) {
+        Entry& entry = entries_[active_[rank]];
+        std::int32_t priority = std::max<std::int32_t>(1, 32 - static_cast<std::int32_t>(rank));
+        if (entry.priority == priority) continue;
+
+        // Las recién admitidas toman su prioridad al empezar; el resto hay que reenviarla
+        bool was_assigned = entry.priority != 0;
+        entry.priority = priority;
+        if (!was_assigned) continue;
+
+        auto pending = std::find_if(priority_changes_.begin(), priority_changes_.end(),
+            [&](const Priority& change) { return change.file_id == active_[rank]; });
+        if (pending != priority_changes_.end()) {
+            pending->priority = priority;
+        } else {
+            priority_changes_.push_back(Priority{ active_[rank], priority });
+        }
+    }
+}
+
+std::int32_t DownloadScheduler::priority(std::int32_t file_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(file_id);
+    return (it != entries_.end() && it->second.priority > 0) ? it->second.priority : 32;
+}
+
+// Simula los turnos round-robin sobre las colas actuales
+void DownloadScheduler::positions(std::vector<Position>& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t position = 0;
+    for (std::size_t depth = 0; ; ++depth) {
+        bool any = false;
+        for (std::int64_t chat_id : rotation_) {
+            auto queue = queues_.find(chat_id);
+            if (queue == queues_.end() || depth >= queue->second.size()) continue;
+            any = true;
+            out.push_back(Position{ queue->second[depth], chat_id, ++position });
+        }
+        if (!any) break;
+    }
+}
+
+void DownloadScheduler::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    queues_.clear();
+    rotation_.clear();
+    active_per_chat_.clear();
+    active_.clear();
+    priority_changes_.clear();
+    stats_.queued = 0;
+    stats_.active = 0;
+}
+
+bool DownloadScheduler::contains(std::int32_t file_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(file_id) != 0;
+}
+
+DownloadScheduler::Stats DownloadScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
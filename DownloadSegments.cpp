@@ -0,0 +1,51 @@
+#include "DownloadSegments.h"
+
+#include <algorithm>
+
+void DownloadSegments::split(std::int64_t offset, std::int64_t size, std::size_t count) {
+    segments_.clear();
+    base_ = offset;
+    if (count < 2 || size - offset < 2 * ALIGNMENT) return;
+
+    // Rangos de igual tamaño redondeado a ALIGNMENT; el último se queda el resto
+    std::int64_t length = (size - offset) / static_cast<std::int64_t>(count);
+    length = std::max(ALIGNMENT, (length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+
+    for (std::int64_t start = offset; start < size; start += length) {
+        segments_.push_back(Segment{ start, std::min(length, size - start) });
+    }
+}
+
+bool DownloadSegments::update(std::int64_t download_offset, std::int64_t prefix_size) {
+    // Los rangos están ordenados por offset
+    auto it = std::lower_bound(segments_.begin(), segments_.end(), download_offset,
+        [](const Segment& segment, std::int64_t offset) { return segment.offset < offset; });
+    if (it == segments_.end() || it->offset != download_offset) return false;
+
+    it->done = std::max(it->done, std::min(it->limit, prefix_size));
+    return true;
+}
+
+bool DownloadSegments::complete() const {
+    for (const Segment& segment : segments_) {
+        if (segment.done < segment.limit) return false;
+    }
+    return true;
+}
+
+std::int64_t DownloadSegments::downloaded() const {
+    std::int64_t total = base_;
+    for (const Segment& segment : segments_) {
+        total += segment.done;
+    }
+    return total;
+}
+
+std::int64_t DownloadSegments::contiguous() const {
+    std::int64_t total = base_;
+    for (const Segment& segment : segments_) {
+        total += segment.done;
+        if (segment.done < segment.limit) break;
+    }
+    return total;
+}
@@ -0,0 +1,644 @@
+#include "FakeTelegramServer.h"
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+namespace td_api = td::td_api;
+
+/**
+ * @brief Constructor del servidor simulado.
+ * @param config Latencia, ancho de banda y tráfico sintético.
+ */
+FakeTelegramServer::FakeTelegramServer(const Config& config) : config_(config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_pump_ = Clock::now();
+    session_ = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    if (!config_.files_directory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(config_.files_directory, error);
+    }
+    tgLog(RZ_LOG_INFO, "[FAKE] Servidor simulado: latencia %lld ms, %.1f MB/s, %lld usuarios, %.1f msg/s",
+        (long long)config_.latency.count(), config_.bandwidth_bytes_per_sec / (1024.0 * 1024.0),
+        (long long)config_.users, config_.messages_per_sec);
+}
+
+/**
+ * @brief Crea un cliente nuevo, que empieza esperando sus parámetros.
+ */
+std::int32_t FakeTelegramServer::create_client_id() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::int32_t client_id = next_client_id_++;
+    clients_[client_id] = Client();
+    push_authorization_state_locked(Clock::now(), client_id);
+    cv_.notify_one();
+    return client_id;
+}
+
+/**
+ * @brief Recibe una petición del bot y programa su respuesta tras la latencia configurada.
+ */
+void FakeTelegramServer::send(std::int32_t client_id, std::uint64_t request_id,
+                              td_api::object_ptr<td_api::Function> request) {
+    if (!request) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    ++stats_.requests;
+
+    auto response = handle_request_locked(client_id, std::move(request), now);
+    if (response) {
+        push_locked(now + config_.latency, client_id, request_id, std::move(response));
+    }
+    cv_.notify_one();
+}
+
+/**
+ * @brief Devuelve el siguiente evento vencido, esperando como mucho timeout segundos.
+ */
+FakeTelegramServer::Response FakeTelegramServer::receive(double timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    Clock::time_point deadline = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+
+    while (true) {
+        pump_locked(now);
+
+        if (!events_.empty() && events_.front().at <= now) {
+            std::pop_heap(events_.begin(), events_.end(), &FakeTelegramServer::event_later);
+            Event event = std::move(events_.back());
+            events_.pop_back();
+            return Response{ event.client_id, event.request_id, std::move(event.object) };
+        }
+
+        if (now >= deadline) {
+            return Response{ 0, 0, nullptr };
+        }
+
+        Clock::time_point wake = deadline;
+        if (!events_.empty()) wake = std::min(wake, events_.front().at);
+        if (!active_files_.empty() || (config_.messages_per_sec > 0.0 && any_ready_locked())) {
+            wake = std::min(wake, now + config_.update_interval);
+        }
+
+        cv_.wait_until(lock, wake);
+        now = Clock::now();
+    }
+}
+
+/**
+ * @brief Reinicia el servidor simulado como si fuese un td::ClientManager nuevo:
+ * sin clientes, hasta el siguiente create_client_id().
+ */
+void FakeTelegramServer::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+    files_.clear();
+    remote_files_.clear();
+    active_files_.clear();
+    clients_.clear();
+    pending_messages_ = 0.0;
+    last_pump_ = Clock::now();
+}
+
+void FakeTelegramServer::inject_text_message(std::int64_t user_id, const std::string& text) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto content = td_api::make_object<td_api::messageText>();
+    content->text_ = td_api::make_object<td_api::formattedText>();
+    content->text_->text_ = text;
+    push_new_message_locked(Clock::now(), user_id, std::move(content));
+    cv_.notify_one();
+}
+
+std::int32_t FakeTelegramServer::inject_video_message(std::int64_t user_id, std::int64_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::int32_t file_id = push_video_message_locked(Clock::now(), user_id, size);
+    cv_.notify_one();
+    return file_id;
+}
+
+void FakeTelegramServer::inject_forwarded_video(std::int64_t user_id, std::int32_t file_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!files_.count(file_id)) return;
+    push_file_message_locked(Clock::now(), user_id, file_id);
+    ++stats_.videos_forwarded;
+    cv_.notify_one();
+}
+
+void FakeTelegramServer::inject_download_failure(std::int32_t file_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failing_files_.push_back(file_id);
+}
+
+std::size_t FakeTelegramServer::inject_disconnect() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::int32_t> ids;
+    for (const auto& client : clients_) ids.push_back(client.first);
+    for (std::int32_t client_id : ids) close_client_locked(client_id, Clock::now());
+    cv_.notify_one();
+    return ids.size();
+}
+
+FakeTelegramServer::Stats FakeTelegramServer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+/* ------------------------------- Internos ------------------------------- */
+
+// Orden del heap de eventos: el más próximo (y, a igualdad, el más antiguo) arriba
+bool FakeTelegramServer::event_later(const Event& a, const Event& b) {
+    return a.at != b.at ? a.at > b.at : a.seq > b.seq;
+}
+
+void FakeTelegramServer::push_locked(Clock::time_point at, std::int32_t client_id, std::uint64_t request_id,
+                                     td_api::object_ptr<td_api::Object> object) {
+    events_.push_back(Event{ at, next_seq_++, client_id, request_id, std::move(object) });
+    std::push_heap(events_.begin(), events_.end(), &FakeTelegramServer::event_later);
+}
+
+void FakeTelegramServer::push_authorization_state_locked(Clock::time_point at, std::int32_t client_id) {
+    auto update = td_api::make_object<td_api::updateAuthorizationState>();
+    switch (clients_[client_id].auth) {
+    case AuthState::WaitParameters:
+        update->authorization_state_ = td_api::make_object<td_api::authorizationStateWaitTdlibParameters>();
+        break;
+    case AuthState::WaitToken:
+        update->authorization_state_ = td_api::make_object<td_api::authorizationStateWaitPhoneNumber>();
+        break;
+    case AuthState::Ready:
+        update->authorization_state_ = td_api::make_object<td_api::authorizationStateReady>();
+        break;
+    }
+    push_locked(at, client_id, 0, std::move(update));
+}
+
+// Sesión que recibe los mensajes de user_id: la primera autorizada de uno de los tokens
+std::int32_t FakeTelegramServer::receiver_locked(std::int64_t user_id) const {
+    std::int32_t receivers[16];
+    std::string tokens[16];
+    std::size_t count = 0;
+    for (const auto& entry : clients_) {
+        if (entry.second.auth != AuthState::Ready) continue;
+        if (std::find(tokens, tokens + count, entry.second.token) != tokens + count) continue;
+        if (count == 16) break;
+        receivers[count] = entry.first;
+        tokens[count++] = entry.second.token;
+    }
+    if (count == 0) return clients_.empty() ? 0 : clients_.begin()->first;
+    return receivers[static_cast<std::size_t>(user_id) % count];
+}
+
+bool FakeTelegramServer::any_ready_locked() const {
+    for (const auto& entry : clients_) {
+        if (entry.second.auth == AuthState::Ready) return true;
+    }
+    return false;
+}
+
+// Como close en TDLib: se cancelan sus descargas y el último update es authorizationStateClosed
+void FakeTelegramServer::close_client_locked(std::int32_t client_id, Clock::time_point at) {
+    std::vector<std::int32_t> stopped;
+    for (std::int32_t id : active_files_) {
+        if (files_[id].client_id == client_id) stopped.push_back(id);
+    }
+    for (std::int32_t id : stopped) stop_file_locked(files_[id]);
+    clients_.erase(client_id);
+
+    auto update = td_api::make_object<td_api::updateAuthorizationState>();
+    update->authorization_state_ = td_api::make_object<td_api::authorizationStateClosed>();
+    push_locked(at, client_id, 0, std::move(update));
+}
+
+// Detiene las transferencias de un archivo conservando lo descargado
+void FakeTelegramServer::stop_file_locked(FakeFile& file) {
+    for (const Stream& stream : file.streams) file.completed += stream.downloaded;
+    file.streams.clear();
+    active_files_.erase(std::remove(active_files_.begin(), active_files_.end(), file.id), active_files_.end());
+}
+
+void FakeTelegramServer::pump_locked(Clock::time_point now) {
+    if (now <= last_pump_) return;
+    generate_traffic_locked(now);
+    advance_downloads_locked(now);
+    last_pump_ = now;
+}
+
+// Mensajes entrantes de los usuarios sintéticos, repartidos en round-robin
+void FakeTelegramServer::generate_traffic_locked(Clock::time_point now) {
+    if (config_.users <= 0 || config_.messages_per_sec <= 0.0 || !any_ready_locked()) return;
+
+    double elapsed = std::chrono::duration<double>(now - last_pump_).count();
+    pending_messages_ += config_.messages_per_sec * elapsed;
+
+    while (pending_messages_ >= 1.0) {
+        pending_messages_ -= 1.0;
+
+        std::uint64_t n = stats_.messages_generated++;
+        std::int64_t user_id = 100000 + (next_user_++ % config_.users);
+
+        // Reparto determinista de vídeos según video_ratio
+        bool is_video = std::floor((n + 1) * config_.video_ratio) > std::floor(n * config_.video_ratio);
+
+        // Y de reenvíos entre los vídeos: el último vídeo vuelve a llegar desde otro usuario
+        std::uint64_t v = stats_.videos_generated;
+        bool is_forward = is_video && last_video_ != 0 &&
+            std::floor((v + 1) * config_.forward_ratio) > std::floor(v * config_.forward_ratio);
+
+        if (is_forward) {
+            push_file_message_locked(now, user_id, last_video_);
+            ++stats_.videos_forwarded;
+        } else if (is_video) {
+            last_video_ = push_video_message_locked(now, user_id, config_.video_size);
+        } else {
+            auto content = td_api::make_object<td_api::messageText>();
+            content->text_ = td_api::make_object<td_api::formattedText>();
+            content->text_->text_ = (n % 4 == 0) ? "/start" : "hola bot " + std::to_string(n);
+            push_new_message_locked(now, user_id, std::move(content));
+        }
+    }
+}
+
+// Mensajes que esperaban mientras el bot estaba apagado, con su fecha de envío original
+// (repartidos en backlog_age hasta el segundo anterior a crear el servidor)
+void FakeTelegramServer::push_backlog_locked(Clock::time_point at) {
+    std::int64_t count = config_.backlog_messages;
+    if (count <= 0) return;
+
+    // Todos enviados antes de crear el servidor (session_ es ese instante en ms)
+    std::int64_t users = std::max<std::int64_t>(1, config_.users);
+    std::int64_t age = std::max<std::int64_t>(1, config_.backlog_age.count());
+    std::int64_t created = static_cast<std::int64_t>(session_ / 1000);
+    for (std::int64_t n = 0; n < count; ++n) {
+        std::int64_t user_id = 100000 + n % users;
+        std::int32_t date = static_cast<std::int32_t>(created - age + (age - 1) * n / count);
+
+        bool is_video = std::floor((n + 1) * config_.video_ratio) > std::floor(n * config_.video_ratio);
+        if (is_video) {
+            push_video_message_locked(at, user_id, config_.video_size, date);
+        } else {
+            auto content = td_api::make_object<td_api::messageText>();
+            content->text_ = td_api::make_object<td_api::formattedText>();
+            content->text_->text_ = (n % 4 == 0) ? "/start" : "hola bot " + std::to_string(n);
+            push_new_message_locked(at, user_id, std::move(content), date);
+        }
+    }
+    stats_.backlog_delivered += static_cast<std::uint64_t>(count);
+}
+
+// Reparte el ancho de banda entre las descargas activas y emite updateFile
+void FakeTelegramServer::advance_downloads_locked(Clock::time_point now) {
+    if (active_files_.empty()) return;
+
+    // El ancho de banda de cada sesión se reparte entre sus transferencias en
+    // proporción a la prioridad de su archivo, con el tope por transferencia si lo hay
+    double elapsed = std::chrono::duration<double>(now - last_pump_).count();
+    std::map<std::int32_t, double> total_priority;
+    for (std::int32_t id : active_files_) {
+        const FakeFile& file = files_[id];
+        total_priority[file.client_id] += double(file.priority) * file.streams.size();
+    }
+    double stream_cap = config_.stream_bandwidth_bytes_per_sec * elapsed;
+
+    for (std::size_t i = 0; i < active_files_.size();) {
+        FakeFile& file = files_[active_files_[i]];
+        double share = config_.bandwidth_bytes_per_sec * elapsed / total_priority[file.client_id];
+
+        for (std::size_t s = 0; s < file.streams.size();) {
+            Stream& stream = file.streams[s];
+
+            double bytes = share * file.priority;
+            if (stream_cap > 0.0) bytes = std::min(bytes, stream_cap);
+            stream.pending_bytes += bytes;
+            std::int64_t chunk = static_cast<std::int64_t>(stream.pending_bytes);
+            stream.pending_bytes -= chunk;
+
+            chunk = std::min(chunk, stream.end - stream.offset - stream.downloaded);
+            stream.downloaded += chunk;
+            stats_.bytes_served += chunk;
+
+            bool stream_done = stream.offset + stream.downloaded >= stream.end;
+            bool file_done = file.downloaded() >= file.size;
+            if (stream_done || file_done || now - stream.last_update >= config_.update_interval) {
+                stream.last_update = now;
+                Stream reported = stream;
+                if (stream_done) {
+                    file.completed += stream.downloaded;
+                    file.streams.erase(file.streams.begin() + s);
+                } else {
+                    ++s;
+                }
+                if (file_done) file.streams.clear();
+
+                auto update = td_api::make_object<td_api::updateFile>();
+                update->file_ = make_file_locked(file, &reported);
+                push_locked(now, file.client_id, 0, std::move(update));
+            } else {
+                ++s;
+            }
+        }
+
+        if (file.streams.empty()) {
+            if (file.downloaded() >= file.size) ++stats_.downloads_completed;
+            active_files_[i] = active_files_.back();
+            active_files_.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Límite de envíos por chat como el de Telegram: cubo de 3 tokens y 429 con retry_after
+td_api::object_ptr<td_api::error> FakeTelegramServer::check_flood_locked(std::int64_t chat_id, Clock::time_point now) {
+    if (config_.flood_chat_rate <= 0.0) return nullptr;
+
+    const double burst = 3.0;
+    FloodBucket& bucket = flood_[chat_id];
+    if (bucket.refilled == Clock::time_point()) {
+        bucket.tokens = burst;
+    } else {
+        double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+        bucket.tokens = std::min(burst, bucket.tokens + elapsed * config_.flood_chat_rate);
+    }
+    bucket.refilled = now;
+
+    if (bucket.tokens >= 1.0) {
+        bucket.tokens -= 1.0;
+        return nullptr;
+    }
+
+    ++stats_.flood_errors;
+    int retry_after = static_cast<int>(std::ceil((1.0 - bucket.tokens) / config_.flood_chat_rate));
+    return td_api::make_object<td_api::error>(429, "Too Many Requests: retry after " + std::to_string(retry_after));
+}
+
+td_api::object_ptr<td_api::Object> FakeTelegramServer::handle_request_locked(
+    std::int32_t client_id, td_api::object_ptr<td_api::Function> request, Clock::time_point now) {
+
+    Clock::time_point reply_at = now + config_.latency;
+
+    auto client = clients_.find(client_id);
+    if (client == clients_.end()) {
+        return td_api::make_object<td_api::error>(500, "Request aborted");   // Cliente cerrado o inexistente
+    }
+
+    switch (request->get_id()) {
+    case td_api::setTdlibParameters::ID:
+        {
+            if (client->second.auth != AuthState::WaitParameters) {
+                return td_api::make_object<td_api::error>(400, "Unexpected setTdlibParameters");
+            }
+            client->second.auth = AuthState::WaitToken;
+            push_authorization_state_locked(reply_at, client_id);
+            return td_api::make_object<td_api::ok>();
+        }
+    case td_api::checkAuthenticationBotToken::ID:
+        {
+            if (client->second.auth != AuthState::WaitToken) {
+                return td_api::make_object<td_api::error>(400, "Unexpected checkAuthenticationBotToken");
+            }
+            client->second.auth = AuthState::Ready;
+            client->second.token = td_api::move_object_as<td_api::checkAuthenticationBotToken>(request)->token_;
+            push_authorization_state_locked(reply_at, client_id);
+            // Como TDLib: los mensajes pendientes llegan justo después de Ready
+            if (!backlog_pushed_) {
+                backlog_pushed_ = true;
+                push_backlog_locked(reply_at);
+            }
+            return td_api::make_object<td_api::ok>();
+        }
+    case td_api::close::ID:
+        {
+            close_client_locked(client_id, reply_at);
+            return td_api::make_object<td_api::ok>();
+        }
+    case td_api::sendMessage::ID:
+        {
+            auto send = td_api::move_object_as<td_api::sendMessage>(request);
+            if (auto flood = check_flood_locked(send->chat_id_, now)) return flood;
+            std::int64_t temp_id = next_message_id_++;
+            std::int64_t real_id = temp_id << 20;
+
+            auto content = td_api::make_object<td_api::messageText>();
+            content->text_ = td_api::make_object<td_api::formattedText>();
+            if (send->input_message_content_ && send->input_message_content_->get_id() == td_api::inputMessageText::ID) {
+                auto input = static_cast<td_api::inputMessageText*>(send->input_message_content_.get());
+                if (input->text_) content->text_->text_ = input->text_->text_;
+            }
+
+            // El mensaje llega primero con ID temporal y después se confirma con el real
+            auto sent = td_api::make_object<td_api::message>();
+            sent->id_ = real_id;
+            sent->chat_id_ = send->chat_id_;
+            sent->is_outgoing_ = true;
+            sent->date_ = static_cast<std::int32_t>(std::time(nullptr));
+            sent->content_ = std::move(content);
+
+            auto temp = td_api::make_object<td_api::message>();
+            temp->id_ = temp_id;
+            temp->chat_id_ = send->chat_id_;
+            temp->is_outgoing_ = true;
+            temp->date_ = sent->date_;
+
+            auto succeeded = td_api::make_object<td_api::updateMessageSendSucceeded>();
+            succeeded->old_message_id_ = temp_id;
+            succeeded->message_ = std::move(sent);
+            push_locked(reply_at + config_.latency, client_id, 0, std::move(succeeded));
+
+            ++stats_.messages_sent;
+            return temp;
+        }
+    case td_api::editMessageText::ID:
+        {
+            auto edit = td_api::move_object_as<td_api::editMessageText>(request);
+            if (auto flood = check_flood_locked(edit->chat_id_, now)) return flood;
+            auto message = td_api::make_object<td_api::message>();
+            message->id_ = edit->message_id_;
+            message->chat_id_ = edit->chat_id_;
+            message->is_outgoing_ = true;
+            message->edit_date_ = static_cast<std::int32_t>(std::time(nullptr));
+            ++stats_.messages_edited;
+            return message;
+        }
+    case td_api::downloadFile::ID:
+        {
+            auto download = td_api::move_object_as<td_api::downloadFile>(request);
+            auto it = files_.find(download->file_id_);
+            if (it == files_.end()) {
+                return td_api::make_object<td_api::error>(400, "Invalid file identifier");
+            }
+
+            // Fallo inyectado: se rechaza sin abrir ninguna transferencia
+            auto failing = std::find(failing_files_.begin(), failing_files_.end(), download->file_id_);
+            if (failing != failing_files_.end()) {
+                failing_files_.erase(failing);
+                ++stats_.downloads_failed;
+                return td_api::make_object<td_api::error>(400, "FILE_DOWNLOAD_FAILED");
+            }
+
+            FakeFile& file = it->second;
+            file.priority = std::max<std::int32_t>(1, std::min<std::int32_t>(32, download->priority_));
+            file.client_id = client_id;
+
+            // limit 0 sobre una descarga en curso solo cambia la prioridad, como en TDLib;
+            // un rango nuevo abre otra transferencia
+            std::int64_t offset = std::max<std::int64_t>(0, std::min(download->offset_, file.size));
+            std::int64_t end = download->limit_ > 0 ? std::min(file.size, offset + download->limit_) : file.size;
+            bool known = download->limit_ == 0 && !file.streams.empty();
+            for (const Stream& stream : file.streams) {
+                if (stream.offset == offset) known = true;
+            }
+
+            if (!known && offset < end && file.downloaded() < file.size) {
+                if (download->limit_ == 0 && file.completed == 0) {
+                    file.base = offset; // Reanudación: lo anterior al offset ya está en disco
+                }
+                if (file.streams.empty()) {
+                    active_files_.push_back(file.id);
+                    ++stats_.downloads_started;
+                }
+                Stream stream;
+                stream.offset = offset;
+                stream.end = end;
+                stream.last_update = now;
+                file.streams.push_back(stream);
+            }
+
+            const Stream* current = nullptr;
+            for (const Stream& stream : file.streams) {
+                if (stream.offset == offset) current = &stream;
+            }
+            return make_file_locked(file, current);
+        }
+    case td_api::cancelDownloadFile::ID:
+        {
+            auto cancel = td_api::move_object_as<td_api::cancelDownloadFile>(request);
+            auto it = files_.find(cancel->file_id_);
+            if (it != files_.end()) stop_file_locked(it->second);
+            return td_api::make_object<td_api::ok>();
+        }
+    case td_api::getRemoteFile::ID:
+        {
+            // El remote_id termina en el tamaño: el archivo "sigue en los servidores"
+            // aunque se reinicie el cliente, y se recrea con un file_id nuevo
+            auto get = td_api::move_object_as<td_api::getRemoteFile>(request);
+            auto known = remote_files_.find(get->remote_file_id_);
+            if (known != remote_files_.end()) {
+                return make_file_locked(files_[known->second]);
+            }
+
+            const std::string& remote_id = get->remote_file_id_;
+            std::size_t dash = remote_id.rfind('-');
+            long long size = dash == std::string::npos ? 0 : std::atoll(remote_id.c_str() + dash + 1);
+            if (remote_id.compare(0, 12, "fake-remote-") != 0 || size <= 0) {
+                return td_api::make_object<td_api::error>(400, "Wrong remote file identifier specified");
+            }
+
+            std::int32_t file_id = create_file_locked(size);
+            files_[file_id].remote_id = remote_id;
+            remote_files_[remote_id] = file_id;
+            return make_file_locked(files_[file_id]);
+        }
+    default:
+        // El resto de peticiones (sendChatAction, etc.) se aceptan sin más
+        return td_api::make_object<td_api::ok>();
+    }
+}
+
+void FakeTelegramServer::push_new_message_locked(Clock::time_point at, std::int64_t user_id,
+                                                 td_api::object_ptr<td_api::MessageContent> content, std::int32_t date) {
+    auto sender = td_api::make_object<td_api::messageSenderUser>();
+    sender->user_id_ = user_id;
+
+    auto message = td_api::make_object<td_api::message>();
+    message->id_ = (next_message_id_++) << 20;
+    message->sender_id_ = std::move(sender);
+    message->chat_id_ = user_id; // chat privado: chat_id == user_id
+    message->date_ = date != 0 ? date : static_cast<std::int32_t>(std::time(nullptr));
+    message->content_ = std::move(content);
+
+    auto update = td_api::make_object<td_api::updateNewMessage>();
+    update->message_ = std::move(message);
+    push_locked(at, receiver_locked(user_id), 0, std::move(update));
+}
+
+std::int32_t FakeTelegramServer::push_video_message_locked(Clock::time_point at, std::int64_t user_id,
+                                                           std::int64_t size, std::int32_t date) {
+    std::int32_t file_id = create_file_locked(size);
+    push_file_message_locked(at, user_id, file_id, date);
+    return file_id;
+}
+
+void FakeTelegramServer::push_file_message_locked(Clock::time_point at, std::int64_t user_id, std::int32_t file_id,
+                                                 std::int32_t date) {
+    auto video = td_api::make_object<td_api::video>();
+    video->file_name_ = "video_" + std::to_string(file_id) + ".mp4";
+    video->mime_type_ = "video/mp4";
+    video->video_ = make_file_locked(files_[file_id]);
+
+    auto content = td_api::make_object<td_api::messageVideo>();
+    content->video_ = std::move(video);
+    content->caption_ = td_api::make_object<td_api::formattedText>();
+
+    push_new_message_locked(at, user_id, std::move(content), date);
+    ++stats_.videos_generated;
+}
+
+std::int32_t FakeTelegramServer::create_file_locked(std::int64_t size) {
+    std::int32_t file_id = next_file_id_++;
+    FakeFile file;
+    file.id = file_id;
+    file.size = size;
+    file.remote_id = "fake-remote-" + std::to_string(session_) + "-" + std::to_string(file_id) + "-" + std::to_string(size);
+    remote_files_[file.remote_id] = file_id;
+
+    // Archivo disperso del tamaño final: hasher y relocator trabajan con un archivo real
+    if (!config_.files_directory.empty()) {
+        file.path = config_.files_directory + "/fake_" + std::to_string(session_) + "_" + std::to_string(file_id) + ".mp4";
+        int fd = ::open(file.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0 || ::ftruncate(fd, size) != 0) {
+            tgLog(RZ_LOG_WARN, "[FAKE] No se pudo crear '%s'", file.path.c_str());
+            file.path.clear();
+        }
+        if (fd >= 0) ::close(fd);
+    }
+    files_.emplace(file_id, file);
+    return file_id;
+}
+
+td_api::object_ptr<td_api::file> FakeTelegramServer::make_file_locked(const FakeFile& file, const Stream* stream) const {
+    std::int64_t downloaded = file.downloaded();
+    bool complete = downloaded >= file.size;
+
+    // download_offset y el prefijo se refieren al rango de la transferencia informada
+    auto local = td_api::make_object<td_api::localFile>();
+    if (!file.path.empty()) {
+        local->path_ = file.path;
+    } else {
+        local->path_ = complete ? "fake/" + std::to_string(file.id) : "";
+    }
+    local->can_be_downloaded_ = true;
+    local->is_downloading_active_ = !file.streams.empty();
+    local->is_downloading_completed_ = complete;
+    local->download_offset_ = stream ? stream->offset : file.base;
+    local->downloaded_prefix_size_ = stream ? stream->downloaded : 0;
+    local->downloaded_size_ = downloaded;
+
+    auto remote = td_api::make_object<td_api::remoteFile>();
+    remote->id_ = file.remote_id;
+    remote->unique_id_ = "fake-unique" + file.remote_id.substr(11); // mismo sufijo que el remote_id
+
+    auto result = td_api::make_object<td_api::file>();
+    result->id_ = file.id;
+    result->size_ = file.size;
+    result->expected_size_ = file.size;
+    result->local_ = std::move(local);
+    result->remote_ = std::move(remote);
+    return result;
+}
@@ -0,0 +1,199 @@
+#include "FileHasher.h"
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+// Lectura por bloques: cabe en la L2 y permite cancelar entre bloques
+static const std::size_t HASH_CHUNK = 1024 * 1024;
+
+/**
+ * @brief Arranca el hilo del hasher.
+ */
+FileHasher::FileHasher() {
+    // Como los hilos de despacho: SIGINT/SIGTERM se quedan en el hilo principal
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    thread_ = std::thread([this] { worker_loop(); });
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+FileHasher::~FileHasher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        for (auto& item : jobs_) item.second->cancelled = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    for (auto& item : jobs_) close_job(*item.second);
+}
+
+void FileHasher::close_job(Job& job) {
+    if (job.fd >= 0) {
+        ::close(job.fd);
+        job.fd = -1;
+    }
+}
+
+// Con mutex_ tomado. Si el hilo está con el archivo, lo reencola él al acabar
+void FileHasher::schedule_locked(std::int32_t file_id, Job& job) {
+    if (job.queued || job.busy) return;
+    job.queued = true;
+    ready_.push_back(file_id);
+    cv_.notify_one();
+}
+
+void FileHasher::advance(std::int32_t file_id, const std::string& path, std::int64_t available) {
+    if (path.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    JobPtr& job = jobs_[file_id];
+    if (!job) {
+        job = std::make_shared<Job>();
+        job->path = path;
+    }
+    if (job->failed || job->size != -2 || available <= job->available) return;
+    job->available = available;
+    if (!job->busy && job->available > job->hashed) schedule_locked(file_id, *job);
+}
+
+void FileHasher::finish(std::int32_t file_id, const std::string& path, std::int64_t size, Callback done) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    JobPtr& job = jobs_[file_id];
+    if (!job) {
+        job = std::make_shared<Job>();
+        job->path = path; // Sin ningún advance(): se lee entero desde la ruta final
+    }
+    job->size = size < 0 ? -1 : size;
+    job->done = std::move(done);
+    schedule_locked(file_id, *job);
+}
+
+void FileHasher::cancel(std::int32_t file_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(file_id);
+    if (it == jobs_.end()) return;
+    it->second->cancelled = true;
+    if (!it->second->busy) close_job(*it->second);
+    jobs_.erase(it);
+}
+
+void FileHasher::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& item : jobs_) {
+        item.second->cancelled = true;
+        if (!item.second->busy) close_job(*item.second);
+    }
+    jobs_.clear();
+    ready_.clear();
+}
+
+void FileHasher::worker_loop() {
+    std::unique_ptr<char[]> buffer(new char[HASH_CHUNK]);
+
+    while (true) {
+        std::int32_t file_id;
+        JobPtr job;
+        std::int64_t target;
+        bool finishing;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !ready_.empty(); });
+            if (stop_) return;
+            file_id = ready_.front();
+            ready_.pop_front();
+            auto it = jobs_.find(file_id);
+            if (it == jobs_.end()) continue;
+            job = it->second;
+            job->queued = false;
+            job->busy = true;
+            finishing = job->size != -2;
+            target = finishing ? job->size : job->available;
+        }
+
+        bool ok = !job->failed;
+        if (ok && job->fd < 0) {
+            job->fd = ::open(job->path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (job->fd < 0) {
+                tgLog(RZ_LOG_WARN, "[HASH] No se pudo abrir '%s': %s", job->path.c_str(), std::strerror(errno));
+                ok = false;
+            }
+        }
+        if (ok) ok = hash_range(*job, target, finishing, buffer.get());
+
+        Callback done;
+        std::string digest;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job->busy = false;
+            if (job->cancelled) {
+                close_job(*job);
+                continue;
+            }
+            if (!ok) job->failed = true;
+
+            if (finishing) {
+                ok = !job->failed && (target < 0 ? job->eof : job->hashed == target);
+                close_job(*job);
+                jobs_.erase(file_id);
+                ++(ok ? stats_.files : stats_.failed);
+                if (ok) digest = job->hash.hex();
+                done = std::move(job->done);
+            } else {
+                // Llegó más mientras se hasheaba. Si el archivo aún no tenía esos
+                // bytes se espera al siguiente advance()
+                bool stalled = job->eof;
+                job->eof = false;
+                if (!job->failed && (job->size != -2 || (!stalled && job->available > job->hashed))) {
+                    schedule_locked(file_id, *job);
+                }
+            }
+        }
+        if (done) done(ok, digest);
+    }
+}
+
+// Hashea hasta target (< 0: hasta EOF) leyendo con pread desde el último byte hasheado
+bool FileHasher::hash_range(Job& job, std::int64_t target, bool finishing, char* buffer) {
+    while (target < 0 || job.hashed < target) {
+        if (job.cancelled) return true;
+
+        std::size_t want = HASH_CHUNK;
+        if (target >= 0) want = static_cast<std::size_t>(std::min<std::int64_t>(target - job.hashed, HASH_CHUNK));
+        ssize_t n = ::pread(job.fd, buffer, want, job.hashed);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            tgLog(RZ_LOG_WARN, "[HASH] Error leyendo '%s': %s", job.path.c_str(), std::strerror(errno));
+            return false;
+        }
+        if (n == 0) {
+            job.eof = true;
+            return !finishing || target < 0; // Al terminar, un archivo corto es un error
+        }
+
+        job.hash.update(buffer, static_cast<std::size_t>(n));
+        job.hashed += n;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.bytes += static_cast<std::uint64_t>(n);
+        if (finishing) stats_.tail_bytes += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+FileHasher::Stats FileHasher::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,227 @@
+#include "FileRelocator.h"
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bloque por llamada al kernel: permite cancelar una copia grande entre bloques
+static const std::size_t COPY_CHUNK = 64 * 1024 * 1024;
+
+/**
+ * @brief Arranca el hilo de traslados.
+ */
+FileRelocator::FileRelocator() {
+    // Como los hilos de despacho: SIGINT/SIGTERM se quedan en el hilo principal
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    thread_ = std::thread([this] { worker_loop(); });
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+FileRelocator::~FileRelocator() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cancel_ = true;
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void FileRelocator::relocate(const std::string& source, const std::string& directory,
+                             const std::string& name, Callback done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(Job{ source, directory, sanitize(name), std::move(done) });
+    }
+    cv_.notify_one();
+}
+
+FileRelocator::Stats FileRelocator::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::string FileRelocator::sanitize(const std::string& name) {
+    std::string clean;
+    clean.reserve(name.size());
+    for (unsigned char c : name) {
+        if (c < 0x20 || c == 0x7f || std::strchr("/\\:*?\"<>|", c)) {
+            clean.push_back('_');
+        } else {
+            clean.push_back(static_cast<char>(c));
+        }
+    }
+
+    // Sin puntos ni espacios al principio (ocultos, "." y "..") ni espacios al final
+    std::size_t first = clean.find_first_not_of(". ");
+    clean.erase(0, first == std::string::npos ? clean.size() : first);
+    while (!clean.empty() && clean.back() == ' ') clean.pop_back();
+
+    // Recorte sin partir un carácter UTF-8 multibyte
+    if (clean.size() > MAX_NAME) {
+        std::size_t cut = MAX_NAME;
+        while (cut > 0 && (static_cast<unsigned char>(clean[cut]) & 0xC0) == 0x80) --cut;
+        clean.resize(cut);
+    }
+    return clean.empty() ? "archivo" : clean;
+}
+
+void FileRelocator::worker_loop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            if (stop_) return; // Los pendientes se quedan en la caché de TDLib
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        std::string path;
+        bool ok = move_file(job, path);
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.failed;
+        }
+        if (job.done) {
+            job.done(ok, ok ? path : job.source);
+        }
+    }
+}
+
+// Nombre con sufijo " (n)" antes de la extensión para no pisar archivos existentes
+static std::string candidate_path(const std::string& directory, const std::string& name, int attempt) {
+    if (attempt == 0) return directory + "/" + name;
+    std::size_t dot = name.rfind('.');
+    if (dot == std::string::npos || dot == 0) dot = name.size();
+    return directory + "/" + name.substr(0, dot) + " (" + std::to_string(attempt) + ")" + name.substr(dot);
+}
+
+bool FileRelocator::move_file(const Job& job, std::string& path) {
+    // Con todos sus antecesores: download_path puede ser una ruta anidada que aún no existe
+    std::error_code error;
+    std::filesystem::create_directories(job.directory, error);
+    if (error) {
+        tgLog(RZ_LOG_ERROR, "[RELOCATE] No se pudo crear '%s': %s", job.directory.c_str(), error.message().c_str());
+        return false;
+    }
+
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        path = candidate_path(job.directory, job.name, attempt);
+
+        // Mismo sistema de archivos: rename atómico que no sobrescribe
+        if (::renameat2(AT_FDCWD, job.source.c_str(), AT_FDCWD, path.c_str(), RENAME_NOREPLACE) == 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.renamed;
+            tgLog(RZ_LOG_INFO, "[RELOCATE] '%s' -> '%s'", job.source.c_str(), path.c_str());
+            return true;
+        }
+        if (errno == EEXIST) continue;
+        if (errno != EXDEV) {
+            tgLog(RZ_LOG_ERROR, "[RELOCATE] No se pudo mover '%s': %s", job.source.c_str(), std::strerror(errno));
+            return false;
+        }
+
+        // Otro sistema de archivos: copia en el kernel a un temporal y rename al nombre final
+        if (::access(path.c_str(), F_OK) == 0) continue;
+        std::string part = path + ".part";
+        if (!copy_file(job.source, part)) {
+            ::unlink(part.c_str());
+            return false;
+        }
+        if (::renameat2(AT_FDCWD, part.c_str(), AT_FDCWD, path.c_str(), RENAME_NOREPLACE) != 0) {
+            int error = errno;
+            ::unlink(part.c_str());
+            if (error == EEXIST) continue; // Alguien ocupó el nombre durante la copia
+            tgLog(RZ_LOG_ERROR, "[RELOCATE] No se pudo renombrar '%s': %s", part.c_str(), std::strerror(error));
+            return false;
+        }
+        ::unlink(job.source.c_str());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.copied;
+        tgLog(RZ_LOG_INFO, "[RELOCATE] '%s' copiado a '%s'", job.source.c_str(), path.c_str());
+        return true;
+    }
+
+    tgLog(RZ_LOG_ERROR, "[RELOCATE] Sin nombre libre para '%s' en '%s'", job.name.c_str(), job.directory.c_str());
+    return false;
+}
+
+bool FileRelocator::copy_file(const std::string& from, const std::string& to) {
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        tgLog(RZ_LOG_ERROR, "[RELOCATE] No se pudo abrir '%s': %s", from.c_str(), std::strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (::fstat(in, &info) != 0) {
+        ::close(in);
+        return false;
+    }
+    int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, info.st_mode & 0777);
+    if (out < 0) {
+        tgLog(RZ_LOG_ERROR, "[RELOCATE] No se pudo crear '%s': %s", to.c_str(), std::strerror(errno));
+        ::close(in);
+        return false;
+    }
+
+    // Todos los bloques de una vez: la copia queda contigua y la falta de espacio se
+    // ve antes de copiar nada. Sin soporte de fallocate se copia igual
+    if (info.st_size > 0 && ::fallocate(out, FALLOC_FL_KEEP_SIZE, 0, info.st_size) != 0 && errno == ENOSPC) {
+        tgLog(RZ_LOG_ERROR, "[RELOCATE] Sin espacio para copiar '%s' (%lld bytes) a '%s'", from.c_str(),
+            (long long)info.st_size, to.c_str());
+        ::close(out);
+        ::close(in);
+        return false;
+    }
+
+    off_t remaining = info.st_size;
+    bool use_sendfile = false;
+    bool ok = true;
+    while (remaining > 0) {
+        if (cancel_) {
+            ok = false;
+            break;
+        }
+        std::size_t chunk = static_cast<std::size_t>(std::min<off_t>(remaining, COPY_CHUNK));
+        ssize_t copied = use_sendfile ? ::sendfile(out, in, nullptr, chunk)
+                                      : ::copy_file_range(in, nullptr, out, nullptr, chunk, 0);
+        if (copied < 0 && !use_sendfile && (errno == ENOSYS || errno == EXDEV || errno == EINVAL)) {
+            use_sendfile = true; // Kernels sin copy_file_range entre sistemas de archivos
+            continue;
+        }
+        if (copied < 0 && errno == EINTR) continue;
+        if (copied <= 0) {
+            tgLog(RZ_LOG_ERROR, "[RELOCATE] Error copiando '%s': %s", from.c_str(),
+                copied < 0 ? std::strerror(errno) : "fin de archivo inesperado");
+            ok = false;
+            break;
+        }
+        remaining -= copied;
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.bytes_copied += static_cast<std::uint64_t>(copied);
+    }
+
+    if (ok && ::fdatasync(out) != 0) ok = false;
+    ::close(out);
+    ::close(in);
+    return ok;
+}
@@ -0,0 +1,138 @@
+#include "MetricsServer.h"
+#include "AsyncLog.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(const std::string& address, std::uint16_t port, Render render) {
+    stop();
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        tgLog(RZ_LOG_ERROR, "[METRICS] Dirección no válida: '%s'", address.c_str());
+        return false;
+    }
+
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    if (listen_fd_ < 0 ||
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd_, 16) != 0 ||
+        ::pipe2(wake_fd_, O_CLOEXEC) != 0) {
+        tgLog(RZ_LOG_ERROR, "[METRICS] No se pudo escuchar en %s:%u: %s", address.c_str(), port, std::strerror(errno));
+        stop();
+        return false;
+    }
+
+    socklen_t length = sizeof(addr);
+    ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &length);
+    port_ = ntohs(addr.sin_port);
+    render_ = std::move(render);
+
+    // Como los hilos de despacho: SIGINT/SIGTERM se quedan en el hilo principal
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    thread_ = std::thread([this] { serve_loop(); });
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+    tgLog(RZ_LOG_INFO, "[METRICS] Sirviendo métricas en http://%s:%u/metrics", address.c_str(), port_);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (thread_.joinable()) {
+        char byte = 0;
+        ssize_t ignored = ::write(wake_fd_[1], &byte, 1);
+        (void)ignored;
+        thread_.join();
+    }
+    for (int* fd : { &listen_fd_, &wake_fd_[0], &wake_fd_[1] }) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+    port_ = 0;
+}
+
+void MetricsServer::serve_loop() {
+    while (true) {
+        pollfd fds[2] = { { listen_fd_, POLLIN, 0 }, { wake_fd_[0], POLLIN, 0 } };
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            tgLog(RZ_LOG_ERROR, "[METRICS] poll: %s", std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents) return;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        serve_client(client);
+        ::close(client);
+    }
+}
+
+// HTTP/1.0 sin keep-alive: una petición por conexión
+void MetricsServer::serve_client(int fd) {
+    // Un cliente lento no puede bloquear el listener más de un segundo
+    timeval timeout = { 1, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char chunk[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        request.append(chunk, static_cast<std::size_t>(n));
+    }
+
+    std::string status;
+    std::string body;
+    std::string type = "text/plain; charset=utf-8";
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0) {
+        status = "200 OK";
+        body = render_();
+        type = "text/plain; version=0.0.4; charset=utf-8";
+    } else if (request.compare(0, 4, "GET ") == 0) {
+        status = "404 Not Found";
+        body = "Solo /metrics\n";
+    } else {
+        status = "405 Method Not Allowed";
+        body = "Solo GET\n";
+    }
+
+    std::string response = "HTTP/1.0 " + status + "\r\nContent-Type: " + type +
+        "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    const char* data = response.data();
+    std::size_t left = response.size();
+    while (left > 0) {
+        ssize_t n = ::send(fd, data, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        data += n;
+        left -= static_cast<std::size_t>(n);
+    }
+}
@@ -0,0 +1,229 @@
+#include "OutboundScheduler.h"
+
+#include <algorithm>
+
+// Un chat sin actividad durante este tiempo se olvida (cubo lleno y sin cola)
+static const std::chrono::minutes CHAT_IDLE_TIMEOUT(5);
+static const std::chrono::seconds SWEEP_INTERVAL(30);
+
+OutboundScheduler::OutboundScheduler() {
+    set_config(Config());
+}
+
+OutboundScheduler::OutboundScheduler(const Config& config) {
+    set_config(config);
+}
+
+void OutboundScheduler::set_config(const Config& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    global_.tokens = config_.global_burst;
+    global_.refilled = Clock::now();
+}
+
+void OutboundScheduler::refill(Bucket& bucket, double rate, double burst, Clock::time_point now) {
+    if (bucket.refilled == Clock::time_point()) {
+        bucket.tokens = burst; // Cubo recién creado
+    } else if (now > bucket.refilled) {
+        double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+        bucket.tokens = std::min(burst, bucket.tokens + elapsed * rate);
+    }
+    bucket.refilled = std::max(bucket.refilled, now);
+}
+
+bool OutboundScheduler::can_send_locked(ChatState& chat, Clock::time_point now) {
+    refill(global_, config_.global_rate, config_.global_burst, now);
+    refill(chat.bucket, config_.chat_rate, config_.chat_burst, now);
+    return now >= chat.blocked_until && chat.bucket.tokens >= 1.0 && global_.tokens >= 1.0;
+}
+
+void OutboundScheduler::consume_locked(ChatState& chat, const Message& message) {
+    global_.tokens -= 1.0;
+    chat.bucket.tokens -= 1.0;
+    if (message.kind == Message::Edit) {
+        chat.last_sent[message.message_id] = std::hash<std::string>()(message.text);
+    }
+    ++stats_.sent;
+}
+
+void OutboundScheduler::mark_ready_locked(std::int64_t chat_id, ChatState& chat) {
+    if (!chat.ready) {
+        chat.ready = true;
+        ready_.push_back(chat_id);
+    }
+}
+
+bool OutboundScheduler::submit(Message& message, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ChatState& chat = chats_[message.chat_id];
+
+    if (message.kind == Message::Edit) {
+        std::size_t hash = std::hash<std::string>()(message.text);
+        auto sent = chat.last_sent.find(message.message_id);
+        bool same_as_sent = sent != chat.last_sent.end() && sent->second == hash;
+
+        // Si ya hay una edición pendiente del mismo mensaje, solo cuenta el texto más reciente
+        for (auto it = chat.queue.begin(); it != chat.queue.end(); ++it) {
+            if (it->kind != Message::Edit || it->message_id != message.message_id) continue;
+
+            if (same_as_sent) {
+                chat.queue.erase(it); // El mensaje ya muestra este texto
+                --stats_.queued;
+                ++stats_.unchanged;
+            } else if (it->text == message.text) {
+                ++stats_.unchanged;
+            } else {
+                it->text = std::move(message.text);
+                ++stats_.coalesced;
+            }
+            return false;
+        }
+
+        if (same_as_sent) {
+            ++stats_.unchanged;
+            return false;
+        }
+    }
+
+    if (chat.queue.empty() && can_send_locked(chat, now)) {
+        consume_locked(chat, message);
+        return true;
+    }
+
+    std::int64_t chat_id = message.chat_id;
+    chat.queue.push_back(std::move(message));
+    ++stats_.delayed;
+    ++stats_.queued;
+    mark_ready_locked(chat_id, chat);
+    return false;
+}
+
+std::size_t OutboundScheduler::pump(Clock::time_point now, std::vector<Message>& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (now - last_sweep_ >= SWEEP_INTERVAL) {
+        sweep_locked(now);
+        last_sweep_ = now;
+    }
+
+    // Pasadas round-robin de un mensaje por chat mientras alguna libere algo
+    std::size_t released = 0;
+    bool progress = true;
+    while (progress && !ready_.empty()) {
+        progress = false;
+        std::size_t rounds = ready_.size();
+        while (rounds-- > 0) {
+            std::int64_t chat_id = ready_.front();
+            ready_.pop_front();
+
+            auto it = chats_.find(chat_id);
+            if (it == chats_.end()) continue;
+            ChatState& chat = it->second;
+
+            if (chat.queue.empty()) {
+                chat.ready = false;
+                continue;
+            }
+            if (!can_send_locked(chat, now)) {
+                ready_.push_back(chat_id);
+                continue;
+            }
+
+            Message message = std::move(chat.queue.front());
+            chat.queue.pop_front();
+            --stats_.queued;
+            consume_locked(chat, message);
+            out.push_back(std::move(message));
+            ++released;
+            progress = true;
+
+            if (chat.queue.empty()) {
+                chat.ready = false;
+            } else {
+                ready_.push_back(chat_id);
+            }
+        }
+    }
+    return released;
+}
+
+void OutboundScheduler::retry(Message message, std::chrono::seconds retry_after, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ChatState& chat = chats_[message.chat_id];
+    chat.blocked_until = std::max(chat.blocked_until, now + retry_after);
+    ++stats_.retried;
+
+    if (message.kind == Message::Edit) {
+        chat.last_sent.erase(message.message_id); // La edición no llegó a aplicarse
+
+        // Una edición posterior del mismo mensaje ya lleva el estado más reciente
+        for (const Message& pending : chat.queue) {
+            if (pending.kind == Message::Edit && pending.message_id == message.message_id) {
+                ++stats_.coalesced;
+                return;
+            }
+        }
+    }
+
+    std::int64_t chat_id = message.chat_id;
+    chat.queue.push_front(std::move(message));
+    ++stats_.queued;
+    mark_ready_locked(chat_id, chat);
+}
+
+void OutboundScheduler::forget(std::int64_t chat_id, std::int64_t message_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = chats_.find(chat_id);
+    if (it != chats_.end()) {
+        it->second.last_sent.erase(message_id);
+    }
+}
+
+OutboundScheduler::Clock::duration OutboundScheduler::next_wait(Clock::time_point now, Clock::duration max_wait) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::duration wait = max_wait;
+
+    for (std::int64_t chat_id : ready_) {
+        auto it = chats_.find(chat_id);
+        if (it == chats_.end() || it->second.queue.empty()) continue;
+        const ChatState& chat = it->second;
+
+        // Tiempo hasta desbloquear el chat y hasta tener un token en ambos cubos
+        Clock::duration chat_wait = chat.blocked_until > now ? chat.blocked_until - now : Clock::duration::zero();
+        double elapsed = std::chrono::duration<double>(now - chat.bucket.refilled).count();
+        double missing = 1.0 - std::min(config_.chat_burst, chat.bucket.tokens + elapsed * config_.chat_rate);
+        if (missing > 0.0 && config_.chat_rate > 0.0) {
+            chat_wait = std::max(chat_wait, std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(missing / config_.chat_rate)));
+        }
+        wait = std::min(wait, chat_wait);
+    }
+
+    if (wait < max_wait && config_.global_rate > 0.0) {
+        double elapsed = std::chrono::duration<double>(now - global_.refilled).count();
+        double missing = 1.0 - std::min(config_.global_burst, global_.tokens + elapsed * config_.global_rate);
+        if (missing > 0.0) {
+            wait = std::max(wait, std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(missing / config_.global_rate)));
+        }
+    }
+    return std::min(wait, max_wait);
+}
+
+OutboundScheduler::Stats OutboundScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+// Olvida los chats sin cola ni actividad reciente para no crecer sin límite
+void OutboundScheduler::sweep_locked(Clock::time_point now) {
+    for (auto it = chats_.begin(); it != chats_.end();) {
+        const ChatState& chat = it->second;
+        if (!chat.ready && chat.queue.empty() && now >= chat.blocked_until &&
+            now - chat.bucket.refilled >= CHAT_IDLE_TIMEOUT) {
+            it = chats_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
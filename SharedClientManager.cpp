@@ -0,0 +1,157 @@
+#include "SharedClientManager.h"
+#include "AsyncLog.h"
+
+#include <chrono>
+#include <signal.h>
+
+// Cada cuánto vuelve receive() sin respuestas: marca lo que tarda stop()
+static const double RECEIVE_TIMEOUT = 0.2;
+
+/**
+ * @class SharedClientManager::Session
+ * @brief Transporte de un bot sobre su buzón del SharedClientManager.
+ */
+class SharedClientManager::Session : public TdTransport {
+    public:
+
+    explicit Session(SharedClientManager& manager) : manager_(manager), inbox_(std::make_shared<Inbox>()) {}
+
+    ~Session() override {
+        if (client_id_ != 0) manager_.close_client(client_id_);
+    }
+
+    // Un reinicio en caliente crea otro cliente sin reset(): el anterior deja de recibir
+    std::int32_t create_client_id() override {
+        if (client_id_ != 0) manager_.close_client(client_id_);
+        client_id_ = manager_.create_client(inbox_);
+        return client_id_;
+    }
+
+    void send(std::int32_t client_id, std::uint64_t request_id,
+              td::td_api::object_ptr<td::td_api::Function> request) override {
+        manager_.backend_->send(client_id, request_id, std::move(request));
+    }
+
+    Response receive(double timeout) override {
+        std::unique_lock<std::mutex> lock(inbox_->mutex);
+        if (inbox_->responses.empty() && timeout > 0.0) {
+            inbox_->cv.wait_for(lock, std::chrono::duration<double>(timeout),
+                [this] { return !inbox_->responses.empty(); });
+        }
+        if (inbox_->responses.empty()) return Response{ 0, 0, nullptr };
+        Response response = std::move(inbox_->responses.front());
+        inbox_->responses.pop_front();
+        return response;
+    }
+
+    // Solo este cliente: los demás bots del proceso siguen conectados
+    void reset() override {
+        if (client_id_ != 0) manager_.close_client(client_id_);
+        client_id_ = 0;
+        std::lock_guard<std::mutex> lock(inbox_->mutex);
+        inbox_->responses.clear();
+    }
+
+    bool supports_ranged_downloads() const override {
+        return manager_.backend_->supports_ranged_downloads();
+    }
+
+    private:
+
+    SharedClientManager& manager_;
+    std::shared_ptr<Inbox> inbox_;
+    std::int32_t client_id_ = 0;
+};
+
+SharedClientManager::SharedClientManager(std::unique_ptr<TdTransport> backend) {
+    if (backend) {
+        backend_ = std::move(backend);
+    } else {
+        backend_.reset(new ClientManagerTransport());
+    }
+}
+
+SharedClientManager::~SharedClientManager() {
+    stop();
+}
+
+std::unique_ptr<TdTransport> SharedClientManager::open_session() {
+    return std::unique_ptr<TdTransport>(new Session(*this));
+}
+
+/**
+ * @brief Arranca el hilo de recepción.
+ */
+void SharedClientManager::start() {
+    if (thread_.joinable()) return;
+    running_ = true;
+
+    // Como los hilos de despacho: SIGINT/SIGTERM se quedan en el hilo principal
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    thread_ = std::thread([this] { receive_loop(); });
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+void SharedClientManager::stop() {
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+}
+
+SharedClientManager::Stats SharedClientManager::stats() const {
+    Stats stats;
+    stats.received = received_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    stats.sessions = routes_.size();
+    return stats;
+}
+
+std::int32_t SharedClientManager::create_client(const std::shared_ptr<Inbox>& inbox) {
+    // Se registra con el lock tomado: ninguna respuesta del cliente nuevo llega antes que su ruta
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    std::int32_t client_id = backend_->create_client_id();
+    routes_[client_id] = inbox;
+    tgLog(RZ_LOG_INFO, "[SHARDS] Cliente %d creado (%zu en el proceso)", client_id, routes_.size());
+    return client_id;
+}
+
+void SharedClientManager::close_client(std::int32_t client_id) {
+    {
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+        if (routes_.erase(client_id) == 0) return;
+    }
+    backend_->send(client_id, 0, td::td_api::make_object<td::td_api::close>());
+    tgLog(RZ_LOG_INFO, "[SHARDS] Cliente %d cerrado", client_id);
+}
+
+void SharedClientManager::receive_loop() {
+    while (running_) {
+        TdTransport::Response response = backend_->receive(RECEIVE_TIMEOUT);
+        if (!response.object) continue;
+        received_.fetch_add(1, std::memory_order_relaxed);
+
+        std::shared_ptr<Inbox> inbox;
+        {
+            std::lock_guard<std::mutex> lock(routes_mutex_);
+            auto it = routes_.find(response.client_id);
+            if (it != routes_.end()) inbox = it->second;
+        }
+        if (!inbox) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(inbox->mutex);
+            inbox->responses.push_back(std::move(response));
+        }
+        inbox->cv.notify_one();
+    }
+}
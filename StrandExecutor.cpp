@@ -0,0 +1,101 @@
+#include "StrandExecutor.h"
+
+#include <signal.h>
+
+/**
+ * @brief Arranca el pool de hilos.
+ * @param threads Número de hilos (0 = ejecución en línea).
+ */
+StrandExecutor::StrandExecutor(std::size_t threads) {
+    workers_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back(new Worker());
+    }
+
+    // Los hilos heredan la máscara: SIGINT/SIGTERM se quedan en el hilo principal,
+    // cuyo handler destruye el bot (y con él este pool)
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    for (auto& worker : workers_) {
+        Worker* w = worker.get();
+        w->thread = std::thread([this, w] { worker_loop(*w); });
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+StrandExecutor::~StrandExecutor() {
+    shutdown();
+}
+
+void StrandExecutor::post(std::uint64_t key, Task task) {
+    if (workers_.empty()) {
+        task();
+        executed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Mezcla de la clave para no concentrar chat_ids consecutivos en el mismo hilo
+    std::uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+    Worker& worker = *workers_[(hash >> 32) % workers_.size()];
+
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(std::move(task));
+    }
+    worker.cv.notify_one();
+}
+
+void StrandExecutor::wait_idle() {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] { return pending_.load(std::memory_order_acquire) == 0; });
+}
+
+void StrandExecutor::shutdown() {
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stop = true;
+        }
+        worker->cv.notify_one();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    workers_.clear();
+}
+
+// Cada hilo vacía su cola de golpe y ejecuta el lote fuera del lock
+void StrandExecutor::worker_loop(Worker& worker) {
+    std::vector<Task> batch;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.cv.wait(lock, [&worker] { return worker.stop || !worker.queue.empty(); });
+            if (worker.queue.empty()) return; // stop y sin trabajo pendiente
+            batch.swap(worker.queue);
+        }
+
+        for (Task& task : batch) {
+            task();
+        }
+
+        std::size_t done = batch.size();
+        batch.clear();
+        executed_.fetch_add(done, std::memory_order_relaxed);
+
+        if (pending_.fetch_sub(done, std::memory_order_acq_rel) == done) {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            idle_cv_.notify_all();
+        }
+    }
+}
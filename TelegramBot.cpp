@@ -3,23 +3,73 @@
 #include <iomanip>
 #include <chrono>
 #include <string>
-#include "rzLogger.h"
+#include "AsyncLog.h"
 #include <td/telegram/Log.h>
 #include <filesystem>
 #include <cmath>
+#include <algorithm>
+
+// Reconexión: el primer reintento es inmediato; los siguientes esperan 250 ms,
+// 500 ms, 1 s... hasta 30 s, con jitter para no reconectar a la vez que otras sesiones
+static const std::chrono::milliseconds RECONNECT_BASE{250};
+static const std::chrono::milliseconds RECONNECT_MAX{30 * 1000};
+
+// Espera a authorizationStateClosed tras pedir close antes de descartar el transporte
+static const std::chrono::seconds CLOSE_TIMEOUT{10};
+
+// Sin mensajes anteriores al arranque durante este tiempo, el backlog ha terminado
+static const std::chrono::seconds BACKLOG_QUIET{2};
+
+// Etiqueta type de tgbot_updates_total. "respuesta" = respuesta a una query con handler
+static const char* const UPDATE_TYPE_NAMES[] = {
+    "respuesta", "updateAuthorizationState", "updateNewMessage", "updateFile",
+    "updateMessageSendSucceeded", "updateMessageSendFailed", "updateMessageEdited",
+    "updateMessageContent", "error", "ok", "message", "otro"
+};
+
+static std::size_t update_type_index(int32_t id) {
+    switch (id) {
+    case td::td_api::updateAuthorizationState::ID:   return 1;
+    case td::td_api::updateNewMessage::ID:           return 2;
+    case td::td_api::updateFile::ID:                 return 3;
+    case td::td_api::updateMessageSendSucceeded::ID: return 4;
+    case td::td_api::updateMessageSendFailed::ID:    return 5;
+    case td::td_api::updateMessageEdited::ID:        return 6;
+    case td::td_api::updateMessageContent::ID:       return 7;
+    case td::td_api::error::ID:                      return 8;
+    case td::td_api::ok::ID:                         return 9;
+    case td::td_api::message::ID:                    return 10;
+    default:                                         return 11;
+    }
+}
 
-std::unordered_map<int32_t, int32_t> last_downloaded_;
-std::unordered_map<int32_t, std::chrono::steady_clock::time_point> last_time_;
-std::unordered_map<int32_t, int> last_progress_reported_;
+/**
+ * @brief Extrae el retry_after de un error de flood de Telegram.
+ * @return Segundos de espera, o 0 si el error no es un flood wait.
+ */
+static int retry_after_seconds(const td::td_api::error& error) {
+    if (error.code_ != 429) return 0;
+    const char* after = std::strstr(error.message_.c_str(), "retry after ");
+    int seconds = after ? std::atoi(after + std::strlen("retry after ")) : 0;
+    return seconds > 0 ? seconds : 1;
+}
 
 /**
  * @brief Constructor de la clase
+ * @param transport Backend de TDLib. Si es null se usa td::ClientManager.
  */
-TelegramBot::TelegramBot() {
+TelegramBot::TelegramBot(std::unique_ptr<TdTransport> transport) {
     td::td_api::setLogVerbosityLevel(0);
     td::Log::set_verbosity_level(0);
-    client_manager_ = new td::ClientManager();
-    client_id_ = client_manager_->create_client_id();
+    if (transport) {
+        transport_ = std::move(transport);
+    } else {
+        transport_.reset(new ClientManagerTransport());
+    }
+    client_id_.store(transport_->create_client_id(), std::memory_order_release);
+    executor_.reset(new StrandExecutor(0));
+    relocator_.reset(new FileRelocator());
+    hasher_.reset(new FileHasher());
     
     authorization_state_ = td::td_api::make_object<td::td_api::authorizationStateClosed>();
     
@@ -27,9 +77,9 @@ TelegramBot::TelegramBot() {
     are_authorized_ = false;
     need_restart_ = false;
     current_query_id_ = 1;
+    register_commands();
     // 0 = solo errores críticos
-    rzLog(RZ_LOG_INFO, "TelegramBot creado");
-    fflush(stdout);
+    tgLog(RZ_LOG_INFO, "TelegramBot creado");
 }
 
 /**
@@ -37,12 +87,20 @@ TelegramBot::TelegramBot() {
  */
 TelegramBot::~TelegramBot() {
     stop();
+
+    // Las corrutinas suspendidas terminan con el error de su query y liberan su frame
+    fail_pending_handlers(500, "Bot detenido");
+
+    // El hilo de métricas lee el estado del bot: es lo primero que se para
+    metrics_server_.reset();
+
+    // Los strands, el hasher y el relocator pueden enviar queries: se paran antes que el transporte
+    executor_.reset();
+    hasher_.reset();
+    relocator_.reset();
     
-    if (client_manager_) {
-        delete client_manager_;
-        client_manager_ = nullptr;
-    }
-    rzLog(RZ_LOG_INFO, "TelegramBot destruido");
+    transport_.reset();
+    tgLog(RZ_LOG_INFO, "TelegramBot destruido");
 }
 
 /**
@@ -57,9 +115,12 @@ bool TelegramBot::initialize(const std::string& api_id, const std::string& bot_t
     api_id_ = api_id;
     api_hash_ = api_hash;
     bot_token_ = bot_token;
-    download_pàth_ = download_path;
+    download_path_ = download_path;
+    // Donde escribe TDLib (files_directory en send_tdlib_parameters) y adonde se trasladan
+    disk_.set_path(files_directory());
+    disk_.set_target_path(download_path_);
     
-   rzLog(RZ_LOG_INFO, "[BOT] Inicializado con API_ID=%s, API_HASH=%s..., BOT_TOKEN=%s...", 
+   tgLog(RZ_LOG_INFO, "[BOT] Inicializado con API_ID=%s, API_HASH=%s..., BOT_TOKEN=%s...", 
            api_id.c_str(), 
            api_hash.substr(0, 8).c_str(),
            bot_token.substr(0, 12).c_str());
@@ -71,17 +132,16 @@ bool TelegramBot::initialize(const std::string& api_id, const std::string& bot_t
  */
 void TelegramBot::run() {
     if (running_) {
-       rzLog(RZ_LOG_INFO, "[BOT] Run");
+       tgLog(RZ_LOG_INFO, "[BOT] Run");
         return;
     }
     
     running_ = true;
+    // Lo enviado antes de este momento es backlog de cuando el bot estaba apagado
+    if (skip_backlog_) {
+        backlog_cutoff_ = static_cast<std::int64_t>(std::time(nullptr)) - backlog_grace_.count();
+    }
     worker_thread_ = std::thread(&TelegramBot::main_loop, this);
-    
-    // FORZAR el inicio enviando parámetros inmediatamente
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    rzLog(RZ_LOG_INFO, "[BOT] Enviando parámetros iniciales...");
-    send_tdlib_parameters();
 }
 
 /**
@@ -90,74 +150,719 @@ void TelegramBot::run() {
 void TelegramBot::stop() {
     if (!running_) return;
     
-    rzLog(RZ_LOG_INFO, "[BOT] Deteniendo...");
+    tgLog(RZ_LOG_INFO, "[BOT] Deteniendo...");
     running_ = false;
     
     if (worker_thread_.joinable()) {
         worker_thread_.join();
     }
-    rzLog(RZ_LOG_INFO, "[BOT] Detenido completamente");
+    executor_->wait_idle();
+
+    LoopStats stats = loop_stats();
+    if (stats.batches > 0) {
+        tgLog(RZ_LOG_INFO, "[LOOP] %llu lotes, %llu objetos (media %.1f, máx %llu), %llu updateFile fusionados, drenado medio %.0f ns",
+            (unsigned long long)stats.batches, (unsigned long long)stats.objects,
+            double(stats.objects) / stats.batches, (unsigned long long)stats.max_batch,
+            (unsigned long long)stats.coalesced, double(stats.drain_ns_total) / stats.batches);
+    }
+
+    ReconnectStats reconnect = reconnect_stats();
+    if (reconnect.reconnects > 0) {
+        tgLog(RZ_LOG_INFO, "[LOOP] %llu reconexiones, %.0f ms de media hasta volver a estar listo (última: %.0f ms)",
+            (unsigned long long)reconnect.reconnects, reconnect.ready_ns_total / 1e6 / reconnect.reconnects,
+            reconnect.ready_ns_last / 1e6);
+    }
+
+    OutboundScheduler::Stats outbound = outbound_.stats();
+    tgLog(RZ_LOG_INFO, "[SEND] %llu mensajes enviados, %llu retrasados, %llu ediciones fusionadas, %llu sin cambios, %llu flood waits, %llu en cola",
+        (unsigned long long)outbound.sent, (unsigned long long)outbound.delayed, (unsigned long long)outbound.coalesced,
+        (unsigned long long)outbound.unchanged, (unsigned long long)outbound.retried, (unsigned long long)outbound.queued);
+
+    AccessControl::Stats access = access_.stats();
+    if (access.unauthorized + access.message_limited + access.download_limited > 0) {
+        tgLog(RZ_LOG_INFO, "[ACCESO] %llu mensajes admitidos; descartados: %llu no autorizados, %llu por límite de mensajes, %llu por límite de descargas",
+            (unsigned long long)access.admitted, (unsigned long long)access.unauthorized,
+            (unsigned long long)access.message_limited, (unsigned long long)access.download_limited);
+    }
+
+    DownloadScheduler::Stats downloads = download_stats();
+    tgLog(RZ_LOG_INFO, "[DESCARGA] %llu iniciadas, %llu terminadas, %llu activas, %llu en cola, espera media %.0f ms (máx %.0f ms)",
+        (unsigned long long)downloads.started, (unsigned long long)downloads.finished,
+        (unsigned long long)downloads.active, (unsigned long long)downloads.queued,
+        downloads.started ? downloads.wait_ms_total / downloads.started : 0.0, downloads.wait_ms_max);
+
+    if (journal_.is_open()) {
+        journal_.sync(std::chrono::steady_clock::now(), true);
+        DownloadJournal::Stats journal = journal_.stats();
+        tgLog(RZ_LOG_INFO, "[JOURNAL] %llu registros en %llu lotes (%llu bytes, %llu fallidos, %llu compactaciones), %llu descargas recuperadas al arrancar",
+            (unsigned long long)journal.records, (unsigned long long)journal.syncs,
+            (unsigned long long)journal.bytes, (unsigned long long)journal.failed,
+            (unsigned long long)journal.compactions, (unsigned long long)journal.recovered);
+    }
+
+    if (dedup_->is_open()) {
+        DedupIndex::Stats dedup = dedup_->stats();
+        tgLog(RZ_LOG_INFO, "[DEDUP] %llu archivos indexados, %llu duplicados servidos del índice, %llu unidos a una descarga en curso",
+            (unsigned long long)dedup.entries, (unsigned long long)dedup.hits, (unsigned long long)shared_downloads_.load());
+    }
+
+    DiskReservations::Stats disk = disk_.stats();
+    tgLog(RZ_LOG_INFO, "[DISCO] %llu descargas admitidas, %llu rechazadas por espacio, %llu preasignadas (%llu fallidas), %lld bytes aún reservados (%lld en destino)",
+        (unsigned long long)disk.granted, (unsigned long long)disk.rejected, (unsigned long long)disk.preallocated,
+        (unsigned long long)disk.preallocate_failed, (long long)disk.reserved_bytes, (long long)disk.target_reserved_bytes);
+
+    FileHasher::Stats hashed = hasher_->stats();
+    tgLog(RZ_LOG_INFO, "[HASH] %llu checksums (%llu fallidos), %llu MB hasheados, %llu MB tras completarse",
+        (unsigned long long)hashed.files, (unsigned long long)hashed.failed,
+        (unsigned long long)(hashed.bytes >> 20), (unsigned long long)(hashed.tail_bytes >> 20));
+
+    FileRelocator::Stats relocated = relocator_->stats();
+    tgLog(RZ_LOG_INFO, "[RELOCATE] %llu renombrados, %llu copiados (%llu bytes), %llu fallidos",
+        (unsigned long long)relocated.renamed, (unsigned long long)relocated.copied,
+        (unsigned long long)relocated.bytes_copied, (unsigned long long)relocated.failed);
+    tgLog(RZ_LOG_INFO, "[BOT] Detenido completamente");
+}
+
+/**
+ * @brief Fija el número de hilos de despacho. Debe llamarse antes de run().
+ * 
+ * Los updateNewMessage y updateFile se reparten por chat_id entre los hilos:
+ * un mismo chat se procesa siempre en orden y chats distintos en paralelo.
+ * Con 0 hilos todo se procesa en el hilo del bucle principal.
+ * @param threads Número de hilos de despacho.
+ * @return bool
+ */
+bool TelegramBot::set_dispatch_threads(std::size_t threads) {
+    if (running_) {
+        tgLog(RZ_LOG_ERROR, "[BOT] Los hilos de despacho deben fijarse antes de run()");
+        return false;
+    }
+    executor_.reset(new StrandExecutor(threads));
+    tgLog(RZ_LOG_INFO, "[BOT] %zu hilos de despacho", threads);
+    return true;
+}
+
+/**
+ * @brief Fija los límites del control de flood de mensajes salientes.
+ * @param config Tasas y ráfagas global y por chat.
+ */
+void TelegramBot::set_outbound_config(const OutboundScheduler::Config& config) {
+    outbound_.set_config(config);
+    tgLog(RZ_LOG_INFO, "[BOT] Control de flood: %.1f msg/s global, %.1f msg/s por chat",
+        config.global_rate, config.chat_rate);
+}
+
+/**
+ * @brief Fija los límites de descargas activas, en total y por chat.
+ * @param config Límites de concurrencia.
+ */
+void TelegramBot::set_download_limits(const DownloadScheduler::Config& config) {
+    download_scheduler_.set_config(config);
+    tgLog(RZ_LOG_INFO, "[BOT] Descargas simultáneas: %zu en total, %zu por chat",
+        config.max_active, config.max_active_per_chat);
+}
+
+/**
+ * @brief Fija la admisión de descargas por espacio libre en disco.
+ * 
+ * Una descarga solo se acepta si su tamaño cabe en el espacio libre del sistema
+ * de archivos de la caché de TDLib, descontando lo reservado por las demás y
+ * margin_bytes. Los archivos de al menos preallocate_min_bytes se preasignan
+ * enteros con fallocate al empezar a escribirse.
+ * @param margin_bytes Bytes que se dejan siempre libres.
+ * @param preallocate_min_bytes Tamaño mínimo para preasignar (0 = nunca).
+ */
+void TelegramBot::set_disk_policy(std::int64_t margin_bytes, std::int64_t preallocate_min_bytes) {
+    disk_.set_policy(margin_bytes, preallocate_min_bytes);
+    if (preallocate_min_bytes > 0) {
+        tgLog(RZ_LOG_INFO, "[BOT] Disco: %lld MB de margen, preasignación desde %lld MB",
+            (long long)(margin_bytes >> 20), (long long)(preallocate_min_bytes >> 20));
+    } else {
+        tgLog(RZ_LOG_INFO, "[BOT] Disco: %lld MB de margen, sin preasignación", (long long)(margin_bytes >> 20));
+    }
+}
+
+void TelegramBot::set_access_config(const AccessControl::Config& config) {
+    access_.set_config(config);
+    tgLog(RZ_LOG_INFO, "[ACCESO] Límite por usuario: %.1f mensajes/s (ráfaga %.0f), %.2f descargas/s (ráfaga %.0f)",
+        config.message_rate, config.message_burst, config.download_rate, config.download_burst);
+}
+
+void TelegramBot::set_allowed_users(std::vector<std::int64_t> users) {
+    access_.set_users(std::move(users));
+    if (access_.restricted()) {
+        tgLog(RZ_LOG_INFO, "[ACCESO] %llu usuarios autorizados", (unsigned long long)access_.stats().users);
+    }
+}
+
+bool TelegramBot::load_allowed_users(const std::string& path) {
+    return access_.load_file(path);
+}
+
+AccessControl::Stats TelegramBot::access_stats() const {
+    return access_.stats();
+}
+
+void TelegramBot::set_backlog_policy(bool skip, std::chrono::seconds grace, bool summary) {
+    skip_backlog_ = skip;
+    backlog_grace_ = grace;
+    backlog_summary_ = summary;
+    if (skip) {
+        tgLog(RZ_LOG_INFO, "[BACKLOG] Se descartan los mensajes anteriores al arranque (margen %lld s)%s",
+            (long long)grace.count(), summary ? ", con un aviso por chat" : "");
+    } else {
+        tgLog(RZ_LOG_INFO, "[BACKLOG] Se atienden los mensajes anteriores al arranque");
+    }
+}
+
+/**
+ * @brief Contadores de las reservas de espacio en disco.
+ * @return DiskReservations::Stats
+ */
+DiskReservations::Stats TelegramBot::disk_stats() const {
+    return disk_.stats();
+}
+
+/**
+ * @brief Contadores del planificador de descargas (profundidad de cola y espera).
+ * @return DownloadScheduler::Stats
+ */
+DownloadScheduler::Stats TelegramBot::download_stats() const {
+    return download_scheduler_.stats();
+}
+
+/**
+ * @brief Configura la descarga por rangos en paralelo.
+ * 
+ * Los archivos de al menos threshold_bytes se dividen en segments rangos que
+ * se piden a la vez con offset/limit. Solo se aplica si el transporte admite
+ * varias transferencias por archivo (TDLib no: un downloadFile sustituye al anterior).
+ * @param threshold_bytes Tamaño mínimo para dividir.
+ * @param segments Número de rangos (0 o 1 = desactivado).
+ */
+void TelegramBot::set_download_segments(std::int64_t threshold_bytes, std::size_t segments) {
+    segment_threshold_ = threshold_bytes;
+    segment_count_ = segments;
+    if (segments < 2) {
+        tgLog(RZ_LOG_INFO, "[BOT] Descarga por rangos desactivada");
+        return;
+    }
+    if (!transport_->supports_ranged_downloads()) {
+        tgLog(RZ_LOG_INFO, "[BOT] El backend no admite descargas por rangos: una transferencia por archivo");
+        return;
+    }
+    tgLog(RZ_LOG_INFO, "[BOT] Descargas de %lld MB o más en %zu rangos", (long long)(threshold_bytes >> 20), segments);
+}
+
+/**
+ * @brief Abre el diario de descargas. Debe llamarse antes de run().
+ * 
+ * Las descargas que no terminaron en la ejecución anterior se reanudan desde
+ * su offset cuando el bot queda autorizado.
+ * @param path Ruta del diario.
+ * @return bool
+ */
+bool TelegramBot::open_journal(const std::string& path) {
+    if (running_) {
+        tgLog(RZ_LOG_ERROR, "[JOURNAL] El diario debe abrirse antes de run()");
+        return false;
+    }
+    std::vector<DownloadJournal::Entry> recovered;
+    return journal_.open(path, recovered);
+}
+
+/**
+ * @brief Abre el índice de archivos descargados. Debe llamarse antes de run().
+ * 
+ * Un vídeo cuyo unique_id ya está en el índice (y sigue en disco) se contesta
+ * con su ruta sin volver a descargarlo.
+ * @param path Ruta del índice.
+ * @return bool
+ */
+bool TelegramBot::open_dedup_index(const std::string& path) {
+    if (running_) {
+        tgLog(RZ_LOG_ERROR, "[DEDUP] El índice debe abrirse antes de run()");
+        return false;
+    }
+    return dedup_->open(path);
+}
+
+/**
+ * @brief Directorio de la base de datos de TDLib de esta sesión.
+ * @return std::string
+ */
+std::string TelegramBot::database_directory() const {
+    return session_index_ == 0 ? "bot_db" : "bot_db/session" + std::to_string(session_index_);
+}
+
+/**
+ * @brief Caché de archivos de TDLib de esta sesión.
+ * 
+ * Vive dentro de la carpeta de descargas: al terminar, el traslado al nombre
+ * final es un rename en el mismo sistema de archivos.
+ * @return std::string
+ */
+std::string TelegramBot::files_directory() const {
+    std::string directory = download_path_.empty() ? "downloads" : download_path_ + "/.tdlib";
+    return session_index_ == 0 ? directory : directory + "-" + std::to_string(session_index_);
+}
+
+/**
+ * @brief Fija el número de sesión dentro del proceso. Debe llamarse antes de run().
+ * 
+ * Cada sesión de TDLib necesita su propia base de datos y su propia caché de
+ * archivos; la 0 usa las de siempre.
+ * @param index Número de sesión.
+ */
+void TelegramBot::set_session_index(std::size_t index) {
+    session_index_ = index;
+    disk_.set_path(files_directory());
+}
+
+/**
+ * @brief Sesión adicional de una cuenta: ignora los mensajes entrantes (los
+ * atiende la primera sesión) y solo hace las descargas que se le pasan.
+ * @param download_only true para no atender mensajes.
+ */
+void TelegramBot::set_download_only(bool download_only) {
+    download_only_ = download_only;
+}
+
+/**
+ * @brief Fija quién decide qué sesión descarga cada vídeo nuevo. Antes de run().
+ * 
+ * El router devuelve true si otra sesión se encarga de la descarga; con false
+ * (o sin router) la descarga se hace aquí.
+ * @param router Función de reparto.
+ */
+void TelegramBot::set_download_router(DownloadRouter router) {
+    download_router_ = std::move(router);
+}
+
+/**
+ * @brief Usa el índice de duplicados de otra sesión. Antes de run().
+ * 
+ * El unique_id es el mismo para todas las cuentas, así que un archivo que
+ * descargó cualquier sesión sirve para todas.
+ * @param other Sesión dueña del índice.
+ */
+void TelegramBot::share_dedup_index(const TelegramBot& other) {
+    dedup_ = other.dedup_;
+}
+
+/**
+ * @brief Descarga en esta sesión un vídeo que llegó a otra de la misma cuenta.
+ * 
+ * El file_id solo vale en la sesión que lo asignó: el archivo se recupera por
+ * su remote_id con getRemoteFile, como al reanudar desde el diario. Los
+ * mensajes de progreso salen desde esta sesión (es el mismo bot).
+ * Thread-safe.
+ * @param entry Chat, remote_id, unique_id, nombre y tamaño del archivo.
+ */
+void TelegramBot::adopt_download(DownloadJournal::Entry entry) {
+    auto query = td::td_api::make_object<td::td_api::getRemoteFile>();
+    query->remote_file_id_ = entry.remote_id;
+    query->file_type_ = td::td_api::make_object<td::td_api::fileTypeVideo>();
+    send_query(std::move(query), [this, entry](auto response) mutable {
+        // Reinicio del cliente antes de responder: se retoma con las demás al autorizarse
+        if (response->get_id() == td::td_api::error::ID &&
+            static_cast<td::td_api::error*>(response.get())->code_ == 500) {
+            std::lock_guard<std::mutex> lock(detached_mutex_);
+            detached_.push_back(DetachedDownload{ std::move(entry), {} });
+            return;
+        }
+        if (response->get_id() != td::td_api::file::ID) {
+            std::string reason = response->get_id() == td::td_api::error::ID
+                ? static_cast<td::td_api::error*>(response.get())->message_ : "respuesta inesperada";
+            tgLog(RZ_LOG_ERROR, "[SHARDS] Sesión %zu: no se pudo recuperar %s: %s", session_index_,
+                entry.file_name.c_str(), reason.c_str());
+            send_text_message(entry.chat_id, "No se pudo descargar " + entry.file_name + ": " + reason, nullptr);
+            return;
+        }
+
+        auto file = td::move_tl_object_as<td::td_api::file>(response);
+        FileType type;
+        type.fileName = entry.file_name;
+        type.extension = entry.extension;
+        type.mimeType = entry.mime_type;
+        type.fileSize = file->size_ > 0 ? file->size_ : entry.size;
+        tgLog(RZ_LOG_INFO, "[SHARDS] Sesión %zu: archivo %d de la sesión original es aquí el %d",
+            session_index_, entry.file_id, file->id_);
+        accept_download(entry.chat_id, file->id_, type, entry.unique_id, entry.remote_id);
+    });
+}
+
+/**
+ * @brief Activa la grabación de todo lo recibido de TDLib. Debe llamarse antes de run().
+ * @param path Ruta del log binario de grabación.
+ * @return bool
+ */
+bool TelegramBot::start_recording(const std::string& path) {
+    if (running_) {
+        tgLog(RZ_LOG_ERROR, "[RECORD] La grabación debe activarse antes de run()");
+        return false;
+    }
+    return recorder_.open(path);
+}
+
+/**
+ * @brief Reproduce un log grabado a través de process_response sin tocar la red.
+ * 
+ * Las queries que genere el bot durante la reproducción se registran pero no se
+ * envían a TDLib, de modo que las respuestas grabadas encuentran sus handlers
+ * si la secuencia de queries es la misma que en la grabación.
+ * @param path Ruta del log binario.
+ * @param realtime true para respetar los tiempos grabados, false para ir lo más rápido posible.
+ * @return bool
+ */
+bool TelegramBot::replay(const std::string& path, bool realtime) {
+    if (running_) {
+        tgLog(RZ_LOG_ERROR, "[REPLAY] No se puede reproducir con el bot en ejecución");
+        return false;
+    }
+
+    UpdateReplayer replayer;
+    if (!replayer.open(path)) {
+        return false;
+    }
+
+    tgLog(RZ_LOG_INFO, "[REPLAY] Reproduciendo '%s' (%s)", path.c_str(), realtime ? "tiempo real" : "máxima velocidad");
+
+    offline_ = true;
+    offline_queries_ = 0;
+
+    std::uint64_t replayed = 0;
+    std::uint64_t skipped = 0;
+    UpdateReplayer::Record record;
+    auto start = std::chrono::steady_clock::now();
+
+    while (replayer.next(record)) {
+        if (realtime) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.timestamp_ns));
+        }
+        if (!record.object) {
+            ++skipped;
+            continue;
+        }
+        process_response(record.request_id, std::move(record.object));
+        expire_timers();
+        ++replayed;
+    }
+
+    // Esperar a que los strands terminen lo que generó la reproducción
+    executor_->wait_idle();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    tgLog(RZ_LOG_INFO, "[REPLAY] %llu objetos reproducidos, %llu ignorados, %llu queries no enviadas en %.3f s (%.0f objetos/s)",
+        (unsigned long long)replayed, (unsigned long long)skipped, (unsigned long long)offline_queries_.load(),
+        elapsed, elapsed > 0.0 ? replayed / elapsed : 0.0);
+
+    offline_ = false;
+    return true;
 }
 
 /**
  * @brief Loop principal del objeto TelegramBot
  */
 void TelegramBot::main_loop() {
-    rzLog(RZ_LOG_INFO, "[LOOP] Bucle principal iniciado");
-    fflush(stdout);
-    
-    // Enviar parámetros iniciales inmediatamente
-    bool params_sent = false;
+    tgLog(RZ_LOG_INFO, "[LOOP] Bucle principal iniciado");
     
     while (running_) {
+        // Un close pedido tras un 401 que no termina: se descarta el transporte entero
+        if (closing_ && std::chrono::steady_clock::now() >= close_deadline_) {
+            tgLog(RZ_LOG_WARN, "[LOOP] El cliente %d no se cerró a tiempo: reinicio en frío", client_id_.load(std::memory_order_relaxed));
+            closing_ = false;
+            cold_restart_ = true;
+            need_restart_ = true;
+        }
+
         if (need_restart_) {
-            rzLog(RZ_LOG_INFO, "[LOOP] Reiniciando cliente...");
-            
-            if (client_manager_) {
-                delete client_manager_;
+            auto now = std::chrono::steady_clock::now();
+            if (!restart_scheduled_) {
+                if (!reconnecting_) {
+                    reconnecting_ = true;
+                    dropped_at_ = now;
+                }
+                std::chrono::milliseconds delay = reconnect_delay(++reconnect_attempts_);
+                restart_at_ = now + delay;
+                restart_scheduled_ = true;
+                tgLog(RZ_LOG_INFO, "[LOOP] Reiniciando cliente %d en %lld ms (intento %u)", client_id_.load(std::memory_order_relaxed),
+                    (long long)delay.count(), reconnect_attempts_);
+
+                // Las descargas siguen en memoria y se reasocian al cliente nuevo
+                detach_downloads();
+
+                // Las queries del cliente anterior ya no recibirán respuesta: se fallan
+                // ya, en orden de query_id, y las que saben reintentarse lo hacen al autorizarse
+                std::size_t failed = fail_pending_handlers(500, "Cliente TDLib reiniciado");
+                if (failed > 0) {
+                    tgLog(RZ_LOG_INFO, "[LOOP] %zu handlers pendientes cancelados por reinicio", failed);
+                }
             }
-            
-            client_manager_ = new td::ClientManager();
-            client_id_ = client_manager_->create_client_id();
-            
-            need_restart_ = false;
-            are_authorized_ = false;
-            params_sent = false; // Reset para reenviar parámetros
-            rzLog(RZ_LOG_INFO, "[LOOP] Cliente reiniciado con ID: %d", client_id_);
+            if (now < restart_at_) {
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                    restart_at_ - now, std::chrono::milliseconds(100)));
+                continue;
+            }
+            restart_client();
         }
         
-        // Enviar parámetros en la primera iteración
-        if (!params_sent) {
-            rzLog(RZ_LOG_INFO, "[LOOP] Enviando parámetros TDLib por primera vez...");
+        // Un único setTdlibParameters por cliente: también lo activa en el ClientManager
+        if (!parameters_sent_) {
             send_tdlib_parameters();
-            params_sent = true;
         }
         
-        if (!client_manager_) {
-            rzLog(RZ_LOG_INFO, "[LOOP] ERROR: client_manager_ es null!");
+        if (!transport_) {
+            tgLog(RZ_LOG_INFO, "[LOOP] ERROR: transport_ es null!");
             continue;
         }
         
-        // Recibir respuesta con timeout
-        auto response = client_manager_->receive(1.0);
+        // Recibir respuesta con timeout (más corto si hay mensajes salientes esperando tokens)
+        double timeout = std::chrono::duration<double>(
+            outbound_.next_wait(std::chrono::steady_clock::now(), std::chrono::seconds(1))).count();
+        auto response = transport_->receive(timeout);
         
         if (response.object) {
-            rzLog(RZ_LOG_DEBUG_EXTRA, "[LOOP] Respuesta recibida, tipo: %d", response.object->get_id());
-            
-            fflush(stdout);
-            process_response(response.request_id, std::move(response.object));
+            receive_batch(std::move(response));
+            dispatch_batch();
         } else {
             // Mostrar que estamos esperando (cada 10 iteraciones para no spam)
             static int wait_counter = 0;
             if (++wait_counter % 10 == 0) {
-                rzLog(RZ_LOG_DEBUG_EXTRA, "[LOOP] Esperando respuestas... (autorizado: %s)", 
+                tgLog(RZ_LOG_DEBUG_EXTRA, "[LOOP] Esperando respuestas... (autorizado: %s)", 
                 are_authorized_ ? "SÍ" : "NO");
-                fflush(stdout);
             }
         }
+
+        // Mensajes salientes que ya tienen tokens
+        flush_outbound();
+
+        // Lote pendiente del diario de descargas (como mucho uno por intervalo)
+        journal_.sync(std::chrono::steady_clock::now());
+
+        // Lista de usuarios autorizados, si su archivo cambió
+        access_.reload_if_changed(std::chrono::steady_clock::now());
+
+        // Resumen del backlog del arranque, cuando deja de llegar
+        flush_backlog(std::chrono::steady_clock::now());
+
+        // El timeout de receive marca el ritmo de la rueda de temporizadores
+        expire_timers();
     }
     
-    rzLog(RZ_LOG_INFO, "[LOOP] Bucle principal terminado");
+    tgLog(RZ_LOG_INFO, "[LOOP] Bucle principal terminado");
+}
+
+/**
+ * @brief Completa un lote con todo lo que ya está encolado en el transporte.
+ * 
+ * Tras el receive bloqueante se drenan con timeout 0 los objetos pendientes
+ * (hasta max_batch_size_) en el buffer reutilizable batch_. Se graban antes de
+ * cualquier fusión para que la captura refleje el flujo original.
+ * @param first Primer objeto recibido.
+ */
+void TelegramBot::receive_batch(TdTransport::Response first) {
+    auto drain_start = std::chrono::steady_clock::now();
+
+    batch_.clear();
+    batch_received_.clear();
+    batch_.push_back(std::move(first));
+    batch_received_.push_back(drain_start);
+    while (batch_.size() < max_batch_size_) {
+        auto response = transport_->receive(0.0);
+        if (!response.object) break;
+        batch_.push_back(std::move(response));
+        batch_received_.push_back(std::chrono::steady_clock::now());
+    }
+
+    std::uint64_t drain_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - drain_start).count());
+
+    if (recorder_.is_open()) {
+        for (const auto& response : batch_) {
+            recorder_.record(response.request_id, *response.object);
+        }
+    }
+
+    // Fusionar updateFile del mismo archivo: solo importa el más reciente
+    std::uint64_t coalesced = 0;
+    if (batch_.size() > 1) {
+        batch_files_.clear();
+        for (auto it = batch_.rbegin(); it != batch_.rend(); ++it) {
+            if (it->request_id != 0 || it->object->get_id() != td::td_api::updateFile::ID) continue;
+            auto update = static_cast<const td::td_api::updateFile*>(it->object.get());
+            if (!update->file_) continue;
+            if (!batch_files_.insert(update->file_->id_).second) {
+                it->object = nullptr;
+                ++coalesced;
+            }
+        }
+    }
+
+    loop_counters_.batches.fetch_add(1, std::memory_order_relaxed);
+    loop_counters_.objects.fetch_add(batch_.size(), std::memory_order_relaxed);
+    loop_counters_.coalesced.fetch_add(coalesced, std::memory_order_relaxed);
+    loop_counters_.drain_ns_total.fetch_add(drain_ns, std::memory_order_relaxed);
+    if (batch_.size() > loop_counters_.max_batch.load(std::memory_order_relaxed)) {
+        loop_counters_.max_batch.store(batch_.size(), std::memory_order_relaxed);
+    }
+    if (drain_ns > loop_counters_.drain_ns_max.load(std::memory_order_relaxed)) {
+        loop_counters_.drain_ns_max.store(drain_ns, std::memory_order_relaxed);
+    }
+
+    tgLog(RZ_LOG_DEBUG_EXTRA, "[LOOP] Lote de %zu objetos (%llu updateFile fusionados, drenado en %llu ns)",
+        batch_.size(), (unsigned long long)coalesced, (unsigned long long)drain_ns);
+}
+
+/**
+ * @brief Despacha en orden todos los objetos del lote actual.
+ */
+void TelegramBot::dispatch_batch() {
+    auto dispatch_start = std::chrono::steady_clock::now();
+    std::int32_t client_id = client_id_.load(std::memory_order_relaxed);   // solo lo cambia este hilo
+
+    for (std::size_t i = 0; i < batch_.size(); ++i) {
+        // Lo que aún llegue de un cliente anterior ya no tiene a quién ir
+        if (batch_[i].object && batch_[i].client_id != client_id) {
+            tgLog(RZ_LOG_DEBUG, "[LOOP] Descartado objeto %d del cliente %d (actual: %d)",
+                batch_[i].object->get_id(), batch_[i].client_id, client_id);
+            continue;
+        }
+        if (batch_[i].object) {
+            metrics_.dispatch_latency.observe(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - batch_received_[i]).count()));
+            process_response(batch_[i].request_id, std::move(batch_[i].object));
+        }
+    }
+    batch_.clear();
+
+    loop_counters_.dispatch_ns_total.fetch_add(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - dispatch_start).count()),
+        std::memory_order_relaxed);
+
+    // Estado propiedad del bucle: se publica como gauge para el hilo de métricas
+    metrics_.handlers.set(static_cast<std::int64_t>(handlers_.size()));
+    metrics_.pending_callbacks.set(static_cast<std::int64_t>(pending_messages_.size()));
+}
+
+/**
+ * @brief Fija el tamaño máximo de lote del bucle principal (1 = sin lotes).
+ * @param max_batch_size Número máximo de objetos por lote.
+ */
+void TelegramBot::set_max_batch_size(std::size_t max_batch_size) {
+    max_batch_size_ = max_batch_size > 0 ? max_batch_size : 1;
+    batch_.reserve(max_batch_size_);
+    batch_received_.reserve(max_batch_size_);
+}
+
+/**
+ * @brief Devuelve una copia de los contadores por lote del bucle principal.
+ * @return LoopStats
+ */
+TelegramBot::LoopStats TelegramBot::loop_stats() const {
+    LoopStats stats;
+    stats.batches = loop_counters_.batches.load(std::memory_order_relaxed);
+    stats.objects = loop_counters_.objects.load(std::memory_order_relaxed);
+    stats.coalesced = loop_counters_.coalesced.load(std::memory_order_relaxed);
+    stats.max_batch = loop_counters_.max_batch.load(std::memory_order_relaxed);
+    stats.drain_ns_total = loop_counters_.drain_ns_total.load(std::memory_order_relaxed);
+    stats.drain_ns_max = loop_counters_.drain_ns_max.load(std::memory_order_relaxed);
+    stats.dispatch_ns_total = loop_counters_.dispatch_ns_total.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/**
+ * @brief Arranca el endpoint HTTP de métricas en un hilo propio.
+ * @param address Dirección IPv4 en la que escuchar (normalmente 127.0.0.1).
+ * @param port Puerto TCP (0 = cualquiera libre).
+ * @return bool
+ */
+bool TelegramBot::start_metrics(const std::string& address, std::uint16_t port) {
+    metrics_server_.reset(new MetricsServer());
+    if (!metrics_server_->start(address, port, [this] { return render_metrics(); })) {
+        metrics_server_.reset();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Genera las métricas en formato de exposición de texto de Prometheus.
+ * 
+ * Se llama desde el hilo del endpoint. Los contadores del bot son atómicos;
+ * los planificadores y el diario se leen con su lock, que nunca se retiene
+ * durante una espera, así que el bucle principal no se detiene.
+ * @return std::string
+ */
+std::string TelegramBot::render_metrics() const {
+    std::string out;
+    out.reserve(4096);
+    char line[160];
+
+    write_header(out, "tgbot_updates_total", "counter", "Objetos recibidos de TDLib por tipo.");
+    for (std::size_t type = 0; type < UPDATE_TYPES; ++type) {
+        std::snprintf(line, sizeof(line), "tgbot_updates_total{type=\"%s\"} %llu\n",
+            UPDATE_TYPE_NAMES[type], (unsigned long long)metrics_.updates[type].get());
+        out += line;
+    }
+
+    write_metric(out, "tgbot_query_handlers", "gauge", "Queries enviadas a TDLib esperando respuesta.", double(metrics_.handlers.get()));
+    write_metric(out, "tgbot_pending_message_callbacks", "gauge", "Mensajes enviados esperando su ID real.", double(metrics_.pending_callbacks.get()));
+
+    LoopStats loop = loop_stats();
+    write_metric(out, "tgbot_loop_batches_total", "counter", "Lotes recibidos por el bucle principal.", double(loop.batches));
+    write_metric(out, "tgbot_loop_coalesced_total", "counter", "updateFile descartados por uno más reciente del mismo archivo.", double(loop.coalesced));
+    metrics_.dispatch_latency.write(out, "tgbot_dispatch_latency_seconds", "Tiempo desde la recepción de un objeto en main_loop hasta su process_response.");
+
+    DownloadScheduler::Stats downloads = download_stats();
+    write_metric(out, "tgbot_downloads_active", "gauge", "Descargas en curso.", double(downloads.active));
+    write_metric(out, "tgbot_downloads_queued", "gauge", "Descargas esperando hueco.", double(downloads.queued));
+    write_metric(out, "tgbot_downloads_started_total", "counter", "Descargas iniciadas.", double(downloads.started));
+    write_metric(out, "tgbot_downloads_finished_total", "counter", "Descargas terminadas o canceladas.", double(downloads.finished));
+    write_metric(out, "tgbot_downloaded_bytes_total", "counter", "Bytes descargados (rate() da los bytes por segundo).", double(metrics_.downloaded_bytes.get()));
+
+    write_metric(out, "tgbot_edits_total", "counter", "Ediciones de mensajes enviadas a TDLib.", double(metrics_.edits.get()));
+    write_metric(out, "tgbot_edit_errors_total", "counter", "Ediciones rechazadas (sin contar flood waits).", double(metrics_.edit_errors.get()));
+    write_metric(out, "tgbot_edit_flood_waits_total", "counter", "Ediciones rechazadas con flood wait y reintentadas.", double(metrics_.edit_flood_waits.get()));
+
+    OutboundScheduler::Stats outbound = outbound_.stats();
+    write_metric(out, "tgbot_outbound_sent_total", "counter", "Envíos y ediciones liberados por el control de flood.", double(outbound.sent));
+    write_metric(out, "tgbot_outbound_coalesced_total", "counter", "Ediciones fusionadas con una posterior del mismo mensaje.", double(outbound.coalesced));
+    write_metric(out, "tgbot_outbound_queued", "gauge", "Envíos esperando tokens del control de flood.", double(outbound.queued));
+
+    write_metric(out, "tgbot_backlog_skipped_total", "counter", "Mensajes anteriores al arranque descartados sin procesar.", double(backlog_skipped()));
+
+    AccessControl::Stats access = access_.stats();
+    write_metric(out, "tgbot_access_allowed_users", "gauge", "Usuarios en la lista de autorizados (0 sin lista).", double(access.users));
+    write_header(out, "tgbot_access_rejected_total", "counter", "Mensajes descartados por el filtro de entrada.");
+    std::snprintf(line, sizeof(line), "tgbot_access_rejected_total{reason=\"unauthorized\"} %llu\n", (unsigned long long)access.unauthorized);
+    out += line;
+    std::snprintf(line, sizeof(line), "tgbot_access_rejected_total{reason=\"message_rate\"} %llu\n", (unsigned long long)access.message_limited);
+    out += line;
+    std::snprintf(line, sizeof(line), "tgbot_access_rejected_total{reason=\"download_rate\"} %llu\n", (unsigned long long)access.download_limited);
+    out += line;
+
+    DiskReservations::Stats disk = disk_.stats();
+    write_metric(out, "tgbot_disk_reserved_bytes", "gauge", "Bytes reservados por descargas aceptadas y aún sin escribir.", double(disk.reserved_bytes));
+    write_metric(out, "tgbot_disk_target_reserved_bytes", "gauge", "Bytes reservados en la carpeta de descargas cuando está en otro sistema de archivos.", double(disk.target_reserved_bytes));
+    write_metric(out, "tgbot_disk_reservations", "gauge", "Descargas con espacio reservado.", double(disk.reservations));
+    write_metric(out, "tgbot_disk_free_bytes", "gauge", "Espacio libre según statvfs en la carpeta de la caché de TDLib.", double(disk_.free_bytes()));
+    write_metric(out, "tgbot_disk_rejected_total", "counter", "Descargas rechazadas por falta de espacio.", double(disk.rejected));
+    write_metric(out, "tgbot_disk_preallocated_total", "counter", "Archivos preasignados con fallocate.", double(disk.preallocated));
+
+    ReconnectStats reconnect = reconnect_stats();
+    write_metric(out, "tgbot_reconnects_total", "counter", "Reinicios del cliente de TDLib que volvieron a Ready.", double(reconnect.reconnects));
+    write_metric(out, "tgbot_reconnect_ready_seconds_total", "counter", "Tiempo sumado desde cada corte hasta volver a Ready.", reconnect.ready_ns_total / 1e9);
+    write_metric(out, "tgbot_reconnect_ready_seconds", "gauge", "Tiempo hasta volver a Ready tras el último corte.", reconnect.ready_ns_last / 1e9);
+
+    FileHasher::Stats hashed = hasher_->stats();
+    write_metric(out, "tgbot_hashed_bytes_total", "counter", "Bytes hasheados por el checksum incremental.", double(hashed.bytes));
+    FileRelocator::Stats relocated = relocator_->stats();
+    write_metric(out, "tgbot_relocate_failed_total", "counter", "Archivos que no se pudieron trasladar.", double(relocated.failed));
+    if (dedup_->is_open()) {
+        write_metric(out, "tgbot_dedup_hits_total", "counter", "Duplicados contestados desde el índice.", double(dedup_->stats().hits));
+    }
+    return out;
 }
 
 /**
@@ -171,86 +876,206 @@ void TelegramBot::handle_file_update(td::td_api::object_ptr<td::td_api::file> fi
     
     //bool is_downloading = file->local_->is_downloading_active_;
     bool is_complete = file->local_->is_downloading_completed_;
+    int64_t contiguous = file->local_->download_offset_ + file->local_->downloaded_prefix_size_;
+
+    bool known = false;
+    bool report = false;
+    bool preallocate = false;
+    int64_t chat_id = 0;
+    int64_t message_id = -1;
+    DownloadInfo finished;
+    std::string editText;
+    char buffer[256];
 
-    DownloadMap::iterator it = downloads_.find(file_id); 
-    if (it == downloads_.end()) {
-        rzLog(RZ_LOG_WARN, "Descarga sin chat asociado. Ignorando.");
-        return;
-    }
+    {
+        // El estado de descargas se comparte entre los hilos de despacho. Una sola
+        // búsqueda por update: lo caliente va junto y los textos solo se leen al reportar
+        std::lock_guard<std::mutex> lock(downloads_mutex_);
+        std::size_t slot = downloads_.find(file_id);
+        if (slot != DownloadTable::npos) {
+            known = true;
+            DownloadProgress& state = downloads_.hot(slot);
+
+            // Por rangos, el progreso es la suma de lo descargado en cada uno
+            if (state.segmented) {
+                DownloadSegments& segments = downloads_.cold(slot).segments;
+                segments.update(file->local_->download_offset_, file->local_->downloaded_prefix_size_);
+                downloaded = segments.downloaded();
+                contiguous = segments.contiguous();
+                is_complete = is_complete || segments.complete();
+            }
+            if (downloaded > state.metered) {
+                metrics_.downloaded_bytes.add(static_cast<std::uint64_t>(downloaded - state.metered));
+                state.metered = downloaded;
+            }
 
-    int64_t chat_id = it->second.chat_id;
-    int64_t message_id = it->second.message_id;
-    
-    // IMPORTANTE: Solo editar si tenemos el ID real
-    if (message_id == -1) {
-        rzLog(RZ_LOG_DEBUG, "Archivo %d: Esperando ID real del mensaje antes de editar...", file_id);
-        return;  // Salir, esperamos siguiente updateFile
-    }
+            chat_id = state.chat_id;
+            message_id = state.message_id;
 
-    if (total <= 0) return; // Evitar división por cero
+            // El primer update con ruta local es el momento de preasignar el archivo parcial
+            if (!state.disk_checked && !is_complete && !file->local_->path_.empty()) {
+                state.disk_checked = true;
+                preallocate = true;
+            }
 
-    float progress = (downloaded * 100.0f / total);
-    int progress_5 = static_cast<int>(std::floor(progress / 5.0f) * 5); // redondear a múltiplo de 5
+            float progress = total > 0 ? (downloaded * 100.0f / total) : 100.0f;
+            int progress_5 = static_cast<int>(std::floor(progress / 5.0f) * 5); // redondear a múltiplo de 5
+
+            // IMPORTANTE: Solo editar si tenemos el ID real. Al completar se sigue
+            // adelante igualmente: el archivo hay que trasladarlo
+            if (message_id == -1 && !is_complete) {
+                tgLog(RZ_LOG_DEBUG, "Archivo %d: Esperando ID real del mensaje antes de editar...", file_id);
+            } else if ((total > 0 || is_complete) &&                     // Evitar división por cero
+                       (is_complete || state.reported_pct != progress_5)) { // Solo al pasar al siguiente 5%
+                report = true;
+
+                auto now = std::chrono::steady_clock::now();
+                double speed_mbps = 0.0;
+                if (state.reported_at != std::chrono::steady_clock::time_point()) {
+                    int64_t delta_bytes = downloaded - state.reported_bytes;
+                    double delta_time = std::chrono::duration<double>(now - state.reported_at).count(); // segundos
+                    if (delta_time > 0.0) {
+                        speed_mbps = (delta_bytes / 1024.0 / 1024.0) / delta_time;
+                    }
+                }
 
-    // Solo reportar si hemos avanzado al siguiente 5%
-    if (!is_complete && last_progress_reported_[file_id] == progress_5) {
-        return;
-    }
+                state.reported_bytes = downloaded;
+                state.reported_at = now;
+                state.reported_pct = progress_5;
+
+                // Calcular ETA aproximado
+                double eta_sec = (speed_mbps > 0.0) ? ((total - downloaded) / 1024.0 / 1024.0) / speed_mbps : 0.0;
+                int eta_min = static_cast<int>(eta_sec / 60);
+                int eta_sec_rem = static_cast<int>(std::round(eta_sec)) % 60;
 
-    auto now = std::chrono::steady_clock::now();
-    double speed_mbps = 0.0;
+                std::snprintf(
+                    buffer,
+                    sizeof(buffer),
+                    "Archivo %d: %d%% (%ld/%ld bytes) | Velocidad: %.2f MB/s | ETA: %d:%02d",
+                    file_id, progress_5, downloaded, total, speed_mbps, eta_min, eta_sec_rem
+                );
 
-    if (last_downloaded_.count(file_id)) {
-        int64_t prev_bytes = last_downloaded_[file_id];
-        auto prev_time = last_time_[file_id];
-        int64_t delta_bytes = downloaded - prev_bytes;
-        double delta_time = std::chrono::duration<double>(now - prev_time).count(); // segundos
+                DownloadInfo& info = downloads_.cold(slot);
+                editText = info.original_text + "\n\nDescargando " + info.file.fileName + "\nExtension: " + info.file.extension;
 
-        if (delta_time > 0.0) {
-            speed_mbps = (delta_bytes / 1024.0 / 1024.0) / delta_time;
+                if (is_complete) {
+                    finished = std::move(info);
+                    downloads_.erase(slot); // ya no necesitamos el mensaje de progreso
+                }
+            }
         }
     }
 
-    last_downloaded_[file_id] = downloaded;
-    last_time_[file_id] = now;
-    last_progress_reported_[file_id] = progress_5;
-
-    // Calcular ETA aproximado
-    double eta_sec = (speed_mbps > 0.0) ? ((total - downloaded) / 1024.0 / 1024.0) / speed_mbps : 0.0;
-    int eta_min = static_cast<int>(eta_sec / 60);
-    int eta_sec_rem = static_cast<int>(std::round(eta_sec)) % 60;
+    // Un archivo que no seguimos (miniaturas, descargas de TDLib, uno ya
+    // cancelado o trasladado) no toca el diario, el planificador ni el disco
+    if (!known) {
+        tgLog(RZ_LOG_DEBUG, "Archivo %d sin descarga asociada. Ignorando.", file_id);
+        return;
+    }
 
+    // Una descarga completada siempre libera su hueco, se reporte o no
+    if (is_complete) {
+        journal_.done(file_id);
+        finish_download_slot(file_id, true);
+    } else {
+        journal_.progress(file_id, contiguous);
+        hasher_->advance(file_id, file->local_->path_, contiguous);
+        download_scheduler_.update_remaining(file_id, total - downloaded);
+        if (preallocate) disk_.preallocate(file_id, file->local_->path_);
+        if (report) disk_.progress(file_id, downloaded);   // Cada 5 %: lo escrito ya lo descuenta statvfs
+        apply_download_priorities();
+    }
 
-    char buffer[256];
-    std::snprintf(
-        buffer,
-        sizeof(buffer),
-        "Archivo %d: %d%% (%ld/%ld bytes) | Velocidad: %.2f MB/s | ETA: %d:%02d",
-        file_id, progress_5, downloaded, total, speed_mbps, eta_min, eta_sec_rem
-    );
+    if (!report) return;
 
-    rzLog(RZ_LOG_DEBUG, buffer);
-    
-    std::string editText = downloads_[file_id].original_text + "\n\nDescargando " + it->second.file.fileName + "\nExtension: " + it->second.file.extension;
+    tgLog(RZ_LOG_DEBUG, "%s", buffer);
 
-    send_edited_message(chat_id, message_id, editText + "\n" + buffer);
+    if (message_id != -1) {
+        send_edited_message(chat_id, message_id, editText + "\n" + buffer);
+    }
 
     if (is_complete) {
-        
-        std::time_t finish = time(nullptr); 
-        double diff = difftime(finish, downloads_[file_id].start_time);
-        int minutes = static_cast<int>(diff / 60);
-        std::string mensaje = "Archivo completado!\nTiempo de descarga: " +
-                            std::to_string(minutes) + " min";
+        // El mensaje de progreso ya no se editará más
+        if (message_id != -1) outbound_.forget(chat_id, message_id);
 
-        send_text_message(chat_id, mensaje, nullptr);
-        downloads_.erase(it); // ya no necesitamos el mensaje de progreso
+        // El aviso de fin sale cuando el archivo está hasheado y en su sitio
+        finish_file(file_id, std::move(finished), file->local_->path_, total);
+    }
+}
+
+/**
+ * @brief Cierra el checksum incremental de un archivo terminado y lo traslada.
+ * 
+ * Casi todo el archivo se hasheó mientras se descargaba; aquí solo queda la
+ * cola desde el último updateFile. Después sigue relocate_download() desde el
+ * hilo del hasher.
+ * @param file_id Identificador del archivo.
+ * @param info Estado de la descarga terminada.
+ * @param path Ruta del archivo en la caché de TDLib.
+ * @param size Tamaño final (0 o menos si no se conoce).
+ */
+void TelegramBot::finish_file(int32_t file_id, DownloadInfo info, const std::string& path, int64_t size) {
+    if (path.empty() || offline_) {
+        hasher_->cancel(file_id);
+        relocate_download(file_id, info, path, "");
+        return;
+    }
 
-        // Limpiar estado
-        last_downloaded_.erase(file_id);
-        last_time_.erase(file_id);
-        last_progress_reported_.erase(file_id);
+    hasher_->finish(file_id, path, size > 0 ? size : -1,
+        [this, file_id, info = std::move(info), path](bool ok, const std::string& digest) {
+            if (ok) {
+                tgLog(RZ_LOG_INFO, "[HASH] Archivo %d: XXH64 %s", file_id, digest.c_str());
+            } else {
+                tgLog(RZ_LOG_WARN, "[HASH] Archivo %d sin checksum", file_id);
+            }
+            relocate_download(file_id, info, path, digest);
+        });
+}
+
+/**
+ * @brief Mueve un archivo terminado a download_path_, lo indexa y avisa a los chats.
+ * 
+ * El traslado (rename, o copia en el kernel entre sistemas de archivos) se hace
+ * en el hilo del relocator; el aviso "Archivo completado" sale desde su callback
+ * al chat de la descarga y a los que reenviaron el mismo archivo mientras tanto.
+ * Sin carpeta de descargas o sin ruta local se avisa directamente.
+ * @param file_id Identificador del archivo.
+ * @param info Estado de la descarga terminada.
+ * @param path Ruta del archivo en la caché de TDLib.
+ * @param checksum XXH64 del archivo (vacío si no se pudo calcular).
+ */
+void TelegramBot::relocate_download(int32_t file_id, const DownloadInfo& info, const std::string& path,
+                                    const std::string& checksum) {
+    int minutes = static_cast<int>(difftime(time(nullptr), info.start_time) / 60);
+    std::string mensaje = "Archivo completado!\nTiempo de descarga: " + std::to_string(minutes) + " min";
+    if (!checksum.empty()) mensaje += "\nXXH64: " + checksum;
+
+    std::vector<int64_t> chats(1, info.chat_id);
+    chats.insert(chats.end(), info.waiters.begin(), info.waiters.end());
+
+    if (download_path_.empty() || path.empty() || offline_) {
+        disk_.relocated(file_id);
+        if (!offline_) dedup_->add(info.unique_id, path, info.file.fileSize, checksum);
+        for (int64_t chat_id : chats) {
+            send_text_message(chat_id, mensaje, nullptr);
+        }
+        return;
     }
+
+    const std::string& name = info.file.fileName;
+    relocator_->relocate(path, download_path_, name.empty() ? path.substr(path.rfind('/') + 1) : name,
+        [this, file_id, chats, mensaje, unique_id = info.unique_id, size = info.file.fileSize, checksum]
+        (bool ok, const std::string& final_path) {
+            disk_.relocated(file_id);   // Copiado o no, ya no hace falta el sitio en destino
+            if (ok) {
+                dedup_->add(unique_id, final_path, size, checksum);
+            } else {
+                tgLog(RZ_LOG_WARN, "[RELOCATE] Archivo %d se queda en '%s'", file_id, final_path.c_str());
+            }
+            for (int64_t chat_id : chats) {
+                send_text_message(chat_id, ok ? mensaje + "\nGuardado en: " + final_path : mensaje, nullptr);
+            }
+        });
 }
 
 
@@ -262,20 +1087,40 @@ void TelegramBot::handle_file_update(td::td_api::object_ptr<td::td_api::file> fi
  */
 void TelegramBot::process_response(uint64_t query_id, td::td_api::object_ptr<td::td_api::Object> response) {
     if (!response) {
-        rzLog(RZ_LOG_INFO, "[PROCESS] Respuesta null recibida");
+        tgLog(RZ_LOG_INFO, "[PROCESS] Respuesta null recibida");
         return;
     }
 
         //PRIMERO: Buscar handler para este query_id
-    if (query_id != 0 && handlers_.find(query_id) != handlers_.end()) {
-        rzLog(RZ_LOG_INFO, "EJECUTANDO CALLBACK para query_id %llu", query_id);
-        handlers_[query_id](std::move(response));
-        handlers_.erase(query_id);
-        return; // Ya manejamos esta respuesta
+    if (query_id != 0) {
+        drain_submissions(); // El handler pudo publicarse desde otro hilo
+        QueryHandler handler = handlers_.take(query_id);
+        if (handler) {
+            metrics_.updates[0].add();
+            tgLog(RZ_LOG_DEBUG, "EJECUTANDO CALLBACK para query_id %llu", query_id);
+            handler(std::move(response));
+            return; // Ya manejamos esta respuesta
+        }
+
+        // Su handler puede seguir detrás de un slot reservado y sin publicar: se
+        // aparca hasta que salga de la cola en vez de tratarla como un update
+        if (submissions_.claimed()) {
+            ++parked_total_;
+            tgLog(RZ_LOG_DEBUG, "[QUERY] Respuesta a query_id %llu antes que su handler: aparcada", (unsigned long long)query_id);
+            parked_responses_.emplace_back(query_id, std::move(response));
+            return;
+        }
     }
 
     int response_id = response->get_id();
-    rzLog(RZ_LOG_DEBUG_EXTRA, "[PROCESS] Procesando respuesta tipo: %d", response_id);
+    metrics_.updates[update_type_index(response_id)].add();
+
+    // Filtro de entrada: lo que no pasa se descarta antes de extraer nada del mensaje
+    if (response_id == td::td_api::updateNewMessage::ID && !download_only_ &&
+        !admit_message(static_cast<const td::td_api::updateNewMessage&>(*response))) {
+        return;
+    }
+    tgLog(RZ_LOG_DEBUG_EXTRA, "[PROCESS] Procesando respuesta tipo: %d", response_id);
 
 
     //OPTIONES A CONTEMPLAR: 900822020, 1264668933, 1834871737, 1469292078... TODAS AL INICIO DE LA EJEC
@@ -283,7 +1128,7 @@ void TelegramBot::process_response(uint64_t query_id, td::td_api::object_ptr<td:
     {
     case td::td_api::updateAuthorizationState::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es updateAuthorizationState");
+            tgLog(RZ_LOG_INFO, "[PROCESS] -> Es updateAuthorizationState");
             auto update = td::td_api::move_object_as<td::td_api::updateAuthorizationState>(response);
             authorization_state_ = std::move(update->authorization_state_);
             handle_authorization_update();
@@ -291,24 +1136,30 @@ void TelegramBot::process_response(uint64_t query_id, td::td_api::object_ptr<td:
         }
     case td::td_api::updateNewMessage::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es updateNewMessage ¡MENSAJE RECIBIDO!");
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> Es updateNewMessage ¡MENSAJE RECIBIDO!");
+            if (download_only_) break;   // Los atiende la primera sesión de la cuenta
             auto update = td::td_api::move_object_as<td::td_api::updateNewMessage>(response);
-            handle_new_updateNewMessage(std::move(update->message_));
+            int64_t chat_id = update->message_ ? update->message_->chat_id_ : 0;
+
+            // Los mensajes de un mismo chat se procesan en orden en su strand
+            executor_->post(static_cast<uint64_t>(chat_id), [this, message = std::move(update->message_)]() mutable {
+                handle_new_updateNewMessage(std::move(message));
+            });
             break;
         }
     case td::td_api::updateMessageEdited::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es updateMessageEdited ¡MENSAJE EDITADO!");
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> Es updateMessageEdited ¡MENSAJE EDITADO!");
             break;
         }
     case td::td_api::updateMessageContent::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es updateMessageContent ¡MENSAJE EDITADO!");
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> Es updateMessageContent ¡MENSAJE EDITADO!");
             break;
         }
     case td::td_api::error::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es error");
+            tgLog(RZ_LOG_INFO, "[PROCESS] -> Es error");
             auto error = td::td_api::move_object_as<td::td_api::error>(response);
             handle_error(error.get());
             break;
@@ -316,52 +1167,62 @@ void TelegramBot::process_response(uint64_t query_id, td::td_api::object_ptr<td:
     case td::td_api::updateFile::ID:
         {
             auto update = td::td_api::move_object_as<td::td_api::updateFile>(response);
-            handle_file_update(std::move(update->file_));
+            if (!update->file_) break;
+
+            // Todos los updates de un archivo en su propio strand, en orden: la
+            // descarga puede entrar en downloads_ (en el strand del chat) entre dos de ellos
+            int32_t file_id = update->file_->id_;
+            executor_->post(file_strand(file_id), [this, file = std::move(update->file_)]() mutable {
+                handle_file_update(std::move(file));
+            });
             break;
         }
     case td::td_api::updateMessageSendSucceeded::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es updateMessageSendSucceeded");
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> Es updateMessageSendSucceeded");
             auto update = td::td_api::move_object_as<td::td_api::updateMessageSendSucceeded>(response);
             
             int64_t temp_id = update->old_message_id_;  // ID temporal
             int64_t real_id = update->message_->id_;     // ID REAL del servidor
             
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> updateMessageSendSucceeded: ID temporal %lld → ID REAL %lld", 
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> updateMessageSendSucceeded: ID temporal %lld → ID REAL %lld", 
                 (long long)temp_id, (long long)real_id);
             
-            // Buscar si hay callback pendiente para este mensaje
-            auto it = pending_message_callbacks_.find(temp_id);
-            if (it != pending_message_callbacks_.end()) {
-                rzLog(RZ_LOG_DEBUG, "Ejecutando callback con ID real %lld", (long long)real_id);
-                
-                // Llamar callback con el ID REAL
-                it->second(real_id);
-                
-                // Limpiar callback usado
-                pending_message_callbacks_.erase(it);
-            }
+            // Reanuda la corrutina o llama al callback que esperaba este mensaje
+            resolve_message_id(temp_id, real_id);
             
             return;
             break;
         }
+    case td::td_api::updateMessageSendFailed::ID:
+        {
+            auto update = td::td_api::move_object_as<td::td_api::updateMessageSendFailed>(response);
+            int64_t temp_id = update->old_message_id_;
+
+            tgLog(RZ_LOG_ERROR, "[PROCESS] -> updateMessageSendFailed: ID temporal %lld (%s)",
+                (long long)temp_id, update->error_ ? update->error_->message_.c_str() : "");
+
+            // El ID real no llegará nunca: avisar a quien lo esperaba
+            resolve_message_id(temp_id, -1);
+            return;
+        }
     case td::td_api::ok::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es ok");
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> Es ok");
             break;
         }
     case td::td_api::message::ID:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es message");
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> Es message");
             auto message = td::td_api::move_object_as<td::td_api::message>(std::move(response));
-                rzLog(RZ_LOG_INFO, "MENSAJE CREADO - ID: %lld, Chat: %lld", 
+                tgLog(RZ_LOG_DEBUG, "MENSAJE CREADO - ID: %lld, Chat: %lld", 
               (long long)message->id_, (long long)message->chat_id_);
         return;
             break;        
         }
     default:
         {
-            rzLog(RZ_LOG_INFO, "[PROCESS] -> Tipo desconocido: %d (ignorando)", response_id);            
+            tgLog(RZ_LOG_DEBUG, "[PROCESS] -> Tipo desconocido: %d (ignorando)", response_id);            
             break;
         }
     }
@@ -375,132 +1236,685 @@ void TelegramBot::process_response(uint64_t query_id, td::td_api::object_ptr<td:
  */
 void TelegramBot::handle_authorization_update() {
     if (!authorization_state_) {
-        rzLog(RZ_LOG_INFO, "[AUTH] Estado de autorización null");
+        tgLog(RZ_LOG_INFO, "[AUTH] Estado de autorización null");
         return;
     }
 
     int auth_state_id = authorization_state_->get_id();
-    rzLog(RZ_LOG_INFO, "[AUTH] Estado de autorización: %d", auth_state_id);
+    tgLog(RZ_LOG_INFO, "[AUTH] Estado de autorización: %d", auth_state_id);
     
     if (auth_state_id == td::td_api::authorizationStateWaitTdlibParameters::ID) {
-        rzLog(RZ_LOG_INFO, "[AUTH] -> Configurando parámetros TDLib...");
-        send_tdlib_parameters();
+        // main_loop ya los envía al crear el cliente
+        if (!parameters_sent_) {
+            tgLog(RZ_LOG_INFO, "[AUTH] -> Configurando parámetros TDLib...");
+            send_tdlib_parameters();
+        }
     }
     else if (auth_state_id == td::td_api::authorizationStateWaitPhoneNumber::ID) {
-        rzLog(RZ_LOG_INFO, "[AUTH] -> Enviando token de bot...");
+        tgLog(RZ_LOG_INFO, "[AUTH] -> Enviando token de bot...");
         send_bot_token();
     }
     else if (auth_state_id == td::td_api::authorizationStateReady::ID) {
         are_authorized_ = true;
-        rzLog(RZ_LOG_INFO, "[AUTH] -> ¡¡¡BOT AUTORIZADO Y LISTO!!!");
+        tgLog(RZ_LOG_INFO, "[AUTH] -> ¡¡¡BOT AUTORIZADO Y LISTO!!!");
+
+        // Tiempo desde el primer corte de la racha hasta volver a estar listo
+        if (reconnecting_) {
+            std::uint64_t ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - dropped_at_).count());
+            reconnects_.fetch_add(1, std::memory_order_relaxed);
+            reconnect_ready_ns_total_.fetch_add(ns, std::memory_order_relaxed);
+            reconnect_ready_ns_last_.store(ns, std::memory_order_relaxed);
+            tgLog(RZ_LOG_INFO, "[LOOP] Cliente %d listo %.0f ms después del corte (%u intentos)", client_id_.load(std::memory_order_relaxed),
+                ns / 1e6, reconnect_attempts_);
+            reconnecting_ = false;
+        }
+        reconnect_attempts_ = 0;
+        resume_downloads();
+    }
+    else if (auth_state_id == td::td_api::authorizationStateClosed::ID) {
+        tgLog(RZ_LOG_INFO, "[AUTH] -> Conexión cerrada, programando reinicio");
+        are_authorized_ = false;
+        closing_ = false;
+        need_restart_ = true;
+    }
+    else if (auth_state_id == td::td_api::authorizationStateLoggingOut::ID) {
+        tgLog(RZ_LOG_INFO, "[AUTH] -> Cerrando sesión...");
+        are_authorized_ = false;
+    }
+    else {
+        tgLog(RZ_LOG_INFO, "[AUTH] -> Estado desconocido: %d", auth_state_id);
+    }
+}
+
+/**
+ * @brief Envía los parámetros de configuración de TDLib necesarios para iniciar sesión.
+ * 
+ * Incluye los valores como API ID, API hash, base de datos local, y otras opciones
+ * necesarias para inicializar correctamente la instancia de TDLib.
+ */
+void TelegramBot::send_tdlib_parameters() {
+    tgLog(RZ_LOG_INFO, "[PARAMS] Creando parámetros TDLib...");
+    
+    auto query = td::td_api::make_object<td::td_api::setTdlibParameters>();
+    
+
+    query->api_id_ = atoi(api_id_.c_str());
+    query->api_hash_ = api_hash_;
+    query->database_directory_ = database_directory();
+    query->files_directory_ = files_directory();
+    query->device_model_ = "Bot";
+    query->application_version_ = "1.0";
+    query->use_file_database_ = true;     // los archivos a medias sobreviven a un reinicio del cliente
+    query->use_message_database_ = false;
+    query->use_secret_chats_ = false;
+    query->system_language_code_ = "es";
+    
+    //query->enable_storage_optimizer_ = true;
+    
+    tgLog(RZ_LOG_INFO, "[PARAMS] Enviando setTdlibParameters con api_id=%d", 
+    query->api_id_);
+    
+    parameters_sent_ = true;
+    send_query(std::move(query), nullptr);
+}
+
+/**
+ * @brief Envía el token del bot a TDLib para completar la autenticación.
+ */
+void TelegramBot::send_bot_token() {
+    tgLog(RZ_LOG_INFO, "[TOKEN] Enviando token de autenticación...");
+    
+    auto auth = td::td_api::make_object<td::td_api::checkAuthenticationBotToken>();
+    auth->token_ = bot_token_;
+    
+    tgLog(RZ_LOG_INFO, "[TOKEN] Token: %s...", bot_token_.substr(0, 12).c_str());
+    
+    send_query(std::move(auth), nullptr);
+}
+
+/**
+ * @brief Maneja la respuesta de la descarga de archivo recibida desde TDLib.
+ * 
+ * @param file_id Identificador del archivo descargado.
+ * @param response Objeto de respuesta devuelto por TDLib que contiene el resultado de la operacion de descarga.
+ */
+void TelegramBot::handle_download_response(int32_t file_id, td::td_api::object_ptr<td::td_api::Object> response) {
+    if (response->get_id() == td::td_api::file::ID) {
+        auto file = td::move_tl_object_as<td::td_api::file>(response);
+        tgLog(RZ_LOG_INFO, "[DESCARGA] Archivo %d descargado en: %s", file_id, file->local_->path_.c_str());
+
+        // Ya estaba en la caché: puede que no llegue ningún updateFile que lo cierre
+        if (file->local_->is_downloading_completed_ && download_scheduler_.contains(file_id)) {
+            executor_->post(file_strand(file_id), [this, file = std::move(file)]() mutable {
+                handle_file_update(std::move(file));
+            });
+        }
+    } else if (response->get_id() == td::td_api::error::ID) {
+        auto err = td::move_tl_object_as<td::td_api::error>(response);
+        if (!download_scheduler_.contains(file_id)) {
+            // Cancelada por el reinicio del cliente: sigue en el diario y se reanudará
+            tgLog(RZ_LOG_INFO, "[DESCARGA] Archivo %d interrumpido: %s", file_id, err->message_.c_str());
+            return;
+        }
+        tgLog(RZ_LOG_ERROR, "[DESCARGA] Error al descargar archivo %d: %s", file_id, err->message_.c_str());
+
+        // Fuera de la tabla: un reenvío del mismo archivo empieza una descarga nueva
+        // en vez de esperar a esta
+        bool known = false;
+        bool segmented = false;
+        int64_t message_id = -1;
+        DownloadInfo failed;
+        {
+            std::lock_guard<std::mutex> lock(downloads_mutex_);
+            std::size_t slot = downloads_.find(file_id);
+            if (slot != DownloadTable::npos) {
+                known = true;
+                message_id = downloads_.hot(slot).message_id;
+                segmented = downloads_.hot(slot).segmented;
+                failed = std::move(downloads_.cold(slot));
+                downloads_.erase(slot);
+            }
+        }
+
+        // Con rangos, el resto de transferencias del archivo ya no sirve
+        if (segmented) {
+            auto cancel = td::td_api::make_object<td::td_api::cancelDownloadFile>();
+            cancel->file_id_ = file_id;
+            cancel->only_if_pending_ = false;
+            send_query(std::move(cancel), nullptr);
+        }
+
+        // La descarga fallida deja su hueco a la siguiente en cola
+        journal_.done(file_id);
+        hasher_->cancel(file_id);
+        finish_download_slot(file_id, false);
+
+        if (known) fail_download(file_id, failed, message_id, err->message_);
+    } else {
+        tgLog(RZ_LOG_WARN, "[DESCARGA] Respuesta inesperada (%d) al descargar archivo %d", response->get_id(), file_id);
+    }
+}
+
+
+/**
+ * @brief Avisa del fallo de una descarga a su chat y a los que esperaban el mismo archivo.
+ * 
+ * El mensaje de progreso, si lo hay, se edita con el error y deja de seguirse.
+ * @param file_id Identificador del archivo.
+ * @param info Estado de la descarga fallida (ya fuera de downloads_).
+ * @param message_id Mensaje de progreso (-1 si no llegó a tener ID real).
+ * @param reason Error devuelto por TDLib.
+ */
+void TelegramBot::fail_download(int32_t file_id, const DownloadInfo& info, int64_t message_id,
+                                const std::string& reason) {
+    std::string mensaje = "No se pudo descargar " + info.file.fileName + ": " + reason +
+                          "\nReenvíalo para intentarlo de nuevo.";
+
+    if (message_id != -1) {
+        send_edited_message(info.chat_id, message_id, info.original_text + "\n\n" + mensaje);
+        outbound_.forget(info.chat_id, message_id);
+    } else {
+        send_text_message(info.chat_id, mensaje, nullptr);
+    }
+    for (int64_t chat_id : info.waiters) {
+        send_text_message(chat_id, mensaje, nullptr);
+    }
+    tgLog(RZ_LOG_INFO, "[DESCARGA] Archivo %d: fallo avisado a %zu chats", file_id, info.waiters.size() + 1);
+}
+
+/**
+ * @brief Inicia la descarga de un archivo especificado.
+ * @param file_id Identificador del archivo a descargar.
+ */
+void TelegramBot::start_file_download(int32_t file_id) {
+    auto download = td::td_api::make_object<td::td_api::downloadFile>();
+    download->file_id_ = file_id;
+    download->priority_ = download_scheduler_.priority(file_id);  // 1-32 según bytes restantes
+    download->limit_ = 0;      // 0 = descargar todo el archivo
+    download->synchronous_ = false;  // Descarga asíncrona
+    
+    std::string text;
+    int64_t chat_id = 0;
+    int64_t message_id = -1;
+    bool has_message = false;
+    bool known = false;
+    std::vector<DownloadSegments::Segment> ranges;
+    {
+        std::lock_guard<std::mutex> lock(downloads_mutex_);
+        std::size_t slot = downloads_.find(file_id);
+        if (slot != DownloadTable::npos) {
+            known = true;
+            DownloadProgress& state = downloads_.hot(slot);
+            DownloadInfo& info = downloads_.cold(slot);
+            download->offset_ = info.offset; // 0 salvo al reanudar desde el diario
+
+            // Archivo grande: rangos en paralelo si el backend lo admite
+            info.segments.clear();
+            if (segment_count_ > 1 && info.file.fileSize - info.offset >= segment_threshold_ &&
+                transport_->supports_ranged_downloads()) {
+                info.segments.split(info.offset, info.file.fileSize, segment_count_);
+                ranges = info.segments.segments();
+            }
+            state.segmented = !ranges.empty();
+            text = (info.offset > 0 ? "Reanudando descarga de " : "Iniciando descarga de ") + info.file.fileName +
+                   "\n Extension: '" + info.file.extension + "'.";
+
+            //Actualizamos tiempo de comienzo de descarga
+            info.start_time = std::time(nullptr);
+            info.original_text = text;
+            chat_id = state.chat_id;
+            message_id = state.message_id;
+            has_message = info.queue_position != 0 || message_id != -1;
+        }
+    }
+
+    // Sin estado (se descartó con un reinicio) no hay nada que descargar: el hueco pasa al siguiente
+    if (!known) {
+        tgLog(RZ_LOG_WARN, "[DESCARGA] Archivo %d admitido sin estado de descarga", file_id);
+        finish_download_slot(file_id, false);
+        return;
+    }
+
+    tgLog(RZ_LOG_INFO, "Iniciando descarga de archivo %d desde el byte %lld", file_id, (long long)download->offset_);
+
+    if (ranges.empty()) {
+        send_query(std::move(download), [this, file_id](auto response) 
+        {
+            handle_download_response(file_id, std::move(response));
+        });
+    }
+
+    // Un downloadFile por rango, con el mismo handler
+    for (const DownloadSegments::Segment& range : ranges) {
+        auto segment = td::td_api::make_object<td::td_api::downloadFile>();
+        segment->file_id_ = file_id;
+        segment->priority_ = download->priority_;
+        segment->offset_ = range.offset;
+        segment->limit_ = range.limit;
+        segment->synchronous_ = false;
+        send_query(std::move(segment), [this, file_id](auto response) {
+            handle_download_response(file_id, std::move(response));
+        });
+    }
+    if (!ranges.empty()) {
+        tgLog(RZ_LOG_INFO, "[DESCARGA] Archivo %d en %zu rangos", file_id, ranges.size());
+    }
+
+    // Si estuvo en cola o se reanuda, su mensaje anterior pasa a ser el de progreso
+    if (has_message) {
+        if (message_id != -1) {
+            send_edited_message(chat_id, message_id, text);
+        }
+        return;
+    }
+
+    attach_progress_message(file_id, chat_id, std::move(text));
+}
+
+/**
+ * @brief Envía el mensaje de una descarga y lo deja como su mensaje de progreso.
+ * 
+ * Corrutina: se suspende hasta tener el ID real y sigue en el bucle principal.
+ */
+BotTask TelegramBot::attach_progress_message(int32_t file_id, int64_t chat_id, std::string text) {
+    int64_t message_id = co_await send_text(chat_id, std::move(text));
+    if (message_id == -1) co_return;
+
+    journal_.set_message(file_id, message_id);
+    std::lock_guard<std::mutex> lock(downloads_mutex_);
+    std::size_t slot = downloads_.find(file_id);
+    if (slot != DownloadTable::npos) {
+        downloads_.hot(slot).message_id = message_id;
+    }
+}
+
+/**
+ * @brief Libera el hueco de una descarga terminada o fallida y arranca las siguientes en cola.
+ * @param file_id Identificador del archivo.
+ * @param completed true si terminó: su reserva en la carpeta final sigue hasta el traslado.
+ */
+void TelegramBot::finish_download_slot(int32_t file_id, bool completed) {
+    // Terminada ya ocupa su sitio en la caché; fallida no necesita nada
+    if (completed) {
+        disk_.downloaded(file_id);
+    } else {
+        disk_.release(file_id);
+    }
+
+    std::vector<int32_t> started;
+    download_scheduler_.finish(file_id, std::chrono::steady_clock::now(), started);
+    for (int32_t next : started) {
+        start_file_download(next);
+    }
+    apply_download_priorities();
+    update_queue_messages();
+}
+
+/**
+ * @brief Reenvía a TDLib las descargas activas cuya prioridad ha cambiado.
+ * 
+ * Repetir downloadFile sobre una descarga en curso solo actualiza su prioridad.
+ */
+void TelegramBot::apply_download_priorities() {
+    std::vector<DownloadScheduler::Priority> changes;
+    download_scheduler_.take_priority_changes(changes);
+
+    std::vector<DownloadSegments::Segment> ranges;
+    for (const DownloadScheduler::Priority& change : changes) {
+        int64_t offset = 0;
+        ranges.clear();
+        {
+            std::lock_guard<std::mutex> lock(downloads_mutex_);
+            std::size_t slot = downloads_.find(change.file_id);
+            if (slot != DownloadTable::npos) {
+                const DownloadInfo& info = downloads_.cold(slot);
+                offset = info.offset;
+                for (const DownloadSegments::Segment& range : info.segments.segments()) {
+                    if (range.done < range.limit) ranges.push_back(range);
+                }
+            }
+        }
+        if (ranges.empty()) {
+            ranges.push_back(DownloadSegments::Segment{ offset, 0 }); // Una sola transferencia
+        }
+
+        // Por rangos, la prioridad se reenvía a cada rango pendiente
+        for (const DownloadSegments::Segment& range : ranges) {
+            auto download = td::td_api::make_object<td::td_api::downloadFile>();
+            download->file_id_ = change.file_id;
+            download->priority_ = change.priority;
+            download->offset_ = range.offset;
+            download->limit_ = range.limit;
+            download->synchronous_ = false;
+            send_query(std::move(download), nullptr);
+        }
+        tgLog(RZ_LOG_DEBUG, "[DESCARGA] Archivo %d: prioridad %d", change.file_id, change.priority);
+    }
+}
+
+/**
+ * @brief Muestra o actualiza el mensaje "en cola" con la posición de cada descarga en espera.
+ */
+void TelegramBot::update_queue_messages() {
+    std::vector<DownloadScheduler::Position> positions;
+    download_scheduler_.positions(positions);
+
+    for (const DownloadScheduler::Position& position : positions) {
+        std::string text;
+        int64_t message_id;
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(downloads_mutex_);
+            std::size_t slot = downloads_.find(position.file_id);
+            if (slot == DownloadTable::npos) continue;
+            DownloadInfo& info = downloads_.cold(slot);
+            if (info.queue_position == position.position) continue;
+
+            message_id = downloads_.hot(slot).message_id;
+            first = info.queue_position == 0 && message_id == -1;
+            info.queue_position = position.position;
+            text = info.file.fileName + " en cola (posición " + std::to_string(position.position) + ")";
+        }
+
+        if (first) {
+            attach_progress_message(position.file_id, position.chat_id, std::move(text));
+        } else if (message_id != -1) {
+            send_edited_message(position.chat_id, message_id, text);
+        }
+    }
+}
+
+/**
+ * @brief Reanuda las descargas que no están asociadas a esta sesión.
+ * 
+ * Primero las del cliente anterior (detached_), con su estado en memoria; después
+ * las del diario que no estén entre ellas. Los file_id no tienen por qué
+ * sobrevivir a un reinicio de TDLib: cada descarga desligada se recupera por su
+ * remote_id con getRemoteFile antes de reanudarla.
+ */
+void TelegramBot::resume_downloads() {
+    std::vector<DetachedDownload> downloads;
+    {
+        std::lock_guard<std::mutex> lock(detached_mutex_);
+        downloads.swap(detached_);
+    }
+
+    std::unordered_set<std::string> attached;
+    for (const DetachedDownload& download : downloads) {
+        if (!download.entry.unique_id.empty()) attached.insert(download.entry.unique_id);
+    }
+
+    std::vector<DownloadJournal::Entry> entries;
+    journal_.detached(entries);
+    for (DownloadJournal::Entry& entry : entries) {
+        if (attached.count(entry.unique_id)) continue;
+        if (entry.remote_id.empty()) {
+            journal_.discard(entry.unique_id);
+            continue;
+        }
+        downloads.push_back(DetachedDownload{ std::move(entry), {} });
+    }
+
+    for (DetachedDownload& download : downloads) {
+        const DownloadJournal::Entry& entry = download.entry;
+        tgLog(RZ_LOG_INFO, "[JOURNAL] Recuperando %s (archivo %d, %lld/%lld bytes)", entry.file_name.c_str(),
+            entry.file_id, (long long)entry.offset, (long long)entry.size);
+
+        auto query = td::td_api::make_object<td::td_api::getRemoteFile>();
+        query->remote_file_id_ = entry.remote_id;
+        query->file_type_ = td::td_api::make_object<td::td_api::fileTypeVideo>();
+        send_query(std::move(query), [this, download = std::move(download)](auto response) mutable {
+            resume_download(std::move(download.entry), std::move(download.waiters), std::move(response));
+        });
+    }
+}
+
+/**
+ * @brief Vuelve a registrar una descarga desligada con el file_id de esta sesión y la encola.
+ * @param entry Estado guardado en el diario o en memoria.
+ * @param waiters Otros chats que esperaban la misma descarga.
+ * @param response Respuesta de getRemoteFile.
+ */
+void TelegramBot::resume_download(DownloadJournal::Entry entry, std::vector<int64_t> waiters,
+                                  td::td_api::object_ptr<td::td_api::Object> response) {
+    if (response->get_id() != td::td_api::file::ID) {
+        if (response->get_id() == td::td_api::error::ID) {
+            auto err = td::move_tl_object_as<td::td_api::error>(response);
+            if (err->code_ == 500) {
+                // Reinicio del cliente: se reintentará al autorizarse
+                std::lock_guard<std::mutex> lock(detached_mutex_);
+                detached_.push_back(DetachedDownload{ std::move(entry), std::move(waiters) });
+                return;
+            }
+            tgLog(RZ_LOG_ERROR, "[JOURNAL] No se pudo recuperar %s: %s", entry.file_name.c_str(), err->message_.c_str());
+        }
+        journal_.discard(entry.unique_id);
+        for (int64_t chat_id : waiters) {
+            send_text_message(chat_id, "No se pudo reanudar la descarga de " + entry.file_name, nullptr);
+        }
+        send_text_message(entry.chat_id, "No se pudo reanudar la descarga de " + entry.file_name, nullptr);
+        return;
+    }
+
+    // Se asocia al file_id de esta sesión
+    auto file = td::move_tl_object_as<td::td_api::file>(response);
+    entry.file_id = file->id_;
+    journal_.start(entry);
+    int32_t file_id = entry.file_id;
+
+    FileType type;
+    type.fileName = entry.file_name;
+    type.extension = entry.extension;
+    type.mimeType = entry.mime_type;
+    type.fileSize = entry.size;
+
+    DownloadInfo info{ entry.chat_id, "", std::time(nullptr), std::time(nullptr), type };
+    info.offset = entry.offset;
+    info.unique_id = entry.unique_id;
+    info.remote_id = entry.remote_id;
+    info.waiters = std::move(waiters);
+
+    // Terminó justo antes del corte: solo falta trasladarlo
+    if (file->local_ && file->local_->is_downloading_completed_) {
+        tgLog(RZ_LOG_INFO, "[JOURNAL] Archivo %d ya estaba completo en: %s", file_id, file->local_->path_.c_str());
+        journal_.done(file_id);
+        finish_file(file_id, std::move(info), file->local_->path_, file->size_);
+        return;
+    }
+
+    {
+        DownloadProgress state;
+        state.chat_id = entry.chat_id;
+        state.message_id = entry.message_id;
+        state.metered = entry.offset;
+
+        std::lock_guard<std::mutex> lock(downloads_mutex_);
+        downloads_.insert(file_id, state, std::move(info));
+    }
+
+    // Ya estaba aceptada: se reserva lo que falta aunque ahora no quepa
+    disk_.reserve(file_id, entry.size, entry.offset, true);
+
+    std::vector<int32_t> started;
+    download_scheduler_.enqueue(file_id, entry.chat_id, entry.size - entry.offset, std::chrono::steady_clock::now(), started);
+    for (int32_t next : started) {
+        start_file_download(next);
     }
-    else if (auth_state_id == td::td_api::authorizationStateClosed::ID) {
-        rzLog(RZ_LOG_INFO, "[AUTH] -> Conexión cerrada, programando reinicio");
-        are_authorized_ = false;
-        need_restart_ = true;
+    update_queue_messages();
+}
+
+/**
+ * @brief Desliga las descargas en curso del cliente que se reinicia.
+ * 
+ * Los file_id del cliente anterior dejan de valer. Lo que hace falta para
+ * seguir (remote_id, mensaje de progreso, bytes contiguos ya escritos, chats
+ * que esperan) se guarda en detached_ y resume_downloads() lo vuelve a
+ * asociar al cliente nuevo en cuanto se autoriza; TDLib conserva lo descargado
+ * en la misma caché. El diario queda intacto por si el proceso muere antes.
+ */
+void TelegramBot::detach_downloads() {
+    executor_->wait_idle();
+
+    std::size_t detached = 0;
+    std::vector<DownloadJournal::Entry> lost;
+    {
+        std::lock_guard<std::mutex> lock(downloads_mutex_);
+        std::lock_guard<std::mutex> detached_lock(detached_mutex_);
+        for (std::size_t slot = 0; slot < downloads_.size(); ++slot) {
+            const DownloadProgress& state = downloads_.hot(slot);
+            DownloadInfo& info = downloads_.cold(slot);
+
+            DownloadJournal::Entry entry;
+            entry.file_id = downloads_.key(slot);
+            entry.remote_id = info.remote_id;
+            entry.unique_id = info.unique_id;
+            entry.chat_id = info.chat_id;
+            entry.message_id = state.message_id;
+            entry.offset = state.segmented ? info.segments.contiguous() : std::max(info.offset, state.metered);
+            entry.size = info.file.fileSize;
+            entry.file_name = info.file.fileName;
+            entry.extension = info.file.extension;
+            entry.mime_type = info.file.mimeType;
+            if (entry.remote_id.empty()) {
+                lost.push_back(std::move(entry));
+                continue;
+            }
+            detached_.push_back(DetachedDownload{ std::move(entry), std::move(info.waiters) });
+            ++detached;
+        }
+        downloads_.clear();
     }
-    else if (auth_state_id == td::td_api::authorizationStateLoggingOut::ID) {
-        rzLog(RZ_LOG_INFO, "[AUTH] -> Cerrando sesión...");
-        are_authorized_ = false;
+
+    download_scheduler_.clear();
+    disk_.clear();
+    journal_.detach_all();
+    hasher_->clear();
+
+    if (detached > 0) {
+        tgLog(RZ_LOG_INFO, "[DESCARGA] %zu descargas en espera de reasociarse al cliente nuevo", detached);
     }
-    else {
-        rzLog(RZ_LOG_INFO, "[AUTH] -> Estado desconocido: %d", auth_state_id);
+    for (const DownloadJournal::Entry& entry : lost) {
+        tgLog(RZ_LOG_WARN, "[DESCARGA] Archivo %d sin remote_id: no se puede reanudar", entry.file_id);
+        journal_.discard(entry.unique_id);
+        send_text_message(entry.chat_id, "Se interrumpió la descarga de " + entry.file_name, nullptr);
     }
 }
 
 /**
- * @brief Envía los parámetros de configuración de TDLib necesarios para iniciar sesión.
+ * @brief Crea el cliente nuevo tras un corte.
  * 
- * Incluye los valores como API ID, API hash, base de datos local, y otras opciones
- * necesarias para inicializar correctamente la instancia de TDLib.
+ * En caliente se reutiliza el transporte (el ClientManager aloja el cliente
+ * nuevo) y la misma bot_db: TDLib ya tiene la sesión y pasa directo a Ready.
+ * Solo si el cliente anterior no llegó a cerrarse se descarta el transporte.
  */
-void TelegramBot::send_tdlib_parameters() {
-    rzLog(RZ_LOG_INFO, "[PARAMS] Creando parámetros TDLib...");
-    
-    auto query = td::td_api::make_object<td::td_api::setTdlibParameters>();
-    
-
-    query->api_id_ = atoi(api_id_.c_str());
-    query->api_hash_ = api_hash_;
-    query->database_directory_ = "bot_db";
-    query->files_directory_="downloads";
-    query->device_model_ = "Bot";
-    query->application_version_ = "1.0";
-    query->use_message_database_ = false;
-    query->use_secret_chats_ = false;
-    query->system_language_code_ = "es";
-    
-    //query->enable_storage_optimizer_ = true;
-    
-    rzLog(RZ_LOG_INFO, "[PARAMS] Enviando setTdlibParameters con api_id=%d", 
-    query->api_id_);
-    
-    send_query(std::move(query), nullptr);
+void TelegramBot::restart_client() {
+    std::int32_t previous = client_id_.load(std::memory_order_relaxed);
+    if (cold_restart_) {
+        transport_->reset();
+        cold_restart_ = false;
+    }
+    client_id_.store(transport_->create_client_id(), std::memory_order_release);
+    parameters_sent_ = false;
+    restart_scheduled_ = false;
+    are_authorized_ = false;
+    need_restart_ = false;
+    tgLog(RZ_LOG_INFO, "[LOOP] Cliente reiniciado con ID: %d (anterior: %d)", client_id_.load(std::memory_order_relaxed), previous);
 }
 
 /**
- * @brief Envía el token del bot a TDLib para completar la autenticación.
+ * @brief Espera antes del intento attempt (1 = el primero tras el corte).
+ * 
+ * Backoff exponencial con jitter: un valor al azar entre la mitad y el total
+ * de RECONNECT_BASE * 2^(attempt - 2), con tope RECONNECT_MAX.
  */
-void TelegramBot::send_bot_token() {
-    rzLog(RZ_LOG_INFO, "[TOKEN] Enviando token de autenticación...");
-    
-    auto auth = td::td_api::make_object<td::td_api::checkAuthenticationBotToken>();
-    auth->token_ = bot_token_;
-    
-    rzLog(RZ_LOG_INFO, "[TOKEN] Token: %s...", bot_token_.substr(0, 12).c_str());
-    
-    send_query(std::move(auth), nullptr);
+std::chrono::milliseconds TelegramBot::reconnect_delay(unsigned attempt) {
+    if (attempt <= 1) return std::chrono::milliseconds(0);
+    std::int64_t delay = RECONNECT_BASE.count() << std::min(attempt - 2, 16u);
+    delay = std::min<std::int64_t>(delay, RECONNECT_MAX.count());
+    std::uniform_int_distribution<std::int64_t> jitter(delay / 2, delay);
+    return std::chrono::milliseconds(jitter(jitter_));
+}
+
+TelegramBot::ReconnectStats TelegramBot::reconnect_stats() const {
+    ReconnectStats stats;
+    stats.reconnects = reconnects_.load(std::memory_order_relaxed);
+    stats.ready_ns_total = reconnect_ready_ns_total_.load(std::memory_order_relaxed);
+    stats.ready_ns_last = reconnect_ready_ns_last_.load(std::memory_order_relaxed);
+    return stats;
 }
 
 /**
- * @brief Maneja la respuesta de la descarga de archivo recibida desde TDLib.
+ * @brief Filtro de entrada de updateNewMessage: lista de autorizados y límite por usuario.
  * 
- * @param file_id Identificador del archivo descargado.
- * @param response Objeto de respuesta devuelto por TDLib que contiene el resultado de la operacion de descarga.
+ * Solo mira el remitente y el tipo de contenido; no copia nada del mensaje.
+ * @param update Update recibido.
+ * @return true si el mensaje se atiende.
  */
-void TelegramBot::handle_download_response(int32_t file_id, td::td_api::object_ptr<td::td_api::Object> response) {
-    if (response->get_id() == td::td_api::file::ID) {
-        auto file = td::move_tl_object_as<td::td_api::file>(response);
-        rzLog(RZ_LOG_INFO, "[DESCARGA] Archivo %d descargado en: %s", file_id, file->local_->path_.c_str());
-    } else if (response->get_id() == td::td_api::error::ID) {
-        auto err = td::move_tl_object_as<td::td_api::error>(response);
-        rzLog(RZ_LOG_ERROR, "[DESCARGA] Error al descargar archivo %d: %s", file_id, err->message_.c_str());
-    } else {
-        rzLog(RZ_LOG_WARN, "[DESCARGA] Respuesta inesperada (%d) al descargar archivo %d", response->get_id(), file_id);
+bool TelegramBot::admit_message(const td::td_api::updateNewMessage& update) {
+    const td::td_api::message* message = update.message_.get();
+    // Los nulos siguen su camino (se registran allí) y los propios no son tráfico de usuarios
+    if (!message || message->is_outgoing_) return true;
+
+    int64_t user_id = 0;
+    if (message->sender_id_ && message->sender_id_->get_id() == td::td_api::messageSenderUser::ID) {
+        user_id = static_cast<const td::td_api::messageSenderUser&>(*message->sender_id_).user_id_;
+    }
+    // Backlog: antes que el límite, para no gastar los tokens del usuario en mensajes viejos
+    if (message->date_ < backlog_cutoff_) {
+        skip_backlog_message(*message, user_id);
+        return false;
     }
+
+    int content_type = message->content_ ? message->content_->get_id() : 0;
+    bool download = content_type == td::td_api::messageVideo::ID || content_type == td::td_api::messageDocument::ID;
+
+    AccessControl::Verdict verdict = access_.admit(user_id, message->chat_id_, download, std::chrono::steady_clock::now());
+    if (verdict == AccessControl::Admitted) return true;
+
+    tgLog(RZ_LOG_DEBUG, "[ACCESO] Mensaje %lld de %lld en chat %lld descartado: %s", (long long)message->id_,
+        (long long)user_id, (long long)message->chat_id_, AccessControl::verdict_name(verdict));
+    return false;
 }
 
+/**
+ * @brief Descarta un mensaje anterior al arranque y lo apunta para el aviso de su chat.
+ * @param message Mensaje descartado.
+ * @param user_id Remitente (0 si no es un usuario).
+ */
+void TelegramBot::skip_backlog_message(const td::td_api::message& message, int64_t user_id) {
+    backlog_skipped_.fetch_add(1, std::memory_order_relaxed);
+    ++backlog_pending_;
+    backlog_last_ = std::chrono::steady_clock::now();
+
+    // Solo se avisa a quien podría haber recibido respuesta
+    if (backlog_summary_ && access_.allowed(user_id)) {
+        ++backlog_chats_[message.chat_id_];
+    }
+    tgLog(RZ_LOG_DEBUG_EXTRA, "[BACKLOG] Mensaje %lld del chat %lld (fecha %d) descartado",
+        (long long)message.id_, (long long)message.chat_id_, message.date_);
+}
 
 /**
- * @brief Inicia la descarga de un archivo especificado.
- * @param file_id Identificador del archivo a descargar.
+ * @brief Cierra una tanda de backlog cuando lleva BACKLOG_QUIET sin llegar nada viejo.
+ * 
+ * Registra cuántos mensajes se descartaron y, si está activado, envía un único
+ * aviso a cada chat afectado (por el control de flood, como cualquier envío).
+ * @param now Instante actual.
  */
-void TelegramBot::start_file_download(int32_t file_id) {
-    auto download = td::td_api::make_object<td::td_api::downloadFile>();
-    download->file_id_ = file_id;
-    download->priority_ = 32;  // Prioridad alta (1-32, 32 = máxima)
-    download->offset_ = 0;     // Desde el inicio
-    download->limit_ = 0;      // 0 = descargar todo el archivo
-    download->synchronous_ = false;  // Descarga asíncrona
-    
-    rzLog(RZ_LOG_INFO, "Iniciando descarga de archivo %d", file_id);
-    
-    std::string text = "Iniciando descarga de " + downloads_[file_id].file.fileName + "\n Extension: '" + downloads_[file_id].file.extension + "'.";
+void TelegramBot::flush_backlog(std::chrono::steady_clock::time_point now) {
+    if (backlog_pending_ == 0 || now - backlog_last_ < BACKLOG_QUIET) return;
 
-    //Actualizamos tiempo de comienzo de descarga
-    downloads_[file_id].start_time = std::time(nullptr);
-    downloads_[file_id].original_text = text;
+    tgLog(RZ_LOG_INFO, "[BACKLOG] %llu mensajes anteriores al arranque descartados, aviso a %zu chats",
+        (unsigned long long)backlog_pending_, backlog_chats_.size());
+    backlog_pending_ = 0;
 
-    send_text_message(downloads_[file_id].chat_id, text,
-    [this, file_id](int64_t msg_id)
-    {
-        if(msg_id != -1)
-            downloads_[file_id].message_id = msg_id;
-    });
-    send_query(std::move(download), [this, file_id](auto response) 
-    {
-        handle_download_response(file_id, std::move(response));
-    });
+    for (const auto& chat : backlog_chats_) {
+        std::string text = "Mientras estaba desconectado me enviaste " + std::to_string(chat.second) +
+            (chat.second == 1 ? " mensaje" : " mensajes") + " que no he procesado. Si aún lo necesitas, vuelve a enviarlo.";
+        send_text_message(chat.first, text, nullptr);
+    }
+    backlog_chats_.clear();
 }
 
 /*Handler del mensaje que llega para su procesamiento*/
@@ -512,41 +1926,45 @@ void TelegramBot::start_file_download(int32_t file_id) {
  * @param message Objeto del mensaje recibido desde TDLib.
  */
 void TelegramBot::handle_new_updateNewMessage(td::td_api::object_ptr<td::td_api::message> message) {
-    //TODO AUTENTICADOR Y FILTRAR POR TIPO DE ARCHIVO
     if (!message) {
-       rzLog(RZ_LOG_INFO, "[MSG] Mensaje null recibido");
+       tgLog(RZ_LOG_INFO, "[MSG] Mensaje null recibido");
         return;
     }
     
     if (!message->content_) {
-        rzLog(RZ_LOG_INFO, "[MSG] Contenido del mensaje null");
+        tgLog(RZ_LOG_INFO, "[MSG] Contenido del mensaje null");
         return;
     }
 
     int64_t chat_id = message->chat_id_;
     int64_t message_id = message->id_;
-    std::string text = extract_updateNewMessage_data(chat_id, message->content_.get());
+    // Vista sobre el texto del mensaje: vale mientras vive message
+    std::string_view text = extract_updateNewMessage_data(chat_id, message->content_.get());
     
-    rzLog(RZ_LOG_INFO, "[MSG] ¡MENSAJE RECIBIDO!");
-    rzLog(RZ_LOG_INFO, "[MSG]   Chat ID: %lld", (long long)chat_id);
-    rzLog(RZ_LOG_INFO, "[MSG]   Message ID: %lld", (long long)message_id);
-    rzLog(RZ_LOG_INFO, "[MSG]   Texto: '%s'", text.c_str());
+    tgLog(RZ_LOG_DEBUG, "[MSG] ¡MENSAJE RECIBIDO!");
+    tgLog(RZ_LOG_DEBUG, "[MSG]   Chat ID: %lld", (long long)chat_id);
+    tgLog(RZ_LOG_DEBUG, "[MSG]   Message ID: %lld", (long long)message_id);
+    tgLog(RZ_LOG_DEBUG, "[MSG]   Texto: '%.*s'", (int)text.size(), text.data());
 
     if (!text.empty()) {
-        //rzLog(RZ_LOG_INFO, "[MSG] Enviando acción de escribir...");
+        //tgLog(RZ_LOG_INFO, "[MSG] Enviando acción de escribir...");
         //send_typing_action(chat_id);
         
-        std::string response = generate_response(text);
-        rzLog(RZ_LOG_INFO, "[MSG] Respuesta generada: '%s'", response.c_str());
+        std::string response = generate_response(chat_id, text);
+        if (response.empty()) {
+            tgLog(RZ_LOG_DEBUG, "[MSG] Comando para otro bot, sin respuesta");
+            return;
+        }
+        tgLog(RZ_LOG_DEBUG, "[MSG] Respuesta generada: '%s'", response.c_str());
         
         send_text_message(chat_id, response, 
         [](int64_t msg_id)
         {
             if(msg_id != -1)
-                  rzLog(RZ_LOG_INFO, "MSG ID: %d", msg_id);
+                  tgLog(RZ_LOG_DEBUG, "MSG ID: %d", msg_id);
         });
     } else {
-        rzLog(RZ_LOG_INFO, "[MSG] Mensaje sin texto, ignorando");
+        tgLog(RZ_LOG_INFO, "[MSG] Mensaje sin texto, ignorando");
     }
 }
 
@@ -556,7 +1974,7 @@ void TelegramBot::handle_new_updateNewMessage(td::td_api::object_ptr<td::td_api:
  * @param chat_id ID del chat donde se recibió el video.
  * @param video Puntero al objeto messageVideo recibido.
  */
-void TelegramBot::handle_video(int32_t chat_id, td::td_api::messageVideo* video)
+void TelegramBot::handle_video(int64_t chat_id, td::td_api::messageVideo* video)
 {
     FileType file;
     std::string name = video->video_->file_name_;
@@ -565,39 +1983,141 @@ void TelegramBot::handle_video(int32_t chat_id, td::td_api::messageVideo* video)
     std::string extension = std::filesystem::path(name).extension().string();
     
     int32_t file_id = video->video_->video_->id_;
-    int32_t size_bytes = video->video_->video_->size_;
+    int64_t size_bytes = video->video_->video_->size_;
 
-    rzLog(RZ_LOG_INFO,"Video: Nombre: '%s', Caption: '%s', Extension: '%s', Type: '%s'", 
+    tgLog(RZ_LOG_DEBUG,"Video: Nombre: '%s', Caption: '%s', Extension: '%s', Type: '%s'", 
                             name.c_str(), 
                             caption.c_str(), 
                             extension.c_str(),
                             mime_type.c_str());
     
+    // El caption, si lo hay, da el nombre final del archivo en download_path_
     if (!caption.empty())
     {
-        video->video_->file_name_ = caption;
+        name = caption;
+        if (std::filesystem::path(caption).extension().string() != extension)
+            name += extension;
     }
 
-    rzLog(RZ_LOG_INFO, "Procesando video");
-    rzLog(RZ_LOG_INFO, "Video detectado - File ID: %d, Tamaño: %d bytes (%.2f MB)", 
-          file_id, size_bytes, size_bytes / (1024.0 * 1024.0));
+    tgLog(RZ_LOG_DEBUG, "Procesando video");
+    tgLog(RZ_LOG_INFO, "Video detectado - File ID: %d, Tamaño: %lld bytes (%.2f MB)", 
+          file_id, (long long)size_bytes, size_bytes / (1024.0 * 1024.0));
 
     file.fileName = name;
     file.extension = extension;
     file.fileSize = size_bytes;
     file.mimeType = mime_type;
 
-    downloads_[file_id] = DownloadInfo{
-        chat_id,
-        -1, //No inicializado,
-        "",
-        std::time(nullptr), //De momento NULL
-        std::time(nullptr), //De momento NULL
-        file
-    };
+    std::string unique_id = video->video_->video_->remote_ ? video->video_->video_->remote_->unique_id_ : "";
+
+    // Reenvío de un archivo ya descargado: se contesta con la ruta existente
+    DedupIndex::Item existing;
+    if (dedup_->find(unique_id, existing)) {
+        tgLog(RZ_LOG_INFO, "[DEDUP] Archivo %d ya descargado en '%s'", file_id, existing.path.c_str());
+        send_text_message(chat_id, "Archivo ya descargado!\nGuardado en: " + existing.path +
+            (existing.checksum.empty() ? "" : "\nXXH64: " + existing.checksum), nullptr);
+        return;
+    }
+
+    std::string remote_id = video->video_->video_->remote_ ? video->video_->video_->remote_->id_ : "";
+
+    // Con varias sesiones de la misma cuenta, la descarga puede ir a otra menos cargada
+    if (download_router_ && !remote_id.empty()) {
+        DownloadJournal::Entry entry;
+        entry.file_id = file_id;
+        entry.remote_id = remote_id;
+        entry.unique_id = unique_id;
+        entry.chat_id = chat_id;
+        entry.size = size_bytes;
+        entry.file_name = name;
+        entry.extension = extension;
+        entry.mime_type = mime_type;
+        if (download_router_(entry)) return;
+    }
+
+    accept_download(chat_id, file_id, file, unique_id, remote_id);
+}
+
+/**
+ * @brief Registra una descarga nueva y la encola, o une el chat a la que ya está en curso.
+ * 
+ * @param chat_id Chat que pidió el archivo.
+ * @param file_id Identificador del archivo en esta sesión.
+ * @param file Nombre, extensión, tipo y tamaño.
+ * @param unique_id remoteFile.unique_id (clave del índice de duplicados).
+ * @param remote_id remoteFile.id (permite recuperarlo en otra sesión).
+ */
+void TelegramBot::accept_download(int64_t chat_id, int32_t file_id, const FileType& file,
+                                  const std::string& unique_id, const std::string& remote_id) {
+    // TDLib da el mismo file_id a todos los reenvíos de un archivo: si ya se está
+    // descargando, este chat espera al final de esa descarga
+    bool shared = false;
+    bool rejected = false;
+    {
+        std::lock_guard<std::mutex> lock(downloads_mutex_);
+        std::size_t slot = downloads_.find(file_id);
+        if (slot != DownloadTable::npos) {
+            DownloadInfo& info = downloads_.cold(slot);
+            std::vector<int64_t>& waiters = info.waiters;
+            if (info.chat_id != chat_id && std::find(waiters.begin(), waiters.end(), chat_id) == waiters.end()) {
+                waiters.push_back(chat_id);
+            }
+            shared = true;
+        } else if (!disk_.reserve(file_id, file.fileSize)) {
+            // Sin sitio para el archivo entero no se acepta: lo reservado por las
+            // demás descargas aceptadas cuenta como ocupado
+            rejected = true;
+        } else {
+            DownloadProgress state;
+            state.chat_id = chat_id;   // message_id = -1: no inicializado
+            DownloadInfo info{
+                chat_id,
+                "",
+                std::time(nullptr), //De momento NULL
+                std::time(nullptr), //De momento NULL
+                file
+            };
+            info.unique_id = unique_id;
+            info.remote_id = remote_id;
+            downloads_.insert(file_id, state, std::move(info));
+        }
+    }
 
-    // Iniciar descarga del archivo
-    start_file_download(file_id);
+    if (shared) {
+        ++shared_downloads_;
+        tgLog(RZ_LOG_INFO, "[DEDUP] Archivo %d ya en descarga: chat %lld esperará a que termine", file_id, (long long)chat_id);
+        send_text_message(chat_id, "Este archivo ya se está descargando. Te aviso cuando termine.", nullptr);
+        return;
+    }
+
+    if (rejected) {
+        std::int64_t available = disk_.available();
+        tgLog(RZ_LOG_WARN, "[DISCO] Archivo %d rechazado: %lld bytes, %lld disponibles", file_id,
+            (long long)file.fileSize, (long long)available);
+        send_text_message(chat_id, "No hay espacio en disco para " + file.fileName + " (" +
+            std::to_string(file.fileSize >> 20) + " MB, disponibles " +
+            std::to_string(available > 0 ? available >> 20 : 0) + " MB).", nullptr);
+        return;
+    }
+
+    DownloadJournal::Entry entry;
+    entry.file_id = file_id;
+    entry.remote_id = remote_id;
+    entry.unique_id = unique_id;
+    entry.chat_id = chat_id;
+    entry.size = file.fileSize;
+    entry.file_name = file.fileName;
+    entry.extension = file.extension;
+    entry.mime_type = file.mimeType;
+    journal_.start(entry);
+
+    // Admisión: empieza ya si hay hueco; si no, espera su turno en cola
+    std::vector<int32_t> started;
+    download_scheduler_.enqueue(file_id, chat_id, file.fileSize, std::chrono::steady_clock::now(), started);
+    for (int32_t next : started) {
+        start_file_download(next);
+    }
+    update_queue_messages();
 }
 
 /**
@@ -608,17 +2128,17 @@ void TelegramBot::handle_video(int32_t chat_id, td::td_api::messageVideo* video)
  * 
  * @return Cadena con el texto o información extraída del mensaje.
  */
-std::string TelegramBot::extract_updateNewMessage_data(int64_t chat_id, td::td_api::MessageContent* content) {
+std::string_view TelegramBot::extract_updateNewMessage_data(int64_t chat_id, td::td_api::MessageContent* content) {
     
-    std::string null_str = "";
+    std::string_view null_str;
 
     if (!content) {
-        rzLog(RZ_LOG_INFO, "[EXTRACT] Contenido null");
-        return "";
+        tgLog(RZ_LOG_INFO, "[EXTRACT] Contenido null");
+        return null_str;
     }
     
     int content_type = content->get_id();
-    rzLog(RZ_LOG_INFO,"[EXTRACT] Tipo de contenido: %d", content_type);
+    tgLog(RZ_LOG_DEBUG,"[EXTRACT] Tipo de contenido: %d", content_type);
     
 
     switch (content_type)
@@ -628,8 +2148,8 @@ std::string TelegramBot::extract_updateNewMessage_data(int64_t chat_id, td::td_a
             td::td_api::messageText* text_message = static_cast<td::td_api::messageText*>(content);
             if (text_message->text_)
             {
-                std::string result = text_message->text_->text_;
-                rzLog(RZ_LOG_INFO,"[EXTRACT] Texto extraído: '%s'", result.c_str());
+                const std::string& result = text_message->text_->text_;
+                tgLog(RZ_LOG_DEBUG,"[EXTRACT] Texto extraído: '%s'", result.c_str());
                 return result;
             }
             break;
@@ -642,37 +2162,51 @@ std::string TelegramBot::extract_updateNewMessage_data(int64_t chat_id, td::td_a
             break;
         }
     default:
-        rzLog(RZ_LOG_INFO,"[EXTRACT] No se pudo extraer DEFAULT");
+        tgLog(RZ_LOG_INFO,"[EXTRACT] No se pudo extraer DEFAULT");
         break;
     }
     
-    return "";
+    return null_str;
+}
+
+/**
+ * @brief Registra los comandos del bot en el router.
+ */
+void TelegramBot::register_commands() {
+    commands_.add("start", "Saludo", [](const CommandRouter::Invocation&) {
+        return std::string("Bienvenido DR.");
+    });
+    commands_.add("help", "Esta ayuda", [this](const CommandRouter::Invocation&) {
+        return commands_.help();
+    });
+    commands_.add("debug", "Info de debug", [this](const CommandRouter::Invocation&) {
+        return "Bot funcionando correctamente. Estado autorizado: " +
+               std::string(are_authorized_ ? "SÍ" : "NO");
+    }, 0, 0);
 }
 
 /**
  * @brief Genera una respuesta automática en función del texto recibido.
  * 
+ * Los comandos van al router; el resto es texto libre.
+ * @param chat_id Chat del que llega el texto.
  * @param text Texto recibido o procesado.
- * 
- * @return Cadena con la respuesta generada.
+ *
+ * @return std::string Respuesta a enviar; vacía si no hay que contestar.
  */
-std::string TelegramBot::generate_response(const std::string& text) {
-    if (strcmp(text.c_str(), "/start") == 0) {
-        return "Bienvenido DR.";
-    }
-    else if (strcmp(text.c_str(), "/help") == 0) {
-        return "Comandos disponibles:\n/start - Saludo \n/help - Esta ayuda \n/debug- Info de debug";
+std::string TelegramBot::generate_response(int64_t chat_id, std::string_view text) {
+    std::string response;
+    if (commands_.dispatch(chat_id, text, response)) {
+        return response;
     }
-    else if (strcmp(text.c_str(), "/debug") == 0) {
-        return "Bot funcionando correctamente. Estado autorizado: " + 
-               std::string(are_authorized_ ? "SÍ" : "NO");
-    }
-    else if (strstr(text.c_str(), "hola") != NULL || strstr(text.c_str(), "Hola") != NULL) {
+
+    if (text.find("hola") != std::string_view::npos || text.find("Hola") != std::string_view::npos) {
         return "¡Hola! ¿Cómo estás?";
     }
-    else {
-        return "Has dicho: " + text;
-    }
+
+    response.reserve(11 + text.size());
+    response.append("Has dicho: ").append(text);
+    return response;
 }
 
 /**
@@ -684,7 +2218,29 @@ std::string TelegramBot::generate_response(const std::string& text) {
  */
 void TelegramBot::send_edited_message(int64_t chat_id, int64_t message_id, const std::string& text)
 {
-    rzLog(RZ_LOG_INFO, "[SEND] Editando mensaje %lld en chat %lld: '%s'", 
+    OutboundScheduler::Message message;
+    message.kind = OutboundScheduler::Message::Edit;
+    message.chat_id = chat_id;
+    message.message_id = message_id;
+    message.text = text;
+
+    // Las ediciones pendientes del mismo mensaje se fusionan y las repetidas se descartan
+    if (outbound_.submit(message, std::chrono::steady_clock::now())) {
+        dispatch_edited_message(std::move(message));
+    }
+}
+
+/**
+ * @brief Envía a TDLib una edición liberada por el planificador de salida.
+ * @param message Edición a realizar.
+ */
+void TelegramBot::dispatch_edited_message(OutboundScheduler::Message message)
+{
+    int64_t chat_id = message.chat_id;
+    int64_t message_id = message.message_id;
+    const std::string& text = message.text;
+
+    tgLog(RZ_LOG_DEBUG, "[SEND] Editando mensaje %lld en chat %lld: '%s'", 
         (long long)message_id, (long long)chat_id, text.c_str());
     
     auto edit_message = td::td_api::make_object<td::td_api::editMessageText>();
@@ -696,18 +2252,27 @@ void TelegramBot::send_edited_message(int64_t chat_id, int64_t message_id, const
     formatted_text->text_ = text;
 
     // Log del texto que se va a establecer
-    rzLog(RZ_LOG_DEBUG, "[SEND] Editando mensaje %lld con texto: '%s'", (long long)message_id, text.c_str());
+    tgLog(RZ_LOG_DEBUG, "[SEND] Editando mensaje %lld con texto: '%s'", (long long)message_id, text.c_str());
 
     content->text_ = std::move(formatted_text);
     edit_message->input_message_content_ = std::move(content);
 
-    send_query(std::move(edit_message), [this, chat_id, message_id](td::td_api::object_ptr<td::td_api::Object> object) {
+    metrics_.edits.add();
+    send_query(std::move(edit_message), [this, chat_id, message_id, message = std::move(message)](td::td_api::object_ptr<td::td_api::Object> object) mutable {
         if (object && object->get_id() == td::td_api::error::ID) {
             auto error = td::td_api::move_object_as<td::td_api::error>(std::move(object));
-            rzLog(RZ_LOG_ERROR, "[SEND] Error al editar mensaje %lld en chat %lld: %s", 
+            int retry_after = retry_after_seconds(*error);
+            if (retry_after > 0) {
+                metrics_.edit_flood_waits.add();
+                tgLog(RZ_LOG_WARN, "[SEND] Flood wait de %d s en chat %lld, reintentando edición", retry_after, (long long)chat_id);
+                outbound_.retry(std::move(message), std::chrono::seconds(retry_after), std::chrono::steady_clock::now());
+                return;
+            }
+            metrics_.edit_errors.add();
+            tgLog(RZ_LOG_ERROR, "[SEND] Error al editar mensaje %lld en chat %lld: %s", 
                 (long long)message_id, (long long)chat_id, error->message_.c_str());
         } else {
-            rzLog(RZ_LOG_DEBUG, "[SEND] Mensaje %lld editado exitosamente en chat %lld", 
+            tgLog(RZ_LOG_DEBUG, "[SEND] Mensaje %lld editado exitosamente en chat %lld", 
                 (long long)message_id, (long long)chat_id);
         }
     });
@@ -720,60 +2285,167 @@ void TelegramBot::send_edited_message(int64_t chat_id, int64_t message_id, const
  * @param text Contenido textual del mensaje.
  * @param callback Función callback opcional que recibe el ID del mensaje enviado.
  */
-void TelegramBot::send_text_message(int64_t chat_id, const std::string& text,
-                                     std::function<void(int64_t message_id)> callback) 
+void TelegramBot::send_text_message(int64_t chat_id, const std::string& text, MessageCallback callback) 
+{
+    OutboundScheduler::Message message;
+    message.kind = OutboundScheduler::Message::Text;
+    message.chat_id = chat_id;
+    message.text = text;
+    message.callback = std::move(callback);
+    submit_text(std::move(message));
+}
+
+/**
+ * @brief Pasa un envío por el control de flood y lo envía si hay tokens.
+ * @param message Envío con su callback o su corrutina en espera.
+ */
+void TelegramBot::submit_text(OutboundScheduler::Message message)
+{
+    // Sin tokens, el mensaje espera en la cola del chat hasta flush_outbound()
+    int64_t chat_id = message.chat_id;
+    if (outbound_.submit(message, std::chrono::steady_clock::now())) {
+        dispatch_outbound(std::move(message));
+    } else {
+        tgLog(RZ_LOG_DEBUG, "[SEND] Mensaje a chat %lld en cola por control de flood", (long long)chat_id);
+    }
+}
+
+/**
+ * @brief Envía a TDLib un mensaje que el planificador de salida ya ha liberado.
+ * 
+ * Si Telegram responde con un flood wait (429), el mensaje vuelve al
+ * planificador, que bloquea su chat durante el retry_after indicado.
+ * @param message Envío o edición a realizar.
+ */
+void TelegramBot::dispatch_outbound(OutboundScheduler::Message message)
+{
+    if (message.kind == OutboundScheduler::Message::Edit) {
+        dispatch_edited_message(std::move(message));
+        return;
+    }
+    dispatch_text(std::move(message));
+}
+
+/**
+ * @brief Envía un texto y deja a quien espera su ID real registrado por el ID temporal.
+ * 
+ * Corrutina: solo cubre el envío (el mensaje sigue en el frame por si hay que
+ * reintentarlo). Con el ID temporal termina; updateMessageSendSucceeded
+ * reanuda directamente la corrutina que esperaba o llama a su callback.
+ * @param message Envío liberado por el planificador de salida.
+ */
+BotTask TelegramBot::dispatch_text(OutboundScheduler::Message message)
 {
-    rzLog(RZ_LOG_INFO,"[SEND] Enviando mensaje a chat %lld: '%s'", 
-    (long long)chat_id, text.c_str());
+    tgLog(RZ_LOG_DEBUG,"[SEND] Enviando mensaje a chat %lld: '%s'", 
+    (long long)message.chat_id, message.text.c_str());
     
-    auto message = td::td_api::make_object<td::td_api::sendMessage>();
-    message->chat_id_ = chat_id;
+    auto send_message = td::td_api::make_object<td::td_api::sendMessage>();
+    send_message->chat_id_ = message.chat_id;
 
     auto content = td::td_api::make_object<td::td_api::inputMessageText>();
     auto formatted_text = td::td_api::make_object<td::td_api::formattedText>();
-    formatted_text->text_ = text;
+    formatted_text->text_ = message.text;
     content->text_ = std::move(formatted_text);
     
-    message->input_message_content_ = std::move(content);
+    send_message->input_message_content_ = std::move(content);
     
-    if(callback != nullptr)
-    {
-        send_query(std::move(message), [this, callback](td::td_api::object_ptr<td::td_api::Object> object) {
-            if (object && object->get_id() == td::td_api::message::ID) {
-                auto message_obj = td::td_api::move_object_as<td::td_api::message>(std::move(object));
-                int64_t message_id = message_obj->id_; 
-                int64_t temp_id = message_obj->id_;  // Este es el ID TEMPORAL
-                rzLog(RZ_LOG_INFO, "[SEND] Mensaje enviado con ID TEMPORAL: %lld", (long long)message_id);
-                
-                // Guardar callback para cuando llegue el ID real
-                pending_message_callbacks_[temp_id] = callback;
-            } 
-            else if (object && object->get_id() == td::td_api::error::ID) {
-                auto error = td::td_api::move_object_as<td::td_api::error>(std::move(object));
-                rzLog(RZ_LOG_ERROR, "[SEND] Error al enviar mensaje: %s", error->message_.c_str());
-                
-                if (callback) {
-                    callback(-1);
-                }
-            }
-            else {
-                rzLog(RZ_LOG_WARN, "[SEND] Respuesta inesperada al enviar mensaje");
-                if (callback) {
-                    callback(-1);
-                }
-            }
-        });
-    } 
-    else 
-    {
-        send_query(std::move(message), nullptr);
+    td::td_api::object_ptr<td::td_api::Object> object = co_await call(std::move(send_message));
+
+    if (object && object->get_id() == td::td_api::message::ID) {
+        int64_t temp_id = static_cast<td::td_api::message*>(object.get())->id_;  // Este es el ID TEMPORAL
+        tgLog(RZ_LOG_DEBUG, "[SEND] Mensaje enviado con ID TEMPORAL: %lld", (long long)temp_id);
+        if (message.waiter || message.callback) {
+            wait_message_id(temp_id, MessageWaiter{ message.waiter, message.result }, std::move(message.callback));
+        }
+        co_return;
+    }
+
+    if (object && object->get_id() == td::td_api::error::ID) {
+        auto error = td::td_api::move_object_as<td::td_api::error>(std::move(object));
+        int retry_after = retry_after_seconds(*error);
+        if (retry_after > 0) {
+            tgLog(RZ_LOG_WARN, "[SEND] Flood wait de %d s en chat %lld, reintentando", retry_after, (long long)message.chat_id);
+            outbound_.retry(std::move(message), std::chrono::seconds(retry_after), std::chrono::steady_clock::now());
+            co_return;
+        }
+        tgLog(RZ_LOG_ERROR, "[SEND] Error al enviar mensaje: %s", error->message_.c_str());
+    } else {
+        tgLog(RZ_LOG_WARN, "[SEND] Respuesta inesperada al enviar mensaje");
+    }
+
+    deliver_message_id(MessageWaiter{ message.waiter, message.result }, message.callback, -1);
+}
+
+/**
+ * @brief Registra quién espera el ID real de un mensaje enviado, con su plazo.
+ * 
+ * Solo desde el bucle principal: una búsqueda en la tabla y sin reservas salvo
+ * al crecer.
+ * @param temp_id ID temporal devuelto por sendMessage.
+ * @param waiter Corrutina que se reanuda con el ID (vacía si hay callback).
+ * @param callback Callback que recibe el ID (vacío si hay corrutina).
+ */
+void TelegramBot::wait_message_id(int64_t temp_id, MessageWaiter waiter, MessageCallback callback) {
+    pending_messages_.insert(temp_id, waiter, std::move(callback));
+    timers_.schedule(TimerKey{ TimerKey::PendingMessage, temp_id }, PENDING_MESSAGE_TIMEOUT);
+}
+
+/**
+ * @brief Entrega el ID real (o -1) a quien esperaba el mensaje temp_id, si había alguien.
+ */
+void TelegramBot::resolve_message_id(int64_t temp_id, int64_t message_id) {
+    std::size_t slot = pending_messages_.find(temp_id);
+    if (slot == PendingMessages::npos) return;
+
+    // Se saca antes de avisar: la corrutina reanudada puede registrar otro mensaje
+    MessageWaiter waiter = pending_messages_.hot(slot);
+    MessageCallback callback = std::move(pending_messages_.cold(slot));
+    pending_messages_.erase(slot);
+    tgLog(RZ_LOG_DEBUG, "Entregando ID real %lld del mensaje %lld", (long long)message_id, (long long)temp_id);
+    deliver_message_id(waiter, callback, message_id);
+}
+
+void TelegramBot::deliver_message_id(MessageWaiter waiter, MessageCallback& callback, int64_t message_id) {
+    if (waiter.handle) {
+        *waiter.result = message_id;
+        waiter.handle.resume();
+    } else if (callback) {
+        callback(message_id);
+    }
+}
+
+bool TelegramBot::QueryAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    if (!query_) {
+        response_ = td::td_api::make_object<td::td_api::error>(400, "Query vacía");
+        return false;
     }
-    rzLog(RZ_LOG_INFO,"[SEND] Query enviado");
+    // Tras send_query la corrutina puede reanudarse ya en el bucle principal: no se toca nada más
+    bot_.send_query(std::move(query_), [this, handle](td::td_api::object_ptr<td::td_api::Object> response) {
+        response_ = std::move(response);
+        handle.resume();
+    });
+    return true;
+}
+
+void TelegramBot::MessageIdAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    bot_.wait_message_id(temp_id_, MessageWaiter{ handle, &message_id_ }, nullptr);
+}
+
+void TelegramBot::SendTextAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    // La corrutina va en el propio mensaje: el ID real la reanuda sin pasar por un callback.
+    // El texto sale del frame antes de enviarlo: la corrutina puede terminar en otro hilo
+    OutboundScheduler::Message message;
+    message.kind = OutboundScheduler::Message::Text;
+    message.chat_id = chat_id_;
+    message.text = std::move(text_);
+    message.waiter = handle;
+    message.result = &message_id_;
+    bot_.submit_text(std::move(message));
 }
 
 void TelegramBot::send_typing_action(int64_t chat_id) 
 {
-    rzLog(RZ_LOG_INFO,"[TYPING] Enviando acción de escribir a chat %lld", 
+    tgLog(RZ_LOG_DEBUG,"[TYPING] Enviando acción de escribir a chat %lld", 
     (long long)chat_id);
     
     auto action = td::td_api::make_object<td::td_api::sendChatAction>();
@@ -793,39 +2465,224 @@ void TelegramBot::send_typing_action(int64_t chat_id)
 void TelegramBot::handle_error(td::td_api::error* error) {
     if (!error) return;
     
-    rzLog(RZ_LOG_ERROR,"TDLib: %s (Código: %d)", 
+    tgLog(RZ_LOG_ERROR,"TDLib: %s (Código: %d)", 
     error->message_.c_str(), error->code_);
     
-    if (error->code_ == 401) {
-        rzLog(RZ_LOG_ERROR,"Error de autenticación! Reiniciando...");
-        need_restart_ = true;
+    // Se cierra el cliente y se reinicia al llegar authorizationStateClosed; la
+    // bot_db queda libre para el cliente nuevo
+    if (error->code_ == 401 && !closing_ && !need_restart_) {
+        tgLog(RZ_LOG_ERROR,"Error de autenticación! Cerrando el cliente para reiniciarlo...");
+        are_authorized_ = false;
+        close_deadline_ = std::chrono::steady_clock::now() + CLOSE_TIMEOUT;
+        closing_ = true;
+        send_query(td::td_api::make_object<td::td_api::close>(), nullptr);
+    }
+}
+
+
+/**
+ * @brief Envía los mensajes encolados por control de flood que ya pueden salir.
+ * 
+ * Se llama en cada iteración de main_loop.
+ */
+void TelegramBot::flush_outbound() {
+    // Sin cliente autorizado los envíos esperan en cola: los de progreso siguen al reconectar
+    if (!are_authorized_) return;
+
+    outbound_ready_.clear();
+    if (outbound_.pump(std::chrono::steady_clock::now(), outbound_ready_) == 0) return;
+
+    for (OutboundScheduler::Message& message : outbound_ready_) {
+        dispatch_outbound(std::move(message));
+    }
+    outbound_ready_.clear();
+}
+
+/**
+ * @brief Expira los handlers y callbacks que llevan demasiado tiempo sin respuesta.
+ * 
+ * Se llama en cada iteración de main_loop. Los handlers de queries reciben un
+ * error sintético 408; los callbacks de mensajes pendientes reciben -1.
+ */
+void TelegramBot::expire_timers() {
+    drain_submissions();
+
+    // Se recogen las claves vencidas y se invocan los handlers fuera de advance()
+    expired_timers_.clear();
+    timers_.advance(std::chrono::steady_clock::now(), [this](const TimerKey& key) {
+        expired_timers_.push_back(key);
+        return true;
+    });
+
+    std::size_t reaped = 0;
+    for (const TimerKey& key : expired_timers_) {
+        if (key.kind == TimerKey::Query) {
+            QueryHandler handler = handlers_.take(static_cast<uint64_t>(key.id));
+            if (!handler) continue; // Ya respondida
+            handler(td::td_api::make_object<td::td_api::error>(408, "Timeout: TDLib no respondió a la query"));
+            ++reaped;
+            continue;
+        }
+
+        if (pending_messages_.find(key.id) == PendingMessages::npos) continue; // Ya llegó el ID real
+        resolve_message_id(key.id, -1);
+        ++reaped;
+    }
+
+    if (reaped > 0) {
+        expired_handlers_total_ += reaped;
+        tgLog(RZ_LOG_WARN, "[TIMERS] %zu handlers expirados (total: %llu, pendientes: %zu queries, %zu mensajes)",
+            reaped, (unsigned long long)expired_handlers_total_,
+            handlers_.size(), pending_messages_.size());
+    }
+}
+
+/**
+ * @brief Falla todos los handlers y callbacks pendientes con el error indicado.
+ * 
+ * @param code Código del error sintético entregado a los handlers.
+ * @param reason Mensaje del error sintético.
+ * @return Número de handlers y callbacks cancelados.
+ */
+std::size_t TelegramBot::fail_pending_handlers(std::int32_t code, const std::string& reason) {
+    drain_submissions();
+
+    // En orden de query_id, el mismo en que se enviaron
+    std::vector<std::pair<uint64_t, QueryHandler>> handlers;
+    handlers_.drain([&](uint64_t query_id, QueryHandler handler) {
+        handlers.emplace_back(query_id, std::move(handler));
+    });
+    std::sort(handlers.begin(), handlers.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (auto& entry : handlers) {
+        entry.second(td::td_api::make_object<td::td_api::error>(code, reason));
+    }
+    std::size_t failed = handlers.size();
+
+    parked_responses_.clear();   // Sin handler que las espere
+
+    // Se sacan todos antes de avisar: una corrutina reanudada puede registrar otro
+    std::vector<std::pair<MessageWaiter, MessageCallback>> waiting;
+    for (std::size_t slot = 0; slot < pending_messages_.size(); ++slot) {
+        waiting.emplace_back(pending_messages_.hot(slot), std::move(pending_messages_.cold(slot)));
+    }
+    pending_messages_.clear();
+    for (auto& entry : waiting) {
+        deliver_message_id(entry.first, entry.second, -1);
+    }
+    failed += waiting.size();
+
+    expired_handlers_total_ += failed;
+    return failed;
+}
+
+/**
+ * @brief Registra en handlers_ y timers_ los handlers publicados por send_query.
+ * 
+ * Solo desde el hilo del bucle principal (o del replay), que es el único
+ * dueño de la tabla de handlers y de la rueda de temporizadores.
+ */
+void TelegramBot::drain_submissions() {
+    Submission submission;
+    while (submissions_.try_pop(submission)) {
+        handlers_.insert(submission.query_id, std::move(submission.handler));
+        timers_.schedule(TimerKey{ TimerKey::Query, static_cast<int64_t>(submission.query_id) }, QUERY_TIMEOUT);
+    }
+
+    if (has_overflow_.load(std::memory_order_acquire)) {
+        std::vector<Submission> overflow;
+        {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            overflow.swap(overflow_submissions_);
+            has_overflow_.store(false, std::memory_order_relaxed);
+        }
+        for (Submission& entry : overflow) {
+            handlers_.insert(entry.query_id, std::move(entry.handler));
+            timers_.schedule(TimerKey{ TimerKey::Query, static_cast<int64_t>(entry.query_id) }, QUERY_TIMEOUT);
+        }
     }
+
+    if (!parked_responses_.empty()) deliver_parked_responses();
 }
 
+/**
+ * @brief Entrega las respuestas aparcadas cuyo handler ya está registrado.
+ * 
+ * Con la cola al día, las que siguen sin handler eran de queries sin él y
+ * siguen el camino normal de process_response.
+ */
+void TelegramBot::deliver_parked_responses() {
+    bool caught_up = !submissions_.claimed();
+
+    std::vector<std::pair<QueryHandler, td::td_api::object_ptr<td::td_api::Object>>> ready;
+    std::vector<std::pair<std::uint64_t, td::td_api::object_ptr<td::td_api::Object>>> unhandled;
+    for (std::size_t i = 0; i < parked_responses_.size();) {
+        auto& parked = parked_responses_[i];
+        QueryHandler handler = handlers_.take(parked.first);
+        if (!handler && !caught_up) {
+            ++i;
+            continue;
+        }
+        if (handler) {
+            ready.emplace_back(std::move(handler), std::move(parked.second));
+        } else {
+            unhandled.emplace_back(parked.first, std::move(parked.second));
+        }
+        if (&parked != &parked_responses_.back()) parked = std::move(parked_responses_.back());
+        parked_responses_.pop_back();
+    }
+
+    // Fuera del recorrido: los handlers pueden enviar queries y volver a drenar
+    for (auto& entry : ready) {
+        metrics_.updates[0].add();
+        entry.first(std::move(entry.second));
+    }
+    for (auto& entry : unhandled) {
+        process_response(entry.first, std::move(entry.second));
+    }
+}
 
 /**
  * @brief Envía una consulta genérica a TDLib y asigna un handler para su respuesta.
  * 
+ * Thread-safe y sin locks en el caso normal: el query_id sale de un contador
+ * atómico y el handler se publica en una cola MPSC que el bucle principal
+ * vacía antes de despachar respuestas. El handler se publica antes de enviar
+ * la query, pero el drenado se detiene en el primer slot reservado y sin
+ * publicar de otro productor: si la respuesta llega antes de que su handler
+ * salga de la cola, process_response la aparca hasta entonces.
  * @param query Objeto que representa la función o acción a ejecutar en TDLib.
  * 
  * @param handler Función callback que recibe la respuesta de TDLib.
  */
 void TelegramBot::send_query(
     td::td_api::object_ptr<td::td_api::Function> query,
-    std::function<void(td::td_api::object_ptr<td::td_api::Object>)> handler) {
+    QueryHandler handler) {
     
-    if (!client_manager_ || !query) {
-        rzLog(RZ_LOG_ERROR, "send_query: client_manager o query null");
+    if (!transport_ || !query) {
+        tgLog(RZ_LOG_ERROR, "send_query: transport o query null");
         return;
     }
     
-    uint64_t query_id = current_query_id_++;
+    uint64_t query_id = current_query_id_.fetch_add(1, std::memory_order_relaxed);
     
-    // Si hay handler, guardarlo
+    // Si hay handler, publicarlo para el bucle principal
     if (handler) {
-        handlers_[query_id] = std::move(handler);
-        rzLog(RZ_LOG_DEBUG, "send_query: Query %llu con handler", query_id);
+        Submission submission{ query_id, std::move(handler) };
+        if (!submissions_.try_push(submission)) {
+            // Cola llena (ráfaga sin drenar): se desborda a un vector con lock
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            overflow_submissions_.push_back(std::move(submission));
+            has_overflow_.store(true, std::memory_order_release);
+        }
+        tgLog(RZ_LOG_DEBUG, "send_query: Query %llu con handler", query_id);
+    }
+
+    // En replay no hay red: la respuesta vendrá (o no) del log grabado
+    if (offline_) {
+        offline_queries_.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
     
-    client_manager_->send(client_id_, query_id, std::move(query));
+    transport_->send(client_id_.load(std::memory_order_acquire), query_id, std::move(query));
 }
\ No newline at end of file
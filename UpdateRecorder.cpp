@@ -0,0 +1,471 @@
+#include "UpdateRecorder.h"
+#include "LogCodec.h"
+#include "AsyncLog.h"
+
+#include <cstring>
+
+namespace td_api = td::td_api;
+
+static const char RECORD_MAGIC[4] = { 'T', 'G', 'R', 'L' };
+static const std::uint32_t RECORD_VERSION = 1;
+
+// Tamaño de la cabecera de cada registro: timestamp, request_id, tipo, longitud
+static const std::size_t RECORD_HEADER_SIZE = 8 + 8 + 4 + 4;
+
+/* ----------------------------- Codificación ----------------------------- */
+
+static void encode_formatted_text(LogWriter& w, const td_api::formattedText* text) {
+    w.put_bool(text != nullptr);
+    if (text) w.put_string(text->text_);
+}
+
+static void encode_file(LogWriter& w, const td_api::file* file) {
+    w.put_bool(file != nullptr);
+    if (!file) return;
+
+    w.put<std::int32_t>(file->id_);
+    w.put<std::int64_t>(file->size_);
+    w.put<std::int64_t>(file->expected_size_);
+
+    const td_api::localFile* local = file->local_.get();
+    w.put_bool(local != nullptr);
+    if (local) {
+        w.put_string(local->path_);
+        w.put_bool(local->is_downloading_active_);
+        w.put_bool(local->is_downloading_completed_);
+        w.put<std::int64_t>(local->download_offset_);
+        w.put<std::int64_t>(local->downloaded_prefix_size_);
+        w.put<std::int64_t>(local->downloaded_size_);
+    }
+
+    const td_api::remoteFile* remote = file->remote_.get();
+    w.put_bool(remote != nullptr);
+    if (remote) {
+        w.put_string(remote->id_);
+        w.put_string(remote->unique_id_);
+    }
+}
+
+static void encode_content(LogWriter& w, const td_api::MessageContent* content) {
+    w.put<std::int32_t>(content ? content->get_id() : 0);
+    if (!content) return;
+
+    switch (content->get_id()) {
+    case td_api::messageText::ID:
+        {
+            auto text = static_cast<const td_api::messageText*>(content);
+            encode_formatted_text(w, text->text_.get());
+            break;
+        }
+    case td_api::messageVideo::ID:
+        {
+            auto video = static_cast<const td_api::messageVideo*>(content);
+            const td_api::video* v = video->video_.get();
+            w.put_bool(v != nullptr);
+            if (v) {
+                w.put<std::int32_t>(v->duration_);
+                w.put<std::int32_t>(v->width_);
+                w.put<std::int32_t>(v->height_);
+                w.put_string(v->file_name_);
+                w.put_string(v->mime_type_);
+                encode_file(w, v->video_.get());
+            }
+            encode_formatted_text(w, video->caption_.get());
+            break;
+        }
+    case td_api::messageDocument::ID:
+        {
+            auto document = static_cast<const td_api::messageDocument*>(content);
+            const td_api::document* d = document->document_.get();
+            w.put_bool(d != nullptr);
+            if (d) {
+                w.put_string(d->file_name_);
+                w.put_string(d->mime_type_);
+                encode_file(w, d->document_.get());
+            }
+            encode_formatted_text(w, document->caption_.get());
+            break;
+        }
+    default:
+        break;
+    }
+}
+
+static void encode_message(LogWriter& w, const td_api::message* message) {
+    w.put_bool(message != nullptr);
+    if (!message) return;
+
+    w.put<std::int64_t>(message->id_);
+    w.put<std::int64_t>(message->chat_id_);
+    w.put<std::int32_t>(message->date_);
+
+    std::int64_t sender_user_id = 0;
+    if (message->sender_id_ && message->sender_id_->get_id() == td_api::messageSenderUser::ID) {
+        sender_user_id = static_cast<const td_api::messageSenderUser*>(message->sender_id_.get())->user_id_;
+    }
+    w.put<std::int64_t>(sender_user_id);
+
+    encode_content(w, message->content_.get());
+}
+
+static void encode_error(LogWriter& w, const td_api::error* error) {
+    w.put_bool(error != nullptr);
+    if (!error) return;
+    w.put<std::int32_t>(error->code_);
+    w.put_string(error->message_);
+}
+
+static void encode_object(LogWriter& w, const td_api::Object& object) {
+    switch (object.get_id()) {
+    case td_api::updateAuthorizationState::ID:
+        {
+            auto& update = static_cast<const td_api::updateAuthorizationState&>(object);
+            w.put<std::int32_t>(update.authorization_state_ ? update.authorization_state_->get_id() : 0);
+            break;
+        }
+    case td_api::updateNewMessage::ID:
+        encode_message(w, static_cast<const td_api::updateNewMessage&>(object).message_.get());
+        break;
+    case td_api::updateFile::ID:
+        encode_file(w, static_cast<const td_api::updateFile&>(object).file_.get());
+        break;
+    case td_api::updateMessageSendSucceeded::ID:
+        {
+            auto& update = static_cast<const td_api::updateMessageSendSucceeded&>(object);
+            w.put<std::int64_t>(update.old_message_id_);
+            encode_message(w, update.message_.get());
+            break;
+        }
+    case td_api::updateMessageSendFailed::ID:
+        {
+            auto& update = static_cast<const td_api::updateMessageSendFailed&>(object);
+            w.put<std::int64_t>(update.old_message_id_);
+            encode_message(w, update.message_.get());
+            encode_error(w, update.error_.get());
+            break;
+        }
+    case td_api::message::ID:
+        encode_message(w, &static_cast<const td_api::message&>(object));
+        break;
+    case td_api::file::ID:
+        encode_file(w, &static_cast<const td_api::file&>(object));
+        break;
+    case td_api::error::ID:
+        encode_error(w, &static_cast<const td_api::error&>(object));
+        break;
+    default:
+        // ok y tipos que el bot ignora: basta con el ID
+        break;
+    }
+}
+
+/* ---------------------------- Decodificación ---------------------------- */
+
+static td_api::object_ptr<td_api::formattedText> decode_formatted_text(LogReader& r) {
+    if (!r.get_bool()) return nullptr;
+    auto text = td_api::make_object<td_api::formattedText>();
+    text->text_ = r.get_string();
+    return text;
+}
+
+static td_api::object_ptr<td_api::file> decode_file(LogReader& r) {
+    if (!r.get_bool()) return nullptr;
+
+    auto file = td_api::make_object<td_api::file>();
+    file->id_ = r.get<std::int32_t>();
+    file->size_ = r.get<std::int64_t>();
+    file->expected_size_ = r.get<std::int64_t>();
+
+    if (r.get_bool()) {
+        auto local = td_api::make_object<td_api::localFile>();
+        local->path_ = r.get_string();
+        local->is_downloading_active_ = r.get_bool();
+        local->is_downloading_completed_ = r.get_bool();
+        local->download_offset_ = r.get<std::int64_t>();
+        local->downloaded_prefix_size_ = r.get<std::int64_t>();
+        local->downloaded_size_ = r.get<std::int64_t>();
+        file->local_ = std::move(local);
+    }
+
+    if (r.get_bool()) {
+        auto remote = td_api::make_object<td_api::remoteFile>();
+        remote->id_ = r.get_string();
+        remote->unique_id_ = r.get_string();
+        file->remote_ = std::move(remote);
+    }
+    return file;
+}
+
+static td_api::object_ptr<td_api::MessageContent> decode_content(LogReader& r) {
+    std::int32_t content_id = r.get<std::int32_t>();
+
+    switch (content_id) {
+    case td_api::messageText::ID:
+        {
+            auto text = td_api::make_object<td_api::messageText>();
+            text->text_ = decode_formatted_text(r);
+            return text;
+        }
+    case td_api::messageVideo::ID:
+        {
+            auto video = td_api::make_object<td_api::messageVideo>();
+            if (r.get_bool()) {
+                auto v = td_api::make_object<td_api::video>();
+                v->duration_ = r.get<std::int32_t>();
+                v->width_ = r.get<std::int32_t>();
+                v->height_ = r.get<std::int32_t>();
+                v->file_name_ = r.get_string();
+                v->mime_type_ = r.get_string();
+                v->video_ = decode_file(r);
+                video->video_ = std::move(v);
+            }
+            video->caption_ = decode_formatted_text(r);
+            return video;
+        }
+    case td_api::messageDocument::ID:
+        {
+            auto document = td_api::make_object<td_api::messageDocument>();
+            if (r.get_bool()) {
+                auto d = td_api::make_object<td_api::document>();
+                d->file_name_ = r.get_string();
+                d->mime_type_ = r.get_string();
+                d->document_ = decode_file(r);
+                document->document_ = std::move(d);
+            }
+            document->caption_ = decode_formatted_text(r);
+            return document;
+        }
+    default:
+        return nullptr;
+    }
+}
+
+static td_api::object_ptr<td_api::message> decode_message(LogReader& r) {
+    if (!r.get_bool()) return nullptr;
+
+    auto message = td_api::make_object<td_api::message>();
+    message->id_ = r.get<std::int64_t>();
+    message->chat_id_ = r.get<std::int64_t>();
+    message->date_ = r.get<std::int32_t>();
+
+    std::int64_t sender_user_id = r.get<std::int64_t>();
+    if (sender_user_id != 0) {
+        auto sender = td_api::make_object<td_api::messageSenderUser>();
+        sender->user_id_ = sender_user_id;
+        message->sender_id_ = std::move(sender);
+    }
+
+    message->content_ = decode_content(r);
+    return message;
+}
+
+static td_api::object_ptr<td_api::error> decode_error(LogReader& r) {
+    if (!r.get_bool()) return nullptr;
+    auto error = td_api::make_object<td_api::error>();
+    error->code_ = r.get<std::int32_t>();
+    error->message_ = r.get_string();
+    return error;
+}
+
+static td_api::object_ptr<td_api::AuthorizationState> decode_authorization_state(std::int32_t state_id) {
+    switch (state_id) {
+    case td_api::authorizationStateWaitTdlibParameters::ID:
+        return td_api::make_object<td_api::authorizationStateWaitTdlibParameters>();
+    case td_api::authorizationStateWaitPhoneNumber::ID:
+        return td_api::make_object<td_api::authorizationStateWaitPhoneNumber>();
+    case td_api::authorizationStateReady::ID:
+        return td_api::make_object<td_api::authorizationStateReady>();
+    case td_api::authorizationStateLoggingOut::ID:
+        return td_api::make_object<td_api::authorizationStateLoggingOut>();
+    case td_api::authorizationStateClosed::ID:
+        return td_api::make_object<td_api::authorizationStateClosed>();
+    default:
+        return nullptr;
+    }
+}
+
+static td_api::object_ptr<td_api::Object> decode_object(std::int32_t type_id, LogReader& r) {
+    switch (type_id) {
+    case td_api::updateAuthorizationState::ID:
+        {
+            auto state = decode_authorization_state(r.get<std::int32_t>());
+            if (!state) return nullptr;
+            auto update = td_api::make_object<td_api::updateAuthorizationState>();
+            update->authorization_state_ = std::move(state);
+            return update;
+        }
+    case td_api::updateNewMessage::ID:
+        {
+            auto update = td_api::make_object<td_api::updateNewMessage>();
+            update->message_ = decode_message(r);
+            return update;
+        }
+    case td_api::updateFile::ID:
+        {
+            auto update = td_api::make_object<td_api::updateFile>();
+            update->file_ = decode_file(r);
+            return update;
+        }
+    case td_api::updateMessageSendSucceeded::ID:
+        {
+            auto update = td_api::make_object<td_api::updateMessageSendSucceeded>();
+            update->old_message_id_ = r.get<std::int64_t>();
+            update->message_ = decode_message(r);
+            return update;
+        }
+    case td_api::updateMessageSendFailed::ID:
+        {
+            auto update = td_api::make_object<td_api::updateMessageSendFailed>();
+            update->old_message_id_ = r.get<std::int64_t>();
+            update->message_ = decode_message(r);
+            update->error_ = decode_error(r);
+            return update;
+        }
+    case td_api::message::ID:
+        return decode_message(r);
+    case td_api::file::ID:
+        return decode_file(r);
+    case td_api::error::ID:
+        return decode_error(r);
+    case td_api::ok::ID:
+        return td_api::make_object<td_api::ok>();
+    default:
+        return nullptr;
+    }
+}
+
+/* ----------------------------- UpdateRecorder ----------------------------- */
+
+UpdateRecorder::~UpdateRecorder() {
+    close();
+}
+
+/**
+ * @brief Abre (trunca) el log de grabación y escribe la cabecera.
+ * @param path Ruta del fichero de log.
+ * @return bool
+ */
+bool UpdateRecorder::open(const std::string& path) {
+    close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        tgLog(RZ_LOG_ERROR, "[RECORD] No se pudo abrir '%s' para grabar", path.c_str());
+        return false;
+    }
+    std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    std::fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC), file_);
+    std::fwrite(&RECORD_VERSION, sizeof(RECORD_VERSION), 1, file_);
+
+    start_ = std::chrono::steady_clock::now();
+    records_ = 0;
+    tgLog(RZ_LOG_INFO, "[RECORD] Grabando updates en '%s'", path.c_str());
+    return true;
+}
+
+void UpdateRecorder::close() {
+    if (!file_) return;
+    std::fclose(file_);
+    file_ = nullptr;
+    tgLog(RZ_LOG_INFO, "[RECORD] Grabación cerrada: %llu registros", (unsigned long long)records_);
+}
+
+/**
+ * @brief Añade un objeto recibido de TDLib al log.
+ * @param request_id request_id con el que llegó el objeto (0 para updates).
+ * @param object Objeto recibido.
+ */
+void UpdateRecorder::record(std::uint64_t request_id, const td::td_api::Object& object) {
+    if (!file_) return;
+
+    buffer_.clear();
+    buffer_.resize(RECORD_HEADER_SIZE);
+
+    LogWriter writer(buffer_);
+    encode_object(writer, object);
+
+    std::uint64_t timestamp_ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+    std::int32_t type_id = object.get_id();
+    std::uint32_t length = static_cast<std::uint32_t>(buffer_.size() - RECORD_HEADER_SIZE);
+
+    char* header = &buffer_[0];
+    std::memcpy(header, &timestamp_ns, 8);
+    std::memcpy(header + 8, &request_id, 8);
+    std::memcpy(header + 16, &type_id, 4);
+    std::memcpy(header + 20, &length, 4);
+
+    std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    ++records_;
+}
+
+/* ----------------------------- UpdateReplayer ----------------------------- */
+
+UpdateReplayer::~UpdateReplayer() {
+    close();
+}
+
+/**
+ * @brief Abre un log de grabación y valida su cabecera.
+ * @param path Ruta del fichero de log.
+ * @return bool
+ */
+bool UpdateReplayer::open(const std::string& path) {
+    close();
+
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) {
+        tgLog(RZ_LOG_ERROR, "[REPLAY] No se pudo abrir '%s'", path.c_str());
+        return false;
+    }
+    std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    char magic[sizeof(RECORD_MAGIC)];
+    std::uint32_t version = 0;
+    if (std::fread(magic, 1, sizeof(magic), file_) != sizeof(magic) ||
+        std::memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0 ||
+        std::fread(&version, sizeof(version), 1, file_) != 1 ||
+        version != RECORD_VERSION) {
+        tgLog(RZ_LOG_ERROR, "[REPLAY] '%s' no es un log de grabación válido", path.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+void UpdateReplayer::close() {
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool UpdateReplayer::next(Record& record) {
+    if (!file_) return false;
+
+    char header[RECORD_HEADER_SIZE];
+    if (std::fread(header, 1, sizeof(header), file_) != sizeof(header)) {
+        return false;
+    }
+
+    std::uint32_t length = 0;
+    std::memcpy(&record.timestamp_ns, header, 8);
+    std::memcpy(&record.request_id, header + 8, 8);
+    std::memcpy(&record.type_id, header + 16, 4);
+    std::memcpy(&length, header + 20, 4);
+
+    buffer_.resize(length);
+    if (length > 0 && std::fread(&buffer_[0], 1, length, file_) != length) {
+        tgLog(RZ_LOG_ERROR, "[REPLAY] Registro truncado");
+        return false;
+    }
+
+    LogReader reader(buffer_.data(), buffer_.size());
+    record.object = decode_object(record.type_id, reader);
+    if (!reader.ok()) {
+        tgLog(RZ_LOG_WARN, "[REPLAY] Registro de tipo %d corrupto, ignorando", record.type_id);
+        record.object = nullptr;
+    }
+    return true;
+}
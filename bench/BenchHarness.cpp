@@ -0,0 +1,66 @@
+#include "BenchHarness.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+std::atomic<std::uint64_t> g_bench_allocs{0};
+
+void* operator new(std::size_t size) {
+    g_bench_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    g_bench_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+BenchSuite::BenchSuite(const std::string& suite, const std::string& output_path)
+    : suite_(suite), output_path_(output_path) {
+    std::fprintf(stderr, "%-48s %12s %12s %14s\n", suite.c_str(), "ns/op", "allocs/op", "ops/s");
+}
+
+/**
+ * @brief Escribe los resultados en JSON Lines al terminar la suite.
+ */
+BenchSuite::~BenchSuite() {
+    if (output_path_.empty()) return;
+
+    std::FILE* out = std::fopen(output_path_.c_str(), "a");
+    if (!out) {
+        std::fprintf(stderr, "No se pudo abrir '%s'\n", output_path_.c_str());
+        return;
+    }
+
+    const char* label = std::getenv("BENCH_LABEL");
+    long long timestamp = static_cast<long long>(std::time(nullptr));
+    for (const BenchResult& r : results_) {
+        std::fprintf(out,
+            "{\"suite\":\"%s\",\"label\":\"%s\",\"timestamp\":%lld,\"name\":\"%s\","
+            "\"iterations\":%llu,\"ns_per_op\":%.3f,\"allocs_per_op\":%.3f,\"ops_per_sec\":%.1f}\n",
+            suite_.c_str(), label ? label : "", timestamp, r.name.c_str(),
+            (unsigned long long)r.iterations, r.ns_per_op, r.allocs_per_op, r.ops_per_sec);
+    }
+    std::fclose(out);
+}
+
+void BenchSuite::report(const std::string& name, std::uint64_t iterations, double elapsed_ns, std::uint64_t allocs) {
+    BenchResult r;
+    r.name = name;
+    r.iterations = iterations;
+    r.ns_per_op = iterations ? elapsed_ns / iterations : 0.0;
+    r.allocs_per_op = iterations ? double(allocs) / iterations : 0.0;
+    r.ops_per_sec = elapsed_ns > 0.0 ? iterations * 1e9 / elapsed_ns : 0.0;
+    results_.push_back(r);
+
+    std::fprintf(stderr, "  %-46s %12.1f %12.2f %14.0f\n", name.c_str(), r.ns_per_op, r.allocs_per_op, r.ops_per_sec);
+}
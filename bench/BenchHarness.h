@@ -0,0 +1,64 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Contador global de reservas de memoria (operator new sustituido en BenchHarness.cpp)
+extern std::atomic<std::uint64_t> g_bench_allocs;
+
+struct BenchResult {
+    std::string name;
+    std::uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    double ops_per_sec;
+};
+
+/**
+ * @class BenchSuite
+ * @brief Ejecuta microbenchmarks y vuelca los resultados en texto y en JSON.
+ *
+ * La tabla legible se escribe en stderr (stdout suele ir a /dev/null para no
+ * medir la terminal) y los resultados en JSON Lines en output_path, una línea
+ * por benchmark, para poder comparar entre versiones.
+ */
+class BenchSuite {
+    public:
+
+    BenchSuite(const std::string& suite, const std::string& output_path);
+    ~BenchSuite();
+
+    /**
+     * @brief Mide body(i) para i en [0, iterations).
+     */
+    template <class Fn>
+    void run(const std::string& name, std::uint64_t iterations, Fn&& body) {
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            body(i);
+        }
+        auto end = std::chrono::steady_clock::now();
+        report(name, iterations, std::chrono::duration<double, std::nano>(end - start).count(),
+               g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+    }
+
+    /**
+     * @brief Registra un resultado medido externamente.
+     */
+    void report(const std::string& name, std::uint64_t iterations, double elapsed_ns, std::uint64_t allocs);
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+    private:
+
+    std::string suite_;
+    std::string output_path_;
+    std::vector<BenchResult> results_;
+};
+
+#endif // BENCH_HARNESS_H
@@ -0,0 +1,113 @@
+/**
+ * @file bench_handler_table.cpp
+ * @brief Microbenchmark del ciclo send_query -> process_response del registro de handlers.
+ *
+ * Compara el esquema anterior (std::map + std::function con find/[]/erase) con
+ * HandlerTable + SmallFunction. Se mantiene una ventana de queries pendientes
+ * para simular cientos de descargas concurrentes editando mensajes.
+ */
+#include "SmallFunction.h"
+#include "HandlerTable.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+
+static std::uint64_t g_allocs = 0;
+
+void* operator new(std::size_t size) {
+    ++g_allocs;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Equivalente a td_api::object_ptr<Object> sin depender de TDLib
+struct Payload { std::int64_t id; };
+using PayloadPtr = std::unique_ptr<Payload>;
+
+static volatile std::int64_t g_sink = 0;
+
+struct Result {
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+template <class Fn>
+static Result measure(std::uint64_t ops, Fn&& body) {
+    std::uint64_t allocs_before = g_allocs;
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return Result{ ns / ops, double(g_allocs - allocs_before) / ops };
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t ops = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    const std::uint64_t window = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 512;
+
+    // Payloads preasignados: solo medimos el coste del registro de handlers
+    std::unique_ptr<PayloadPtr[]> payloads(new PayloadPtr[ops + window]);
+    for (std::uint64_t i = 0; i < ops + window; ++i) payloads[i].reset(new Payload{ std::int64_t(i) });
+
+    std::function<void(std::int64_t)> user_callback = [](std::int64_t id) { g_sink = g_sink + id; };
+    int32_t file_id = 42;
+    void* self = payloads.get();
+
+    // Antes: std::map + std::function
+    Result before = measure(ops, [&] {
+        std::map<std::uint64_t, std::function<void(PayloadPtr)>> handlers;
+        std::uint64_t next_id = 1;
+        for (std::uint64_t i = 0; i < ops + window; ++i) {
+            std::uint64_t id = next_id++;
+            if (i & 1) {
+                handlers[id] = [self, file_id](PayloadPtr p) { g_sink = g_sink + p->id + file_id + (self != nullptr); };
+            } else {
+                handlers[id] = [self, user_callback](PayloadPtr p) { g_sink = g_sink + p->id + (self != nullptr); };
+            }
+            if (i >= window) {
+                std::uint64_t done = id - window;
+                if (handlers.find(done) != handlers.end()) {
+                    handlers[done](std::move(payloads[done - 1]));
+                    handlers.erase(done);
+                }
+            }
+        }
+    });
+
+    for (std::uint64_t i = 0; i < ops + window; ++i) payloads[i].reset(new Payload{ std::int64_t(i) });
+
+    // Después: HandlerTable + SmallFunction
+    using Handler = SmallFunction<void(PayloadPtr), 64>;
+    Result after = measure(ops, [&] {
+        HandlerTable<Handler> handlers;
+        std::uint64_t next_id = 1;
+        for (std::uint64_t i = 0; i < ops + window; ++i) {
+            std::uint64_t id = next_id++;
+            if (i & 1) {
+                handlers.insert(id, [self, file_id](PayloadPtr p) { g_sink = g_sink + p->id + file_id + (self != nullptr); });
+            } else {
+                handlers.insert(id, [self, user_callback](PayloadPtr p) { g_sink = g_sink + p->id + (self != nullptr); });
+            }
+            if (i >= window) {
+                std::uint64_t done = id - window;
+                Handler handler = handlers.take(done);
+                if (handler) {
+                    handler(std::move(payloads[done - 1]));
+                }
+            }
+        }
+    });
+
+    std::printf("handler_table ops=%llu window=%llu\n", (unsigned long long)ops, (unsigned long long)window);
+    std::printf("  map+function       : %8.2f ns/op  %5.2f allocs/op\n", before.ns_per_op, before.allocs_per_op);
+    std::printf("  HandlerTable+Small : %8.2f ns/op  %5.2f allocs/op\n", after.ns_per_op, after.allocs_per_op);
+    return 0;
+}
@@ -0,0 +1,1095 @@
+/**
+ * @file bench_hot_paths.cpp
+ * @brief Microbenchmarks de los caminos calientes del bot.
+ *
+ * Cubre el despacho de process_response por tipo de update, el cálculo de
+ * progreso de handle_file_update, el registro de handlers de send_query,
+ * generate_response y el router de comandos, el control de flood, el escalado del despacho por chat, el
+ * XXH64 del checksum incremental y el coste de rzLog frente a tgLog. Los objetos TDLib se
+ * construyen antes de medir y las queries van a un transporte nulo. La descarga
+ * por rangos se mide de extremo a extremo contra el servidor simulado.
+ *
+ * Uso: bench_hot_paths [salida.json] [iteraciones]
+ * Con BENCH_REPLAY=<log> mide también la reproducción de un log grabado.
+ */
+#include "BenchHarness.h"
+#include "TelegramBot.h"
+#include "FakeTelegramServer.h"
+#include "BotShards.h"
+#include "XxHash64.h"
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <random>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace td_api = td::td_api;
+
+/**
+ * @class NullTransport
+ * @brief Transporte que descarta todas las peticiones: solo se mide la lógica del bot.
+ */
+class NullTransport : public TdTransport {
+    public:
+    std::int32_t create_client_id() override { return 1; }
+    void send(std::int32_t, std::uint64_t, td_api::object_ptr<td_api::Function>) override {}
+    Response receive(double) override { return Response{ 0, 0, nullptr }; }
+    void reset() override {}
+};
+
+/**
+ * @class QueueTransport
+ * @brief Transporte que entrega una ráfaga de objetos preconstruidos.
+ */
+class QueueTransport : public TdTransport {
+    public:
+    std::int32_t create_client_id() override { return 1; }
+    void send(std::int32_t, std::uint64_t, td_api::object_ptr<td_api::Function>) override {}
+    Response receive(double) override {
+        if (next_ >= objects_.size()) return Response{ 0, 0, nullptr };
+        return Response{ 1, 0, std::move(objects_[next_++]) };
+    }
+    void reset() override {}
+
+    void load(std::vector<td_api::object_ptr<td_api::Object>> objects) {
+        objects_ = std::move(objects);
+        next_ = 0;
+    }
+
+    private:
+    std::vector<td_api::object_ptr<td_api::Object>> objects_;
+    std::size_t next_ = 0;
+};
+
+/**
+ * @class EchoTransport
+ * @brief Transporte que contesta cada petición al momento: guarda su query_id para el consumidor.
+ */
+class EchoTransport : public TdTransport {
+    public:
+    std::int32_t create_client_id() override { return 1; }
+    void send(std::int32_t, std::uint64_t request_id, td_api::object_ptr<td_api::Function>) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        answered_.push_back(request_id);
+    }
+    Response receive(double) override { return Response{ 0, 0, nullptr }; }
+    void reset() override {}
+
+    bool pop(std::uint64_t& request_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (answered_.empty()) return false;
+        request_id = answered_.front();
+        answered_.pop_front();
+        return true;
+    }
+
+    private:
+    std::mutex mutex_;
+    std::deque<std::uint64_t> answered_;
+};
+
+// Captura que a veces se detiene al moverse. send_query la mueve al slot de la cola
+// entre reservarlo y publicarlo: es el productor que se queda a medias
+static std::atomic<std::uint64_t> g_stall_moves{0};
+
+struct StallOnMove {
+    StallOnMove() = default;
+    StallOnMove(StallOnMove&&) noexcept {
+        if ((g_stall_moves.fetch_add(1, std::memory_order_relaxed) & 7) == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+};
+
+/**
+ * @class TelegramBotBench
+ * @brief Acceso a los miembros privados de TelegramBot para los benchmarks.
+ */
+class TelegramBotBench {
+    public:
+
+    using FileType = TelegramBot::FileType;
+    using DownloadProgress = TelegramBot::DownloadProgress;
+    using DownloadInfo = TelegramBot::DownloadInfo;
+    using DownloadTable = TelegramBot::DownloadTable;
+
+    static void process_response(TelegramBot& bot, std::uint64_t query_id, td_api::object_ptr<td_api::Object> object) {
+        bot.process_response(query_id, std::move(object));
+    }
+
+    static void handle_file_update(TelegramBot& bot, td_api::object_ptr<td_api::file> file) {
+        bot.handle_file_update(std::move(file));
+    }
+
+    static std::string generate_response(TelegramBot& bot, std::string_view text) {
+        return bot.generate_response(0, text);
+    }
+
+    static std::uint64_t send_query(TelegramBot& bot, td_api::object_ptr<td_api::Function> query, bool with_handler) {
+        std::uint64_t query_id = bot.current_query_id_.load();
+        if (with_handler) {
+            bot.send_query(std::move(query), [](td_api::object_ptr<td_api::Object> object) {});
+        } else {
+            bot.send_query(std::move(query), nullptr);
+        }
+        return query_id;
+    }
+
+    static void send_query(TelegramBot& bot, td_api::object_ptr<td_api::Function> query,
+                           TelegramBot::QueryHandler handler) {
+        bot.send_query(std::move(query), std::move(handler));
+    }
+
+    static std::uint64_t parked_responses(const TelegramBot& bot) {
+        return bot.parked_total_;
+    }
+
+    static void add_download(TelegramBot& bot, std::int32_t file_id, std::int64_t chat_id,
+                             std::int64_t message_id, std::int64_t size) {
+        TelegramBot::FileType file{ "video_bench.mp4", ".mp4", "video/mp4", size };
+        TelegramBot::DownloadProgress state;
+        state.chat_id = chat_id;
+        state.message_id = message_id;
+        bot.downloads_.insert(file_id, state, TelegramBot::DownloadInfo{
+            chat_id, "Iniciando descarga de video_bench.mp4", std::time(nullptr), std::time(nullptr), file
+        });
+    }
+
+    // Una iteración del bucle principal por lote hasta vaciar el transporte
+    static void drain_batches(TelegramBot& bot, TdTransport& transport) {
+        while (true) {
+            auto response = transport.receive(0.0);
+            if (!response.object) break;
+            bot.receive_batch(std::move(response));
+            bot.dispatch_batch();
+        }
+    }
+
+    static void add_pending_message(TelegramBot& bot, std::int64_t temp_id) {
+        bot.wait_message_id(temp_id, TelegramBot::MessageWaiter{}, [](std::int64_t) {});
+    }
+
+    static void drain_submissions(TelegramBot& bot) {
+        bot.drain_submissions();
+    }
+
+    static std::uint64_t next_query_id(const TelegramBot& bot) {
+        return bot.current_query_id_.load();
+    }
+
+    // El flujo enviar -> ID temporal -> ID real escrito con handlers anidados
+    static void send_with_callbacks(TelegramBot& bot, td_api::object_ptr<td_api::Function> query,
+                                    std::int64_t temp_id, std::uint64_t& done) {
+        bot.send_query(std::move(query), [&bot, temp_id, &done](td_api::object_ptr<td_api::Object> object) {
+            if (!object) return;
+            bot.wait_message_id(temp_id, TelegramBot::MessageWaiter{},
+                [&done](std::int64_t message_id) { done += message_id > 0; });
+        });
+    }
+
+    // send_text_message completo (control de flood, sendMessage, ID real) con callback
+    static void send_text_message(TelegramBot& bot, std::int64_t chat_id, const std::string& text, std::uint64_t& done) {
+        bot.send_text_message(chat_id, text, [&done](std::int64_t message_id) { done += message_id > 0; });
+    }
+
+    static std::size_t pending_handlers(const TelegramBot& bot) {
+        return bot.handlers_.size();
+    }
+
+    static void wait_dispatch(TelegramBot& bot) {
+        bot.executor_->wait_idle();
+    }
+
+    static bool authorized(const TelegramBot& bot) {
+        return bot.are_authorized_;
+    }
+};
+
+// El mismo flujo como corrutina
+static BotTask send_with_coroutine(TelegramBot& bot, td_api::object_ptr<td_api::Function> query,
+                                   std::int64_t temp_id, std::uint64_t& done) {
+    auto object = co_await bot.call(std::move(query));
+    if (!object) co_return;
+    std::int64_t message_id = co_await bot.real_message_id(temp_id);
+    done += message_id > 0;
+}
+
+// send_text completo desde una corrutina
+static BotTask send_text_coroutine(TelegramBot& bot, std::int64_t chat_id, std::string text, std::uint64_t& done) {
+    std::int64_t message_id = co_await bot.send_text(chat_id, std::move(text));
+    done += message_id > 0;
+}
+
+/* ---------------------------- Constructores ---------------------------- */
+
+static td_api::object_ptr<td_api::file> make_file(std::int32_t file_id, std::int64_t downloaded, std::int64_t size) {
+    auto file = td_api::make_object<td_api::file>();
+    file->id_ = file_id;
+    file->size_ = size;
+    file->expected_size_ = size;
+    file->local_ = td_api::make_object<td_api::localFile>();
+    file->local_->downloaded_size_ = downloaded;
+    file->local_->downloaded_prefix_size_ = downloaded;
+    file->local_->is_downloading_active_ = downloaded < size;
+    file->local_->is_downloading_completed_ = downloaded >= size;
+    file->remote_ = td_api::make_object<td_api::remoteFile>();
+    return file;
+}
+
+/**
+ * @class CacheMisses
+ * @brief Fallos de caché del hilo actual con perf_event_open (si el kernel lo permite).
+ */
+class CacheMisses {
+    public:
+    CacheMisses() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~CacheMisses() { if (fd_ >= 0) ::close(fd_); }
+
+    bool available() const { return fd_ >= 0; }
+    void start() {
+        if (fd_ < 0) return;
+        ::ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    std::uint64_t stop() {
+        std::uint64_t count = 0;
+        if (fd_ < 0) return 0;
+        ::ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (::read(fd_, &count, sizeof(count)) != sizeof(count)) return 0;
+        return count;
+    }
+
+    private:
+    int fd_ = -1;
+};
+
+static td_api::object_ptr<td_api::message> make_message(std::int64_t chat_id, std::int64_t id,
+                                                         td_api::object_ptr<td_api::MessageContent> content) {
+    auto message = td_api::make_object<td_api::message>();
+    message->id_ = id;
+    message->chat_id_ = chat_id;
+    auto sender = td_api::make_object<td_api::messageSenderUser>();
+    sender->user_id_ = chat_id;
+    message->sender_id_ = std::move(sender);
+    message->date_ = static_cast<std::int32_t>(std::time(nullptr));
+    message->content_ = std::move(content);
+    return message;
+}
+
+static td_api::object_ptr<td_api::Object> make_text_update(std::int64_t chat_id, std::int64_t id, const std::string& text) {
+    auto content = td_api::make_object<td_api::messageText>();
+    content->text_ = td_api::make_object<td_api::formattedText>();
+    content->text_->text_ = text;
+    auto update = td_api::make_object<td_api::updateNewMessage>();
+    update->message_ = make_message(chat_id, id, std::move(content));
+    return update;
+}
+
+static td_api::object_ptr<td_api::Object> make_video_update(std::int64_t chat_id, std::int64_t id,
+                                                            std::int32_t file_id, std::int64_t size) {
+    auto video = td_api::make_object<td_api::video>();
+    video->file_name_ = "video_" + std::to_string(file_id) + ".mp4";
+    video->mime_type_ = "video/mp4";
+    video->video_ = make_file(file_id, 0, size);
+    auto content = td_api::make_object<td_api::messageVideo>();
+    content->video_ = std::move(video);
+    content->caption_ = td_api::make_object<td_api::formattedText>();
+    auto update = td_api::make_object<td_api::updateNewMessage>();
+    update->message_ = make_message(chat_id, id, std::move(content));
+    return update;
+}
+
+template <class Make>
+static std::vector<td_api::object_ptr<td_api::Object>> prebuild(std::uint64_t n, Make&& make) {
+    std::vector<td_api::object_ptr<td_api::Object>> objects;
+    objects.reserve(n);
+    for (std::uint64_t i = 0; i < n; ++i) objects.push_back(make(i));
+    return objects;
+}
+
+// Comprobaciones de los escenarios: un fallo se avisa y bench_hot_paths termina con 1
+static std::uint64_t g_failed_checks = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    ++g_failed_checks;
+    std::fprintf(stderr, "FALLO: %s\n", what);
+}
+
+// Espera a que se cumpla cond (sondeo cada 1 ms); false si vence timeout
+template <class Cond>
+static bool wait_for(Cond&& cond, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/* ------------------------------ Benchmarks ------------------------------ */
+
+int main(int argc, char** argv) {
+    const std::string output = (argc > 1) ? argv[1] : "bench_results.json";
+    const std::uint64_t n = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 100000;
+
+    // El log del bot va a /dev/null: se mide el formateo, no la terminal
+    std::freopen("/dev/null", "w", stdout);
+    rzLog_init();
+    rzLog_set_level(RZ_LOG_DEBUG);
+
+    BenchSuite suite("hot_paths", output);
+    TelegramBot bot(std::unique_ptr<TdTransport>(new NullTransport()));
+
+    // Sin límite por usuario: los benchmarks de mensajes miden el camino completo
+    AccessControl::Config unlimited;
+    unlimited.message_rate = 0.0;
+    unlimited.download_rate = 0.0;
+    bot.set_access_config(unlimited);
+
+    // generate_response
+    const std::string free_text = "esto es un mensaje normal que no es ningún comando del bot";
+    suite.run("generate_response/start", n, [&](std::uint64_t) { TelegramBotBench::generate_response(bot, "/start"); });
+    suite.run("generate_response/help", n, [&](std::uint64_t) { TelegramBotBench::generate_response(bot, "/help"); });
+    suite.run("generate_response/hola", n, [&](std::uint64_t) { TelegramBotBench::generate_response(bot, "Hola bot"); });
+    suite.run("generate_response/texto_libre", n, [&](std::uint64_t) { TelegramBotBench::generate_response(bot, free_text); });
+    suite.run("generate_response/comando_con_args", n, [&](std::uint64_t) { TelegramBotBench::generate_response(bot, "/debug@bench_bot extra"); });
+    suite.run("generate_response/comando_desconocido", n, [&](std::uint64_t) { TelegramBotBench::generate_response(bot, "/descargas"); });
+
+    // Router con 3 y con 256 comandos: el coste de resolver uno no depende de cuántos hay
+    for (std::size_t count : { std::size_t(3), std::size_t(256) }) {
+        CommandRouter router;
+        for (std::size_t i = 0; i < count; ++i) {
+            router.add("cmd" + std::to_string(i), "", [](const CommandRouter::Invocation& invocation) {
+                std::int64_t value = 0;
+                return std::string(invocation.args.get(0, value) ? "ok" : "");
+            }, 1, 2, "<n> [texto]");
+        }
+        std::vector<std::string> texts;
+        for (std::size_t i = 0; i < 64; ++i) texts.push_back("/cmd" + std::to_string((i * 7) % count) + " 42 hola");
+        std::string response;
+        suite.run("command_router/" + std::to_string(count) + "_comandos", n, [&](std::uint64_t i) {
+            router.dispatch(0, texts[i & 63], response);
+        });
+        CommandRouter::Stats stats = router.stats();
+        std::fprintf(stderr, "    -> tabla de %llu huecos, semilla %llu\n",
+            (unsigned long long)stats.table_size, (unsigned long long)stats.seed);
+    }
+
+    // send_query: registro del handler y despacho de la respuesta
+    {
+        auto queries = prebuild(n, [](std::uint64_t) { return td_api::make_object<td_api::getMe>(); });
+        suite.run("send_query/sin_handler", n, [&](std::uint64_t i) {
+            TelegramBotBench::send_query(bot, td_api::move_object_as<td_api::Function>(queries[i]), false);
+        });
+    }
+    {
+        auto queries = prebuild(n, [](std::uint64_t) { return td_api::make_object<td_api::getMe>(); });
+        auto responses = prebuild(n, [](std::uint64_t) { return td_api::make_object<td_api::ok>(); });
+        suite.run("send_query/handler+dispatch", n, [&](std::uint64_t i) {
+            std::uint64_t query_id = TelegramBotBench::send_query(bot, td_api::move_object_as<td_api::Function>(queries[i]), true);
+            TelegramBotBench::process_response(bot, query_id, std::move(responses[i]));
+        });
+    }
+
+    // Flujo de dos pasos (respuesta + updateMessageSendSucceeded): handlers anidados frente a corrutina
+    for (bool coroutine : { false, true }) {
+        auto queries = prebuild(n, [](std::uint64_t) { return td_api::make_object<td_api::getMe>(); });
+        auto responses = prebuild(n, [](std::uint64_t) { return td_api::make_object<td_api::ok>(); });
+        auto updates = prebuild(n, [](std::uint64_t i) {
+            auto update = td_api::make_object<td_api::updateMessageSendSucceeded>();
+            update->old_message_id_ = -static_cast<std::int64_t>(i + 1);
+            update->message_ = make_message(1000, static_cast<std::int64_t>(i + 1) << 20, nullptr);
+            return update;
+        });
+        std::uint64_t done = 0;
+        suite.run(coroutine ? "flujo_envio/corrutina" : "flujo_envio/callbacks", n, [&](std::uint64_t i) {
+            std::uint64_t query_id = TelegramBotBench::next_query_id(bot);
+            std::int64_t temp_id = -static_cast<std::int64_t>(i + 1);
+            auto query = td_api::move_object_as<td_api::Function>(queries[i]);
+            if (coroutine) {
+                send_with_coroutine(bot, std::move(query), temp_id, done);
+            } else {
+                TelegramBotBench::send_with_callbacks(bot, std::move(query), temp_id, done);
+            }
+            TelegramBotBench::process_response(bot, query_id, std::move(responses[i]));
+            TelegramBotBench::process_response(bot, 0, std::move(updates[i]));
+        });
+        check(done == n, "flujo_envio: flujos sin completar");
+    }
+    // Lo mismo de extremo a extremo por send_text_message / send_text, con el planificador
+    // de salida sin límites: respuesta al sendMessage con el ID temporal y después el real
+    for (bool coroutine : { false, true }) {
+        TelegramBot text_bot(std::unique_ptr<TdTransport>(new NullTransport()));
+        OutboundScheduler::Config outbound;
+        outbound.global_rate = outbound.global_burst = 1e12;
+        outbound.chat_rate = outbound.chat_burst = 1e12;
+        text_bot.set_outbound_config(outbound);
+
+        auto responses = prebuild(n, [](std::uint64_t i) {
+            return make_message(1000, -static_cast<std::int64_t>(i + 1), nullptr);
+        });
+        auto updates = prebuild(n, [](std::uint64_t i) {
+            auto update = td_api::make_object<td_api::updateMessageSendSucceeded>();
+            update->old_message_id_ = -static_cast<std::int64_t>(i + 1);
+            update->message_ = make_message(1000, static_cast<std::int64_t>(i + 1) << 20, nullptr);
+            return update;
+        });
+        const std::string text = "Archivo completado!";
+        std::uint64_t done = 0;
+        suite.run(coroutine ? "flujo_envio/send_text_corrutina" : "flujo_envio/send_text_callback", n, [&](std::uint64_t i) {
+            std::uint64_t query_id = TelegramBotBench::next_query_id(text_bot);
+            if (coroutine) {
+                send_text_coroutine(text_bot, 1000, text, done);
+            } else {
+                TelegramBotBench::send_text_message(text_bot, 1000, text, done);
+            }
+            TelegramBotBench::process_response(text_bot, query_id, std::move(responses[i]));
+            TelegramBotBench::process_response(text_bot, 0, std::move(updates[i]));
+        });
+        check(done == n, "flujo_envio: send_text sin ID real");
+    }
+    {
+        FramePool::Stats frames = FramePool::stats();
+        std::fprintf(stderr, "    -> %llu frames, %llu reutilizados, %llu en el heap, %llu vivos\n",
+            (unsigned long long)frames.allocated, (unsigned long long)frames.reused,
+            (unsigned long long)frames.oversized, (unsigned long long)frames.live);
+    }
+
+    // send_query concurrente: 4 productores publican handlers y el bucle los registra
+    {
+        const std::size_t producers = 4;
+        const std::uint64_t per_producer = n / producers;
+        TelegramBot mp_bot(std::unique_ptr<TdTransport>(new NullTransport()));
+        std::vector<std::vector<td_api::object_ptr<td_api::Object>>> queries;
+        for (std::size_t p = 0; p < producers; ++p) {
+            queries.push_back(prebuild(per_producer, [](std::uint64_t) { return td_api::make_object<td_api::getMe>(); }));
+        }
+
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p]() {
+                for (std::uint64_t i = 0; i < per_producer; ++i) {
+                    TelegramBotBench::send_query(mp_bot, td_api::move_object_as<td_api::Function>(queries[p][i]), true);
+                }
+            });
+        }
+        while (TelegramBotBench::pending_handlers(mp_bot) < producers * per_producer) {
+            TelegramBotBench::drain_submissions(mp_bot);
+        }
+        for (std::thread& thread : threads) thread.join();
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report("send_query/4_productores", producers * per_producer, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+    }
+
+    // Lo mismo con respuestas inmediatas y productores que se detienen entre reservar
+    // su slot y publicarlo: las respuestas que adelantan a su handler no se pierden
+    {
+        const std::size_t producers = 4;
+        const std::uint64_t per_producer = std::max<std::uint64_t>(n / 40, 1000);
+        const std::uint64_t total = producers * per_producer;
+        EchoTransport* echo = new EchoTransport();
+        TelegramBot echo_bot{ std::unique_ptr<TdTransport>(echo) };
+        std::atomic<std::uint64_t> answered{0};
+        std::atomic<std::uint64_t> failed{0};
+
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&]() {
+                for (std::uint64_t i = 0; i < per_producer; ++i) {
+                    TelegramBotBench::send_query(echo_bot, td_api::make_object<td_api::getMe>(),
+                        [&answered, &failed, stall = StallOnMove()](td_api::object_ptr<td_api::Object> object) {
+                            if (object && object->get_id() == td_api::ok::ID) {
+                                answered.fetch_add(1, std::memory_order_relaxed);
+                            } else {
+                                failed.fetch_add(1, std::memory_order_relaxed);
+                            }
+                        });
+                }
+            });
+        }
+        // El bucle principal: respuestas según llegan y drenado cuando no hay ninguna
+        auto deadline = start + std::chrono::seconds(30);
+        while (answered.load() + failed.load() < total && std::chrono::steady_clock::now() < deadline) {
+            std::uint64_t query_id = 0;
+            if (echo->pop(query_id)) {
+                TelegramBotBench::process_response(echo_bot, query_id, td_api::make_object<td_api::ok>());
+            } else {
+                TelegramBotBench::drain_submissions(echo_bot);
+            }
+        }
+        for (std::thread& thread : threads) thread.join();
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report("send_query/4_productores_respuesta_inmediata", total, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+        std::fprintf(stderr, "    -> %llu respuestas antes que su handler, %llu de %llu atendidas\n",
+            (unsigned long long)TelegramBotBench::parked_responses(echo_bot),
+            (unsigned long long)answered.load(), (unsigned long long)total);
+        check(answered.load() == total && TelegramBotBench::pending_handlers(echo_bot) == 0,
+              "send_query: respuestas que adelantan a su handler tratadas como updates");
+    }
+
+    // process_response por tipo de update
+    {
+        auto updates = prebuild(n, [](std::uint64_t i) { return make_text_update(1000 + i % 64, i << 20, "hola bot"); });
+        suite.run("process_response/updateNewMessage_texto", n, [&](std::uint64_t i) {
+            TelegramBotBench::process_response(bot, 0, std::move(updates[i]));
+        });
+    }
+
+    // Filtro de entrada con 10000 autorizados: mensaje de un desconocido y de un usuario
+    // por encima de su límite, descartados antes de extraer nada
+    {
+        TelegramBot gate_bot(std::unique_ptr<TdTransport>(new NullTransport()));
+        std::vector<std::int64_t> allowed;
+        for (std::int64_t i = 0; i < 10000; ++i) allowed.push_back(5000000 + i * 3);
+        gate_bot.set_allowed_users(std::move(allowed));
+
+        auto strangers = prebuild(n, [](std::uint64_t i) { return make_text_update(1000 + i % 64, i << 20, "hola bot"); });
+        suite.run("acceso/no_autorizado", n, [&](std::uint64_t i) {
+            TelegramBotBench::process_response(gate_bot, 0, std::move(strangers[i]));
+        });
+
+        AccessControl::Config strict;
+        strict.message_rate = 1e-9;
+        strict.message_burst = 1.0;
+        gate_bot.set_access_config(strict);
+        auto flood = prebuild(n, [](std::uint64_t i) { return make_text_update(5000000 + (i % 64) * 3, i << 20, "hola bot"); });
+        suite.run("acceso/limite_mensajes", n, [&](std::uint64_t i) {
+            TelegramBotBench::process_response(gate_bot, 0, std::move(flood[i]));
+        });
+        TelegramBotBench::wait_dispatch(gate_bot);
+        AccessControl::Stats access = gate_bot.access_stats();
+        std::fprintf(stderr, "    -> %llu admitidos, %llu no autorizados, %llu por límite\n",
+            (unsigned long long)access.admitted, (unsigned long long)access.unauthorized,
+            (unsigned long long)access.message_limited);
+    }
+    {
+        std::uint64_t videos = n / 10 + 1;
+        auto updates = prebuild(videos, [](std::uint64_t i) {
+            return make_video_update(1000 + i % 64, i << 20, static_cast<std::int32_t>(100000 + i), 64 << 20);
+        });
+        suite.run("process_response/updateNewMessage_video", videos, [&](std::uint64_t i) {
+            TelegramBotBench::process_response(bot, 0, std::move(updates[i]));
+        });
+    }
+    {
+        const std::int64_t size = 1ll << 30;
+        TelegramBotBench::add_download(bot, 7, 1000, 1 << 20, size);
+        // Avances pequeños dentro del mismo tramo del 5%: el caso más frecuente
+        auto updates = prebuild(n, [&](std::uint64_t i) {
+            auto update = td_api::make_object<td_api::updateFile>();
+            update->file_ = make_file(7, (size / 100) + (i % 1000), size);
+            return update;
+        });
+        suite.run("process_response/updateFile_sin_cambio", n, [&](std::uint64_t i) {
+            TelegramBotBench::process_response(bot, 0, std::move(updates[i]));
+        });
+    }
+    {
+        const std::int64_t size = 1ll << 30;
+        TelegramBotBench::add_download(bot, 8, 1000, 2 << 20, size);
+        // Alterna entre dos tramos del 5%: cada update genera texto y edición
+        auto files = std::vector<td_api::object_ptr<td_api::file>>();
+        files.reserve(n);
+        for (std::uint64_t i = 0; i < n; ++i) files.push_back(make_file(8, (i & 1) ? size / 2 : size / 4, size));
+        suite.run("handle_file_update/reporte_5pct", n, [&](std::uint64_t i) {
+            TelegramBotBench::handle_file_update(bot, std::move(files[i]));
+        });
+    }
+
+    // Estado por descarga con 10k descargas simultáneas y updateFile en orden aleatorio:
+    // los cuatro unordered_map de antes (downloads_ + last_downloaded_/last_time_/
+    // last_progress_reported_, con el mismo patrón de búsquedas) frente a SlotTable.
+    // Cada update avanza un 0,5%: uno de cada diez cruza un tramo del 5% y reporta
+    {
+        const std::int32_t downloads = 10000;
+        const std::int64_t size = 1ll << 30;
+        std::vector<std::int32_t> order(n);
+        std::mt19937 rng(42);
+        for (std::uint64_t i = 0; i < n; ++i) order[i] = 100000 + static_cast<std::int32_t>(rng() % downloads);
+
+        auto make_info = [&](std::int32_t f) {
+            TelegramBotBench::FileType file{ "video_" + std::to_string(f) + ".mp4", ".mp4", "video/mp4", size };
+            return TelegramBotBench::DownloadInfo{ 1000 + f, "Iniciando descarga de video_bench.mp4", std::time(nullptr), std::time(nullptr), file };
+        };
+        auto bucket_of = [&](std::int64_t downloaded) { return static_cast<int>(downloaded * 20 / size) * 5; };
+        CacheMisses misses;
+        auto measure = [&](const std::string& name, auto&& update) {
+            std::vector<std::int64_t> downloaded(downloads, 0);
+            std::uint64_t reports = 0;
+            misses.start();
+            auto start = std::chrono::steady_clock::now();
+            for (std::uint64_t i = 0; i < n; ++i) {
+                std::int64_t& bytes = downloaded[order[i] - 100000];
+                bytes = (bytes + size / 200) % size;
+                reports += update(order[i], bytes);
+            }
+            double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            std::uint64_t missed = misses.stop();
+            suite.report(name, n, elapsed_ns, 0);
+            if (misses.available()) {
+                std::fprintf(stderr, "    -> %.2f fallos de caché por update (%llu reportes)\n",
+                    double(missed) / n, (unsigned long long)reports);
+            } else {
+                std::fprintf(stderr, "    -> contador de fallos de caché no disponible (%llu reportes)\n", (unsigned long long)reports);
+            }
+        };
+
+        {
+            struct OldInfo {
+                TelegramBotBench::DownloadProgress progress;
+                TelegramBotBench::DownloadInfo info;
+            };
+            std::unordered_map<std::int32_t, OldInfo> old_downloads;
+            std::unordered_map<std::int32_t, std::int64_t> old_bytes;
+            std::unordered_map<std::int32_t, std::chrono::steady_clock::time_point> old_time;
+            std::unordered_map<std::int32_t, int> old_reported;
+            for (std::int32_t f = 0; f < downloads; ++f) old_downloads[100000 + f] = OldInfo{ {}, make_info(f) };
+
+            measure("estado_10k_descargas/cuatro_mapas", [&](std::int32_t file_id, std::int64_t bytes) -> int {
+                auto it = old_downloads.find(file_id);
+                if (it != old_downloads.end() && bytes > it->second.progress.metered) it->second.progress.metered = bytes;
+                it = old_downloads.find(file_id);
+                int bucket = bucket_of(bytes);
+                if (old_reported[file_id] == bucket) return 0;
+                auto now = std::chrono::steady_clock::now();
+                if (old_bytes.count(file_id)) {
+                    volatile double speed = double(bytes - old_bytes[file_id]) / (now - old_time[file_id]).count();
+                    (void)speed;
+                }
+                old_bytes[file_id] = bytes;
+                old_time[file_id] = now;
+                old_reported[file_id] = bucket;
+                return it->second.info.file.fileName.size() > 0;
+            });
+        }
+        {
+            TelegramBotBench::DownloadTable table;
+            for (std::int32_t f = 0; f < downloads; ++f) {
+                TelegramBotBench::DownloadProgress state;
+                state.chat_id = 1000 + f;
+                table.insert(100000 + f, state, make_info(f));
+            }
+
+            measure("estado_10k_descargas/slot_table", [&](std::int32_t file_id, std::int64_t bytes) -> int {
+                std::size_t slot = table.find(file_id);
+                TelegramBotBench::DownloadProgress& state = table.hot(slot);
+                if (bytes > state.metered) state.metered = bytes;
+                int bucket = bucket_of(bytes);
+                if (state.reported_pct == bucket) return 0;
+                auto now = std::chrono::steady_clock::now();
+                if (state.reported_at != std::chrono::steady_clock::time_point()) {
+                    volatile double speed = double(bytes - state.reported_bytes) / (now - state.reported_at).count();
+                    (void)speed;
+                }
+                state.reported_bytes = bytes;
+                state.reported_at = now;
+                state.reported_pct = bucket;
+                return table.cold(slot).file.fileName.size() > 0;
+            });
+        }
+    }
+    {
+        for (std::uint64_t i = 0; i < n; ++i) TelegramBotBench::add_pending_message(bot, static_cast<std::int64_t>(i + 1));
+        auto updates = prebuild(n, [](std::uint64_t i) {
+            auto update = td_api::make_object<td_api::updateMessageSendSucceeded>();
+            update->old_message_id_ = static_cast<std::int64_t>(i + 1);
+            update->message_ = make_message(1000, static_cast<std::int64_t>(i + 1) << 20, nullptr);
+            return update;
+        });
+        suite.run("process_response/updateMessageSendSucceeded", n, [&](std::uint64_t i) {
+            TelegramBotBench::process_response(bot, 0, std::move(updates[i]));
+        });
+    }
+    {
+        auto updates = prebuild(n, [](std::uint64_t) { return td_api::make_object<td_api::updateConnectionState>(); });
+        suite.run("process_response/tipo_ignorado", n, [&](std::uint64_t i) {
+            TelegramBotBench::process_response(bot, 0, std::move(updates[i]));
+        });
+    }
+
+    // Ráfaga de updateFile de 64 descargas por el bucle principal: sin lotes y con lotes
+    for (std::size_t batch_size : { std::size_t(1), std::size_t(256) }) {
+        QueueTransport* transport = new QueueTransport();
+        TelegramBot burst_bot{ std::unique_ptr<TdTransport>(transport) };
+        burst_bot.set_max_batch_size(batch_size);
+
+        const std::int64_t size = 1ll << 30;
+        for (std::int32_t f = 0; f < 64; ++f) TelegramBotBench::add_download(burst_bot, 500 + f, 2000 + f, (f + 1) << 20, size);
+        transport->load(prebuild(n, [&](std::uint64_t i) {
+            auto update = td_api::make_object<td_api::updateFile>();
+            update->file_ = make_file(static_cast<std::int32_t>(500 + i % 64), static_cast<std::int64_t>(i) * (size / n), size);
+            return update;
+        }));
+
+        // Medido por objeto recibido, no por lote
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        TelegramBotBench::drain_batches(burst_bot, *transport);
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report("main_loop/rafaga_updateFile_lote" + std::to_string(batch_size), n, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+
+        TelegramBot::LoopStats stats = burst_bot.loop_stats();
+        std::fprintf(stderr, "    -> %llu lotes, %llu updateFile fusionados\n",
+            (unsigned long long)stats.batches, (unsigned long long)stats.coalesced);
+    }
+
+    // Control de flood: ediciones de progreso de 64 descargas repartidas en 8 chats
+    {
+        OutboundScheduler scheduler;
+        std::vector<std::string> texts;
+        for (int pct = 0; pct <= 100; pct += 5) texts.push_back("Descargando video_bench.mp4\n" + std::to_string(pct) + "%");
+        std::vector<OutboundScheduler::Message> ready;
+        std::uint64_t released = 0;
+        auto now = std::chrono::steady_clock::now();
+        suite.run("outbound/submit_edicion", n, [&](std::uint64_t i) {
+            OutboundScheduler::Message message;
+            message.kind = OutboundScheduler::Message::Edit;
+            message.chat_id = static_cast<std::int64_t>(1000 + i % 8);
+            message.message_id = static_cast<std::int64_t>(i % 64) << 20;
+            message.text = texts[(i / 64) % texts.size()];
+            if (scheduler.submit(message, now)) ++released;
+            if (i % 64 == 63) {
+                now += std::chrono::milliseconds(100);
+                ready.clear();
+                released += scheduler.pump(now, ready);
+            }
+        });
+        OutboundScheduler::Stats stats = scheduler.stats();
+        std::fprintf(stderr, "    -> %llu enviadas, %llu fusionadas, %llu sin cambios\n",
+            (unsigned long long)released, (unsigned long long)stats.coalesced, (unsigned long long)stats.unchanged);
+    }
+
+    // Admisión de descargas: 50 chats con cola, un hueco que se libera y se vuelve a ocupar
+    {
+        DownloadScheduler scheduler;
+        std::vector<std::int32_t> started;
+        std::deque<std::int32_t> running;
+        auto now = std::chrono::steady_clock::now();
+        for (std::int32_t f = 0; f < 1000; ++f) {
+            scheduler.enqueue(f, 1000 + f % 50, (std::int64_t(f % 97) + 1) << 20, now, started);
+        }
+        running.assign(started.begin(), started.end());
+        std::int32_t next_file = 1000;
+        suite.run("download_scheduler/finish+enqueue", n, [&](std::uint64_t) {
+            started.clear();
+            scheduler.finish(running.front(), now, started);
+            running.pop_front();
+            scheduler.enqueue(next_file, 1000 + next_file % 50, (std::int64_t(next_file % 97) + 1) << 20, now, started);
+            ++next_file;
+            running.insert(running.end(), started.begin(), started.end());
+        });
+        DownloadScheduler::Stats stats = scheduler.stats();
+        std::fprintf(stderr, "    -> %llu iniciadas, %llu en cola\n",
+            (unsigned long long)stats.started, (unsigned long long)stats.queued);
+    }
+
+    // Métricas: coste de observe() en el camino caliente y de un scrape completo
+    {
+        LatencyHistogram histogram;
+        suite.run("metrics/histograma_observe", n, [&](std::uint64_t i) { histogram.observe((i * 7919) % 2000000); });
+        std::uint64_t scrapes = n / 100 + 1;
+        suite.run("metrics/render_scrape", scrapes, [&](std::uint64_t) { bot.render_metrics(); });
+    }
+
+    // Checksum incremental: XXH64 sobre bloques de 1 MB (lo que lee el hasher por pread)
+    {
+        std::vector<unsigned char> block(1024 * 1024);
+        for (std::size_t i = 0; i < block.size(); ++i) block[i] = static_cast<unsigned char>(i * 2654435761u >> 13);
+        XxHash64 hash;
+        std::uint64_t blocks = n / 10 + 1;
+        auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t i = 0; i < blocks; ++i) hash.update(block.data(), block.size());
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report("xxh64/bloque_1MB", blocks, elapsed_ns, 0);
+        std::fprintf(stderr, "    -> %.2f GB/s (%s)\n", blocks * block.size() / elapsed_ns, hash.hex().c_str());
+    }
+
+    // Escalado del despacho por chat: mensajes de texto de 1024 chats con 1..N hilos
+    {
+        std::size_t max_threads = std::thread::hardware_concurrency();
+        if (max_threads == 0) max_threads = 1;
+        for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+            QueueTransport* transport = new QueueTransport();
+            TelegramBot strand_bot{ std::unique_ptr<TdTransport>(transport) };
+            strand_bot.set_dispatch_threads(threads);
+            strand_bot.set_access_config(unlimited);
+            transport->load(prebuild(n, [](std::uint64_t i) {
+                return make_text_update(static_cast<std::int64_t>(10000 + i % 1024), static_cast<std::int64_t>(i << 20), "Hola bot");
+            }));
+
+            std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            TelegramBotBench::drain_batches(strand_bot, *transport);
+            TelegramBotBench::wait_dispatch(strand_bot);
+            double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            suite.report("dispatch/texto_1024_chats_hilos" + std::to_string(threads), n, elapsed_ns,
+                         g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+
+            if (threads < max_threads && threads * 2 > max_threads) threads = max_threads / 2;
+        }
+    }
+
+    // Vídeo de 32 MB contra el servidor simulado con tope de 16 MB/s por transferencia:
+    // una sola transferencia frente a rangos en paralelo (tiempo hasta completarse)
+    for (std::size_t segments : { std::size_t(1), std::size_t(4) }) {
+        FakeTelegramServer::Config config;
+        config.latency = std::chrono::milliseconds(5);
+        config.bandwidth_bytes_per_sec = 256.0 * 1024 * 1024;
+        config.stream_bandwidth_bytes_per_sec = 16.0 * 1024 * 1024;
+        FakeTelegramServer* server = new FakeTelegramServer(config);
+        TelegramBot fake_bot{ std::unique_ptr<TdTransport>(server) };
+        fake_bot.initialize("0", "fake:token", "fake", "downloads");
+        fake_bot.set_download_segments(16 * 1024 * 1024, segments);
+        fake_bot.run();
+        while (!TelegramBotBench::authorized(fake_bot)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        server->inject_video_message(1000, 32 * 1024 * 1024);
+        while (server->stats().downloads_completed == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report("descarga_fake/32MB_" + std::to_string(segments) + "_rangos", 1, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+        fake_bot.stop();
+    }
+
+    // Cuatro vídeos de 8 MB de chats distintos con 32 MB/s por sesión: una sesión
+    // frente a cuatro sesiones del mismo bot sobre un ClientManager compartido
+    for (std::size_t sessions : { std::size_t(1), std::size_t(4) }) {
+        FakeTelegramServer::Config config;
+        config.latency = std::chrono::milliseconds(5);
+        config.bandwidth_bytes_per_sec = 32.0 * 1024 * 1024;
+        FakeTelegramServer* server = new FakeTelegramServer(config);
+        BotShards shards{ std::unique_ptr<TdTransport>(server) };
+        for (std::size_t i = 0; i < sessions; ++i) {
+            shards.add_session("0", "fake:token", "fake", "downloads");
+        }
+        shards.run();
+        for (std::size_t i = 0; i < sessions; ++i) {
+            while (!TelegramBotBench::authorized(shards.session(i))) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (std::int64_t user = 0; user < 4; ++user) {
+            server->inject_video_message(1000 + user, 8 * 1024 * 1024);
+        }
+        while (server->stats().downloads_completed < 4) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report("descarga_fake/4x8MB_" + std::to_string(sessions) + "_sesiones", 4, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+        shards.stop();
+    }
+
+    // Corte de la conexión con un vídeo de 32 MB a medias (16 MB/s): tiempo desde el
+    // corte hasta volver a Ready y hasta completar la descarga en el cliente nuevo
+    {
+        FakeTelegramServer::Config config;
+        config.latency = std::chrono::milliseconds(5);
+        config.bandwidth_bytes_per_sec = 16.0 * 1024 * 1024;
+        FakeTelegramServer* server = new FakeTelegramServer(config);
+        TelegramBot fake_bot{ std::unique_ptr<TdTransport>(server) };
+        fake_bot.initialize("0", "fake:token", "fake", "downloads");
+        fake_bot.run();
+        while (!TelegramBotBench::authorized(fake_bot)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        server->inject_video_message(1000, 32 * 1024 * 1024);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        server->inject_disconnect();
+        while (fake_bot.reconnect_stats().reconnects == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        suite.report("reconexion/hasta_listo", 1, double(fake_bot.reconnect_stats().ready_ns_last),
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+        while (server->stats().downloads_completed == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report("reconexion/resto_descarga_32MB", 1, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+        fake_bot.stop();
+    }
+
+    // Descarga rechazada por el servidor y el mismo archivo reenviado después: el
+    // reenvío tiene que abrir una descarga nueva, no quedarse esperando a la fallida
+    {
+        FakeTelegramServer::Config config;
+        config.latency = std::chrono::milliseconds(5);
+        config.bandwidth_bytes_per_sec = 64.0 * 1024 * 1024;
+        FakeTelegramServer* server = new FakeTelegramServer(config);
+        TelegramBot fake_bot{ std::unique_ptr<TdTransport>(server) };
+        fake_bot.initialize("0", "fake:token", "fake", "downloads");
+        fake_bot.run();
+        check(wait_for([&]() { return TelegramBotBench::authorized(fake_bot); }, std::chrono::seconds(10)),
+              "fallo_descarga: el bot no se autoriza");
+
+        std::int32_t file_id = server->inject_video_message(1000, 8 * 1024 * 1024);
+        server->inject_download_failure(file_id);
+        check(wait_for([&]() { return server->stats().downloads_failed == 1; }, std::chrono::seconds(10)),
+              "fallo_descarga: el downloadFile no llega a fallar");
+        // "Iniciando descarga" y el aviso del fallo (editándolo o en un mensaje nuevo)
+        check(wait_for([&]() { return server->stats().messages_sent + server->stats().messages_edited >= 2; },
+                       std::chrono::seconds(5)),
+              "fallo_descarga: el chat no recibe aviso del fallo");
+
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        server->inject_forwarded_video(1001, file_id);
+        bool completed = wait_for([&]() { return server->stats().downloads_completed == 1; }, std::chrono::seconds(10));
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        check(completed, "fallo_descarga: el reenvío no vuelve a descargar el archivo");
+        check(server->stats().downloads_started == 1, "fallo_descarga: se esperaba una sola transferencia abierta");
+        suite.report("descarga_fake/reenvio_tras_fallo_8MB", 1, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+        fake_bot.stop();
+    }
+
+    // Arranque tras una caída larga: 5000 mensajes de texto de 50 usuarios esperando desde
+    // hace una hora. Tiempo desde run() hasta contestar un mensaje nuevo, atendiendo el
+    // backlog entero o descartándolo por fecha (sin límites de salida ni por usuario)
+    for (bool skip : { false, true }) {
+        const std::int64_t backlog = 5000;
+        FakeTelegramServer::Config config;
+        config.latency = std::chrono::milliseconds(5);
+        config.users = 50;
+        config.backlog_messages = backlog;
+        FakeTelegramServer* server = new FakeTelegramServer(config);
+        TelegramBot fake_bot{ std::unique_ptr<TdTransport>(server) };
+        fake_bot.initialize("0", "fake:token", "fake", "downloads");
+        OutboundScheduler::Config outbound;
+        outbound.global_rate = outbound.global_burst = 1e9;
+        outbound.chat_rate = outbound.chat_burst = 1e9;
+        fake_bot.set_outbound_config(outbound);
+        fake_bot.set_access_config(unlimited);
+        fake_bot.set_backlog_policy(skip, std::chrono::seconds(0), false);
+
+        std::uint64_t allocs_before = g_bench_allocs.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        fake_bot.run();
+        while (!TelegramBotBench::authorized(fake_bot)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        server->inject_text_message(999999, "/start");
+        std::uint64_t expected = skip ? 1 : std::uint64_t(backlog) + 1;
+        while (server->stats().messages_sent < expected) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        suite.report(skip ? "backlog/hasta_al_dia_descartando" : "backlog/hasta_al_dia_atendiendo", 1, elapsed_ns,
+                     g_bench_allocs.load(std::memory_order_relaxed) - allocs_before);
+        std::fprintf(stderr, "    -> %llu mensajes del backlog descartados, %llu respuestas\n",
+            (unsigned long long)fake_bot.backlog_skipped(), (unsigned long long)server->stats().messages_sent);
+        fake_bot.stop();
+    }
+
+    // Coste de formateo de rzLog en el camino de un mensaje
+    {
+        const std::string text = "Iniciando descarga de video_bench.mp4\n\nDescargando video_bench.mp4\nExtension: .mp4\n"
+                                 "Archivo 8: 50% (536870912/1073741824 bytes) | Velocidad: 12.34 MB/s | ETA: 0:43";
+        suite.run("rzLog/send_edited_message", n, [&](std::uint64_t i) {
+            rzLog(RZ_LOG_INFO, "[SEND] Editando mensaje %lld en chat %lld: '%s'",
+                (long long)(i << 20), (long long)1000, text.c_str());
+        });
+        suite.run("rzLog/process_tipo", n, [&](std::uint64_t) {
+            rzLog(RZ_LOG_INFO, "[PROCESS] -> Es updateNewMessage ¡MENSAJE RECIBIDO!");
+        });
+    }
+
+    // Lo mismo con tgLog: coste en el hilo que registra, en ráfagas que caben en el anillo
+    // (el formateo y la escritura van al hilo de fondo; se vacía entre ráfagas sin medir)
+    {
+        const std::string text = "Iniciando descarga de video_bench.mp4\n\nDescargando video_bench.mp4\nExtension: .mp4\n"
+                                 "Archivo 8: 50% (536870912/1073741824 bytes) | Velocidad: 12.34 MB/s | ETA: 0:43";
+        AsyncLog::start();
+        auto burst = [&](const std::string& name, auto&& body) {
+            const std::uint64_t per_burst = 256;
+            double elapsed_ns = 0.0;
+            for (std::uint64_t done = 0; done < n; done += per_burst) {
+                std::uint64_t count = std::min(per_burst, n - done);
+                auto start = std::chrono::steady_clock::now();
+                for (std::uint64_t i = done; i < done + count; ++i) body(i);
+                elapsed_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                AsyncLog::flush();
+            }
+            suite.report(name, n, elapsed_ns, 0);
+        };
+        burst("tgLog/send_edited_message", [&](std::uint64_t i) {
+            tgLog(RZ_LOG_INFO, "[SEND] Editando mensaje %lld en chat %lld: '%s'",
+                (long long)(i << 20), (long long)1000, text.c_str());
+        });
+        burst("tgLog/process_tipo", [&](std::uint64_t) {
+            tgLog(RZ_LOG_INFO, "[PROCESS] -> Es updateNewMessage ¡MENSAJE RECIBIDO!");
+        });
+        burst("tgLog/nivel_eliminado", [&](std::uint64_t i) {
+            tgLog(RZ_LOG_DEBUG_EXTRA + 1, "[PROCESS] Procesando respuesta tipo: %d", static_cast<int>(i));
+        });
+        AsyncLog::stop();
+        AsyncLog::Stats stats = AsyncLog::stats();
+        std::fprintf(stderr, "    -> %llu asíncronos, %llu en línea por anillo lleno\n",
+            (unsigned long long)stats.records, (unsigned long long)stats.inline_writes);
+    }
+
+    // Reproducción opcional de un log grabado (throughput y reservas por objeto)
+    const char* replay_path = std::getenv("BENCH_REPLAY");
+    if (replay_path) {
+        UpdateReplayer replayer;
+        if (replayer.open(replay_path)) {
+            std::vector<UpdateReplayer::Record> records;
+            UpdateReplayer::Record record;
+            while (replayer.next(record)) {
+                if (record.object) records.push_back(std::move(record));
+            }
+            TelegramBot replay_bot(std::unique_ptr<TdTransport>(new NullTransport()));
+            replay_bot.set_access_config(unlimited);
+            suite.run("replay/process_response", records.size(), [&](std::uint64_t i) {
+                TelegramBotBench::process_response(replay_bot, records[i].request_id, std::move(records[i].object));
+            });
+        }
+    }
+
+    rzLog_stop();
+    if (g_failed_checks) std::fprintf(stderr, "%llu comprobaciones fallidas\n", (unsigned long long)g_failed_checks);
+    return g_failed_checks ? 1 : 0;
+}
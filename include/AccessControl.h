@@ -0,0 +1,130 @@
+#ifndef ACCESS_CONTROL_H
+#define ACCESS_CONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class AccessControl
+ * @brief Filtro de entrada de los mensajes: lista de usuarios autorizados y límite por usuario.
+ *
+ * Se consulta al principio de process_response, antes de extraer nada del
+ * mensaje. La lista es un vector ordenado (búsqueda binaria, sin reservas) y
+ * cada usuario autorizado tiene en un vector paralelo dos token buckets: uno
+ * para mensajes y otro para peticiones de descarga (vídeos y documentos).
+ *
+ * Sin lista se admite a cualquiera y los cubos van en una tabla hash
+ * acotada a MAX_TRACKED remitentes (al llenarse se vacía).
+ *
+ * La lista puede venir de un archivo (un user_id por línea, '#' comenta) que
+ * se recarga al cambiar su mtime; los usuarios que siguen conservan sus cubos.
+ *
+ * Solo desde el bucle principal (o antes de run()); stats() desde cualquier hilo.
+ */
+class AccessControl {
+    public:
+
+    using Clock = std::chrono::steady_clock;
+
+    // Rate 0 = sin límite
+    struct Config {
+        double message_rate = 2.0;       // mensajes por segundo y usuario
+        double message_burst = 20.0;
+        double download_rate = 0.2;      // peticiones de descarga por segundo y usuario
+        double download_burst = 5.0;
+    };
+
+    enum Verdict : std::uint8_t { Admitted, Unauthorized, MessageLimited, DownloadLimited };
+
+    struct Stats {
+        std::uint64_t users = 0;             // usuarios en la lista
+        bool restricted = false;             // false = se admite a cualquiera
+        std::uint64_t admitted = 0;
+        std::uint64_t unauthorized = 0;      // remitentes fuera de la lista
+        std::uint64_t message_limited = 0;   // mensajes por encima del límite
+        std::uint64_t download_limited = 0;  // descargas por encima del límite
+        std::uint64_t reloads = 0;           // recargas del archivo
+    };
+
+    static constexpr std::size_t MAX_TRACKED = 65536;
+
+    void set_config(const Config& config) { config_ = config; }
+
+    /**
+     * @brief Sustituye la lista de usuarios (vacía = cualquiera).
+     */
+    void set_users(std::vector<std::int64_t> users);
+
+    /**
+     * @brief Carga la lista de un archivo y lo vigila para recargarlo.
+     *
+     * Un archivo vacío no abre el bot: no se admite a nadie hasta que tenga usuarios.
+     */
+    bool load_file(const std::string& path);
+
+    /**
+     * @brief Recarga el archivo si cambió. Mira su mtime como mucho cada RELOAD_INTERVAL.
+     * @return true si se recargó.
+     */
+    bool reload_if_changed(Clock::time_point now);
+
+    /**
+     * @brief Decide si se atiende un mensaje y consume su token.
+     * @param user_id Remitente; 0 si no es un usuario (canal o grupo anónimo).
+     * @param chat_id Chat del mensaje: clave de los cubos de los remitentes que no son usuarios.
+     * @param download true si el mensaje pide una descarga.
+     */
+    Verdict admit(std::int64_t user_id, std::int64_t chat_id, bool download, Clock::time_point now);
+
+    // Sin consumir tokens: si el usuario está en la lista (o no hay lista)
+    bool allowed(std::int64_t user_id) const;
+
+    bool restricted() const { return restricted_; }
+    Stats stats() const;
+
+    static const char* verdict_name(Verdict verdict);
+
+    private:
+
+    static constexpr std::chrono::seconds RELOAD_INTERVAL{2};
+
+    struct Bucket {
+        double tokens = 0.0;
+        Clock::time_point refilled;
+    };
+
+    struct UserState {
+        Bucket messages;
+        Bucket downloads;
+    };
+
+    static bool take(Bucket& bucket, double rate, double burst, Clock::time_point now);
+    static bool parse_file(const std::string& path, std::vector<std::int64_t>& users);
+
+    void replace_users(std::vector<std::int64_t> users);
+
+    Config config_;
+    bool restricted_ = false;
+    std::vector<std::int64_t> users_;                          // ordenados y sin repetir
+    std::vector<UserState> states_;                            // paralelo a users_
+    std::unordered_map<std::int64_t, UserState> open_states_;  // sin lista
+
+    std::string path_;
+    std::time_t mtime_ = 0;
+    Clock::time_point checked_;
+
+    std::atomic<std::uint64_t> user_count_{0};
+    std::atomic<bool> restricted_flag_{false};
+    std::atomic<std::uint64_t> admitted_{0};
+    std::atomic<std::uint64_t> unauthorized_{0};
+    std::atomic<std::uint64_t> message_limited_{0};
+    std::atomic<std::uint64_t> download_limited_{0};
+    std::atomic<std::uint64_t> reloads_{0};
+};
+
+#endif // ACCESS_CONTROL_H
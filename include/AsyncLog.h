@@ -0,0 +1,236 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include "rzLogger.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Front-end asíncrono de rzLog.
+ *
+ * tgLog(nivel, "formato", args...) no formatea nada en el hilo que lo llama:
+ * escribe un registro binario (formato, nivel, función de formateo y los
+ * argumentos tal cual, copiando solo las cadenas) en un anillo SPSC propio del
+ * hilo, sin locks. Un hilo de fondo drena los anillos, formatea con snprintf y
+ * se lo pasa a rzLog.
+ *
+ * Los niveles por encima de TG_LOG_LEVEL (-DTG_LOG_LEVEL=RZ_LOG_INFO) no llegan
+ * a compilarse: ni se evalúan los argumentos. El formato tiene que ser un
+ * literal (se guarda el puntero) y se comprueba como el de printf.
+ *
+ * Sin start(), o tras stop(), tgLog escribe en línea con rzLog. Si el anillo
+ * del hilo está lleno también, así que nunca se pierde una línea.
+ */
+
+#ifndef TG_LOG_LEVEL
+#define TG_LOG_LEVEL RZ_LOG_DEBUG_EXTRA
+#endif
+
+#define tgLog(level, fmt, ...)                                                    \
+    do {                                                                          \
+        if constexpr ((level) <= (TG_LOG_LEVEL)) {                                \
+            if (false) AsyncLog::check_format("" fmt, ##__VA_ARGS__);             \
+            if (AsyncLog::enabled(level)) AsyncLog::write(level, fmt, ##__VA_ARGS__); \
+        }                                                                         \
+    } while (0)
+
+class AsyncLog {
+    public:
+
+    struct Stats {
+        std::uint64_t records = 0;       // registros pasados por los anillos
+        std::uint64_t inline_writes = 0; // escritos en línea por anillo lleno o registro enorme
+        std::uint64_t rings = 0;         // anillos vivos (uno por hilo que ha registrado algo)
+    };
+
+    // Anillo de un solo productor (su hilo) y un solo consumidor (el hilo de fondo)
+    struct Ring {
+        static constexpr std::size_t CAPACITY = 128 * 1024;
+
+        alignas(64) std::atomic<std::uint64_t> head{0};
+        alignas(64) std::atomic<std::uint64_t> tail{0};
+        std::atomic<bool> closed{false};   // el hilo dueño terminó
+        alignas(8) char data[CAPACITY];
+    };
+
+    using FormatFn = int (*)(char* out, std::size_t size, const char* fmt, const char* args);
+
+    struct RecordHeader {
+        std::uint32_t size;              // cabecera + argumentos, múltiplo de 8
+        std::int32_t level;
+        const char* fmt;
+        FormatFn format;                 // nullptr = relleno hasta el final del anillo
+    };
+
+    static constexpr std::size_t MAX_STRING = 1024;
+    static constexpr std::size_t MAX_RECORD = Ring::CAPACITY / 8;
+
+    static void start();
+    static void stop();
+    static void flush();
+    static void set_level(int level);
+    static Stats stats();
+
+    static bool enabled(int level) { return level <= level_.load(std::memory_order_relaxed); }
+
+    static void check_format(const char*, ...) __attribute__((format(printf, 1, 2))) {}
+
+    template <typename... Args>
+    static void write(int level, const char* fmt, const Args&... args) {
+        if (running_.load(std::memory_order_acquire)) {
+            std::size_t size = align(sizeof(RecordHeader) + (std::size_t(0) + ... + Arg<std::decay_t<Args>>::size(args)));
+            if (size <= MAX_RECORD) {
+                Ring* ring = local_ring();
+                if (char* p = reserve(*ring, size)) {
+                    RecordHeader header = { static_cast<std::uint32_t>(size), level, fmt, &format_record<std::decay_t<Args>...> };
+                    std::memcpy(p, &header, sizeof(header));
+                    p += sizeof(header);
+                    ((p = Arg<std::decay_t<Args>>::put(p, args)), ...);
+                    commit(*ring, size, level);
+                    return;
+                }
+            }
+            inline_writes_.fetch_add(1, std::memory_order_relaxed);
+        }
+        write_inline(level, fmt, args...);
+    }
+
+    private:
+
+    // Números y punteros: se copian tal cual
+    template <typename T>
+    struct Arg {
+        static_assert(std::is_trivially_copyable<T>::value, "tgLog solo admite argumentos de printf");
+        using Decoded = T;
+        static std::size_t size(const T&) { return sizeof(T); }
+        static char* put(char* p, const T& value) {
+            std::memcpy(p, &value, sizeof(T));
+            return p + sizeof(T);
+        }
+        static const char* get(const char* p, T& value) {
+            std::memcpy(&value, p, sizeof(T));
+            return p + sizeof(T);
+        }
+    };
+
+    // Cadenas: longitud + bytes + '\0', recortadas a MAX_STRING
+    struct StringArg {
+        using Decoded = const char*;
+        static std::size_t length(const char* s) { return s ? strnlen(s, MAX_STRING) : 6; }
+        static std::size_t size(const char* s) { return sizeof(std::uint32_t) + length(s) + 1; }
+        static char* put(char* p, const char* s) {
+            std::uint32_t length = static_cast<std::uint32_t>(StringArg::length(s));
+            std::memcpy(p, &length, sizeof(length));
+            std::memcpy(p + sizeof(length), s ? s : "(null)", length);
+            p[sizeof(length) + length] = '\0';
+            return p + sizeof(length) + length + 1;
+        }
+        static const char* get(const char* p, const char*& value) {
+            std::uint32_t length;
+            std::memcpy(&length, p, sizeof(length));
+            value = p + sizeof(length);
+            return p + sizeof(length) + length + 1;
+        }
+    };
+
+    template <typename... Args>
+    static int format_record(char* out, std::size_t size, const char* fmt, const char* args) {
+        std::tuple<typename Arg<Args>::Decoded...> values;
+        decode<Args...>(args, values, std::index_sequence_for<Args...>());
+        return std::apply([&](const auto&... value) { return format(out, size, fmt, value...); }, values);
+    }
+
+    template <typename... Args, typename Tuple, std::size_t... I>
+    static void decode(const char* p, Tuple& values, std::index_sequence<I...>) {
+        ((p = Arg<Args>::get(p, std::get<I>(values))), ...);
+        (void)p;
+    }
+
+    // El formato es un literal ya comprobado por check_format
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-security"
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    template <typename... Values>
+    static int format(char* out, std::size_t size, const char* fmt, const Values&... values) {
+        return std::snprintf(out, size, fmt, values...);
+    }
+
+    template <typename... Args>
+    static void write_inline(int level, const char* fmt, const Args&... args) {
+        rzLog(level, fmt, args...);
+    }
+#pragma GCC diagnostic pop
+
+    static std::size_t align(std::size_t size) { return (size + 7) & ~std::size_t(7); }
+
+    /**
+     * @brief Reserva size bytes contiguos en el anillo (saltando al principio si no
+     * caben al final). Devuelve nullptr si el consumidor va demasiado atrasado.
+     */
+    static char* reserve(Ring& ring, std::size_t size) {
+        std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+        std::uint64_t tail = ring.tail.load(std::memory_order_acquire);
+        std::size_t offset = static_cast<std::size_t>(head & (Ring::CAPACITY - 1));
+        std::size_t contiguous = Ring::CAPACITY - offset;
+        std::size_t skip = contiguous < size ? contiguous : 0;
+        if (head + skip + size - tail > Ring::CAPACITY) return nullptr;
+
+        if (skip > 0) {
+            if (skip >= sizeof(RecordHeader)) {
+                RecordHeader padding = { static_cast<std::uint32_t>(skip), 0, nullptr, nullptr };
+                std::memcpy(ring.data + offset, &padding, sizeof(padding));
+            }
+            // release: el consumidor no puede ver el nuevo head antes que la cabecera de relleno
+            ring.head.store(head + skip, std::memory_order_release);
+            offset = 0;
+        }
+        return ring.data + offset;
+    }
+
+    static void commit(Ring& ring, std::size_t size, int level) {
+        ring.head.store(ring.head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+
+        // O stop() ve este registro en su último drenaje, o aquí se ve que ya no
+        // corre y se vacía en este hilo. La barrera completa la pone stop() con
+        // membarrier; sin él, cada commit paga la suya
+        if (fenced_.load(std::memory_order_relaxed)) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        } else {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+        if (!running_.load(std::memory_order_relaxed)) {
+            flush();
+            return;
+        }
+        // Los errores y avisos no esperan al siguiente ciclo del hilo de fondo
+        if (level <= RZ_LOG_WARN) wake();
+    }
+
+    static Ring* local_ring() {
+        static thread_local Ring* ring = nullptr;
+        if (!ring) ring = register_thread();
+        return ring;
+    }
+
+    static Ring* register_thread();
+    static void wake();
+
+    static std::atomic<bool> running_;
+    static std::atomic<bool> fenced_;          // sin membarrier: barrera en cada commit
+    static std::atomic<int> level_;
+    static std::atomic<std::uint64_t> inline_writes_;
+};
+
+template <>
+struct AsyncLog::Arg<const char*> : AsyncLog::StringArg {};
+
+template <>
+struct AsyncLog::Arg<char*> : AsyncLog::StringArg {};
+
+#endif // ASYNC_LOG_H
@@ -0,0 +1,86 @@
+#ifndef BOT_SHARDS_H
+#define BOT_SHARDS_H
+
+#include "SharedClientManager.h"
+#include "TelegramBot.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class BotShards
+ * @brief Varias sesiones de TDLib (bots distintos o sesiones de un mismo bot) en un proceso.
+ *
+ * Todas comparten un SharedClientManager: un solo receive() reparte las
+ * respuestas por client_id a cada TelegramBot, que conserva su propio estado
+ * (handlers, descargas, diario, planificadores).
+ *
+ * Las sesiones con el mismo token forman un grupo. La primera atiende los
+ * mensajes; cada vídeo nuevo se descarga en la sesión del grupo con menos
+ * descargas activas y en cola (la otra lo recupera por su remote_id), así el
+ * ancho de banda de descarga crece con el número de sesiones. Los reenvíos del
+ * mismo archivo van a la misma sesión para unirse a su descarga. Entre bots
+ * distintos no se reparte: un file_id de un bot no vale para otro.
+ *
+ * El índice de duplicados de la sesión 0 se comparte con todas.
+ */
+class BotShards {
+    public:
+
+    struct Stats {
+        std::uint64_t sessions = 0;
+        std::uint64_t routed = 0;        // vídeos descargados en otra sesión del grupo
+        std::uint64_t kept = 0;          // vídeos descargados en la sesión que los recibió
+    };
+
+    // Backend null = td::ClientManager
+    explicit BotShards(std::unique_ptr<TdTransport> backend = nullptr);
+    ~BotShards();
+
+    BotShards(const BotShards&) = delete;
+    BotShards& operator=(const BotShards&) = delete;
+
+    /**
+     * @brief Añade una sesión inicializada. Repetir un token añade otra sesión del mismo bot.
+     * @return La sesión, para configurarla antes de run(); nullptr si no se pudo inicializar.
+     */
+    TelegramBot* add_session(const std::string& api_id, const std::string& bot_token,
+                             const std::string& api_hash, const std::string& download_path);
+
+    std::size_t size() const { return sessions_.size(); }
+    TelegramBot& session(std::size_t index) { return *sessions_[index]; }
+
+    void run();
+    void stop();
+
+    // /metrics con las métricas de todas las sesiones, etiquetadas con session="N"
+    bool start_metrics(const std::string& address, std::uint16_t port);
+    std::string render_metrics() const;
+
+    Stats stats() const;
+
+    private:
+
+    bool route(std::size_t from, const DownloadJournal::Entry& entry);
+
+    std::unique_ptr<SharedClientManager> manager_;
+    std::vector<std::unique_ptr<TelegramBot>> sessions_;
+    std::vector<std::string> tokens_;
+    std::vector<std::size_t> group_;             // primera sesión del grupo de cada sesión
+
+    std::mutex route_mutex_;
+    std::unordered_map<std::string, std::size_t> placement_;  // unique_id -> sesión que lo descarga
+    std::size_t next_ = 0;                       // desempate round-robin entre sesiones igual de cargadas
+    std::atomic<std::uint64_t> routed_{0};
+    std::atomic<std::uint64_t> kept_{0};
+
+    bool running_ = false;
+    std::unique_ptr<MetricsServer> metrics_server_;
+};
+
+#endif // BOT_SHARDS_H
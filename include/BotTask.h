@@ -0,0 +1,126 @@
+#ifndef BOT_TASK_H
+#define BOT_TASK_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class FramePool
+ * @brief Reserva de los frames de las corrutinas del bot en listas libres por tamaño.
+ *
+ * Un flujo corto (enviar, esperar el ID real, editar) vive unos cientos de
+ * milisegundos y se repite con cada descarga: los frames se reciclan en cuatro
+ * clases de tamaño (128 a 1024 bytes) en lugar de ir al heap cada vez. Los
+ * frames más grandes van directamente al heap.
+ *
+ * Thread-safe: un flujo empieza en cualquier hilo y suele terminar en el bucle
+ * principal. Cada hilo guarda hasta LOCAL_MAX frames por clase sin locks; solo
+ * al vaciarse o llenarse esa caché se pasa por la lista común de la clase, que
+ * tiene su mutex. Los contadores también son del hilo y stats() los suma.
+ */
+class FramePool {
+    public:
+
+    struct Stats {
+        std::uint64_t allocated = 0;     // frames pedidos
+        std::uint64_t reused = 0;        // servidos desde una lista libre
+        std::uint64_t oversized = 0;     // demasiado grandes para el pool (heap)
+        std::uint64_t live = 0;          // frames en uso
+    };
+
+    static void* allocate(std::size_t size);
+    static void deallocate(void* frame, std::size_t size) noexcept;
+    static Stats stats();
+
+    // Frames libres que se guardan por clase; los que sobran vuelven al heap
+    static constexpr std::size_t MAX_FREE = 256;
+
+    private:
+
+    static constexpr std::size_t CLASSES = 4;
+    static constexpr std::size_t MIN_SIZE = 128;
+    static constexpr std::size_t LOCAL_MAX = 32;
+
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+
+    // Solo los escribe su hilo: load + store en vez de una operación atómica con lock
+    struct Counters {
+        std::atomic<std::uint64_t> allocated{0};
+        std::atomic<std::uint64_t> reused{0};
+        std::atomic<std::uint64_t> oversized{0};
+        std::atomic<std::uint64_t> released{0};
+    };
+
+    // Frames libres y contadores del hilo; al terminar el hilo los frames vuelven a
+    // las listas comunes y los contadores se suman a retired_
+    struct LocalCache {
+        FreeFrame* free[CLASSES] = {};
+        std::size_t count[CLASSES] = {};
+        Counters counters;
+        LocalCache();
+        ~LocalCache();
+    };
+
+    static LocalCache& local();
+    static void push_shared(int index, FreeFrame* frame) noexcept;
+    static void bump(std::atomic<std::uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    struct SizeClass {
+        std::mutex mutex;
+        FreeFrame* free = nullptr;
+        std::size_t count = 0;
+    };
+
+    static int class_of(std::size_t size) {
+        std::size_t capacity = MIN_SIZE;
+        for (std::size_t i = 0; i < CLASSES; ++i, capacity <<= 1) {
+            if (size <= capacity) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    static SizeClass classes_[CLASSES];
+    static std::mutex caches_mutex_;
+    static std::vector<LocalCache*> caches_;   // cachés de los hilos vivos
+    static Stats retired_;                     // contadores de los hilos ya terminados
+    static std::uint64_t retired_released_;    // liberados por esos hilos
+};
+
+/**
+ * @class BotTask
+ * @brief Corrutina "lanzar y olvidar" para los flujos de varios pasos del bot.
+ *
+ * Empieza a ejecutarse al llamarla y se destruye sola al terminar; nadie la
+ * espera. Se suspende en los awaitables de TelegramBot (call, real_message_id,
+ * send_text), que la reanudan directamente desde process_response en el hilo
+ * del bucle principal: el paso siguiente ve el mismo estado que vería el
+ * handler equivalente.
+ *
+ * Sus frames salen de FramePool. Una excepción no capturada termina el proceso,
+ * igual que en un handler.
+ */
+class BotTask {
+    public:
+
+    struct promise_type {
+        BotTask get_return_object() noexcept { return BotTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void* frame, std::size_t size) noexcept { FramePool::deallocate(frame, size); }
+    };
+};
+
+#endif // BOT_TASK_H
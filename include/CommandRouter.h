@@ -0,0 +1,145 @@
+#ifndef COMMAND_ROUTER_H
+#define COMMAND_ROUTER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class CommandArgs
+ * @brief Argumentos de un comando separados por espacios, como vistas sobre el texto recibido.
+ *
+ * Se parten una vez, sin copiar: las vistas solo valen mientras vive el texto
+ * del mensaje. Se guardan hasta MAX_ARGS; el resto se lee con rest().
+ */
+class CommandArgs {
+    public:
+
+    static constexpr std::size_t MAX_ARGS = 8;
+
+    CommandArgs() = default;
+    explicit CommandArgs(std::string_view text);
+
+    std::size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    std::string_view operator[](std::size_t index) const { return index < MAX_ARGS ? args_[index] : std::string_view(); }
+
+    // Texto desde el argumento index hasta el final (con sus espacios)
+    std::string_view rest(std::size_t index = 0) const;
+
+    // Argumento index como entero; false si falta o no es un número completo
+    bool get(std::size_t index, std::int64_t& value) const;
+
+    private:
+
+    std::string_view text_;
+    std::array<std::string_view, MAX_ARGS> args_{};
+    std::size_t count_ = 0;
+};
+
+/**
+ * @class CommandRouter
+ * @brief Despacho de comandos "/comando@bot args" en tiempo constante.
+ *
+ * El texto se parte una sola vez en nombre, destinatario y argumentos (vistas,
+ * sin copias) y el nombre se resuelve con un hash perfecto: al registrar los
+ * comandos se busca una semilla con la que ninguno colisiona en una tabla de
+ * potencia de dos, así que cada búsqueda es un hash, un acceso y una
+ * comparación, con igual coste tenga el bot 3 comandos o 300.
+ *
+ * Cada comando declara cuántos argumentos admite; si no cuadran, se contesta
+ * con su uso sin llamar al handler. /help se genera con las descripciones.
+ *
+ * Los comandos se registran antes de run(). Después el router solo se lee y
+ * add() no es thread-safe; dispatch() sí lo es si los handlers lo son.
+ */
+class CommandRouter {
+    public:
+
+    static constexpr std::size_t ANY = std::numeric_limits<std::size_t>::max();
+
+    // "/comando@bot args" partido en vistas sobre el texto
+    struct Parsed {
+        std::string_view name;           // sin la barra
+        std::string_view bot;            // vacío si no lleva @bot
+        std::string_view args;
+    };
+
+    struct Invocation {
+        std::int64_t chat_id = 0;
+        std::string_view name;
+        CommandArgs args;
+    };
+
+    using Handler = std::function<std::string(const Invocation&)>;
+
+    struct Stats {
+        std::uint64_t commands = 0;      // comandos registrados
+        std::uint64_t table_size = 0;    // huecos de la tabla del hash perfecto
+        std::uint64_t seed = 0;
+    };
+
+    CommandRouter();
+
+    /**
+     * @brief Registra un comando.
+     * @param name Nombre sin la barra ("start").
+     * @param description Línea de /help; vacía para no listarlo.
+     * @param handler Devuelve la respuesta; vacía para no contestar.
+     * @param min_args,max_args Argumentos admitidos (ANY sin límite).
+     * @param usage Argumentos que se muestran si no cuadran ("<file_id>").
+     * @return false si el nombre ya existe o no es válido.
+     */
+    bool add(std::string_view name, std::string description, Handler handler,
+             std::size_t min_args = 0, std::size_t max_args = ANY, std::string usage = std::string());
+
+    /**
+     * @brief Parte "/comando@bot args". false si el texto no empieza por '/'.
+     */
+    static bool parse(std::string_view text, Parsed& out);
+
+    /**
+     * @brief Ejecuta el comando del texto, si lo es y está registrado.
+     * @param response Respuesta del handler o uso del comando.
+     * @return false si no es un comando de este bot: el texto sigue como texto libre.
+     */
+    bool dispatch(std::int64_t chat_id, std::string_view text, std::string& response) const;
+
+    // Solo se aceptan los "/comando@bot" dirigidos a este nombre (vacío = cualquiera)
+    void set_bot_username(std::string username) { username_ = std::move(username); }
+
+    const std::string& help() const { return help_; }
+    Stats stats() const;
+
+    private:
+
+    struct Command {
+        std::string name;
+        std::string description;
+        std::string usage;
+        std::size_t min_args = 0;
+        std::size_t max_args = ANY;
+        Handler handler;
+    };
+
+    static constexpr std::uint16_t EMPTY = 0xFFFF;
+    static constexpr std::size_t MAX_NAME = 32;
+
+    static std::uint32_t hash(std::string_view name, std::uint32_t seed);
+    const Command* find(std::string_view name) const;
+    void rebuild();
+
+    std::vector<Command> commands_;
+    std::vector<std::uint16_t> slots_;   // índice en commands_ o EMPTY
+    std::uint32_t mask_ = 0;
+    std::uint32_t seed_ = 0;
+    std::string username_;
+    std::string help_;
+};
+
+#endif // COMMAND_ROUTER_H
@@ -0,0 +1,79 @@
+#ifndef DEDUP_INDEX_H
+#define DEDUP_INDEX_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class DedupIndex
+ * @brief Índice persistente de archivos ya descargados por unique_id remoto.
+ *
+ * El unique_id de Telegram es el mismo para todos los reenvíos de un archivo,
+ * así que basta una búsqueda en la tabla hash para contestar un duplicado con
+ * la ruta que ya existe en vez de descargarlo otra vez.
+ *
+ * En disco es un archivo de registros append-only (mismo formato que el diario
+ * de descargas). open() lo carga, descarta las entradas cuyo archivo ya no está
+ * o ha cambiado de tamaño y lo reescribe compacto y ordenado por unique_id.
+ * Cada alta se escribe con fdatasync al momento: son pocas (una por descarga
+ * terminada) y se hacen fuera del bucle principal.
+ *
+ * Thread-safe.
+ */
+class DedupIndex {
+    public:
+
+    struct Item {
+        std::string path;                // ruta final del archivo
+        std::int64_t size = 0;
+        std::string checksum;            // XXH64 en hexadecimal (vacío si no se pudo calcular)
+    };
+
+    struct Stats {
+        std::uint64_t entries = 0;       // archivos indexados
+        std::uint64_t hits = 0;          // duplicados contestados desde el índice
+        std::uint64_t misses = 0;
+        std::uint64_t stale = 0;         // entradas cuyo archivo ya no existía
+    };
+
+    DedupIndex() = default;
+    ~DedupIndex();
+
+    DedupIndex(const DedupIndex&) = delete;
+    DedupIndex& operator=(const DedupIndex&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    /**
+     * @brief Busca un archivo ya descargado. Comprueba con stat() que sigue en su
+     * ruta con el mismo tamaño; si no, lo quita del índice.
+     */
+    bool find(const std::string& unique_id, Item& out);
+
+    void add(const std::string& unique_id, const std::string& path, std::int64_t size,
+             const std::string& checksum = std::string());
+    void remove(const std::string& unique_id);
+
+    Stats stats() const;
+
+    private:
+
+    enum RecordType : std::uint8_t { Add = 1, Remove = 2 };
+
+    static std::string encode_add(const std::string& unique_id, const Item& item);
+    static bool exists(const Item& item);
+    void append(const std::string& record);
+
+    mutable std::mutex mutex_;
+    std::mutex write_mutex_;         // escrituras en orden, sin bloquear las búsquedas
+    int fd_ = -1;
+    std::string path_;
+    std::unordered_map<std::string, Item> items_;
+    Stats stats_;
+};
+
+#endif // DEDUP_INDEX_H
@@ -0,0 +1,136 @@
+#ifndef DISK_RESERVATIONS_H
+#define DISK_RESERVATIONS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class DiskReservations
+ * @brief Admisión de descargas por espacio libre en el sistema de archivos de destino.
+ *
+ * Cada descarga aceptada reserva los bytes que aún le faltan por escribir. Una
+ * nueva solo se acepta si cabe en lo que statvfs() da como libre (f_bavail),
+ * menos lo ya reservado y un margen: así varias descargas grandes aceptadas a la
+ * vez no pueden llenar el disco entre todas.
+ *
+ * Si la carpeta final (set_target_path) está en otro sistema de archivos, el
+ * traslado copia el archivo entero: cada descarga reserva también ahí su tamaño
+ * completo, y esa reserva dura hasta relocated(), no hasta que termina.
+ *
+ * Lo que una descarga ya escribió ocupa disco de verdad y statvfs() lo descuenta,
+ * así que su reserva baja con progress(). preallocate() reserva de golpe todos
+ * los bloques del archivo parcial con fallocate(FALLOC_FL_KEEP_SIZE): el archivo
+ * se escribe contiguo sin cambiar el tamaño que ve TDLib, y su reserva queda a cero.
+ *
+ * Todos los tamaños son de 64 bits. Thread-safe.
+ */
+class DiskReservations {
+    public:
+
+    struct Stats {
+        std::int64_t reserved_bytes = 0;     // bytes reservados y aún sin escribir
+        std::int64_t target_reserved_bytes = 0; // reservados en la carpeta final (otro sistema de archivos)
+        std::uint64_t reservations = 0;      // descargas con reserva
+        std::uint64_t granted = 0;
+        std::uint64_t rejected = 0;          // descargas rechazadas por falta de espacio
+        std::uint64_t preallocated = 0;      // archivos preasignados con fallocate
+        std::uint64_t preallocate_failed = 0;
+    };
+
+    DiskReservations() = default;
+
+    DiskReservations(const DiskReservations&) = delete;
+    DiskReservations& operator=(const DiskReservations&) = delete;
+
+    /**
+     * @brief Carpeta donde se escriben las descargas. Si aún no existe se mide
+     * el sistema de archivos de su primer antecesor que exista.
+     */
+    void set_path(const std::string& path);
+
+    /**
+     * @brief Carpeta final a la que se trasladan. Solo cuenta si su st_dev es
+     * distinto del de path (vacía = no se traslada).
+     */
+    void set_target_path(const std::string& path);
+
+    /**
+     * @brief margin: bytes que se dejan siempre libres. preallocate_min: tamaño
+     * mínimo para preasignar el archivo (0 = nunca).
+     */
+    void set_policy(std::int64_t margin, std::int64_t preallocate_min);
+
+    /**
+     * @brief Reserva size - written bytes para file_id (o la sustituye).
+     * @param force Reserva aunque no quepa (descargas ya aceptadas antes de un reinicio).
+     * @return false si no cabe; entonces no se reserva nada.
+     */
+    bool reserve(std::int32_t file_id, std::int64_t size, std::int64_t written = 0, bool force = false);
+
+    /**
+     * @brief La descarga ya escribió written bytes: su reserva baja a size - written.
+     */
+    void progress(std::int32_t file_id, std::int64_t written);
+
+    /**
+     * @brief Preasigna el archivo parcial de file_id en path si llega al umbral.
+     * Solo lo intenta una vez por reserva.
+     * @return true si el archivo quedó preasignado.
+     */
+    bool preallocate(std::int32_t file_id, const std::string& path);
+
+    /**
+     * @brief Descarga terminada: ya ocupa su sitio en la caché, pero su reserva en
+     * la carpeta final sigue hasta relocated().
+     */
+    void downloaded(std::int32_t file_id);
+    void relocated(std::int32_t file_id);
+
+    // Fallida o cancelada: se libera todo
+    void release(std::int32_t file_id);
+
+    // Las reservas de los traslados en curso se mantienen
+    void clear();
+
+    /**
+     * @brief Bytes libres para nuevas descargas: libre - reservado - margen, el
+     * menor de la caché y la carpeta final. Negativo si ya no cabe nada;
+     * INT64_MAX si no se puede medir.
+     */
+    std::int64_t available() const;
+
+    /**
+     * @brief Bytes libres del sistema de archivos según statvfs (-1 si no se puede medir).
+     */
+    std::int64_t free_bytes() const;
+
+    Stats stats() const;
+
+    private:
+
+    struct Reservation {
+        std::int64_t size = 0;
+        std::int64_t written = 0;            // ya ocupa disco: no cuenta como reserva
+        std::int64_t target = 0;             // reservado en la carpeta final
+        bool preallocate_tried = false;
+    };
+
+    static std::int64_t pending(const Reservation& reservation);
+    bool separate_target_locked() const;
+    bool fits_locked(const std::string& path, std::int64_t needed, std::int64_t reserved) const;
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::int64_t margin_ = 0;
+    std::int64_t preallocate_min_ = 0;
+    std::string target_path_;
+    std::unordered_map<std::int32_t, Reservation> reservations_;
+    std::unordered_map<std::int32_t, std::int64_t> relocating_;   // terminadas aún sin trasladar
+    Stats stats_;
+    mutable std::atomic<bool> warned_{false};   // statvfs ha fallado alguna vez
+};
+
+#endif // DISK_RESERVATIONS_H
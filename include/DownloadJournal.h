@@ -0,0 +1,146 @@
+#ifndef DOWNLOAD_JOURNAL_H
+#define DOWNLOAD_JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class DownloadJournal
+ * @brief Diario append-only del estado de las descargas para reanudarlas tras un reinicio.
+ *
+ * Cada cambio (alta, mensaje de progreso, offset descargado, fin) se añade como
+ * un registro con longitud y checksum. Los registros se acumulan en memoria y
+ * sync() los escribe con un único write + fdatasync por lote, como mucho una vez
+ * por sync_interval: un corte pierde a lo sumo el último lote, nunca corrompe
+ * los anteriores. Un registro incompleto al final se descarta al abrir.
+ *
+ * Las descargas se identifican por el unique_id remoto, que no cambia entre
+ * sesiones; el file_id solo vale dentro de la sesión de TDLib que lo asignó.
+ * Una entrada recuperada queda desligada hasta que start() la vuelve a asociar
+ * a su file_id actual.
+ *
+ * open() reconstruye las descargas vivas y compacta el diario reescribiéndolas
+ * en un archivo temporal que sustituye al original con rename(). Con el bot en
+ * marcha, sync() vuelve a compactar cuando el diario pasa de compact_size y
+ * ha doblado lo que ocupaba la última vez.
+ *
+ * Un lote que no se pudo escribir se deshace (ftruncate al tamaño anterior) y
+ * vuelve delante de los pendientes para el siguiente sync().
+ *
+ * Thread-safe: se escribe desde los hilos de despacho y se sincroniza desde el bucle.
+ */
+class DownloadJournal {
+    public:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::int32_t file_id = 0;
+        std::string remote_id;           // remoteFile.id: permite recuperar el archivo en otra sesión
+        std::string unique_id;           // remoteFile.unique_id
+        std::int64_t chat_id = 0;
+        std::int64_t message_id = -1;    // mensaje de progreso (-1 = todavía sin ID real)
+        std::int64_t offset = 0;         // bytes contiguos ya descargados desde el inicio
+        std::int64_t size = 0;
+        std::string file_name;
+        std::string extension;
+        std::string mime_type;
+    };
+
+    struct Stats {
+        std::uint64_t records = 0;       // registros añadidos desde open()
+        std::uint64_t syncs = 0;         // lotes escritos con fdatasync
+        std::uint64_t bytes = 0;         // bytes escritos desde open()
+        std::uint64_t recovered = 0;     // descargas vivas encontradas al abrir
+        std::uint64_t discarded = 0;     // bytes corruptos o incompletos descartados al abrir
+        std::uint64_t failed = 0;        // lotes que no se pudieron escribir (se reintentan)
+        std::uint64_t compactions = 0;   // compactaciones desde open()
+    };
+
+    DownloadJournal() = default;
+    ~DownloadJournal();
+
+    DownloadJournal(const DownloadJournal&) = delete;
+    DownloadJournal& operator=(const DownloadJournal&) = delete;
+
+    /**
+     * @brief Carga y compacta el diario y lo deja abierto para añadir registros.
+     * @param recovered Descargas que no habían terminado.
+     */
+    bool open(const std::string& path, std::vector<Entry>& recovered);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    void set_sync_interval(Clock::duration interval) { sync_interval_ = interval; }
+    void set_compact_size(std::size_t size) { compact_size_ = size; }
+
+    /**
+     * @brief Da de alta (o vuelve a asociar) una descarga. Sin unique_id no se anota.
+     */
+    void start(const Entry& entry);
+    void set_message(std::int32_t file_id, std::int64_t message_id);
+
+    /**
+     * @brief Anota el offset descargado. Solo genera registro cada PROGRESS_STEP bytes.
+     */
+    void progress(std::int32_t file_id, std::int64_t offset);
+    void done(std::int32_t file_id);
+
+    /**
+     * @brief Elimina una descarga desligada que ya no se puede recuperar.
+     */
+    void discard(const std::string& unique_id);
+
+    /**
+     * @brief Copia las descargas vivas que no están asociadas a un file_id de esta sesión.
+     */
+    void detached(std::vector<Entry>& out) const;
+
+    /**
+     * @brief Desliga todas las descargas (los file_id del cliente anterior dejan de valer).
+     */
+    void detach_all();
+
+    /**
+     * @brief Escribe el lote pendiente si ha pasado sync_interval (o siempre con force).
+     */
+    void sync(Clock::time_point now, bool force = false);
+
+    Stats stats() const;
+
+    static constexpr std::int64_t PROGRESS_STEP = 4 * 1024 * 1024;
+    static constexpr std::size_t COMPACT_SIZE = 4 * 1024 * 1024;
+
+    private:
+
+    enum RecordType : std::uint8_t { Start = 1, Message = 2, Progress = 3, Done = 4 };
+
+    void append_locked(RecordType type, const std::string& payload);
+    static std::string encode_entry(const Entry& entry);
+    static std::string compact(const std::unordered_map<std::string, Entry>& live);
+    bool write_all(int fd, const char* data, std::size_t size);
+    int replace_file(const std::string& path, const std::string& data);
+
+    mutable std::mutex mutex_;
+    std::mutex sync_mutex_;          // un único lote en escritura
+    std::atomic<int> fd_{-1};        // lo cambian open(), close() y la compactación de sync()
+    std::string path_;
+    std::unordered_map<std::string, Entry> live_;         // por unique_id
+    std::unordered_map<std::int32_t, std::string> ids_;   // file_id de esta sesión -> unique_id
+    std::string pending_;            // registros aún no escritos
+    std::string writing_;            // lote en escritura, reutilizado entre syncs
+    std::size_t size_ = 0;           // bytes del diario en disco (solo con sync_mutex_)
+    std::size_t compacted_ = 0;      // tamaño tras la última compactación
+    bool rewrite_ = false;           // quedó un lote a medias que no se pudo deshacer: compactar
+    std::size_t compact_size_ = COMPACT_SIZE;
+    Clock::duration sync_interval_ = std::chrono::seconds(1);
+    Clock::time_point last_sync_;
+    Stats stats_;
+};
+
+#endif // DOWNLOAD_JOURNAL_H
@@ -0,0 +1,122 @@
+#ifndef DOWNLOAD_SCHEDULER_H
+#define DOWNLOAD_SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class DownloadScheduler
+ * @brief Admisión de descargas con límites de concurrencia y reparto justo por chat.
+ *
+ * Como mucho max_active descargas activas en total y max_active_per_chat por
+ * chat; el resto espera en la cola de su chat, ordenada de menor a mayor tamaño.
+ * Los huecos se reparten en round-robin entre chats, así que un usuario con 50
+ * vídeos no bloquea a los demás. Entre las activas, la prioridad de TDLib se
+ * asigna por bytes restantes (la que menos le falta, 32), lo que minimiza el
+ * tiempo medio de finalización.
+ *
+ * Thread-safe: se usa desde los hilos de despacho.
+ */
+class DownloadScheduler {
+    public:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Config {
+        std::size_t max_active = 4;
+        std::size_t max_active_per_chat = 2;
+    };
+
+    struct Stats {
+        std::uint64_t queued = 0;        // en cola ahora mismo
+        std::uint64_t active = 0;        // descargando ahora mismo
+        std::uint64_t started = 0;
+        std::uint64_t finished = 0;
+        double wait_ms_total = 0.0;      // espera en cola de las ya iniciadas
+        double wait_ms_max = 0.0;
+    };
+
+    struct Priority {
+        std::int32_t file_id;
+        std::int32_t priority;
+    };
+
+    struct Position {
+        std::int32_t file_id;
+        std::int64_t chat_id;
+        std::size_t position;            // 1 = la siguiente en empezar
+    };
+
+    DownloadScheduler();
+    explicit DownloadScheduler(const Config& config);
+
+    void set_config(const Config& config);
+
+    /**
+     * @brief Añade una descarga. Las que pueden empezar ya se añaden a started.
+     */
+    void enqueue(std::int32_t file_id, std::int64_t chat_id, std::int64_t size,
+                 Clock::time_point now, std::vector<std::int32_t>& started);
+
+    /**
+     * @brief Libera el hueco de una descarga terminada o fallida y admite las siguientes.
+     */
+    void finish(std::int32_t file_id, Clock::time_point now, std::vector<std::int32_t>& started);
+
+    /**
+     * @brief Actualiza los bytes restantes de una descarga activa.
+     */
+    void update_remaining(std::int32_t file_id, std::int64_t remaining);
+
+    /**
+     * @brief Extrae las descargas activas cuya prioridad ha cambiado desde la última llamada.
+     */
+    void take_priority_changes(std::vector<Priority>& out);
+
+    /**
+     * @brief Prioridad de TDLib (1-32) asignada a una descarga activa.
+     */
+    std::int32_t priority(std::int32_t file_id) const;
+
+    /**
+     * @brief Posición de cada descarga en cola según el orden round-robin actual.
+     */
+    void positions(std::vector<Position>& out) const;
+
+    /**
+     * @brief Olvida todas las descargas, activas y en cola (reinicio del cliente).
+     */
+    void clear();
+
+    bool contains(std::int32_t file_id) const;
+    Stats stats() const;
+
+    private:
+
+    struct Entry {
+        std::int64_t chat_id;
+        std::int64_t remaining;
+        std::int32_t priority = 0;
+        bool active = false;
+        Clock::time_point enqueued;
+    };
+
+    void admit_locked(Clock::time_point now, std::vector<std::int32_t>& started);
+    void reprioritize_locked();
+
+    mutable std::mutex mutex_;
+    Config config_;
+    std::unordered_map<std::int32_t, Entry> entries_;
+    std::unordered_map<std::int64_t, std::deque<std::int32_t>> queues_; // por chat, menor tamaño primero
+    std::deque<std::int64_t> rotation_;                                 // chats con cola, en turno round-robin
+    std::unordered_map<std::int64_t, std::size_t> active_per_chat_;
+    std::vector<std::int32_t> active_;
+    std::vector<Priority> priority_changes_;
+    Stats stats_;
+};
+
+#endif // DOWNLOAD_SCHEDULER_H
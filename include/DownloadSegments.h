@@ -0,0 +1,58 @@
+#ifndef DOWNLOAD_SEGMENTS_H
+#define DOWNLOAD_SEGMENTS_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class DownloadSegments
+ * @brief Reparto de un archivo en rangos que se descargan en paralelo.
+ *
+ * Divide [offset, size) en rangos contiguos alineados a ALIGNMENT y lleva la
+ * cuenta de lo descargado en cada uno a partir del download_offset y el
+ * downloaded_prefix_size de los updateFile. El archivo está completo cuando
+ * lo están todos los rangos.
+ *
+ * No es thread-safe: vive dentro de DownloadInfo, bajo downloads_mutex_.
+ */
+class DownloadSegments {
+    public:
+
+    struct Segment {
+        std::int64_t offset;
+        std::int64_t limit;
+        std::int64_t done = 0;
+    };
+
+    static constexpr std::int64_t ALIGNMENT = 1024 * 1024;
+
+    /**
+     * @brief Divide [offset, size) en hasta count rangos. Con count < 2 no divide.
+     */
+    void split(std::int64_t offset, std::int64_t size, std::size_t count);
+    void clear() { segments_.clear(); }
+
+    /**
+     * @brief Anota el prefijo descargado desde download_offset.
+     * @return false si download_offset no es el inicio de ningún rango.
+     */
+    bool update(std::int64_t download_offset, std::int64_t prefix_size);
+
+    bool empty() const { return segments_.empty(); }
+    bool complete() const;
+
+    // Bytes descargados en total, incluidos los anteriores al primer rango
+    std::int64_t downloaded() const;
+
+    // Bytes contiguos desde el inicio del archivo (para el diario)
+    std::int64_t contiguous() const;
+
+    const std::vector<Segment>& segments() const { return segments_; }
+
+    private:
+
+    std::int64_t base_ = 0;   // bytes ya descargados antes del primer rango
+    std::vector<Segment> segments_;
+};
+
+#endif // DOWNLOAD_SEGMENTS_H
@@ -0,0 +1,212 @@
+#ifndef FAKE_TELEGRAM_SERVER_H
+#define FAKE_TELEGRAM_SERVER_H
+
+#include "TdTransport.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class FakeTelegramServer
+ * @brief Backend local que imita a TDLib para pruebas de carga sin red.
+ *
+ * Responde a setTdlibParameters, checkAuthenticationBotToken, sendMessage,
+ * editMessageText, downloadFile, cancelDownloadFile, getRemoteFile y close, y genera los flujos de updateNewMessage,
+ * updateMessageSendSucceeded y updateFile con la latencia y el ancho de banda
+ * configurados. El tráfico sintético de usuarios arranca al autorizarse el bot.
+ *
+ * Admite varios clientes a la vez, como td::ClientManager: cada respuesta va al
+ * client_id que hizo la petición y los updateFile a la sesión que descarga el
+ * archivo. Los mensajes entrantes llegan a la primera sesión autorizada de cada
+ * token (los usuarios se reparten entre tokens distintos). Los archivos son
+ * comunes a todas las sesiones y cada una tiene su propio ancho de banda.
+ */
+class FakeTelegramServer : public TdTransport {
+    public:
+
+    struct Config {
+        std::chrono::milliseconds latency{20};              // latencia de cada respuesta
+        double bandwidth_bytes_per_sec = 50.0 * 1024 * 1024; // ancho de banda de descarga de cada sesión
+        std::chrono::milliseconds update_interval{100};     // cadencia de updateFile por descarga
+        std::int64_t users = 0;                             // usuarios sintéticos (0 = sin tráfico)
+        double messages_per_sec = 0.0;                      // mensajes entrantes por segundo (total)
+        double video_ratio = 0.0;                           // fracción de mensajes que son vídeos
+        double forward_ratio = 0.0;                         // fracción de vídeos que reenvían el anterior (mismo archivo)
+        std::int64_t video_size = 64 * 1024 * 1024;         // tamaño de cada vídeo sintético
+        double flood_chat_rate = 0.0;                       // envíos+ediciones/s por chat antes de 429 (0 = sin límite)
+        double stream_bandwidth_bytes_per_sec = 0.0;        // tope de cada transferencia (0 = sin tope)
+        std::string files_directory;                        // crea cada archivo en disco, disperso (vacío = solo en memoria)
+        std::int64_t backlog_messages = 0;                  // acumulados con el bot apagado: llegan al autorizarse
+        std::chrono::seconds backlog_age{3600};             // antigüedad del primero (el resto, repartidos hasta crear el servidor)
+    };
+
+    struct Stats {
+        std::uint64_t requests = 0;
+        std::uint64_t messages_generated = 0;
+        std::uint64_t backlog_delivered = 0;
+        std::uint64_t videos_generated = 0;
+        std::uint64_t videos_forwarded = 0;
+        std::uint64_t messages_sent = 0;
+        std::uint64_t messages_edited = 0;
+        std::uint64_t flood_errors = 0;
+        std::uint64_t downloads_started = 0;
+        std::uint64_t downloads_completed = 0;
+        std::uint64_t downloads_failed = 0;
+        std::uint64_t bytes_served = 0;
+    };
+
+    explicit FakeTelegramServer(const Config& config);
+    ~FakeTelegramServer() override = default;
+
+    std::int32_t create_client_id() override;
+    void send(std::int32_t client_id, std::uint64_t request_id,
+              td::td_api::object_ptr<td::td_api::Function> request) override;
+    Response receive(double timeout) override;
+    void reset() override;
+
+    // Cada downloadFile con limit > 0 abre una transferencia propia para su rango
+    bool supports_ranged_downloads() const override { return true; }
+
+    /**
+     * @brief Inyecta un mensaje de texto entrante como si lo enviase user_id.
+     */
+    void inject_text_message(std::int64_t user_id, const std::string& text);
+
+    /**
+     * @brief Inyecta un vídeo entrante de size bytes como si lo enviase user_id.
+     * @return ID del archivo simulado.
+     */
+    std::int32_t inject_video_message(std::int64_t user_id, std::int64_t size);
+
+    /**
+     * @brief Reenvía a user_id un vídeo ya existente (mismo file_id y unique_id, como en TDLib).
+     */
+    void inject_forwarded_video(std::int64_t user_id, std::int32_t file_id);
+
+    /**
+     * @brief El próximo downloadFile de file_id falla con un error (una sola vez).
+     */
+    void inject_download_failure(std::int32_t file_id);
+
+    /**
+     * @brief Corta todos los clientes como una caída de la conexión: cada uno recibe
+     * authorizationStateClosed y sus transferencias se detienen conservando lo descargado.
+     * @return Clientes cerrados.
+     */
+    std::size_t inject_disconnect();
+
+    Stats stats() const;
+
+    private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        Clock::time_point at;
+        std::uint64_t seq;
+        std::int32_t client_id;
+        std::uint64_t request_id;
+        td::td_api::object_ptr<td::td_api::Object> object;
+    };
+
+    // Transferencia de un rango [offset, end) de un archivo
+    struct Stream {
+        std::int64_t offset;
+        std::int64_t end;
+        std::int64_t downloaded = 0;
+        double pending_bytes = 0.0;
+        Clock::time_point last_update;
+    };
+
+    struct FakeFile {
+        std::int32_t id;
+        std::int64_t size;
+        std::string remote_id;                    // "fake-remote-<sesión>-<id>-<tamaño>"
+        std::string path;                         // archivo disperso en disco (vacío sin files_directory)
+        std::int64_t base = 0;                    // bytes previos al offset de la primera descarga (reanudación)
+        std::int64_t completed = 0;               // bytes de rangos ya terminados
+        std::vector<Stream> streams;              // transferencias activas (rangos disjuntos)
+        std::int32_t priority = 1;
+        std::int32_t client_id = 0;               // sesión que lo descarga (recibe los updateFile)
+
+        std::int64_t downloaded() const {
+            std::int64_t total = base + completed;
+            for (const Stream& stream : streams) total += stream.downloaded;
+            return total;
+        }
+    };
+
+    struct FloodBucket {
+        double tokens = 0.0;
+        Clock::time_point refilled;
+    };
+
+    enum class AuthState { WaitParameters, WaitToken, Ready };
+
+    struct Client {
+        AuthState auth = AuthState::WaitParameters;
+        std::string token;
+    };
+
+    static bool event_later(const Event& a, const Event& b);
+
+    void push_locked(Clock::time_point at, std::int32_t client_id, std::uint64_t request_id,
+                     td::td_api::object_ptr<td::td_api::Object> object);
+    void push_authorization_state_locked(Clock::time_point at, std::int32_t client_id);
+    std::int32_t receiver_locked(std::int64_t user_id) const;
+    bool any_ready_locked() const;
+    void close_client_locked(std::int32_t client_id, Clock::time_point at);
+    void stop_file_locked(FakeFile& file);
+    void pump_locked(Clock::time_point now);
+    void generate_traffic_locked(Clock::time_point now);
+    void push_backlog_locked(Clock::time_point at);
+    void advance_downloads_locked(Clock::time_point now);
+
+    td::td_api::object_ptr<td::td_api::error> check_flood_locked(std::int64_t chat_id, Clock::time_point now);
+    td::td_api::object_ptr<td::td_api::Object> handle_request_locked(
+        std::int32_t client_id, td::td_api::object_ptr<td::td_api::Function> request, Clock::time_point now);
+
+    // date 0 = ahora
+    void push_new_message_locked(Clock::time_point at, std::int64_t user_id,
+                                 td::td_api::object_ptr<td::td_api::MessageContent> content, std::int32_t date = 0);
+    std::int32_t push_video_message_locked(Clock::time_point at, std::int64_t user_id, std::int64_t size,
+                                           std::int32_t date = 0);
+    void push_file_message_locked(Clock::time_point at, std::int64_t user_id, std::int32_t file_id,
+                                  std::int32_t date = 0);
+    std::int32_t create_file_locked(std::int64_t size);
+    td::td_api::object_ptr<td::td_api::file> make_file_locked(const FakeFile& file, const Stream* stream = nullptr) const;
+
+    Config config_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Event> events_; // heap por (at, seq)
+    std::uint64_t next_seq_ = 0;
+
+    std::map<std::int32_t, Client> clients_;       // ordenados: la primera sesión de cada token recibe los mensajes
+    std::int32_t next_client_id_ = 1;
+    std::int64_t next_message_id_ = 1;
+    std::int32_t next_file_id_ = 1000;
+    std::int32_t last_video_ = 0;                  // último vídeo generado (para los reenvíos)
+    std::uint64_t session_ = 0;                    // distingue los remote_id entre ejecuciones
+    std::int64_t next_user_ = 0;
+    double pending_messages_ = 0.0;
+    bool backlog_pushed_ = false;
+    Clock::time_point last_pump_;
+
+    std::unordered_map<std::int32_t, FakeFile> files_;
+    std::unordered_map<std::string, std::int32_t> remote_files_; // remote_id -> archivo
+    std::vector<std::int32_t> active_files_;
+    std::vector<std::int32_t> failing_files_;      // su próximo downloadFile devuelve un error
+    std::unordered_map<std::int64_t, FloodBucket> flood_;
+
+    Stats stats_;
+};
+
+#endif // FAKE_TELEGRAM_SERVER_H
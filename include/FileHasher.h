@@ -0,0 +1,103 @@
+#ifndef FILE_HASHER_H
+#define FILE_HASHER_H
+
+#include "XxHash64.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @class FileHasher
+ * @brief Calcula el XXH64 de los archivos mientras se descargan.
+ *
+ * Cada updateFile informa del prefijo contiguo ya escrito (advance()) y un
+ * hilo propio va leyendo y hasheando solo los bytes nuevos, todavía en la
+ * caché de páginas. Al terminar la descarga (finish()) solo falta la cola
+ * desde la última actualización, así que el checksum está listo casi a la vez
+ * que el archivo, sin releerlo entero del disco.
+ *
+ * El descriptor se abre en el primer advance() y se mantiene hasta el final:
+ * si TDLib mueve el archivo parcial a su ruta definitiva se sigue leyendo el
+ * mismo inodo.
+ *
+ * Thread-safe. El callback de finish() se ejecuta en el hilo del hasher.
+ */
+class FileHasher {
+    public:
+
+    // ok = false si no se pudo leer el archivo completo
+    using Callback = std::function<void(bool ok, const std::string& digest)>;
+
+    struct Stats {
+        std::uint64_t files = 0;         // checksums completados
+        std::uint64_t failed = 0;
+        std::uint64_t bytes = 0;         // bytes hasheados en total
+        std::uint64_t tail_bytes = 0;    // de ellos, hasheados después de completarse la descarga
+    };
+
+    FileHasher();
+    ~FileHasher();
+
+    FileHasher(const FileHasher&) = delete;
+    FileHasher& operator=(const FileHasher&) = delete;
+
+    /**
+     * @brief Los bytes [0, available) de path ya están escritos.
+     */
+    void advance(std::int32_t file_id, const std::string& path, std::int64_t available);
+
+    /**
+     * @brief La descarga terminó con size bytes (< 0: hasta el final del archivo).
+     */
+    void finish(std::int32_t file_id, const std::string& path, std::int64_t size, Callback done);
+
+    void cancel(std::int32_t file_id);
+    void clear();
+
+    Stats stats() const;
+
+    private:
+
+    struct Job {
+        // Protegido por mutex_
+        std::string path;
+        std::int64_t available = 0;
+        std::int64_t size = -2;          // -2 = descarga en curso, -1 = hasta EOF
+        Callback done;
+        bool queued = false;
+        bool busy = false;
+        bool failed = false;
+        std::atomic<bool> cancelled{false};
+
+        // Solo el hilo del hasher
+        int fd = -1;
+        XxHash64 hash;
+        std::int64_t hashed = 0;
+        bool eof = false;
+    };
+
+    using JobPtr = std::shared_ptr<Job>;
+
+    void worker_loop();
+    bool hash_range(Job& job, std::int64_t target, bool finishing, char* buffer);
+    void schedule_locked(std::int32_t file_id, Job& job);
+    static void close_job(Job& job);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<std::int32_t, JobPtr> jobs_;
+    std::deque<std::int32_t> ready_;
+    bool stop_ = false;
+    Stats stats_;
+    std::thread thread_;
+};
+
+#endif // FILE_HASHER_H
@@ -0,0 +1,84 @@
+#ifndef FILE_RELOCATOR_H
+#define FILE_RELOCATOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @class FileRelocator
+ * @brief Mueve los archivos terminados de la caché de TDLib a la carpeta de descargas.
+ *
+ * Dentro del mismo sistema de archivos basta un renameat2(RENAME_NOREPLACE)
+ * atómico. Entre sistemas de archivos se copia en el kernel con
+ * copy_file_range (o sendfile si no está disponible) a un ".part" que se
+ * renombra al nombre final, así que los datos no pasan por buffers de usuario.
+ * Todo se hace en un hilo propio: una copia de varios GB nunca bloquea el
+ * bucle principal ni los hilos de despacho. Si el nombre ya existe se añade
+ * " (1)", " (2)"... antes de la extensión.
+ *
+ * relocate() puede llamarse desde cualquier hilo; el callback se ejecuta en el hilo del relocator.
+ */
+class FileRelocator {
+    public:
+
+    // ok = false si el archivo sigue en su ruta original
+    using Callback = std::function<void(bool ok, const std::string& path)>;
+
+    struct Stats {
+        std::uint64_t renamed = 0;       // movidos con rename
+        std::uint64_t copied = 0;        // copiados entre sistemas de archivos
+        std::uint64_t failed = 0;
+        std::uint64_t bytes_copied = 0;
+    };
+
+    FileRelocator();
+    ~FileRelocator();
+
+    FileRelocator(const FileRelocator&) = delete;
+    FileRelocator& operator=(const FileRelocator&) = delete;
+
+    /**
+     * @brief Encola el traslado de source a directory/name.
+     * @param name Nombre final; se sanea con sanitize().
+     */
+    void relocate(const std::string& source, const std::string& directory, const std::string& name, Callback done);
+
+    Stats stats() const;
+
+    /**
+     * @brief Nombre de archivo seguro: sin separadores, caracteres de control ni
+     * reservados, sin puntos iniciales y como mucho MAX_NAME bytes (UTF-8 íntegro).
+     */
+    static std::string sanitize(const std::string& name);
+
+    static constexpr std::size_t MAX_NAME = 200;
+
+    private:
+
+    struct Job {
+        std::string source;
+        std::string directory;
+        std::string name;
+        Callback done;
+    };
+
+    void worker_loop();
+    bool move_file(const Job& job, std::string& path);
+    bool copy_file(const std::string& from, const std::string& to);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    bool stop_ = false;
+    std::atomic<bool> cancel_{false};    // aborta la copia en curso al destruirse
+    Stats stats_;
+    std::thread thread_;
+};
+
+#endif // FILE_RELOCATOR_H
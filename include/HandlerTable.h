@@ -0,0 +1,114 @@
+#ifndef HANDLER_TABLE_H
+#define HANDLER_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @class HandlerTable
+ * @brief Tabla de handlers indexada directamente por query_id.
+ *
+ * Los query_id son consecutivos y crecientes, así que se usa un anillo de
+ * tamaño potencia de dos donde el slot de una query es (query_id & mask).
+ * Insertar, consultar y extraer son O(1) sin recorrer ningún árbol.
+ * Si una query antigua sigue pendiente cuando su slot se vuelve a necesitar,
+ * el anillo duplica su tamaño y recoloca las entradas vivas.
+ *
+ * No es thread-safe: la usa únicamente el hilo del bucle principal.
+ */
+template <class Handler>
+class HandlerTable {
+    public:
+
+    explicit HandlerTable(std::size_t initial_capacity = 1024) {
+        std::size_t capacity = 1;
+        while (capacity < initial_capacity) capacity <<= 1;
+        slots_.resize(capacity);
+        mask_ = capacity - 1;
+    }
+
+    /**
+     * @brief Registra el handler de una query. query_id debe ser distinto de 0.
+     */
+    void insert(std::uint64_t query_id, Handler handler) {
+        Slot* slot = &slots_[query_id & mask_];
+        while (slot->query_id != 0 && slot->query_id != query_id) {
+            grow();
+            slot = &slots_[query_id & mask_];
+        }
+        if (slot->query_id == 0) ++size_;
+        slot->query_id = query_id;
+        slot->handler = std::move(handler);
+    }
+
+    /**
+     * @brief Extrae y elimina el handler asociado a query_id.
+     * @return Handler vacío si no había ninguno registrado.
+     */
+    Handler take(std::uint64_t query_id) {
+        Slot& slot = slots_[query_id & mask_];
+        if (query_id == 0 || slot.query_id != query_id) {
+            return Handler();
+        }
+        Handler handler = std::move(slot.handler);
+        slot.handler = nullptr;
+        slot.query_id = 0;
+        --size_;
+        return handler;
+    }
+
+    /**
+     * @brief Extrae todos los handlers pendientes y llama a fn(query_id, handler) con cada uno.
+     * @return Número de handlers extraídos.
+     */
+    template <class Fn>
+    std::size_t drain(Fn&& fn) {
+        std::size_t drained = 0;
+        for (Slot& slot : slots_) {
+            if (slot.query_id == 0) continue;
+            std::uint64_t query_id = slot.query_id;
+            Handler handler = std::move(slot.handler);
+            slot.handler = nullptr;
+            slot.query_id = 0;
+            --size_;
+            ++drained;
+            fn(query_id, std::move(handler));
+        }
+        return drained;
+    }
+
+    bool contains(std::uint64_t query_id) const {
+        return query_id != 0 && slots_[query_id & mask_].query_id == query_id;
+    }
+
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return slots_.size(); }
+
+    private:
+
+    struct Slot {
+        std::uint64_t query_id = 0;
+        Handler handler;
+    };
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        mask_ = slots_.size() - 1;
+        for (Slot& slot : old) {
+            if (slot.query_id != 0) {
+                Slot& dst = slots_[slot.query_id & mask_];
+                dst.query_id = slot.query_id;
+                dst.handler = std::move(slot.handler);
+            }
+        }
+    }
+
+    std::vector<Slot> slots_;
+    std::size_t mask_ = 0;
+    std::size_t size_ = 0;
+};
+
+#endif // HANDLER_TABLE_H
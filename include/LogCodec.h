@@ -0,0 +1,131 @@
+#ifndef LOG_CODEC_H
+#define LOG_CODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/*
+ * Serialización little-endian mínima de los logs binarios (grabación de updates,
+ * diario de descargas e índice de archivos). Los objetos anidados opcionales
+ * llevan un byte de presencia delante.
+ */
+class LogWriter {
+    public:
+    explicit LogWriter(std::string& out) : out_(out) {}
+
+    template <class T>
+    void put(T value) {
+        char raw[sizeof(T)];
+        std::memcpy(raw, &value, sizeof(T));
+        out_.append(raw, sizeof(T));
+    }
+
+    void put_bool(bool value) { put<std::uint8_t>(value ? 1 : 0); }
+
+    void put_string(const std::string& value) {
+        put<std::uint32_t>(static_cast<std::uint32_t>(value.size()));
+        out_.append(value);
+    }
+
+    private:
+    std::string& out_;
+};
+
+class LogReader {
+    public:
+    LogReader(const char* data, std::size_t size) : data_(data), size_(size) {}
+
+    template <class T>
+    T get() {
+        T value{};
+        if (pos_ + sizeof(T) > size_) {
+            ok_ = false;
+            return value;
+        }
+        std::memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    bool get_bool() { return get<std::uint8_t>() != 0; }
+
+    std::string get_string() {
+        std::uint32_t length = get<std::uint32_t>();
+        if (!ok_ || pos_ + length > size_) {
+            ok_ = false;
+            return std::string();
+        }
+        std::string value(data_ + pos_, length);
+        pos_ += length;
+        return value;
+    }
+
+    bool ok() const { return ok_; }
+
+    // Campos añadidos al final por versiones posteriores: se leen solo si quedan bytes
+    bool at_end() const { return pos_ >= size_; }
+
+    private:
+    const char* data_;
+    std::size_t size_;
+    std::size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+/*
+ * Registros append-only con tipo, longitud y checksum (diario e índice):
+ *   u8 tipo | u32 longitud | payload | u32 FNV-1a de todo lo anterior
+ * Un registro a medio escribir no pasa el checksum y marca el final válido.
+ */
+static const std::size_t LOG_RECORD_HEADER_SIZE = 1 + 4;
+static const std::size_t LOG_RECORD_CHECKSUM_SIZE = 4;
+
+// FNV-1a de 32 bits: suficiente para detectar registros a medio escribir
+inline std::uint32_t log_checksum(const char* data, std::size_t size) {
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<std::uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+inline void append_log_record(std::string& out, std::uint8_t type, const std::string& payload) {
+    std::size_t start = out.size();
+    LogWriter w(out);
+    w.put<std::uint8_t>(type);
+    w.put<std::uint32_t>(static_cast<std::uint32_t>(payload.size()));
+    out.append(payload);
+    w.put<std::uint32_t>(log_checksum(out.data() + start, out.size() - start));
+}
+
+struct LogRecord {
+    std::uint8_t type = 0;
+    const char* payload = nullptr;
+    std::uint32_t length = 0;
+};
+
+/**
+ * @brief Lee el registro en pos y avanza pos. Devuelve false al llegar a un
+ * registro incompleto o corrupto (pos queda en el último byte válido).
+ */
+inline bool read_log_record(const std::string& data, std::size_t& pos, LogRecord& record) {
+    if (pos + LOG_RECORD_HEADER_SIZE + LOG_RECORD_CHECKSUM_SIZE > data.size()) return false;
+    std::uint32_t length;
+    std::memcpy(&length, data.data() + pos + 1, 4);
+    std::size_t record_size = LOG_RECORD_HEADER_SIZE + length + LOG_RECORD_CHECKSUM_SIZE;
+    if (pos + record_size > data.size()) return false;
+
+    std::uint32_t stored;
+    std::memcpy(&stored, data.data() + pos + LOG_RECORD_HEADER_SIZE + length, 4);
+    if (stored != log_checksum(data.data() + pos, LOG_RECORD_HEADER_SIZE + length)) return false;
+
+    record.type = static_cast<std::uint8_t>(data[pos]);
+    record.payload = data.data() + pos + LOG_RECORD_HEADER_SIZE;
+    record.length = length;
+    pos += record_size;
+    return true;
+}
+
+#endif // LOG_CODEC_H
@@ -0,0 +1,110 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * Primitivas de métricas para el endpoint Prometheus. Todas son atómicas con
+ * memory_order_relaxed: el camino caliente solo hace fetch_add/store y el
+ * hilo del scrape lee sin tomar ningún lock (los valores de un mismo scrape
+ * pueden estar desfasados entre sí unos nanosegundos, lo normal en Prometheus).
+ */
+
+/**
+ * @brief Añade las líneas # HELP y # TYPE de una métrica (sin límite de longitud).
+ */
+inline void write_header(std::string& out, const char* name, const char* type, const char* help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+class MetricCounter {
+    public:
+    void add(std::uint64_t value = 1) { value_.fetch_add(value, std::memory_order_relaxed); }
+    std::uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+class MetricGauge {
+    public:
+    void set(std::int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    std::int64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+    std::atomic<std::int64_t> value_{0};
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Histograma de latencias con cubos fijos de 10 µs a 1 s.
+ *
+ * observe() busca el cubo con una pasada lineal sobre 12 límites y hace un
+ * fetch_add; los acumulados que pide el formato se calculan al escribir.
+ */
+class LatencyHistogram {
+    public:
+
+    static constexpr std::size_t BUCKETS = 12;
+
+    void observe(std::uint64_t ns) {
+        std::size_t bucket = 0;
+        while (bucket < BUCKETS && ns > bound_ns(bucket)) ++bucket;
+        counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Añade el histograma en formato de exposición de texto (segundos).
+     */
+    void write(std::string& out, const char* name, const char* help) const {
+        write_header(out, name, "histogram", help);
+
+        char line[160];
+
+        std::uint64_t cumulative = 0;
+        for (std::size_t bucket = 0; bucket <= BUCKETS; ++bucket) {
+            cumulative += counts_[bucket].load(std::memory_order_relaxed);
+            if (bucket < BUCKETS) {
+                std::snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", name,
+                    bound_ns(bucket) / 1e9, (unsigned long long)cumulative);
+            } else {
+                std::snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)cumulative);
+            }
+            out += line;
+        }
+        std::snprintf(line, sizeof(line), "%s_sum %.9f\n%s_count %llu\n", name,
+            sum_ns_.load(std::memory_order_relaxed) / 1e9, name, (unsigned long long)cumulative);
+        out += line;
+    }
+
+    private:
+
+    // 10 µs, 25 µs, 50 µs, 100 µs, 250 µs, 500 µs, 1 ms, 5 ms, 10 ms, 50 ms, 100 ms, 1 s
+    static std::uint64_t bound_ns(std::size_t bucket) {
+        static const std::uint64_t bounds[BUCKETS] = {
+            10000, 25000, 50000, 100000, 250000, 500000,
+            1000000, 5000000, 10000000, 50000000, 100000000, 1000000000
+        };
+        return bounds[bucket];
+    }
+
+    std::atomic<std::uint64_t> counts_[BUCKETS + 1] = {};
+    std::atomic<std::uint64_t> sum_ns_{0};
+};
+
+/**
+ * @brief Añade una métrica sin etiquetas con su cabecera HELP/TYPE.
+ */
+inline void write_metric(std::string& out, const char* name, const char* type, const char* help, double value) {
+    write_header(out, name, type, help);
+    char line[128];
+    std::snprintf(line, sizeof(line), "%s %.17g\n", name, value);
+    out += line;
+}
+
+#endif // METRICS_H
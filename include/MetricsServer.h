@@ -0,0 +1,48 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * @class MetricsServer
+ * @brief Listener HTTP mínimo que sirve GET /metrics en formato de texto Prometheus.
+ *
+ * Un hilo propio atiende las conexiones de una en una (los scrapes son pocos y
+ * cortos) y llama a render() para generar el cuerpo. render() debe leer solo
+ * contadores atómicos o estado con locks breves: nunca espera al bucle principal.
+ */
+class MetricsServer {
+    public:
+
+    using Render = std::function<std::string()>;
+
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    /**
+     * @brief Escucha en address:port (port 0 = puerto libre cualquiera).
+     */
+    bool start(const std::string& address, std::uint16_t port, Render render);
+    void stop();
+
+    std::uint16_t port() const { return port_; }
+
+    private:
+
+    void serve_loop();
+    void serve_client(int fd);
+
+    Render render_;
+    int listen_fd_ = -1;
+    int wake_fd_[2] = { -1, -1 };    // pipe para despertar al hilo en stop()
+    std::uint16_t port_ = 0;
+    std::thread thread_;
+};
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,103 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @class MpscQueue
+ * @brief Cola acotada sin locks de múltiples productores y un único consumidor.
+ *
+ * Anillo de tamaño potencia de dos en el que cada slot lleva un número de
+ * secuencia: los productores reservan posición con un compare_exchange sobre
+ * tail_ y publican el slot con un store release de su secuencia; el consumidor
+ * lee en orden desde head_ sin operaciones atómicas de lectura-modificación.
+ * try_push() no bloquea nunca: devuelve false si el anillo está lleno.
+ *
+ * push puede llamarse desde cualquier hilo; pop solo desde el hilo consumidor.
+ */
+template <class T>
+class MpscQueue {
+    public:
+
+    explicit MpscQueue(std::size_t capacity = 4096) {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        slots_.reset(new Slot[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask_ = size - 1;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * @brief Encola value si queda sitio. Thread-safe.
+     * @return false si la cola está llena (value no se modifica).
+     */
+    bool try_push(T& value) {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Llena: el consumidor no ha liberado el slot
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Extrae el elemento más antiguo. Solo desde el hilo consumidor.
+     * @return false si la cola está vacía.
+     */
+    bool try_pop(T& value) {
+        Slot& slot = slots_[head_ & mask_];
+        std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != head_ + 1) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.value = T();
+        slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+    /**
+     * @brief Solo desde el hilo consumidor: true si queda algún slot reservado sin extraer.
+     *
+     * Incluye los reservados que su productor aún no ha publicado: try_pop() se
+     * detiene en el primero de ellos aunque los siguientes ya estén publicados.
+     */
+    bool claimed() const { return tail_.load(std::memory_order_acquire) != head_; }
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    private:
+
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_ = 0;
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::size_t head_ = 0;
+};
+
+#endif // MPSC_QUEUE_H
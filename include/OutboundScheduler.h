@@ -0,0 +1,131 @@
+#ifndef OUTBOUND_SCHEDULER_H
+#define OUTBOUND_SCHEDULER_H
+
+#include "SmallFunction.h"
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class OutboundScheduler
+ * @brief Control de flood de los mensajes salientes (envíos y ediciones).
+ *
+ * Cada envío consume un token del cubo global y otro del cubo de su chat. Si no
+ * hay tokens, el mensaje espera en la cola FIFO del chat y el bucle principal lo
+ * libera con pump() cuando se rellenan. Mientras espera, una edición nueva del
+ * mismo (chat_id, message_id) sustituye el texto de la pendiente, y las
+ * ediciones con el mismo texto que lo último enviado se descartan. Un
+ * retry_after de Telegram bloquea el chat durante ese tiempo y el mensaje
+ * vuelve a la cabeza de su cola, así que el estado final nunca se pierde.
+ *
+ * submit() puede llamarse desde cualquier hilo; pump() y retry() desde el bucle.
+ */
+class OutboundScheduler {
+    public:
+
+    using Clock = std::chrono::steady_clock;
+
+    // Límites por defecto de la Bot API: ~30 mensajes/s en total y ~1/s por chat
+    struct Config {
+        double global_rate = 30.0;  // tokens por segundo
+        double global_burst = 30.0; // tokens máximos acumulados
+        double chat_rate = 1.0;
+        double chat_burst = 3.0;
+    };
+
+    // Aviso del ID real de un envío (-1 si falla): move-only y sin heap para lambdas pequeñas
+    using SentCallback = SmallFunction<void(std::int64_t message_id), 48>;
+
+    struct Message {
+        enum Kind : std::uint8_t { Text, Edit };
+        Kind kind = Text;
+        std::int64_t chat_id = 0;
+        std::int64_t message_id = 0;                     // solo ediciones
+        std::string text;
+        SentCallback callback;                           // solo envíos
+        std::coroutine_handle<> waiter{};                // solo envíos desde una corrutina: se reanuda con el ID real
+        std::int64_t* result = nullptr;                  // dónde deja el ID real antes de reanudar waiter
+    };
+
+    struct Stats {
+        std::uint64_t sent = 0;       // liberados para enviar
+        std::uint64_t delayed = 0;    // encolados por falta de tokens
+        std::uint64_t coalesced = 0;  // ediciones sustituidas por otra más reciente
+        std::uint64_t unchanged = 0;  // ediciones descartadas por no cambiar el texto
+        std::uint64_t retried = 0;    // reencolados por retry_after
+        std::uint64_t queued = 0;     // pendientes ahora mismo
+    };
+
+    OutboundScheduler();
+    explicit OutboundScheduler(const Config& config);
+
+    void set_config(const Config& config);
+
+    /**
+     * @brief Entrega un mensaje al planificador.
+     * @return true si puede enviarse ya (message sigue siendo del llamante);
+     *         false si queda encolado, fusionado o descartado.
+     */
+    bool submit(Message& message, Clock::time_point now);
+
+    /**
+     * @brief Añade a out los mensajes encolados que ya tienen tokens, en round-robin por chat.
+     * @return Número de mensajes liberados.
+     */
+    std::size_t pump(Clock::time_point now, std::vector<Message>& out);
+
+    /**
+     * @brief Reencola un mensaje rechazado por flood y bloquea su chat retry_after.
+     */
+    void retry(Message message, std::chrono::seconds retry_after, Clock::time_point now);
+
+    /**
+     * @brief Olvida el último texto enviado de un mensaje que ya no se editará más.
+     */
+    void forget(std::int64_t chat_id, std::int64_t message_id);
+
+    /**
+     * @brief Tiempo hasta que algún mensaje encolado pueda salir, acotado por max_wait.
+     */
+    Clock::duration next_wait(Clock::time_point now, Clock::duration max_wait) const;
+
+    Stats stats() const;
+
+    private:
+
+    struct Bucket {
+        double tokens = 0.0;
+        Clock::time_point refilled;
+    };
+
+    struct ChatState {
+        Bucket bucket;
+        Clock::time_point blocked_until;
+        std::deque<Message> queue;
+        std::unordered_map<std::int64_t, std::size_t> last_sent; // message_id -> hash del texto
+        bool ready = false;                                      // está en ready_
+    };
+
+    static void refill(Bucket& bucket, double rate, double burst, Clock::time_point now);
+    bool can_send_locked(ChatState& chat, Clock::time_point now);
+    void consume_locked(ChatState& chat, const Message& message);
+    void mark_ready_locked(std::int64_t chat_id, ChatState& chat);
+    void sweep_locked(Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    Config config_;
+    Bucket global_;
+    std::unordered_map<std::int64_t, ChatState> chats_;
+    std::deque<std::int64_t> ready_; // chats con mensajes encolados
+    Clock::time_point last_sweep_;
+    Stats stats_;
+};
+
+#endif // OUTBOUND_SCHEDULER_H
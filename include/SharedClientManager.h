@@ -0,0 +1,78 @@
+#ifndef SHARED_CLIENT_MANAGER_H
+#define SHARED_CLIENT_MANAGER_H
+
+#include "TdTransport.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @class SharedClientManager
+ * @brief Un único backend (td::ClientManager o el simulado) para varios bots.
+ *
+ * td::ClientManager aloja muchos clientes y los multiplexa en un solo receive().
+ * Aquí un hilo propio hace ese receive() y reparte cada respuesta, por su
+ * client_id, al buzón de la sesión que lo creó. Cada TelegramBot recibe una
+ * sesión (open_session()) que implementa TdTransport sobre su buzón, así que
+ * su bucle principal no cambia.
+ *
+ * El reset() de una sesión solo cierra su cliente (td_api::close) y crea otro:
+ * las demás sesiones siguen conectadas. Lo que llegue de un cliente ya cerrado
+ * se descarta.
+ */
+class SharedClientManager {
+    public:
+
+    struct Stats {
+        std::uint64_t received = 0;      // respuestas recibidas del backend
+        std::uint64_t dropped = 0;       // de clientes ya cerrados o desconocidos
+        std::uint64_t sessions = 0;      // clientes vivos
+    };
+
+    // Backend null = td::ClientManager
+    explicit SharedClientManager(std::unique_ptr<TdTransport> backend = nullptr);
+    ~SharedClientManager();
+
+    SharedClientManager(const SharedClientManager&) = delete;
+    SharedClientManager& operator=(const SharedClientManager&) = delete;
+
+    /**
+     * @brief Transporte para un bot. Debe destruirse antes que el SharedClientManager.
+     */
+    std::unique_ptr<TdTransport> open_session();
+
+    void start();
+    void stop();
+
+    Stats stats() const;
+
+    private:
+
+    class Session;
+
+    struct Inbox {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<TdTransport::Response> responses;
+    };
+
+    std::int32_t create_client(const std::shared_ptr<Inbox>& inbox);
+    void close_client(std::int32_t client_id);
+    void receive_loop();
+
+    std::unique_ptr<TdTransport> backend_;
+    mutable std::mutex routes_mutex_;
+    std::unordered_map<std::int32_t, std::shared_ptr<Inbox>> routes_;
+    std::atomic<bool> running_{false};
+    std::atomic<std::uint64_t> received_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::thread thread_;
+};
+
+#endif // SHARED_CLIENT_MANAGER_H
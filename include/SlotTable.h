@@ -0,0 +1,164 @@
+#ifndef SLOT_TABLE_H
+#define SLOT_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @class SlotTable
+ * @brief Tabla densa indexada por una clave entera (file_id, ID de mensaje), con
+ * la parte caliente y la fría de cada entrada en arrays separados.
+ *
+ * Los registros viven contiguos en hot_ / cold_ (sin huecos: al borrar, el
+ * último ocupa el sitio del borrado). Un índice de direccionamiento abierto con
+ * sondeo lineal, de 8 bytes por cubeta y ocupación máxima del 50 %, traduce la
+ * clave a su slot (16 bytes por cubeta con claves de 64 bits). Una búsqueda suele ser una sola línea de caché del índice
+ * más la del registro caliente; los textos de la parte fría no se tocan salvo
+ * que se pidan.
+ *
+ * Los slots son estables hasta el siguiente insert() o erase(): quien los use
+ * entre llamadas debe volver a buscarlos. No es thread-safe.
+ */
+template <class Hot, class Cold, class Key = std::int32_t>
+class SlotTable {
+    public:
+
+    static constexpr std::size_t npos = ~std::size_t(0);
+
+    explicit SlotTable(std::size_t initial_capacity = 64) {
+        std::size_t capacity = 16;
+        while (capacity < initial_capacity * 2) capacity <<= 1;
+        rehash(capacity);
+    }
+
+    /**
+     * @brief Slot de key, o npos si no está.
+     */
+    std::size_t find(Key key) const {
+        for (std::size_t i = bucket_of(key);; i = (i + 1) & mask_) {
+            const Bucket& bucket = index_[i];
+            if (bucket.slot == EMPTY) return npos;
+            if (bucket.key == key) return bucket.slot;
+        }
+    }
+
+    /**
+     * @brief Inserta (o sustituye) la entrada de key.
+     * @return Slot de la entrada.
+     */
+    std::size_t insert(Key key, Hot hot, Cold cold) {
+        std::size_t slot = find(key);
+        if (slot != npos) {
+            hot_[slot] = std::move(hot);
+            cold_[slot] = std::move(cold);
+            return slot;
+        }
+
+        if ((keys_.size() + 1) * 2 > index_.size()) rehash(index_.size() * 2);
+
+        slot = keys_.size();
+        keys_.push_back(key);
+        hot_.push_back(std::move(hot));
+        cold_.push_back(std::move(cold));
+
+        std::size_t i = bucket_of(key);
+        while (index_[i].slot != EMPTY) i = (i + 1) & mask_;
+        index_[i] = Bucket{ key, static_cast<std::uint32_t>(slot) };
+        return slot;
+    }
+
+    /**
+     * @brief Elimina la entrada de un slot. La última entrada pasa a ocupar su sitio.
+     */
+    void erase(std::size_t slot) {
+        Key key = keys_[slot];
+        std::size_t i = bucket_position(key);
+
+        // Borrado con desplazamiento hacia atrás: sin lápidas que alarguen los sondeos
+        std::size_t j = i;
+        while (true) {
+            j = (j + 1) & mask_;
+            if (index_[j].slot == EMPTY) break;
+            std::size_t ideal = bucket_of(index_[j].key);
+            if (((j - ideal) & mask_) >= ((j - i) & mask_)) {
+                index_[i] = index_[j];
+                i = j;
+            }
+        }
+        index_[i].slot = EMPTY;
+
+        std::size_t last = keys_.size() - 1;
+        if (slot != last) {
+            keys_[slot] = keys_[last];
+            hot_[slot] = std::move(hot_[last]);
+            cold_[slot] = std::move(cold_[last]);
+            index_[bucket_position(keys_[slot])].slot = static_cast<std::uint32_t>(slot);
+        }
+        keys_.pop_back();
+        hot_.pop_back();
+        cold_.pop_back();
+    }
+
+    void clear() {
+        keys_.clear();
+        hot_.clear();
+        cold_.clear();
+        for (Bucket& bucket : index_) bucket.slot = EMPTY;
+    }
+
+    Hot& hot(std::size_t slot) { return hot_[slot]; }
+    const Hot& hot(std::size_t slot) const { return hot_[slot]; }
+    Cold& cold(std::size_t slot) { return cold_[slot]; }
+    const Cold& cold(std::size_t slot) const { return cold_[slot]; }
+    Key key(std::size_t slot) const { return keys_[slot]; }
+
+    std::size_t size() const { return keys_.size(); }
+    bool empty() const { return keys_.empty(); }
+
+    private:
+
+    static constexpr std::uint32_t EMPTY = ~std::uint32_t(0);
+
+    struct Bucket {
+        Key key = 0;
+        std::uint32_t slot = EMPTY;
+    };
+
+    // Hash de Fibonacci: los file_id son casi consecutivos y así se reparten por todo el índice
+    // (los bits altos del producto dependen de todos los de la clave, también en los ID de mensaje)
+    std::size_t bucket_of(Key key) const {
+        using Bits = typename std::make_unsigned<Key>::type;
+        return static_cast<std::size_t>((std::uint64_t(Bits(key)) * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+
+    // Cubeta de una clave que está en la tabla
+    std::size_t bucket_position(Key key) const {
+        std::size_t i = bucket_of(key);
+        while (index_[i].key != key || index_[i].slot == EMPTY) i = (i + 1) & mask_;
+        return i;
+    }
+
+    void rehash(std::size_t capacity) {
+        index_.assign(capacity, Bucket());
+        mask_ = capacity - 1;
+        shift_ = 64;
+        for (std::size_t c = capacity; c > 1; c >>= 1) --shift_;
+        for (std::size_t slot = 0; slot < keys_.size(); ++slot) {
+            std::size_t i = bucket_of(keys_[slot]);
+            while (index_[i].slot != EMPTY) i = (i + 1) & mask_;
+            index_[i] = Bucket{ keys_[slot], static_cast<std::uint32_t>(slot) };
+        }
+    }
+
+    std::vector<Bucket> index_;
+    std::vector<Key> keys_;
+    std::vector<Hot> hot_;
+    std::vector<Cold> cold_;
+    std::size_t mask_ = 0;
+    unsigned shift_ = 64;
+};
+
+#endif // SLOT_TABLE_H
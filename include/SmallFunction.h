@@ -0,0 +1,147 @@
+#ifndef SMALL_FUNCTION_H
+#define SMALL_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <class Signature, std::size_t Capacity = 48>
+class SmallFunction;
+
+/**
+ * @class SmallFunction
+ * @brief Callable move-only con buffer interno (small-buffer optimization).
+ *
+ * Sustituye a std::function en los caminos calientes: las lambdas cuyo tamaño
+ * cabe en Capacity se construyen dentro del propio objeto, sin reservar memoria
+ * en el heap. Las que no caben se guardan en el heap como último recurso.
+ * Al ser move-only admite capturas que no se pueden copiar (unique_ptr, etc.).
+ */
+template <class R, class... Args, std::size_t Capacity>
+class SmallFunction<R(Args...), Capacity> {
+    public:
+
+    SmallFunction() noexcept = default;
+    SmallFunction(std::nullptr_t) noexcept {}
+
+    template <class F,
+              class D = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<D, SmallFunction>::value &&
+                                              !std::is_same<D, std::nullptr_t>::value>::type>
+    SmallFunction(F&& f) {
+        assign<D>(std::forward<F>(f));
+    }
+
+    SmallFunction(SmallFunction&& other) noexcept {
+        move_from(other);
+    }
+
+    SmallFunction& operator=(SmallFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    SmallFunction& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    SmallFunction(const SmallFunction&) = delete;
+    SmallFunction& operator=(const SmallFunction&) = delete;
+
+    ~SmallFunction() { reset(); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    R operator()(Args... args) {
+        return ops_->invoke(storage_, std::forward<Args>(args)...);
+    }
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    /**
+     * @brief Indica si el callable está alojado en el buffer interno.
+     */
+    bool is_inline() const noexcept { return ops_ && ops_->inline_storage; }
+
+    private:
+
+    struct Ops {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+        bool inline_storage;
+    };
+
+    template <class D>
+    static constexpr bool fits_inline() {
+        return sizeof(D) <= Capacity &&
+               alignof(std::max_align_t) % alignof(D) == 0 &&
+               std::is_nothrow_move_constructible<D>::value;
+    }
+
+    template <class D>
+    struct InlineOps {
+        static R invoke(void* s, Args&&... args) {
+            return (*static_cast<D*>(s))(std::forward<Args>(args)...);
+        }
+        static void move(void* dst, void* src) noexcept {
+            ::new (dst) D(std::move(*static_cast<D*>(src)));
+            static_cast<D*>(src)->~D();
+        }
+        static void destroy(void* s) noexcept {
+            static_cast<D*>(s)->~D();
+        }
+        static constexpr Ops ops = { &invoke, &move, &destroy, true };
+    };
+
+    template <class D>
+    struct HeapOps {
+        static D*& ptr(void* s) { return *static_cast<D**>(s); }
+        static R invoke(void* s, Args&&... args) {
+            return (*ptr(s))(std::forward<Args>(args)...);
+        }
+        static void move(void* dst, void* src) noexcept {
+            ::new (dst) D*(ptr(src));
+        }
+        static void destroy(void* s) noexcept {
+            delete ptr(s);
+        }
+        static constexpr Ops ops = { &invoke, &move, &destroy, false };
+    };
+
+    template <class D, class F>
+    void assign(F&& f) {
+        if constexpr (fits_inline<D>()) {
+            ::new (static_cast<void*>(storage_)) D(std::forward<F>(f));
+            ops_ = &InlineOps<D>::ops;
+        } else {
+            ::new (static_cast<void*>(storage_)) D*(new D(std::forward<F>(f)));
+            ops_ = &HeapOps<D>::ops;
+        }
+    }
+
+    void move_from(SmallFunction& other) noexcept {
+        if (other.ops_) {
+            other.ops_->move(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    static_assert(Capacity >= sizeof(void*), "SmallFunction: capacidad insuficiente");
+
+    alignas(std::max_align_t) unsigned char storage_[Capacity];
+    const Ops* ops_ = nullptr;
+};
+
+#endif // SMALL_FUNCTION_H
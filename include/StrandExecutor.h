@@ -0,0 +1,71 @@
+#ifndef STRAND_EXECUTOR_H
+#define STRAND_EXECUTOR_H
+
+#include "SmallFunction.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class StrandExecutor
+ * @brief Pool de hilos con ejecución ordenada por clave (strands).
+ *
+ * Cada clave (chat_id, o la de un archivo) se asigna siempre al mismo hilo, así que las tareas de
+ * una misma clave se ejecutan en orden de llegada y nunca en paralelo, mientras
+ * que claves distintas se reparten entre todos los hilos.
+ * Con 0 hilos las tareas se ejecutan en línea en el hilo que las publica.
+ */
+class StrandExecutor {
+    public:
+
+    using Task = SmallFunction<void(), 64>;
+
+    explicit StrandExecutor(std::size_t threads = 0);
+    ~StrandExecutor();
+
+    StrandExecutor(const StrandExecutor&) = delete;
+    StrandExecutor& operator=(const StrandExecutor&) = delete;
+
+    /**
+     * @brief Encola task en el strand de key.
+     */
+    void post(std::uint64_t key, Task task);
+
+    /**
+     * @brief Espera a que no quede ninguna tarea encolada ni en ejecución.
+     */
+    void wait_idle();
+
+    /**
+     * @brief Ejecuta las tareas pendientes y detiene los hilos.
+     */
+    void shutdown();
+
+    std::size_t threads() const { return workers_.size(); }
+    std::uint64_t executed() const { return executed_.load(std::memory_order_relaxed); }
+
+    private:
+
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Task> queue;
+        bool stop = false;
+        std::thread thread;
+    };
+
+    void worker_loop(Worker& worker);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<std::uint64_t> pending_{0};
+    std::atomic<std::uint64_t> executed_{0};
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+};
+
+#endif // STRAND_EXECUTOR_H
@@ -0,0 +1,76 @@
+#ifndef TD_TRANSPORT_H
+#define TD_TRANSPORT_H
+
+#include <td/telegram/Client.h>
+#include <td/telegram/td_api.h>
+
+#include <cstdint>
+#include <memory>
+
+/**
+ * @class TdTransport
+ * @brief Interfaz entre el bot y el backend de TDLib.
+ *
+ * Abstrae el send/receive de td::ClientManager para poder sustituir TDLib por
+ * un backend local (FakeTelegramServer) en pruebas de carga y benchmarks.
+ * send() puede llamarse desde cualquier hilo; receive() solo desde el bucle principal.
+ */
+class TdTransport {
+    public:
+
+    using Response = td::ClientManager::Response;
+
+    virtual ~TdTransport() = default;
+
+    virtual std::int32_t create_client_id() = 0;
+    virtual void send(std::int32_t client_id, std::uint64_t request_id,
+                      td::td_api::object_ptr<td::td_api::Function> request) = 0;
+    virtual Response receive(double timeout) = 0;
+
+    /**
+     * @brief Descarta la instancia actual y empieza de cero (reinicio del cliente).
+     */
+    virtual void reset() = 0;
+
+    /**
+     * @brief true si el backend descarga en paralelo varios rangos de un mismo archivo.
+     *
+     * TDLib mantiene un único offset/limit por file_id (un downloadFile nuevo
+     * sustituye al anterior), así que con ClientManager no se usa.
+     */
+    virtual bool supports_ranged_downloads() const { return false; }
+};
+
+/**
+ * @class ClientManagerTransport
+ * @brief Transporte real sobre td::ClientManager.
+ */
+class ClientManagerTransport : public TdTransport {
+    public:
+
+    ClientManagerTransport() : manager_(new td::ClientManager()) {}
+
+    std::int32_t create_client_id() override {
+        return manager_->create_client_id();
+    }
+
+    void send(std::int32_t client_id, std::uint64_t request_id,
+              td::td_api::object_ptr<td::td_api::Function> request) override {
+        manager_->send(client_id, request_id, std::move(request));
+    }
+
+    Response receive(double timeout) override {
+        return manager_->receive(timeout);
+    }
+
+    void reset() override {
+        manager_.reset();
+        manager_.reset(new td::ClientManager());
+    }
+
+    private:
+
+    std::unique_ptr<td::ClientManager> manager_;
+};
+
+#endif // TD_TRANSPORT_H
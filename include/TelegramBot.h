@@ -7,13 +7,42 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <cstdio>     // Para printf
 #include <cstring>    // Para strcmp, strstr
 #include <cstdlib>    // Para atoi
 #include <map>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 #include <functional>
+#include <memory>
+#include <random>
+
+#include "SmallFunction.h"
+#include "BotTask.h"
+#include "CommandRouter.h"
+#include "AccessControl.h"
+#include "HandlerTable.h"
+#include "SlotTable.h"
+#include "MpscQueue.h"
+#include "TimingWheel.h"
+#include "UpdateRecorder.h"
+#include "TdTransport.h"
+#include "StrandExecutor.h"
+#include "OutboundScheduler.h"
+#include "DownloadScheduler.h"
+#include "DedupIndex.h"
+#include "DiskReservations.h"
+#include "DownloadJournal.h"
+#include "DownloadSegments.h"
+#include "FileHasher.h"
+#include "FileRelocator.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
 
 /**
  * @class TelegramBot
@@ -23,6 +52,9 @@
  * descargas de archivos, manejo de errores y respuestas automáticas.
  */
 class TelegramBot {
+    // Acceso a los caminos internos desde bench/bench_hot_paths.cpp
+    friend class TelegramBotBench;
+
     private:
     
     struct FileType {
@@ -32,61 +64,373 @@ class TelegramBot {
         int64_t fileSize;
     };
     
+    // Parte caliente de una descarga: lo que lee y escribe cada updateFile
+    struct DownloadProgress {
+        int64_t chat_id = 0;
+        int64_t message_id = -1;        // mensaje de progreso (-1 hasta tener el ID real)
+        int64_t metered = 0;            // bytes ya sumados a tgbot_downloaded_bytes_total
+        int64_t reported_bytes = 0;     // bytes en el último reporte (para la velocidad)
+        std::chrono::steady_clock::time_point reported_at{};  // vacío = sin reportes todavía
+        int32_t reported_pct = 0;       // último múltiplo de 5% reportado
+        bool segmented = false;         // el progreso sale de DownloadInfo::segments
+        bool disk_checked = false;      // ya se intentó preasignar su archivo parcial
+    };
+
+    // Parte fría: textos y estado que solo se usan al empezar, en cola o al terminar
     struct DownloadInfo {
-        int64_t chat_id;
-        int64_t message_id;
+        int64_t chat_id;                // copia inmutable de DownloadProgress::chat_id para el aviso final
         std::string original_text;
         time_t start_time;
         time_t finish_time;
         FileType file;
+        std::size_t queue_position = 0; // posición mostrada en el mensaje "en cola" (0 = nunca en cola)
+        int64_t offset = 0;             // bytes ya descargados al reanudar desde el diario
+        DownloadSegments segments{};    // rangos en paralelo (vacío = una sola transferencia)
+        std::string unique_id{};        // remoteFile.unique_id: clave del índice de duplicados
+        std::string remote_id{};        // remoteFile.id: recupera el archivo tras reiniciar el cliente
+        std::vector<int64_t> waiters{}; // otros chats que reenviaron el mismo archivo en curso
+    };
+
+    using DownloadTable = SlotTable<DownloadProgress, DownloadInfo>;
+
+    // Handler de respuesta de una query: move-only y sin heap para lambdas pequeñas
+    using QueryHandler = SmallFunction<void(td::td_api::object_ptr<td::td_api::Object>), 64>;
+
+    // Envíos esperando su ID real, por ID temporal: la corrutina que espera (handle y
+    // dónde dejar el ID) en la parte caliente y el callback de los demás en la fría
+    struct MessageWaiter {
+        std::coroutine_handle<> handle{};
+        int64_t* result = nullptr;
     };
 
-    using DownloadMap = std::unordered_map<int32_t, DownloadInfo>;
+    using MessageCallback = OutboundScheduler::SentCallback;
+    using PendingMessages = SlotTable<MessageWaiter, MessageCallback, int64_t>;
 
-    // Mapa para callbacks pendientes esperando ID real
-    std::map<int64_t, std::function<void(int64_t)>> pending_message_callbacks_;
+    // Solo desde el bucle principal
+    PendingMessages pending_messages_;
 
     // Credenciales
     std::string api_id_;
     std::string api_hash_;
     std::string bot_token_;
-    std::string download_pàth_;
+    std::string download_path_;
     
-    td::ClientManager* client_manager_; 
-    std::int32_t client_id_;
+    std::unique_ptr<TdTransport> transport_;
+    std::atomic<std::int32_t> client_id_{0};        // lo escribe el bucle principal; send_query lo lee desde cualquier hilo
     
     // Estado del bot
     std::atomic<bool> running_;
     std::atomic<bool> are_authorized_;
     std::atomic<bool> need_restart_;
+
+    // Reinicio en caliente: mismo transporte y misma bot_db, cliente nuevo. Salvo
+    // los atómicos, solo lo toca el bucle principal
+    struct DetachedDownload {
+        DownloadJournal::Entry entry;
+        std::vector<int64_t> waiters;
+    };
+
+    bool parameters_sent_ = false;                  // setTdlibParameters ya enviado al cliente actual
+    std::atomic<bool> closing_{false};              // close pedido tras un 401, esperando authorizationStateClosed
+    std::atomic<bool> cold_restart_{false};         // el cliente no cerró a tiempo: se descarta el transporte
+    std::chrono::steady_clock::time_point close_deadline_{};
+    bool restart_scheduled_ = false;
+    std::chrono::steady_clock::time_point restart_at_{};
+    unsigned reconnect_attempts_ = 0;               // reinicios seguidos sin llegar a Ready
+    bool reconnecting_ = false;
+    std::chrono::steady_clock::time_point dropped_at_{};  // primer corte de la racha actual
+    std::minstd_rand jitter_{std::random_device{}()};
+    std::atomic<std::uint64_t> reconnects_{0};
+    std::atomic<std::uint64_t> reconnect_ready_ns_total_{0};
+    std::atomic<std::uint64_t> reconnect_ready_ns_last_{0};
+
+    // Descargas del cliente anterior que se vuelven a asociar al nuevo al autorizarse
+    std::mutex detached_mutex_;
+    std::vector<DetachedDownload> detached_;
     
     // Hilo de trabajo
     std::thread worker_thread_;
     
-    // Sistema de queries
-    std::uint64_t current_query_id_ = 1;
-    std::map<std::uint64_t, std::function<void(td::td_api::object_ptr<td::td_api::Object>)>> handlers_;
+    // Sistema de queries. Cualquier hilo reserva su query_id con current_query_id_
+    // y publica el handler en submissions_; el bucle principal es el único dueño
+    // de handlers_ y timers_ y los registra antes de despachar respuestas
+    struct Submission {
+        std::uint64_t query_id = 0;
+        QueryHandler handler;
+    };
+
+    std::atomic<std::uint64_t> current_query_id_{1};
+    MpscQueue<Submission> submissions_;
+    std::atomic<bool> has_overflow_{false};        // submissions_ llena: se usa overflow_submissions_
+    std::mutex overflow_mutex_;
+    std::vector<Submission> overflow_submissions_;
+    HandlerTable<QueryHandler> handlers_;
+
+    // Respuestas que llegan antes que su handler: otro productor reservó un slot
+    // anterior de submissions_ sin publicarlo todavía y el drenado se detiene en él.
+    // Se entregan al registrarse su handler. Casi siempre vacío
+    std::vector<std::pair<std::uint64_t, td::td_api::object_ptr<td::td_api::Object>>> parked_responses_;
+    std::uint64_t parked_total_ = 0;
     
     // Estado de autorización
     td::td_api::object_ptr<td::td_api::AuthorizationState> authorization_state_;
 
+    // Expiración de handlers huérfanos
+    struct TimerKey {
+        enum Kind : std::uint8_t { Query, PendingMessage };
+        Kind kind;
+        std::int64_t id;
+    };
+
+    static constexpr std::chrono::milliseconds QUERY_TIMEOUT{60 * 1000};
+    static constexpr std::chrono::milliseconds PENDING_MESSAGE_TIMEOUT{5 * 60 * 1000};
+
+    TimingWheel<TimerKey> timers_;
+    std::vector<TimerKey> expired_timers_;
+    std::uint64_t expired_handlers_total_ = 0;
+
+    // Grabación / reproducción del flujo de updates
+    UpdateRecorder recorder_;
+    std::atomic<bool> offline_{false};              // true durante replay: no se envía nada a TDLib
+    std::atomic<std::uint64_t> offline_queries_{0}; // queries descartadas en modo offline
+
+    // Recepción por lotes: buffer reutilizable y contadores
+    struct LoopCounters {
+        std::atomic<std::uint64_t> batches{0};
+        std::atomic<std::uint64_t> objects{0};
+        std::atomic<std::uint64_t> coalesced{0};
+        std::atomic<std::uint64_t> max_batch{0};
+        std::atomic<std::uint64_t> drain_ns_total{0};
+        std::atomic<std::uint64_t> drain_ns_max{0};
+        std::atomic<std::uint64_t> dispatch_ns_total{0};
+    };
+
+    std::size_t max_batch_size_ = 256;
+    std::vector<TdTransport::Response> batch_;
+    std::unordered_set<std::int32_t> batch_files_;
+    LoopCounters loop_counters_;
+    std::vector<std::chrono::steady_clock::time_point> batch_received_;  // llegada de cada objeto del lote
+
+    // Métricas de /metrics: el camino caliente solo hace fetch_add/store relaxed
+    static constexpr std::size_t UPDATE_TYPES = 12;
+    struct BotMetrics {
+        MetricCounter updates[UPDATE_TYPES];     // por tipo (ver UPDATE_TYPE_NAMES)
+        MetricGauge handlers;                    // handlers_.size() tras cada lote
+        MetricGauge pending_callbacks;           // pending_messages_.size() tras cada lote
+        MetricCounter downloaded_bytes;
+        MetricCounter edits;
+        MetricCounter edit_errors;
+        MetricCounter edit_flood_waits;
+        LatencyHistogram dispatch_latency;       // de la recepción en main_loop a process_response
+    };
+    BotMetrics metrics_;
+    std::unique_ptr<MetricsServer> metrics_server_;
+
+    // Control de flood de mensajes salientes
+    OutboundScheduler outbound_;
+    std::vector<OutboundScheduler::Message> outbound_ready_;
+
+    // Comandos "/..." de los mensajes de texto
+    CommandRouter commands_;
+
+    // Filtro de updateNewMessage, solo desde el bucle principal
+    AccessControl access_;
+
+    // Backlog del arranque, solo desde el bucle principal
+    bool skip_backlog_ = true;
+    bool backlog_summary_ = false;
+    std::chrono::seconds backlog_grace_{0};
+    std::int64_t backlog_cutoff_ = 0;                              // fecha unix desde la que se atiende (0 = todo)
+    std::unordered_map<int64_t, std::uint32_t> backlog_chats_;     // chat -> descartados, para el aviso
+    std::uint64_t backlog_pending_ = 0;                            // descartados aún sin resumir
+    std::chrono::steady_clock::time_point backlog_last_;           // último descartado
+    std::atomic<std::uint64_t> backlog_skipped_{0};
+
 
 public:
 
-    TelegramBot();
+    // Contadores por lote del bucle principal
+    struct LoopStats {
+        std::uint64_t batches = 0;
+        std::uint64_t objects = 0;
+        std::uint64_t coalesced = 0;        // updateFile descartados por uno más reciente del mismo archivo
+        std::uint64_t max_batch = 0;
+        std::uint64_t drain_ns_total = 0;   // tiempo drenando el transporte con timeout 0
+        std::uint64_t drain_ns_max = 0;
+        std::uint64_t dispatch_ns_total = 0;
+    };
+
+    explicit TelegramBot(std::unique_ptr<TdTransport> transport = nullptr);
     ~TelegramBot();
     
     // Funciones principales
     bool initialize(const std::string& api_id, const std::string& bot_token, const std::string& api_hash, const std::string& download_path);
     void run();
     void stop();
+
+    // Grabación y reproducción offline del flujo de TDLib
+    bool start_recording(const std::string& path);
+    bool replay(const std::string& path, bool realtime);
+
+    // Despacho multihilo ordenado por chat
+    bool set_dispatch_threads(std::size_t threads);
+
+    // Control de flood de mensajes salientes
+    void set_outbound_config(const OutboundScheduler::Config& config);
+
+    // Planificación de descargas
+    void set_download_limits(const DownloadScheduler::Config& config);
+    DownloadScheduler::Stats download_stats() const;
+
+    // Descarga por rangos en paralelo de los archivos grandes (si el backend lo admite)
+    void set_download_segments(std::int64_t threshold_bytes, std::size_t segments);
+
+    // Admisión por espacio libre: margen que se deja libre y tamaño mínimo para preasignar (0 = nunca)
+    void set_disk_policy(std::int64_t margin_bytes, std::int64_t preallocate_min_bytes);
+    DiskReservations::Stats disk_stats() const;
+
+    // Filtro de entrada: usuarios autorizados (vacío = cualquiera) y límite por usuario. Antes de run()
+    void set_access_config(const AccessControl::Config& config);
+    void set_allowed_users(std::vector<std::int64_t> users);
+    bool load_allowed_users(const std::string& path);   // se recarga solo al cambiar el archivo
+    AccessControl::Stats access_stats() const;
+
+    // Mensajes enviados antes del arranque (fecha < inicio - grace): se descartan sin
+    // extraerlos y, con summary, cada chat recibe un único aviso. Antes de run()
+    void set_backlog_policy(bool skip, std::chrono::seconds grace, bool summary);
+    std::uint64_t backlog_skipped() const { return backlog_skipped_.load(std::memory_order_relaxed); }
+
+    // Diario de descargas para reanudarlas tras un reinicio. Antes de run()
+    bool open_journal(const std::string& path);
+
+    // Índice de archivos ya descargados: los reenvíos no se descargan de nuevo. Antes de run()
+    bool open_dedup_index(const std::string& path);
+
+    // Recepción por lotes
+    void set_max_batch_size(std::size_t max_batch_size);
+    LoopStats loop_stats() const;
+
+    // Reinicios del cliente y tiempo desde el corte hasta volver a estar autorizado
+    struct ReconnectStats {
+        std::uint64_t reconnects = 0;
+        std::uint64_t ready_ns_total = 0;
+        std::uint64_t ready_ns_last = 0;
+    };
+    ReconnectStats reconnect_stats() const;
+
+    // Endpoint HTTP de métricas en formato Prometheus (port 0 = puerto libre)
+    bool start_metrics(const std::string& address, std::uint16_t port);
+    std::string render_metrics() const;
+
+    // Varias sesiones en un proceso (ver BotShards). Todo antes de run()
+    using DownloadRouter = std::function<bool(const DownloadJournal::Entry& entry)>;
+    void set_session_index(std::size_t index);
+    void set_download_only(bool download_only);
+    void set_download_router(DownloadRouter router);
+    void share_dedup_index(const TelegramBot& other);
+
+    // Registro de comandos: añadir los propios antes de run()
+    CommandRouter& commands() { return commands_; }
+
+    // Descarga un archivo recibido por otra sesión de la misma cuenta (por su remote_id)
+    void adopt_download(DownloadJournal::Entry entry);
+    bool is_ready() const { return are_authorized_; }
+
+    /**
+     * @brief Awaitable de una query: co_await bot.call(query) devuelve la respuesta de TDLib.
+     *
+     * La corrutina se reanuda dentro de process_response, en el hilo del bucle
+     * principal. El handler solo guarda el handle y el awaiter, así que cabe en
+     * el buffer de QueryHandler sin reservar memoria.
+     */
+    class QueryAwaiter {
+        public:
+
+        QueryAwaiter(TelegramBot& bot, td::td_api::object_ptr<td::td_api::Function> query)
+            : bot_(bot), query_(std::move(query)) {}
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        td::td_api::object_ptr<td::td_api::Object> await_resume() noexcept { return std::move(response_); }
+
+        private:
+
+        TelegramBot& bot_;
+        td::td_api::object_ptr<td::td_api::Function> query_;
+        td::td_api::object_ptr<td::td_api::Object> response_;
+    };
+
+    /**
+     * @brief Awaitable del ID real de un mensaje enviado (-1 si falla o expira).
+     *
+     * Solo desde el bucle principal, normalmente justo después de un call(sendMessage):
+     * se registra antes de que pueda llegar su updateMessageSendSucceeded.
+     */
+    class MessageIdAwaiter {
+        public:
+
+        MessageIdAwaiter(TelegramBot& bot, int64_t temp_id) : bot_(bot), temp_id_(temp_id) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        int64_t await_resume() const noexcept { return message_id_; }
+
+        private:
+
+        TelegramBot& bot_;
+        int64_t temp_id_;
+        int64_t message_id_ = -1;
+    };
+
+    /**
+     * @brief Awaitable de send_text_message: pasa por el control de flood y devuelve el ID real.
+     */
+    class SendTextAwaiter {
+        public:
+
+        SendTextAwaiter(TelegramBot& bot, int64_t chat_id, std::string text)
+            : bot_(bot), chat_id_(chat_id), text_(std::move(text)) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        int64_t await_resume() const noexcept { return message_id_; }
+
+        private:
+
+        TelegramBot& bot_;
+        int64_t chat_id_;
+        std::string text_;
+        int64_t message_id_ = -1;
+    };
+
+    QueryAwaiter call(td::td_api::object_ptr<td::td_api::Function> query) { return QueryAwaiter(*this, std::move(query)); }
+    MessageIdAwaiter real_message_id(int64_t temp_id) { return MessageIdAwaiter(*this, temp_id); }
+    SendTextAwaiter send_text(int64_t chat_id, std::string text) { return SendTextAwaiter(*this, chat_id, std::move(text)); }
     
 private:
 
-    DownloadMap downloads_;
+    // downloads_ se protege con downloads_mutex_
+    std::mutex downloads_mutex_;
+    DownloadTable downloads_;
+    DownloadScheduler download_scheduler_;
+    DownloadJournal journal_;
+    std::shared_ptr<DedupIndex> dedup_{std::make_shared<DedupIndex>()};  // compartido entre sesiones
+    DiskReservations disk_;
+    std::atomic<std::uint64_t> shared_downloads_{0};  // reenvíos unidos a una descarga en curso
+    std::atomic<std::int64_t> segment_threshold_{64 * 1024 * 1024};
+    std::atomic<std::size_t> segment_count_{4};
+
+    // Sesión dentro de un proceso con varias (0 = la única o la primera)
+    std::size_t session_index_ = 0;
+    bool download_only_ = false;            // no atiende mensajes: solo descargas adoptadas
+    DownloadRouter download_router_;        // reparte los vídeos nuevos entre sesiones
+    std::string files_directory() const;
+    std::string database_directory() const;
 
     // Bucle principal
     void main_loop();
+    void receive_batch(TdTransport::Response first);
+    void dispatch_batch();
     
     // Procesar respuestas
     void process_response(uint64_t query_id, td::td_api::object_ptr<td::td_api::Object> response);
@@ -97,31 +441,79 @@ private:
     void send_bot_token();
     
     void start_file_download(int32_t file_id);
+    void finish_download_slot(int32_t file_id, bool completed);
+    void apply_download_priorities();
+    void update_queue_messages();
+    void resume_downloads();
+    void resume_download(DownloadJournal::Entry entry, std::vector<int64_t> waiters,
+                         td::td_api::object_ptr<td::td_api::Object> response);
+    void detach_downloads();
+    void restart_client();
+    std::chrono::milliseconds reconnect_delay(unsigned attempt);
+    void fail_download(int32_t file_id, const DownloadInfo& info, int64_t message_id, const std::string& reason);
+    void finish_file(int32_t file_id, DownloadInfo info, const std::string& path, int64_t size);
+    void relocate_download(int32_t file_id, const DownloadInfo& info, const std::string& path,
+                           const std::string& checksum);
 
     // Manejo de mensajes
+    bool admit_message(const td::td_api::updateNewMessage& update);
+    void skip_backlog_message(const td::td_api::message& message, int64_t user_id);
+    void flush_backlog(std::chrono::steady_clock::time_point now);
     void handle_new_updateNewMessage(td::td_api::object_ptr<td::td_api::message> message);
-    std::string extract_updateNewMessage_data(int64_t chat_id, td::td_api::MessageContent* content);
-    std::string generate_response(const std::string& text);
+    std::string_view extract_updateNewMessage_data(int64_t chat_id, td::td_api::MessageContent* content);
+    std::string generate_response(int64_t chat_id, std::string_view text);
+    void register_commands();
     
     // Envío de mensajes
-    void send_text_message(int64_t chat_id, const std::string& text, std::function<void(int64_t message_id)> callback);
+    void send_text_message(int64_t chat_id, const std::string& text, MessageCallback callback);
+    void submit_text(OutboundScheduler::Message message);
+    void wait_message_id(int64_t temp_id, MessageWaiter waiter, MessageCallback callback);
+    void resolve_message_id(int64_t temp_id, int64_t message_id);
+    static void deliver_message_id(MessageWaiter waiter, MessageCallback& callback, int64_t message_id);
     //void send_text_message(int64_t chat_id, const std::string& text);
     void send_edited_message(int64_t chat_id, int64_t message_id, const std::string& text);
+    void dispatch_outbound(OutboundScheduler::Message message);
+    BotTask dispatch_text(OutboundScheduler::Message message);
+    void dispatch_edited_message(OutboundScheduler::Message message);
+    BotTask attach_progress_message(int32_t file_id, int64_t chat_id, std::string text);
+    void flush_outbound();
 
     void send_typing_action(int64_t chat_id);
     
-    void handle_video(int32_t chat_id, td::td_api::messageVideo* video);
+    void handle_video(int64_t chat_id, td::td_api::messageVideo* video);
+    void accept_download(int64_t chat_id, int32_t file_id, const FileType& file,
+                         const std::string& unique_id, const std::string& remote_id);
     
+    // Strand de los updates de un archivo: fijo desde el primero, esté o no ya en
+    // downloads_. El bit alto lo separa de las claves de chat
+    static uint64_t file_strand(int32_t file_id) { return (uint64_t(1) << 63) | static_cast<uint32_t>(file_id); }
     void handle_file_update(td::td_api::object_ptr<td::td_api::file> file);
     void handle_download_response(int32_t file_id, td::td_api::object_ptr<td::td_api::Object> response);
     
     // Manejo de errores
     void handle_error(td::td_api::error* error);
+
+    // Registro en el bucle principal de los handlers publicados por send_query
+    void drain_submissions();
+    void deliver_parked_responses();
+
+    // Expiración de handlers
+    void expire_timers();
+    std::size_t fail_pending_handlers(std::int32_t code, const std::string& reason);
     
     // Sistema de queries
     void send_query(
         td::td_api::object_ptr<td::td_api::Function> query,
-        std::function<void(td::td_api::object_ptr<td::td_api::Object>)> handler);
+        QueryHandler handler);
+
+    // Traslado de los archivos terminados a download_path_ (hilo propio)
+    std::unique_ptr<FileRelocator> relocator_;
+
+    // Checksum XXH64 incremental de las descargas en curso (hilo propio)
+    std::unique_ptr<FileHasher> hasher_;
+
+    // Hilos de despacho por chat. Último miembro: se destruye antes que el resto
+    std::unique_ptr<StrandExecutor> executor_;
 };
 
 #endif // TELEGRAM_BOT_H
\ No newline at end of file
@@ -0,0 +1,119 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @class TimingWheel
+ * @brief Rueda de temporizadores jerárquica (estilo kernel de Linux).
+ *
+ * Cada nivel tiene 64 slots; el nivel 0 avanza un slot por tick y los niveles
+ * superiores cubren rangos 64 veces mayores. Programar un temporizador es O(1)
+ * y avanzar el reloj solo toca el slot que vence (más una recolocación
+ * ocasional desde los niveles superiores).
+ *
+ * La cancelación es perezosa: al vencer se invoca on_expire(key) y es el
+ * llamante quien comprueba si la clave sigue viva. No es thread-safe.
+ */
+template <class Key>
+class TimingWheel {
+    public:
+
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimingWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(1000))
+        : tick_(tick), origin_(Clock::now()) {}
+
+    /**
+     * @brief Programa la expiración de key tras delay.
+     */
+    void schedule(Key key, std::chrono::milliseconds delay) {
+        std::uint64_t ticks = static_cast<std::uint64_t>((delay + tick_ - std::chrono::milliseconds(1)) / tick_);
+        if (ticks == 0) ticks = 1;
+        place(Entry{ current_tick_ + ticks, std::move(key) });
+        ++size_;
+    }
+
+    /**
+     * @brief Avanza el reloj hasta now e invoca on_expire(key) por cada entrada vencida.
+     * @return Número de entradas para las que on_expire devolvió true.
+     */
+    template <class Fn>
+    std::size_t advance(Clock::time_point now, Fn&& on_expire) {
+        std::uint64_t target = static_cast<std::uint64_t>((now - origin_) / tick_);
+        std::size_t reaped = 0;
+
+        while (current_tick_ < target) {
+            ++current_tick_;
+            cascade();
+
+            std::vector<Entry>& slot = levels_[0][current_tick_ & kSlotMask];
+            if (slot.empty()) continue;
+
+            // Se intercambia con un buffer propio: on_expire puede programar nuevas entradas
+            expired_.swap(slot);
+            for (Entry& entry : expired_) {
+                --size_;
+                if (on_expire(entry.key)) ++reaped;
+            }
+            expired_.clear();
+        }
+        return reaped;
+    }
+
+    /**
+     * @brief Entradas programadas (incluye las ya canceladas de forma perezosa).
+     */
+    std::size_t size() const { return size_; }
+
+    private:
+
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr std::uint64_t kSlots = 1u << kSlotBits;
+    static constexpr std::uint64_t kSlotMask = kSlots - 1;
+
+    struct Entry {
+        std::uint64_t expires;
+        Key key;
+    };
+
+    void place(Entry entry) {
+        std::uint64_t delta = entry.expires - current_tick_;
+        for (int level = 0; level < kLevels; ++level) {
+            if (delta < (kSlots << (kSlotBits * level)) || level == kLevels - 1) {
+                std::uint64_t index = (entry.expires >> (kSlotBits * level)) & kSlotMask;
+                levels_[level][index].push_back(std::move(entry));
+                return;
+            }
+        }
+    }
+
+    // Al pasar por el slot 0 de un nivel se bajan las entradas del siguiente
+    void cascade() {
+        for (int level = 1; level < kLevels; ++level) {
+            if ((current_tick_ & ((std::uint64_t(1) << (kSlotBits * level)) - 1)) != 0) break;
+
+            std::uint64_t index = (current_tick_ >> (kSlotBits * level)) & kSlotMask;
+            std::vector<Entry> moved;
+            moved.swap(levels_[level][index]);
+            for (Entry& entry : moved) {
+                place(std::move(entry));
+            }
+        }
+    }
+
+    std::chrono::milliseconds tick_;
+    Clock::time_point origin_;
+    std::uint64_t current_tick_ = 0;
+    std::size_t size_ = 0;
+    std::array<std::array<std::vector<Entry>, kSlots>, kLevels> levels_;
+    std::vector<Entry> expired_;
+};
+
+#endif // TIMING_WHEEL_H
@@ -0,0 +1,80 @@
+#ifndef UPDATE_RECORDER_H
+#define UPDATE_RECORDER_H
+
+#include <td/telegram/td_api.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * @class UpdateRecorder
+ * @brief Graba en un log binario compacto todo lo que devuelve ClientManager::receive.
+ *
+ * Formato: cabecera "TGRL" + versión, y después un registro por objeto:
+ * timestamp (ns desde el inicio), request_id, ID del tipo TDLib, longitud y payload.
+ * Solo se serializa el contenido de los tipos que procesa el bot; del resto se
+ * guarda el ID del tipo con payload vacío.
+ */
+class UpdateRecorder {
+    public:
+
+    UpdateRecorder() = default;
+    ~UpdateRecorder();
+
+    UpdateRecorder(const UpdateRecorder&) = delete;
+    UpdateRecorder& operator=(const UpdateRecorder&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return file_ != nullptr; }
+
+    void record(std::uint64_t request_id, const td::td_api::Object& object);
+
+    std::uint64_t records() const { return records_; }
+
+    private:
+
+    std::FILE* file_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+    std::string buffer_;
+    std::uint64_t records_ = 0;
+};
+
+/**
+ * @class UpdateReplayer
+ * @brief Lee un log generado por UpdateRecorder y reconstruye los objetos TDLib.
+ */
+class UpdateReplayer {
+    public:
+
+    struct Record {
+        std::uint64_t timestamp_ns;
+        std::uint64_t request_id;
+        std::int32_t type_id;
+        td::td_api::object_ptr<td::td_api::Object> object; // null si el tipo no se serializa
+    };
+
+    UpdateReplayer() = default;
+    ~UpdateReplayer();
+
+    UpdateReplayer(const UpdateReplayer&) = delete;
+    UpdateReplayer& operator=(const UpdateReplayer&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    /**
+     * @brief Lee el siguiente registro.
+     * @return false al llegar al final del log o si está corrupto.
+     */
+    bool next(Record& record);
+
+    private:
+
+    std::FILE* file_ = nullptr;
+    std::string buffer_;
+};
+
+#endif // UPDATE_RECORDER_H
@@ -0,0 +1,157 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/**
+ * @class XxHash64
+ * @brief XXH64 incremental (compatible con la referencia de xxHash, semilla 0 por defecto).
+ *
+ * Cuatro acumuladores independientes sobre bloques de 32 bytes: el compilador
+ * los intercala y el hash va a varios GB/s por núcleo, muy por encima de la
+ * velocidad de descarga. update() acepta trozos de cualquier tamaño.
+ */
+class XxHash64 {
+    public:
+
+    explicit XxHash64(std::uint64_t seed = 0) { reset(seed); }
+
+    void reset(std::uint64_t seed = 0) {
+        seed_ = seed;
+        v_[0] = seed + PRIME1 + PRIME2;
+        v_[1] = seed + PRIME2;
+        v_[2] = seed;
+        v_[3] = seed - PRIME1;
+        total_ = 0;
+        buffered_ = 0;
+    }
+
+    void update(const void* data, std::size_t size) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + size;
+        total_ += size;
+
+        // Completa el bloque a medias de la llamada anterior
+        if (buffered_ > 0) {
+            std::size_t take = 32 - buffered_;
+            if (size < take) {
+                std::memcpy(buffer_ + buffered_, p, size);
+                buffered_ += size;
+                return;
+            }
+            std::memcpy(buffer_ + buffered_, p, take);
+            consume(buffer_);
+            p += take;
+            buffered_ = 0;
+        }
+
+        std::uint64_t v0 = v_[0], v1 = v_[1], v2 = v_[2], v3 = v_[3];
+        while (end - p >= 32) {
+            v0 = round(v0, read64(p));
+            v1 = round(v1, read64(p + 8));
+            v2 = round(v2, read64(p + 16));
+            v3 = round(v3, read64(p + 24));
+            p += 32;
+        }
+        v_[0] = v0; v_[1] = v1; v_[2] = v2; v_[3] = v3;
+
+        buffered_ = static_cast<std::size_t>(end - p);
+        if (buffered_ > 0) std::memcpy(buffer_, p, buffered_);
+    }
+
+    std::uint64_t digest() const {
+        std::uint64_t h;
+        if (total_ >= 32) {
+            h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+            for (std::uint64_t v : v_) h = merge(h, v);
+        } else {
+            h = seed_ + PRIME5;
+        }
+        h += total_;
+
+        const unsigned char* p = buffer_;
+        std::size_t left = buffered_;
+        for (; left >= 8; left -= 8, p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * PRIME1 + PRIME4;
+        }
+        if (left >= 4) {
+            h ^= static_cast<std::uint64_t>(read32(p)) * PRIME1;
+            h = rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+            left -= 4;
+        }
+        for (; left > 0; --left, ++p) {
+            h ^= (*p) * PRIME5;
+            h = rotl(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // 16 dígitos hexadecimales, como xxh64sum
+    std::string hex() const {
+        char text[17];
+        std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(digest()));
+        return text;
+    }
+
+    std::uint64_t size() const { return total_; }
+
+    private:
+
+    static constexpr std::uint64_t PRIME1 = 11400714785074694791ULL;
+    static constexpr std::uint64_t PRIME2 = 14029467366897019727ULL;
+    static constexpr std::uint64_t PRIME3 = 1609587929392839161ULL;
+    static constexpr std::uint64_t PRIME4 = 9650029242287828579ULL;
+    static constexpr std::uint64_t PRIME5 = 2870177450012600261ULL;
+
+    static std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+        acc += input * PRIME2;
+        return rotl(acc, 31) * PRIME1;
+    }
+
+    static std::uint64_t merge(std::uint64_t acc, std::uint64_t v) {
+        acc ^= round(0, v);
+        return acc * PRIME1 + PRIME4;
+    }
+
+    // Lecturas little-endian sin alineación (x86 y ARM en modo LE)
+    static std::uint64_t read64(const unsigned char* p) {
+        std::uint64_t value;
+        std::memcpy(&value, p, 8);
+        return value;
+    }
+
+    static std::uint32_t read32(const unsigned char* p) {
+        std::uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    void consume(const unsigned char* block) {
+        v_[0] = round(v_[0], read64(block));
+        v_[1] = round(v_[1], read64(block + 8));
+        v_[2] = round(v_[2], read64(block + 16));
+        v_[3] = round(v_[3], read64(block + 24));
+    }
+
+    std::uint64_t seed_;
+    std::uint64_t v_[4];
+    std::uint64_t total_;
+    unsigned char buffer_[32];
+    std::size_t buffered_;
+};
+
+#endif // XXHASH64_H
@@ -1,75 +1,306 @@
 #include "TelegramBot.h"
+#include "BotShards.h"
+#include "FakeTelegramServer.h"
+#include <atomic>
 #include <iostream>
 #include <cstdlib>
 #include <signal.h>
 #include <thread>
 #include <chrono>
-#include "rzLogger.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "AsyncLog.h"
 
 TelegramBot* bot = nullptr;
+BotShards* shards = nullptr;
+
+// Lee una variable de entorno numérica con valor por defecto
+static double env_number(const char* name, double default_value) {
+    const char* value = std::getenv(name);
+    return value ? std::atof(value) : default_value;
+}
 
 void signal_handler(int signal) {
+    // timeout/systemd mandan la señal también al grupo: una segunda entrada, en
+    // otro hilo, no puede volver a borrar el bot mientras la primera lo detiene
+    static std::atomic<bool> stopping{false};
+    if (stopping.exchange(true)) return;
+
     std::cout << "\nRecibida señal de interrupción. Cerrando bot..." << std::endl;
     if (bot) {
         bot->stop();
         delete bot;
         bot = nullptr;
     }
+    if (shards) {
+        shards->stop();
+        delete shards;
+        shards = nullptr;
+    }
     exit(0);
 }
 
+// Ruta propia de cada sesión: la 0 conserva la de siempre
+static std::string session_path(const std::string& path, std::size_t session) {
+    return session == 0 ? path : path + "." + std::to_string(session);
+}
+
+/*
+ * Aplica a una sesión la configuración de las variables de entorno.
+ * sessions: sesiones en el proceso; bot_sessions: sesiones de su mismo bot.
+ */
+static bool configure_bot(TelegramBot* bot, std::size_t session, std::size_t sessions, std::size_t bot_sessions) {
+    // Hilos de despacho por chat (por defecto, uno por núcleo repartido entre las sesiones)
+    std::size_t dispatch_threads = std::max<std::size_t>(1, std::thread::hardware_concurrency() / sessions);
+    bot->set_dispatch_threads(static_cast<std::size_t>(env_number("TELEGRAM_DISPATCH_THREADS", double(dispatch_threads))));
+
+    // Control de flood de mensajes salientes (límites de la Bot API por defecto)
+    OutboundScheduler::Config outbound;
+    // El límite global es por bot: sus sesiones se lo reparten
+    outbound.global_rate = env_number("TELEGRAM_RATE_GLOBAL", outbound.global_rate) / bot_sessions;
+    outbound.chat_rate = env_number("TELEGRAM_RATE_CHAT", outbound.chat_rate);
+    bot->set_outbound_config(outbound);
+
+    // Descargas simultáneas en total y por chat
+    DownloadScheduler::Config downloads;
+    downloads.max_active = static_cast<std::size_t>(env_number("TELEGRAM_MAX_DOWNLOADS", double(downloads.max_active)));
+    downloads.max_active_per_chat = static_cast<std::size_t>(env_number("TELEGRAM_MAX_DOWNLOADS_PER_CHAT", double(downloads.max_active_per_chat)));
+    bot->set_download_limits(downloads);
+
+    // Archivos grandes en rangos paralelos (solo con backends que lo admiten)
+    bot->set_download_segments(static_cast<std::int64_t>(env_number("TELEGRAM_SEGMENT_THRESHOLD_MB", 64) * 1024 * 1024),
+                               static_cast<std::size_t>(env_number("TELEGRAM_SEGMENTS", 4)));
+
+    // Admisión por espacio libre y preasignación de los archivos grandes (0 = sin preasignar)
+    bot->set_disk_policy(static_cast<std::int64_t>(env_number("TELEGRAM_DISK_MARGIN_MB", 256) * 1024 * 1024),
+                         static_cast<std::int64_t>(env_number("TELEGRAM_PREALLOCATE_MB", 0) * 1024 * 1024));
+
+    // Filtro de entrada: usuarios autorizados (lista o archivo recargable) y límite por usuario
+    AccessControl::Config access;
+    access.message_rate = env_number("TELEGRAM_USER_MSG_RATE", access.message_rate);
+    access.message_burst = env_number("TELEGRAM_USER_MSG_BURST", access.message_burst);
+    access.download_rate = env_number("TELEGRAM_USER_DOWNLOAD_RATE", access.download_rate);
+    access.download_burst = env_number("TELEGRAM_USER_DOWNLOAD_BURST", access.download_burst);
+    bot->set_access_config(access);
+
+    if (const char* users_file = std::getenv("TELEGRAM_ALLOWED_USERS_FILE")) {
+        if (!bot->load_allowed_users(users_file)) return false;
+    } else if (const char* users = std::getenv("TELEGRAM_ALLOWED_USERS")) {
+        std::vector<std::int64_t> allowed;
+        for (const char* p = users; *p; ) {
+            char* end = nullptr;
+            long long user_id = std::strtoll(p, &end, 10);
+            if (end == p) {
+                ++p;
+                continue;
+            }
+            allowed.push_back(user_id);
+            p = end;
+        }
+        bot->set_allowed_users(std::move(allowed));
+    }
+
+    // Mensajes enviados mientras el bot estaba apagado: se descartan (y opcionalmente se avisa a cada chat)
+    bot->set_backlog_policy(env_number("TELEGRAM_SKIP_BACKLOG", 1) != 0,
+                            std::chrono::seconds(static_cast<long>(env_number("TELEGRAM_BACKLOG_GRACE_S", 0))),
+                            env_number("TELEGRAM_BACKLOG_SUMMARY", 0) != 0);
+
+    // Nombre del bot para filtrar los "/comando@otro_bot" de los grupos (vacío = no se filtra)
+    if (const char* username = std::getenv("TELEGRAM_BOT_USERNAME")) {
+        bot->commands().set_bot_username(username);
+    }
+
+    // Tamaño máximo de lote del bucle principal (1 = un objeto por iteración)
+    if (std::getenv("TELEGRAM_BATCH_SIZE")) {
+        bot->set_max_batch_size(static_cast<std::size_t>(env_number("TELEGRAM_BATCH_SIZE", 256)));
+    }
+
+    // Grabación opcional del flujo de TDLib para reproducirlo offline
+    const char* record_path = std::getenv("TELEGRAM_RECORD_PATH");
+    if (record_path && !bot->start_recording(session_path(record_path, session))) {
+        tgLog(RZ_LOG_ERROR, "Error al activar la grabación");
+        return false;
+    }
+
+    // Diario de descargas: las interrumpidas se reanudan al arrancar. Con el backend
+    // simulado solo se activa si se pide, para no mezclarlo con el diario real
+    const char* journal_path = std::getenv("TELEGRAM_JOURNAL_PATH");
+    if (!journal_path && env_number("TELEGRAM_FAKE_SERVER", 0) == 0) {
+        journal_path = "bot_db/downloads.journal";
+    }
+    if (journal_path && *journal_path && !bot->open_journal(session_path(journal_path, session))) {
+        tgLog(RZ_LOG_ERROR, "Error al abrir el diario de descargas");
+        return false;
+    }
+
+    // Índice de archivos descargados por unique_id (mismo criterio que el diario).
+    // Uno para todo el proceso: las demás sesiones comparten el de la 0
+    const char* dedup_path = std::getenv("TELEGRAM_DEDUP_PATH");
+    if (!dedup_path && env_number("TELEGRAM_FAKE_SERVER", 0) == 0) {
+        dedup_path = "bot_db/downloads.index";
+    }
+    if (session == 0 && dedup_path && *dedup_path && !bot->open_dedup_index(dedup_path)) {
+        tgLog(RZ_LOG_ERROR, "Error al abrir el índice de archivos descargados");
+        return false;
+    }
+    return true;
+}
+
 int main() {
     // Manejar señales de interrupción
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
     rzLog_init();
-    rzLog_set_level(RZ_LOG_DEBUG);
+    AsyncLog::set_level(RZ_LOG_DEBUG);
+    AsyncLog::start();
+    // Cualquier salida (return, exit) vacía antes los registros pendientes
+    std::atexit(AsyncLog::stop);
 
-    rzLog(RZ_LOG_INFO, "Iniciando bot...");
+    tgLog(RZ_LOG_INFO, "Iniciando bot...");
+
+    // Modo replay: reproduce un log grabado sin credenciales ni red
+    const char* replay_path = std::getenv("TELEGRAM_REPLAY_PATH");
+    if (replay_path) {
+        const char* realtime = std::getenv("TELEGRAM_REPLAY_REALTIME");
+        TelegramBot replay_bot;
+        bool ok = replay_bot.replay(replay_path, realtime && std::atoi(realtime) != 0);
+        AsyncLog::stop();
+        rzLog_stop();
+        return ok ? 0 : 1;
+    }
 
     // Obtener credenciales de variables de entorno
     const char* api_id_str = std::getenv("TELEGRAM_API_ID");
     const char* api_hash = std::getenv("TELEGRAM_API_HASH");
     const char* bot_token = std::getenv("TELEGRAM_BOT_TOKEN");
+    const char* bot_tokens = std::getenv("TELEGRAM_BOT_TOKENS");
     const char* download_path = std::getenv("TELEGRAM_DOWNLOAD_PATH");
 
-    if (!api_id_str || !api_hash || !bot_token || !download_path) {
-        rzLog(RZ_LOG_ERROR, "Error: Debes establecer las variables de entorno: TELEGRAM_API_ID, TELEGRAM_API_HASH, TELEGRAM_BOT_TOKEN, TELEGRAM_DOWNLOAD_PATH");
+    // Backend simulado para pruebas de carga: no necesita credenciales reales
+    std::unique_ptr<TdTransport> transport;
+    if (env_number("TELEGRAM_FAKE_SERVER", 0) != 0) {
+        FakeTelegramServer::Config config;
+        config.latency = std::chrono::milliseconds(static_cast<long>(env_number("TELEGRAM_FAKE_LATENCY_MS", 20)));
+        config.bandwidth_bytes_per_sec = env_number("TELEGRAM_FAKE_BANDWIDTH_MBPS", 50) * 1024 * 1024;
+        config.users = static_cast<std::int64_t>(env_number("TELEGRAM_FAKE_USERS", 0));
+        config.messages_per_sec = env_number("TELEGRAM_FAKE_MSG_RATE", 0);
+        config.video_ratio = env_number("TELEGRAM_FAKE_VIDEO_RATIO", 0);
+        config.video_size = static_cast<std::int64_t>(env_number("TELEGRAM_FAKE_VIDEO_MB", 64) * 1024 * 1024);
+        config.forward_ratio = env_number("TELEGRAM_FAKE_FORWARD_RATIO", 0);
+        config.flood_chat_rate = env_number("TELEGRAM_FAKE_FLOOD_RATE", 0);
+        config.stream_bandwidth_bytes_per_sec = env_number("TELEGRAM_FAKE_STREAM_MBPS", 0) * 1024 * 1024;
+        if (const char* files = std::getenv("TELEGRAM_FAKE_FILES_DIR")) config.files_directory = files;
+        config.backlog_messages = static_cast<std::int64_t>(env_number("TELEGRAM_FAKE_BACKLOG", 0));
+        config.backlog_age = std::chrono::seconds(static_cast<long>(env_number("TELEGRAM_FAKE_BACKLOG_AGE_S", 3600)));
+        transport.reset(new FakeTelegramServer(config));
+
+        if (!api_id_str) api_id_str = "0";
+        if (!api_hash) api_hash = "fake";
+        if (!bot_token) bot_token = "fake:token";
+        // Los archivos simulados no existen en disco: sin carpeta no se trasladan
+        if (!download_path) download_path = "";
+    }
+
+    // Varios bots en el proceso: tokens separados por comas
+    std::vector<std::string> tokens;
+    if (bot_tokens) {
+        std::string list(bot_tokens);
+        std::size_t begin = 0;
+        while (begin <= list.size()) {
+            std::size_t end = list.find(',', begin);
+            if (end == std::string::npos) end = list.size();
+            if (end > begin) tokens.push_back(list.substr(begin, end - begin));
+            begin = end + 1;
+        }
+    }
+    if (tokens.empty() && bot_token) tokens.push_back(bot_token);
+
+    if (!api_id_str || !api_hash || tokens.empty() || !download_path) {
+        tgLog(RZ_LOG_ERROR, "Error: Debes establecer las variables de entorno: TELEGRAM_API_ID, TELEGRAM_API_HASH, TELEGRAM_BOT_TOKEN, TELEGRAM_DOWNLOAD_PATH");
         return 1;
     }
 
     std::string api_id(api_id_str);
 
+    // Sesiones por bot: los vídeos se reparten entre ellas
+    std::size_t bot_sessions = static_cast<std::size_t>(std::max(1.0, env_number("TELEGRAM_BOT_SESSIONS", 1)));
+    std::size_t sessions = tokens.size() * bot_sessions;
+
     try {
         
-        bot = new TelegramBot();
-        
-        if (!bot->initialize(api_id, bot_token, api_hash, download_path)) {
-            rzLog(RZ_LOG_ERROR, "Error al inicializar el bot");
-            delete bot;
-            return 1;
+        if (sessions > 1) {
+            // Todas las sesiones sobre un mismo ClientManager. Primero la principal de
+            // cada bot, después sus sesiones de descarga
+            shards = new BotShards(std::move(transport));
+            for (std::size_t copy = 0; copy < bot_sessions; ++copy) {
+                for (const std::string& token : tokens) {
+                    TelegramBot* session = shards->add_session(api_id, token, api_hash, download_path);
+                    if (!session || !configure_bot(session, shards->size() - 1, sessions, bot_sessions)) {
+                        tgLog(RZ_LOG_ERROR, "Error al inicializar la sesión %zu", shards->size());
+                        delete shards;
+                        shards = nullptr;
+                        return 1;
+                    }
+                }
+            }
+        } else {
+            bot = new TelegramBot(std::move(transport));
+            
+            if (!bot->initialize(api_id, tokens[0], api_hash, download_path)) {
+                tgLog(RZ_LOG_ERROR, "Error al inicializar el bot");
+                delete bot;
+                return 1;
+            }
+            if (!configure_bot(bot, 0, 1, 1)) {
+                delete bot;
+                return 1;
+            }
         }
 
-        rzLog(RZ_LOG_INFO, "Bot inicializado correctamente");
-        rzLog(RZ_LOG_INFO, "Esperando respuestas de TDLib...");
+        // Endpoint de métricas Prometheus (desactivado salvo que se indique un puerto)
+        int metrics_port = static_cast<int>(env_number("TELEGRAM_METRICS_PORT", 0));
+        if (metrics_port > 0) {
+            const char* metrics_address = std::getenv("TELEGRAM_METRICS_ADDRESS");
+            std::string address = metrics_address ? metrics_address : "127.0.0.1";
+            bool started = shards ? shards->start_metrics(address, static_cast<std::uint16_t>(metrics_port))
+                                  : bot->start_metrics(address, static_cast<std::uint16_t>(metrics_port));
+            if (!started) {
+                tgLog(RZ_LOG_ERROR, "Error al arrancar el endpoint de métricas");
+                delete bot;
+                delete shards;
+                return 1;
+            }
+        }
+
+        tgLog(RZ_LOG_INFO, "Bot inicializado correctamente");
+        tgLog(RZ_LOG_INFO, "Esperando respuestas de TDLib...");
 
-        bot->run();
+        if (shards) {
+            shards->run();
+        } else {
+            bot->run();
+        }
 
         // Mantener el programa corriendo
         while (true) {
             std::this_thread::sleep_for(std::chrono::seconds(5));
-            //rzLog(RZ_LOG_INFO, "[MAIN] Bot ejecutándose...");
+            //tgLog(RZ_LOG_INFO, "[MAIN] Bot ejecutándose...");
         }
 
     } catch (const std::exception& e) {
-        rzLog(RZ_LOG_ERROR,"Excepción: ");
+        tgLog(RZ_LOG_ERROR,"Excepción: ");
+        AsyncLog::stop();
         rzLog_stop();
         if (bot) {
             delete bot;
         }
+        if (shards) {
+            delete shards;
+        }
         return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}